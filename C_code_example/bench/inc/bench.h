@@ -0,0 +1,38 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Microbenchmarks for the sample-path code of the tools. Each case runs its operation
+ * `iterations` times and returns a checksum of the results, which the driver folds into
+ * a volatile sink so the compiler cannot drop the work. Cases are listed in NULL
+ * terminated tables, one per tool source compiled into the bench.
+ */
+typedef struct s_bench_case {
+    const char *name;
+    const char *unit;
+    uint64_t (*run)(unsigned long iterations);
+}   t_bench_case;
+
+extern const t_bench_case g_output_bench_cases[];
+extern const t_bench_case g_input_bench_cases[];
+
+/*
+ * In-memory device sinks standing in for /dev/i2c-1, /dev/spidev0.x and the terminal.
+ * The tool sources are included with ioctl and write mapped onto these.
+ */
+typedef struct s_bench_sink_stats {
+    unsigned long ioctls;
+    unsigned long writes;
+    unsigned long bytes;
+}   t_bench_sink_stats;
+
+extern t_bench_sink_stats g_bench_sink;
+
+int bench_ioctl(int fd, unsigned long request, ...);
+ssize_t bench_write(int fd, const void *buf, size_t count);
+
+#endif
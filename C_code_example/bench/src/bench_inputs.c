@@ -0,0 +1,172 @@
+#define _GNU_SOURCE
+#include "bench.h"
+
+/*
+ * input_reader.c compiled as-is into the bench, like bench_outputs.c: SPI_IOC_MESSAGE
+ * goes to the in-memory MCP3008 pair and dashboard frames to the write sink.
+ */
+#define main input_reader_main
+#define ioctl bench_ioctl
+#define write bench_write
+#include "../../inputs/src/input_reader.c"
+#undef write
+#undef ioctl
+#undef main
+
+#define BENCH_SPI0_FD 4
+#define BENCH_SPI1_FD 5
+
+static t_runtime_options g_bench_options;
+static t_hat_adc g_bench_spi;
+static t_history_record g_bench_scans[STREAM_DRAIN_BATCH];
+static int g_bench_ready;
+
+static void bench_inputs_setup(void)
+{
+    char *argv[] = {"bench", NULL};
+    uint16_t valid_mask = 0;
+
+    if (g_bench_ready) {
+        return;
+    }
+    parse_runtime_options(1, argv, &g_bench_options);
+    calibration_init_nominal(&g_calibration);
+    hat_transport_init(&g_transport, NULL, NULL, 0);
+    hat_adc_init(&g_bench_spi, &g_transport, ADS_SPI_SPEED_HZ);
+    g_bench_spi.spi_fd[0] = BENCH_SPI0_FD;
+    g_bench_spi.spi_fd[1] = BENCH_SPI1_FD;
+    g_bench_spi.ready = 1;
+    // A batch of full scans from the simulated chips feeds the filter and format cases.
+    for (unsigned int i = 0; i < STREAM_DRAIN_BATCH; i++) {
+        ads_capture_snapshot(&g_bench_spi, 0xFFFFU, g_bench_scans[i].codes, &valid_mask);
+        g_bench_scans[i].sample_counter = i;
+        g_bench_scans[i].valid_mask = valid_mask;
+    }
+    g_bench_ready = 1;
+}
+
+// Both MCP3008s, all 16 channels: one batched message per chip plus the code decode.
+static uint64_t bench_scan_16ch(unsigned long iterations)
+{
+    uint16_t codes[ADS_CHANNEL_COUNT] = {0};
+    uint16_t valid_mask = 0;
+    uint64_t checksum = 0;
+
+    bench_inputs_setup();
+    for (unsigned long i = 0; i < iterations; i++) {
+        ads_capture_snapshot(&g_bench_spi, 0xFFFFU, codes, &valid_mask);
+        checksum += codes[i & (ADS_CHANNEL_COUNT - 1)] + valid_mask;
+    }
+    return checksum;
+}
+
+// Calibrated code -> mV for a whole scan; frac_bits selects raw codes or filtered Q6 values.
+static uint64_t bench_scale_scan(unsigned int frac_bits, unsigned long iterations)
+{
+    uint64_t checksum = 0;
+
+    bench_inputs_setup();
+    for (unsigned long i = 0; i < iterations; i++) {
+        const t_history_record *scan = &g_bench_scans[i % STREAM_DRAIN_BATCH];
+
+        uint32_t fraction = (uint32_t)i & ((1U << frac_bits) - 1U);
+
+        for (uint8_t ch = 0; ch < ADS_CHANNEL_COUNT; ch++) {
+            checksum += ads_code_to_mv(ch, (uint16_t)(((uint32_t)scan->codes[ch] << frac_bits) | fraction), frac_bits);
+        }
+    }
+    return checksum;
+}
+
+static uint64_t bench_scale_raw(unsigned long iterations)
+{
+    return bench_scale_scan(0, iterations);
+}
+
+static uint64_t bench_scale_q6(unsigned long iterations)
+{
+    return bench_scale_scan(FILTER_FRAC_BITS, iterations);
+}
+
+// Filter `iterations` scans in stream-consumer batches; ns/op is per 16-channel scan.
+static uint64_t bench_filter(const char *spec, unsigned long iterations)
+{
+    static t_filter_bank bank;
+    static t_history_record filtered[STREAM_DRAIN_BATCH];
+    t_filter_config config;
+    uint64_t checksum = 0;
+
+    bench_inputs_setup();
+    if (parse_filter_spec(spec, &config) != 0) {
+        return 0;
+    }
+    filter_bank_init(&bank, &config);
+    while (iterations > 0) {
+        unsigned int count = iterations < STREAM_DRAIN_BATCH ? (unsigned int)iterations : STREAM_DRAIN_BATCH;
+
+        filter_bank_process(&bank, g_bench_scans, count, filtered);
+        checksum += filtered[count - 1].codes[count & (ADS_CHANNEL_COUNT - 1)] + filtered[count - 1].valid_mask;
+        iterations -= count;
+    }
+    return checksum;
+}
+
+static uint64_t bench_filter_avg(unsigned long iterations)
+{
+    return bench_filter("avg:16", iterations);
+}
+
+static uint64_t bench_filter_cic_lp(unsigned long iterations)
+{
+    return bench_filter("cic:8:3,lp:4", iterations);
+}
+
+static uint64_t bench_history_line(unsigned long iterations)
+{
+    char line[SCREEN_LINE_LEN];
+    uint64_t checksum = 0;
+
+    bench_inputs_setup();
+    for (unsigned long i = 0; i < iterations; i++) {
+        ads_format_history_line(line, sizeof(line), &g_bench_scans[i % STREAM_DRAIN_BATCH], 0);
+        checksum += (uint8_t)line[i % 16];
+    }
+    return checksum;
+}
+
+// One dashboard frame: the history scrolls by one scan and every bar moves.
+static uint64_t bench_dashboard(unsigned long iterations)
+{
+    static t_screen screen;
+    t_history_record history[ADS_HISTORY_LINES];
+    t_dashboard_snapshot snapshot;
+    uint64_t written = g_bench_sink.bytes;
+
+    bench_inputs_setup();
+    memset(history, 0, sizeof(history));
+    memset(&snapshot, 0, sizeof(snapshot));
+    for (unsigned long i = 0; i < iterations; i++) {
+        const t_history_record *scan = &g_bench_scans[i % STREAM_DRAIN_BATCH];
+
+        memmove(&history[1], &history[0], sizeof(history) - sizeof(history[0]));
+        history[0] = *scan;
+        history[0].sample_counter = i;
+        snapshot.sample_counter = i;
+        snapshot.ticks = i;
+        snapshot.valid_mask = scan->valid_mask;
+        memcpy(snapshot.codes, scan->codes, sizeof(snapshot.codes));
+        ads_render_dashboard(&screen, history, ADS_HISTORY_LINES, &snapshot, &g_bench_options);
+    }
+    return g_bench_sink.bytes - written;
+}
+
+const t_bench_case g_input_bench_cases[] = {
+    {"mcp3008_scan_16ch", "scan", bench_scan_16ch},
+    {"adc_scale_mv", "scan", bench_scale_raw},
+    {"adc_scale_mv_q6", "scan", bench_scale_q6},
+    {"adc_filter_avg16", "scan", bench_filter_avg},
+    {"adc_filter_cic8x3_lp4", "scan", bench_filter_cic_lp},
+    {"ads_history_line", "line", bench_history_line},
+    {"ads_dashboard", "frame", bench_dashboard},
+    {NULL, NULL, NULL},
+};
@@ -0,0 +1,167 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include "bench.h"
+
+/*
+ * Runs every case until one timed run lasts at least --min-ms, then keeps the best of
+ * --repeat runs. Results go to stdout as CSV (one row per case), progress and warnings
+ * to stderr, so `make bench > results.csv` can be diffed between commits.
+ */
+#define DEFAULT_MIN_MS 200U
+#define MAX_MIN_MS 60000U
+#define DEFAULT_REPEAT 3U
+#define MAX_REPEAT 100U
+#define MAX_ITERATIONS (1UL << 40)
+
+typedef struct s_bench_options {
+    unsigned int min_ms;
+    unsigned int repeat;
+    const char *filter;
+    int list;
+}   t_bench_options;
+
+static volatile uint64_t g_bench_checksum;
+
+static unsigned int parse_u32_or_default(const char *raw_value, const char *param_name,
+    unsigned int default_value, unsigned int min_value, unsigned int max_value)
+{
+    char *end = NULL;
+    unsigned long parsed;
+
+    if (!raw_value || *raw_value == '\0') {
+        fprintf(stderr, "Warning: missing value for %s, using default %u\n", param_name, default_value);
+        return default_value;
+    }
+    errno = 0;
+    parsed = strtoul(raw_value, &end, 10);
+    if (errno != 0 || end == raw_value || *end != '\0' || parsed < min_value || parsed > max_value) {
+        fprintf(stderr, "Warning: invalid %s='%s' (range %u..%u), using default %u\n",
+            param_name, raw_value, min_value, max_value, default_value);
+        return default_value;
+    }
+    return (unsigned int)parsed;
+}
+
+static int parse_bench_options(int argc, char **argv, t_bench_options *options)
+{
+    options->min_ms = DEFAULT_MIN_MS;
+    options->repeat = DEFAULT_REPEAT;
+    options->filter = NULL;
+    options->list = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            printf("Usage: %s [--min-ms=N] [--repeat=N] [--filter=TEXT] [--list]\n", argv[0]);
+            printf("  --min-ms=N      Minimum duration of one timed run (default %u, max %u)\n",
+                DEFAULT_MIN_MS, MAX_MIN_MS);
+            printf("  --repeat=N      Timed runs per case, best one reported (default %u, max %u)\n",
+                DEFAULT_REPEAT, MAX_REPEAT);
+            printf("  --filter=TEXT   Only run cases whose name contains TEXT\n");
+            printf("  --list          Print the case names and exit\n");
+            printf("Output: CSV on stdout: benchmark,unit,iterations,ns_per_op,ops_per_s\n");
+            return 1;
+        } else if (strncmp(argv[i], "--min-ms=", 9) == 0) {
+            options->min_ms = parse_u32_or_default(argv[i] + 9, "--min-ms", DEFAULT_MIN_MS, 1, MAX_MIN_MS);
+        } else if (strncmp(argv[i], "--repeat=", 9) == 0) {
+            options->repeat = parse_u32_or_default(argv[i] + 9, "--repeat", DEFAULT_REPEAT, 1, MAX_REPEAT);
+        } else if (strncmp(argv[i], "--filter=", 9) == 0) {
+            options->filter = argv[i] + 9;
+        } else if (strcmp(argv[i], "--list") == 0) {
+            options->list = 1;
+        } else {
+            fprintf(stderr, "Warning: unknown option '%s' (use --help)\n", argv[i]);
+        }
+    }
+    return 0;
+}
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000ULL) + (uint64_t)now.tv_nsec;
+}
+
+static uint64_t bench_time_run(const t_bench_case *bench, unsigned long iterations)
+{
+    uint64_t start_ns = monotonic_ns();
+
+    g_bench_checksum += bench->run(iterations);
+    return monotonic_ns() - start_ns;
+}
+
+// Grow the iteration count until one run takes min_ms, then report the best of `repeat` runs.
+static void bench_measure(const t_bench_case *bench, const t_bench_options *options)
+{
+    uint64_t min_ns = (uint64_t)options->min_ms * 1000000ULL;
+    unsigned long iterations = 1;
+    uint64_t elapsed_ns;
+    double best_ns_per_op = 0.0;
+
+    // Warm-up call: lazy setup, page faults and caches stay out of the timed runs.
+    g_bench_checksum += bench->run(1);
+    for (;;) {
+        elapsed_ns = bench_time_run(bench, iterations);
+        if (elapsed_ns >= min_ns || iterations >= MAX_ITERATIONS) {
+            break;
+        }
+        // Aim 20% past the target from the last rate, at most x100 per step.
+        if (elapsed_ns < min_ns / 100U) {
+            iterations *= 100U;
+        } else {
+            iterations = (unsigned long)((double)iterations * 1.2 * (double)min_ns / (double)elapsed_ns) + 1UL;
+        }
+    }
+    for (unsigned int run = 0; run < options->repeat; run++) {
+        double ns_per_op;
+
+        if (run > 0) {
+            elapsed_ns = bench_time_run(bench, iterations);
+        }
+        ns_per_op = (double)elapsed_ns / (double)iterations;
+        if (run == 0 || ns_per_op < best_ns_per_op) {
+            best_ns_per_op = ns_per_op;
+        }
+    }
+    printf("%s,%s,%lu,%.2f,%.0f\n", bench->name, bench->unit, iterations, best_ns_per_op,
+        best_ns_per_op > 0.0 ? 1e9 / best_ns_per_op : 0.0);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    const t_bench_case *tables[] = {g_output_bench_cases, g_input_bench_cases};
+    t_bench_options options;
+    unsigned int matched = 0;
+
+    if (parse_bench_options(argc, argv, &options) != 0) {
+        return 0;
+    }
+    if (!options.list) {
+        printf("benchmark,unit,iterations,ns_per_op,ops_per_s\n");
+    }
+    for (size_t t = 0; t < sizeof(tables) / sizeof(tables[0]); t++) {
+        for (const t_bench_case *bench = tables[t]; bench->name; bench++) {
+            if (options.filter && !strstr(bench->name, options.filter)) {
+                continue;
+            }
+            matched++;
+            if (options.list) {
+                printf("%s\n", bench->name);
+                continue;
+            }
+            fprintf(stderr, "Running %s...\n", bench->name);
+            bench_measure(bench, &options);
+        }
+    }
+    if (matched == 0) {
+        fprintf(stderr, "Error: no benchmark matches '%s'\n", options.filter ? options.filter : "");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,242 @@
+#define _GNU_SOURCE
+#include "bench.h"
+
+/*
+ * output_generator.c compiled as-is into the bench: its main() is renamed and its
+ * ioctl()/write() calls land in the in-memory sinks, so the cases below time the real
+ * static functions rather than copies of them.
+ */
+#define main output_generator_main
+#define ioctl bench_ioctl
+#define write bench_write
+#include "../../outputs/src/output_generator.c"
+#undef write
+#undef ioctl
+#undef main
+
+#define BENCH_I2C_FD 3
+
+static t_sine_options g_bench_options;
+static t_dds_engine g_bench_dds;
+static int g_bench_ready;
+
+static void bench_outputs_setup(void)
+{
+    char *argv[] = {"bench", NULL};
+
+    if (g_bench_ready) {
+        return;
+    }
+    parse_sine_runtime_options(1, argv, &g_bench_options);
+    calibration_init_nominal(&g_calibration);
+    hat_transport_init(&g_transport, NULL, NULL, 0);
+    hat_dac_init(&g_dac, &g_transport);
+    g_dac.fd = BENCH_I2C_FD;
+    dds_init(&g_bench_dds, &g_bench_options);
+    g_bench_ready = 1;
+}
+
+static uint64_t bench_dds_render(unsigned long iterations)
+{
+    uint16_t values[MCP_OUTPUT_COUNT];
+    uint64_t checksum = 0;
+
+    bench_outputs_setup();
+    for (unsigned long i = 0; i < iterations; i++) {
+        dds_render(&g_bench_dds, values);
+        checksum += values[i & (MCP_OUTPUT_COUNT - 1)];
+    }
+    return checksum;
+}
+
+/*
+ * One 64-frame block of all five shapes through a given wave kernel (the prerender
+ * block size). NULL name = the kernel auto-selected for this CPU.
+ */
+static uint64_t bench_wave_block(const char *kernel_name, unsigned long iterations)
+{
+    static uint16_t frames[DEFAULT_PRERENDER_FRAMES][MCP_OUTPUT_COUNT];
+    t_dds_engine *dds = &g_bench_dds;
+    const t_wave_kernel *saved;
+    uint64_t checksum = 0;
+
+    bench_outputs_setup();
+    saved = dds->kernel;
+    dds->kernel = wave_kernel_select(kernel_name);
+    for (int output = 0; output < MCP_OUTPUT_COUNT; output++) {
+        dds->bank.osc[output].shape = (t_wave_shape)(output % WAVE_SHAPE_COUNT);
+    }
+    for (unsigned long i = 0; i < iterations; i++) {
+        dds_render_block(dds, frames, DEFAULT_PRERENDER_FRAMES);
+        checksum += frames[i & (DEFAULT_PRERENDER_FRAMES - 1U)][i & (MCP_OUTPUT_COUNT - 1)];
+    }
+    for (int output = 0; output < MCP_OUTPUT_COUNT; output++) {
+        dds->bank.osc[output].shape = WAVE_SINE;
+    }
+    dds->kernel = saved;
+    return checksum;
+}
+
+static uint64_t bench_wave_block_scalar(unsigned long iterations)
+{
+    return bench_wave_block("scalar", iterations);
+}
+
+static uint64_t bench_wave_block_auto(unsigned long iterations)
+{
+    return bench_wave_block(NULL, iterations);
+}
+
+static uint64_t bench_frame_encode(t_mcp4728_frame_mode mode, unsigned long iterations)
+{
+    t_mcp_output_frame frame;
+    uint16_t values[MCP_OUTPUT_COUNT];
+    uint64_t checksum = 0;
+
+    bench_outputs_setup();
+    for (unsigned long i = 0; i < iterations; i++) {
+        dds_render(&g_bench_dds, values);
+        hat_build_output_frame(&frame, mode, 0, values, MCP_ALL_OUTPUTS);
+        checksum += frame.msg_count + frame.data[i % (2 * MCP4728_FRAME_MAX_LEN)];
+    }
+    return checksum;
+}
+
+static uint64_t bench_frame_fast(unsigned long iterations)
+{
+    return bench_frame_encode(MCP4728_FRAME_FAST, iterations);
+}
+
+static uint64_t bench_frame_multi(unsigned long iterations)
+{
+    return bench_frame_encode(MCP4728_FRAME_MULTI, iterations);
+}
+
+static uint64_t bench_frame_sequential(unsigned long iterations)
+{
+    return bench_frame_encode(MCP4728_FRAME_SEQUENTIAL, iterations);
+}
+
+static uint64_t bench_frame_single(unsigned long iterations)
+{
+    return bench_frame_encode(MCP4728_FRAME_SINGLE, iterations);
+}
+
+// Encode + submit through the sink: the per-sample cost of the write path minus the bus.
+static uint64_t bench_frame_submit(t_i2c_transport transport, unsigned long iterations)
+{
+    uint16_t values[MCP_OUTPUT_COUNT];
+    uint64_t checksum = 0;
+
+    bench_outputs_setup();
+    g_dac.transport = transport;
+    g_dac.frame_mode = MCP4728_FRAME_FAST;
+    g_dac.udac = 0;
+    for (unsigned long i = 0; i < iterations; i++) {
+        dds_render(&g_bench_dds, values);
+        checksum += (uint64_t)write_all_mcp_outputs(&g_dac, values, 0);
+    }
+    return checksum + g_dac.syscalls;
+}
+
+/*
+ * --dac-delta: shadow compare, encoding and submit of the outputs that changed. moving
+ * is the number of outputs following the DDS, the others hold a static CV.
+ */
+static uint64_t bench_frame_delta(unsigned int moving, unsigned long iterations)
+{
+    uint16_t values[MCP_OUTPUT_COUNT];
+    uint16_t rendered[MCP_OUTPUT_COUNT];
+    uint64_t checksum = 0;
+
+    bench_outputs_setup();
+    g_dac.transport = I2C_TRANSPORT_RDWR;
+    g_dac.frame_mode = MCP4728_FRAME_FAST;
+    g_dac.udac = 1;
+    for (unsigned int output = 0; output < MCP_OUTPUT_COUNT; output++) {
+        values[output] = (uint16_t)(output * 512U);
+    }
+    for (unsigned long i = 0; i < iterations; i++) {
+        dds_render(&g_bench_dds, rendered);
+        memcpy(values, rendered, moving * sizeof(values[0]));
+        checksum += (uint64_t)write_all_mcp_outputs(&g_dac, values, 1);
+    }
+    return checksum + g_dac.bytes;
+}
+
+static uint64_t bench_delta_static(unsigned long iterations)
+{
+    return bench_frame_delta(1, iterations);
+}
+
+static uint64_t bench_delta_moving(unsigned long iterations)
+{
+    return bench_frame_delta(MCP_OUTPUT_COUNT, iterations);
+}
+
+static uint64_t bench_submit_rdwr(unsigned long iterations)
+{
+    return bench_frame_submit(I2C_TRANSPORT_RDWR, iterations);
+}
+
+static uint64_t bench_submit_slave(unsigned long iterations)
+{
+    return bench_frame_submit(I2C_TRANSPORT_SLAVE, iterations);
+}
+
+static uint64_t bench_history_line(unsigned long iterations)
+{
+    t_history_record record;
+    char line[SCREEN_LINE_LEN];
+    uint64_t checksum = 0;
+
+    bench_outputs_setup();
+    memset(&record, 0, sizeof(record));
+    for (unsigned long i = 0; i < iterations; i++) {
+        record.sample_counter = i;
+        dds_render(&g_bench_dds, record.codes);
+        mcp_format_history_line(line, sizeof(line), &record);
+        checksum += (uint8_t)line[i % 16];
+    }
+    return checksum;
+}
+
+// One dashboard frame: the history scrolls by one record and every bar moves.
+static uint64_t bench_dashboard(unsigned long iterations)
+{
+    static t_screen screen;
+    t_history_record history[MCP_HISTORY_LINES];
+    t_dashboard_snapshot snapshot;
+    uint64_t written = g_bench_sink.bytes;
+
+    bench_outputs_setup();
+    memset(history, 0, sizeof(history));
+    memset(&snapshot, 0, sizeof(snapshot));
+    for (unsigned long i = 0; i < iterations; i++) {
+        memmove(&history[1], &history[0], sizeof(history) - sizeof(history[0]));
+        history[0].sample_counter = i;
+        dds_render(&g_bench_dds, history[0].codes);
+        snapshot.sample_counter = i;
+        snapshot.ticks = i;
+        memcpy(snapshot.codes, history[0].codes, sizeof(snapshot.codes));
+        mcp_render_dashboard(&screen, history, MCP_HISTORY_LINES, &snapshot, &g_bench_options);
+    }
+    return g_bench_sink.bytes - written;
+}
+
+const t_bench_case g_output_bench_cases[] = {
+    {"dds_render", "sample", bench_dds_render},
+    {"wave_block64_scalar", "block", bench_wave_block_scalar},
+    {"wave_block64_auto", "block", bench_wave_block_auto},
+    {"mcp4728_frame_fast", "frame", bench_frame_fast},
+    {"mcp4728_frame_multi", "frame", bench_frame_multi},
+    {"mcp4728_frame_sequential", "frame", bench_frame_sequential},
+    {"mcp4728_frame_single", "frame", bench_frame_single},
+    {"mcp4728_submit_rdwr", "frame", bench_submit_rdwr},
+    {"mcp4728_submit_slave", "frame", bench_submit_slave},
+    {"mcp4728_delta_static", "frame", bench_delta_static},
+    {"mcp4728_delta_moving", "frame", bench_delta_moving},
+    {"mcp_history_line", "line", bench_history_line},
+    {"mcp_dashboard", "frame", bench_dashboard},
+    {NULL, NULL, NULL},
+};
@@ -0,0 +1,215 @@
+#include <stdarg.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+#include <linux/i2c.h>
+#include <linux/spi/spidev.h>
+#include "gpiod.h"
+#include "spidev_lib.h"
+#include "bench.h"
+
+t_bench_sink_stats g_bench_sink;
+
+// xorshift32: cheap, deterministic stand-in for the voltages on the ADC inputs.
+static uint32_t g_adc_noise = 0x2545F491U;
+
+static uint16_t bench_adc_code(void)
+{
+    g_adc_noise ^= g_adc_noise << 13;
+    g_adc_noise ^= g_adc_noise >> 17;
+    g_adc_noise ^= g_adc_noise << 5;
+    return (uint16_t)(g_adc_noise & 0x3FFU);
+}
+
+/*
+ * I2C_SLAVE and I2C_RDWR are accepted and counted; SPI_IOC_MESSAGE(n) answers every
+ * transfer with an MCP3008 reply frame carrying a pseudo-random 10-bit code.
+ */
+int bench_ioctl(int fd, unsigned long request, ...)
+{
+    va_list args;
+    void *arg;
+
+    (void)fd;
+    va_start(args, request);
+    arg = va_arg(args, void *);
+    va_end(args);
+    g_bench_sink.ioctls++;
+    if (request == I2C_SLAVE) {
+        return 0;
+    }
+    if (request == I2C_RDWR) {
+        const struct i2c_rdwr_ioctl_data *xfer = (const struct i2c_rdwr_ioctl_data *)arg;
+
+        for (unsigned int i = 0; i < xfer->nmsgs; i++) {
+            g_bench_sink.bytes += xfer->msgs[i].len;
+        }
+        return (int)xfer->nmsgs;
+    }
+    if (_IOC_TYPE(request) == SPI_IOC_MAGIC && _IOC_NR(request) == 0) {
+        struct spi_ioc_transfer *xfers = (struct spi_ioc_transfer *)arg;
+        unsigned int count = _IOC_SIZE(request) / sizeof(struct spi_ioc_transfer);
+
+        for (unsigned int i = 0; i < count; i++) {
+            uint8_t *rx = (uint8_t *)(uintptr_t)xfers[i].rx_buf;
+            uint16_t code = bench_adc_code();
+
+            rx[0] = 0;
+            rx[1] = (uint8_t)(code >> 8);
+            rx[2] = (uint8_t)code;
+            g_bench_sink.bytes += xfers[i].len;
+        }
+        return (int)count;
+    }
+    errno = ENOTTY;
+    return -1;
+}
+
+ssize_t bench_write(int fd, const void *buf, size_t count)
+{
+    (void)fd;
+    (void)buf;
+    g_bench_sink.writes++;
+    g_bench_sink.bytes += count;
+    return (ssize_t)count;
+}
+
+// libgpiod: no chip, so the tools run without LDAC.
+struct gpiod_chip *gpiod_chip_open(const char *path)
+{
+    (void)path;
+    errno = ENOENT;
+    return NULL;
+}
+
+void gpiod_chip_close(struct gpiod_chip *chip)
+{
+    (void)chip;
+}
+
+struct gpiod_line_settings *gpiod_line_settings_new(void)
+{
+    return NULL;
+}
+
+void gpiod_line_settings_free(struct gpiod_line_settings *settings)
+{
+    (void)settings;
+}
+
+int gpiod_line_settings_set_direction(struct gpiod_line_settings *settings, enum gpiod_line_direction direction)
+{
+    (void)settings;
+    (void)direction;
+    return -1;
+}
+
+int gpiod_line_settings_set_output_value(struct gpiod_line_settings *settings, enum gpiod_line_value value)
+{
+    (void)settings;
+    (void)value;
+    return -1;
+}
+
+struct gpiod_line_config *gpiod_line_config_new(void)
+{
+    return NULL;
+}
+
+void gpiod_line_config_free(struct gpiod_line_config *config)
+{
+    (void)config;
+}
+
+int gpiod_line_config_add_line_settings(struct gpiod_line_config *config, const unsigned int *offsets,
+    size_t num_offsets, struct gpiod_line_settings *settings)
+{
+    (void)config;
+    (void)offsets;
+    (void)num_offsets;
+    (void)settings;
+    return -1;
+}
+
+int gpiod_line_config_set_output_values(struct gpiod_line_config *config, const enum gpiod_line_value *values,
+    size_t num_values)
+{
+    (void)config;
+    (void)values;
+    (void)num_values;
+    return -1;
+}
+
+struct gpiod_request_config *gpiod_request_config_new(void)
+{
+    return NULL;
+}
+
+void gpiod_request_config_free(struct gpiod_request_config *config)
+{
+    (void)config;
+}
+
+void gpiod_request_config_set_consumer(struct gpiod_request_config *config, const char *consumer)
+{
+    (void)config;
+    (void)consumer;
+}
+
+struct gpiod_line_request *gpiod_chip_request_lines(struct gpiod_chip *chip, struct gpiod_request_config *req_cfg,
+    struct gpiod_line_config *line_cfg)
+{
+    (void)chip;
+    (void)req_cfg;
+    (void)line_cfg;
+    errno = ENOENT;
+    return NULL;
+}
+
+void gpiod_line_request_release(struct gpiod_line_request *request)
+{
+    (void)request;
+}
+
+int gpiod_line_request_set_value(struct gpiod_line_request *request, unsigned int offset,
+    enum gpiod_line_value value)
+{
+    (void)request;
+    (void)offset;
+    (void)value;
+    return -1;
+}
+
+int gpiod_line_request_set_values(struct gpiod_line_request *request, const enum gpiod_line_value *values)
+{
+    (void)request;
+    (void)values;
+    return -1;
+}
+
+// spidev-lib: no device nodes; the bench drives the batched SPI_IOC_MESSAGE path instead.
+int spi_open(char *device, spi_config_t config)
+{
+    (void)device;
+    (void)config;
+    errno = ENOENT;
+    return -1;
+}
+
+int spi_close(int fd)
+{
+    (void)fd;
+    return 0;
+}
+
+int spi_xfer(int fd, uint8_t *tx_buffer, uint8_t tx_len, uint8_t *rx_buffer, uint8_t rx_len)
+{
+    (void)fd;
+    (void)tx_buffer;
+    (void)tx_len;
+    (void)rx_buffer;
+    (void)rx_len;
+    errno = ENODEV;
+    return -1;
+}
@@ -0,0 +1,586 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "capture_format.h"
+
+#define CSV_STDOUT_BUFFER (1U << 20)
+#define NS_PER_SECOND 1000000000.0
+
+typedef enum e_capture_command {
+    COMMAND_INFO,
+    COMMAND_CSV,
+    COMMAND_STATS,
+    COMMAND_SLICE
+}   t_capture_command;
+
+typedef struct s_tool_options {
+    t_capture_command command;
+    const char *path;
+    const char *out_path;
+    double from_s;
+    double to_s;
+    uint16_t channels;
+    int channels_set;
+    int volts;
+}   t_tool_options;
+
+// Read-only mapping of a capture file; blocks are addressed straight in the page cache.
+typedef struct s_capture_map {
+    const uint8_t *base;
+    size_t size;
+    const t_capture_header *header;
+    uint64_t block_count;
+}   t_capture_map;
+
+// Channels and time window to visit; slots[] index the codes stored in each scan.
+typedef struct s_capture_selection {
+    uint64_t from_ns;
+    uint64_t to_ns;
+    uint16_t mask;
+    unsigned int count;
+    uint8_t channels[CAPTURE_MAX_CHANNELS];
+    uint8_t slots[CAPTURE_MAX_CHANNELS];
+}   t_capture_selection;
+
+typedef struct s_channel_stats {
+    uint64_t count;
+    uint64_t missing;
+    uint64_t sum;
+    uint64_t sum_sq;
+    uint16_t min;
+    uint16_t max;
+}   t_channel_stats;
+
+static void print_usage(const char *name)
+{
+    printf("Usage: %s info <file.cap>\n"
+        "       %s csv <file.cap> [--from=<s>] [--to=<s>] [--channels=<list>] [--volts]\n"
+        "       %s stats <file.cap> [--from=<s>] [--to=<s>] [--channels=<list>]\n"
+        "       %s slice <file.cap> <out.cap> [--from=<s>] [--to=<s>] [--channels=<list>]\n",
+        name, name, name, name);
+    printf("  info       : header, channel list, scan count, rates and duration\n");
+    printf("  csv        : timestamp_ns and raw codes (or volts) as CSV on stdout\n");
+    printf("  stats      : per-channel count, min, max, mean and standard deviation\n");
+    printf("  slice      : copy a time window and/or a channel subset to a new capture\n");
+    printf("  --from/--to: time window in seconds from the start of the capture, default: whole file\n");
+    printf("  --channels : recorded channels to keep, e.g. 0,3,8-11, default: all recorded\n");
+    printf("  --volts    : csv prints volts instead of raw codes\n");
+}
+
+static double parse_seconds_or_default(const char *raw_value, const char *param_name, double default_value)
+{
+    char *end = NULL;
+    double parsed;
+
+    errno = 0;
+    parsed = strtod(raw_value, &end);
+    if (errno != 0 || end == raw_value || *end != '\0' || parsed < 0.0 || !isfinite(parsed)) {
+        printf("Warning: invalid %s='%s' (seconds >= 0), ignoring\n", param_name, raw_value);
+        return default_value;
+    }
+    return parsed;
+}
+
+// Parse "0,3,8-11" into a bit mask. Keeps the previous mask on error.
+static int parse_channel_list(const char *raw_value, const char *param_name, unsigned int channel_count,
+    uint16_t *mask)
+{
+    uint16_t parsed_mask = 0;
+    const char *cursor = raw_value;
+
+    while (cursor && *cursor != '\0') {
+        char *end;
+        unsigned long first = strtoul(cursor, &end, 10);
+        unsigned long last = first;
+
+        if (end == cursor) {
+            break;
+        }
+        if (*end == '-') {
+            const char *range = end + 1;
+
+            last = strtoul(range, &end, 10);
+            if (end == range) {
+                break;
+            }
+        }
+        if (first > last || last >= channel_count) {
+            break;
+        }
+        for (unsigned long ch = first; ch <= last; ch++) {
+            parsed_mask |= (uint16_t)(1U << ch);
+        }
+        if (*end == '\0') {
+            *mask = parsed_mask;
+            return 0;
+        }
+        if (*end != ',') {
+            break;
+        }
+        cursor = end + 1;
+    }
+    printf("Warning: invalid %s='%s' (channels 0..%u, e.g. 0,3,8-11), keeping current selection\n",
+        param_name, raw_value ? raw_value : "", channel_count - 1U);
+    return -1;
+}
+
+static int parse_tool_options(int argc, char **argv, t_tool_options *options)
+{
+    int positional = 0;
+
+    memset(options, 0, sizeof(*options));
+    options->to_s = INFINITY;
+    if (argc < 3 || strcmp(argv[1], "--help") == 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (strcmp(argv[1], "info") == 0) {
+        options->command = COMMAND_INFO;
+    } else if (strcmp(argv[1], "csv") == 0) {
+        options->command = COMMAND_CSV;
+    } else if (strcmp(argv[1], "stats") == 0) {
+        options->command = COMMAND_STATS;
+    } else if (strcmp(argv[1], "slice") == 0) {
+        options->command = COMMAND_SLICE;
+    } else {
+        printf("Error: unknown command '%s' (use --help)\n", argv[1]);
+        return -1;
+    }
+
+    for (int i = 2; i < argc; i++) {
+        if (strncmp(argv[i], "--from=", 7) == 0) {
+            options->from_s = parse_seconds_or_default(argv[i] + 7, "from", 0.0);
+        } else if (strncmp(argv[i], "--to=", 5) == 0) {
+            options->to_s = parse_seconds_or_default(argv[i] + 5, "to", INFINITY);
+        } else if (strncmp(argv[i], "--channels=", 11) == 0) {
+            if (parse_channel_list(argv[i] + 11, "channels", CAPTURE_MAX_CHANNELS, &options->channels) == 0) {
+                options->channels_set = 1;
+            }
+        } else if (strcmp(argv[i], "--volts") == 0) {
+            options->volts = 1;
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            printf("Warning: unknown option '%s' (use --help)\n", argv[i]);
+        } else if (positional == 0) {
+            options->path = argv[i];
+            positional++;
+        } else if (positional == 1 && options->command == COMMAND_SLICE) {
+            options->out_path = argv[i];
+            positional++;
+        } else {
+            printf("Warning: extra argument '%s' ignored\n", argv[i]);
+        }
+    }
+    if (!options->path || (options->command == COMMAND_SLICE && !options->out_path)) {
+        print_usage(argv[0]);
+        return -1;
+    }
+    return 0;
+}
+
+static int capture_map_open(t_capture_map *map, const char *path)
+{
+    const t_capture_header *header;
+    struct stat st;
+    int fd;
+
+    memset(map, 0, sizeof(*map));
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        printf("Error: unable to open '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < CAPTURE_HEADER_SIZE) {
+        printf("Error: '%s' is not a capture file (too short)\n", path);
+        close(fd);
+        return -1;
+    }
+    map->size = (size_t)st.st_size;
+    map->base = mmap(NULL, map->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map->base == MAP_FAILED) {
+        printf("Error: unable to map '%s': %s\n", path, strerror(errno));
+        map->base = NULL;
+        return -1;
+    }
+
+    header = (const t_capture_header *)map->base;
+    if (memcmp(header->magic, CAPTURE_MAGIC, sizeof(header->magic)) != 0) {
+        printf("Error: '%s' is not a capture file (bad magic)\n", path);
+        return -1;
+    }
+    if (header->byte_order != CAPTURE_BYTE_ORDER || header->version != CAPTURE_VERSION) {
+        printf("Error: '%s' was written with another byte order or format version (%u)\n", path,
+            header->version);
+        return -1;
+    }
+    if (header->header_size < sizeof(*header) || header->block_size <= sizeof(t_capture_block)
+        || header->channel_count != capture_channel_count(header->channel_mask)
+        || header->scan_size != capture_scan_size(header->channel_count)
+        || header->scans_per_block != (header->block_size - sizeof(t_capture_block)) / header->scan_size) {
+        printf("Error: '%s' has an inconsistent header\n", path);
+        return -1;
+    }
+    map->header = header;
+    map->block_count = map->size > header->header_size
+        ? (map->size - header->header_size) / header->block_size : 0;
+    // An interrupted recording has no totals in its header: trust the blocks actually on disk.
+    if ((header->flags & CAPTURE_FLAG_COMPLETE) && header->block_count < map->block_count) {
+        map->block_count = header->block_count;
+    }
+    for (uint64_t i = 0; i < map->block_count; i++) {
+        const t_capture_block *block = capture_block_at(map->base, header, i);
+
+        if (block->block_index != i || block->scan_count == 0 || block->scan_count > header->scans_per_block) {
+            map->block_count = i;
+            break;
+        }
+    }
+    return 0;
+}
+
+static void capture_map_close(t_capture_map *map)
+{
+    if (map->base) {
+        munmap((void *)map->base, map->size);
+        map->base = NULL;
+    }
+}
+
+static int selection_init(t_capture_selection *selection, const t_capture_map *map, const t_tool_options *options)
+{
+    const t_capture_header *header = map->header;
+    unsigned int slot = 0;
+
+    memset(selection, 0, sizeof(*selection));
+    selection->mask = options->channels_set ? options->channels : header->channel_mask;
+    if (selection->mask & ~header->channel_mask) {
+        printf("Warning: channels 0x%04X not recorded in this capture, ignoring them\n",
+            selection->mask & ~header->channel_mask);
+        selection->mask &= header->channel_mask;
+    }
+    if (selection->mask == 0) {
+        printf("Error: no recorded channel selected\n");
+        return -1;
+    }
+    for (uint8_t ch = 0; ch < CAPTURE_MAX_CHANNELS; ch++) {
+        if (!(header->channel_mask & (1U << ch))) {
+            continue;
+        }
+        if (selection->mask & (1U << ch)) {
+            selection->channels[selection->count] = ch;
+            selection->slots[selection->count] = (uint8_t)slot;
+            selection->count++;
+        }
+        slot++;
+    }
+    selection->from_ns = header->start_monotonic_ns + (uint64_t)(options->from_s * NS_PER_SECOND);
+    selection->to_ns = isinf(options->to_s) ? UINT64_MAX
+        : header->start_monotonic_ns + (uint64_t)(options->to_s * NS_PER_SECOND);
+    if (selection->to_ns < selection->from_ns) {
+        printf("Error: --to is before --from\n");
+        return -1;
+    }
+    return 0;
+}
+
+// First block whose last scan is not before from_ns (blocks are in time order).
+static uint64_t capture_find_block(const t_capture_map *map, uint64_t from_ns)
+{
+    uint64_t low = 0;
+    uint64_t high = map->block_count;
+
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2U;
+
+        if (capture_block_at(map->base, map->header, mid)->last_timestamp_ns < from_ns) {
+            low = mid + 1U;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/*
+ * Visit every scan of the selection in file order. The callback sees the scan in place
+ * (zero copy) and returns non-zero to stop early.
+ */
+typedef int (*t_scan_visitor)(const t_capture_scan *scan, const t_capture_selection *selection, void *arg);
+
+static int capture_for_each_scan(const t_capture_map *map, const t_capture_selection *selection,
+    t_scan_visitor visit, void *arg)
+{
+    uint64_t first = capture_find_block(map, selection->from_ns);
+
+    madvise((void *)map->base, map->size, MADV_SEQUENTIAL);
+    for (uint64_t i = first; i < map->block_count; i++) {
+        const t_capture_block *block = capture_block_at(map->base, map->header, i);
+
+        if (block->first_timestamp_ns > selection->to_ns) {
+            break;
+        }
+        for (unsigned int s = 0; s < block->scan_count; s++) {
+            const t_capture_scan *scan = capture_scan_at(block, map->header, s);
+
+            if (scan->timestamp_ns < selection->from_ns || scan->timestamp_ns > selection->to_ns) {
+                continue;
+            }
+            if (visit(scan, selection, arg) != 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static void format_channel_list(char *line, size_t line_size, uint16_t mask)
+{
+    size_t used = 0;
+
+    line[0] = '\0';
+    for (uint8_t ch = 0; ch < CAPTURE_MAX_CHANNELS && used < line_size; ch++) {
+        if (mask & (1U << ch)) {
+            int written = snprintf(line + used, line_size - used, "%s%u", used ? "," : "", ch);
+
+            if (written < 0) {
+                return;
+            }
+            used += (size_t)written;
+        }
+    }
+}
+
+static int run_info(const t_capture_map *map, const char *path)
+{
+    const t_capture_header *header = map->header;
+    uint64_t scans = 0;
+    double duration_s = 0.0;
+    char channels[64];
+    char start[64] = "unknown";
+    time_t start_s = (time_t)(header->start_realtime_ns / 1000000000ULL);
+    struct tm start_tm;
+
+    for (uint64_t i = 0; i < map->block_count; i++) {
+        scans += capture_block_at(map->base, header, i)->scan_count;
+    }
+    if (map->block_count > 0) {
+        const t_capture_block *last = capture_block_at(map->base, header, map->block_count - 1U);
+
+        duration_s = (double)(last->last_timestamp_ns - capture_block_at(map->base, header, 0)->first_timestamp_ns)
+            / NS_PER_SECOND;
+    }
+    if (localtime_r(&start_s, &start_tm)) {
+        strftime(start, sizeof(start), "%Y-%m-%d %H:%M:%S", &start_tm);
+    }
+    format_channel_list(channels, sizeof(channels), header->channel_mask);
+
+    printf("File: %s (%zu bytes, format v%u)\n", path, map->size, header->version);
+    printf("Channels: %s (mask 0x%04X) | %u-bit codes | full scale %.3f V\n", channels, header->channel_mask,
+        header->code_bits, (double)header->full_scale_uv / 1e6);
+    printf("Scans: %llu in %llu blocks (%u per %u-byte block, %u bytes/scan) | dropped while recording: %llu\n",
+        (unsigned long long)scans, (unsigned long long)map->block_count, header->scans_per_block,
+        header->block_size, header->scan_size, (unsigned long long)header->dropped_scans);
+    if (header->sample_rate_hz > 0.0) {
+        printf("Rate: requested %.1f Hz | measured %.1f scans/s\n", header->sample_rate_hz,
+            duration_s > 0.0 ? (double)(scans - 1U) / duration_s : 0.0);
+    } else {
+        printf("Rate: free-running | measured %.1f scans/s\n",
+            duration_s > 0.0 ? (double)(scans - 1U) / duration_s : 0.0);
+    }
+    printf("Start: %s.%03llu | duration %.3f s\n", start,
+        (unsigned long long)(header->start_realtime_ns % 1000000000ULL / 1000000ULL), duration_s);
+    if (!(header->flags & CAPTURE_FLAG_COMPLETE)) {
+        printf("Status: incomplete (recording was interrupted), %llu blocks recovered\n",
+            (unsigned long long)map->block_count);
+    }
+    return 0;
+}
+
+typedef struct s_csv_ctx {
+    double volts_per_code;
+    int volts;
+}   t_csv_ctx;
+
+static int csv_visit(const t_capture_scan *scan, const t_capture_selection *selection, void *arg)
+{
+    const t_csv_ctx *csv = (const t_csv_ctx *)arg;
+
+    printf("%llu", (unsigned long long)scan->timestamp_ns);
+    for (unsigned int i = 0; i < selection->count; i++) {
+        uint16_t code = scan->codes[selection->slots[i]];
+
+        if (code == CAPTURE_CODE_INVALID) {
+            fputc(',', stdout);
+        } else if (csv->volts) {
+            printf(",%.4f", (double)code * csv->volts_per_code);
+        } else {
+            printf(",%u", code);
+        }
+    }
+    // A closed pipe (e.g. | head) ends the export.
+    return fputc('\n', stdout) == EOF;
+}
+
+static int run_csv(const t_capture_map *map, const t_capture_selection *selection, int volts)
+{
+    static char stdout_buffer[CSV_STDOUT_BUFFER];
+    t_csv_ctx csv;
+
+    setvbuf(stdout, stdout_buffer, _IOFBF, sizeof(stdout_buffer));
+    csv.volts = volts;
+    csv.volts_per_code = (double)map->header->full_scale_uv / 1e6 / (double)((1U << map->header->code_bits) - 1U);
+    printf("timestamp_ns");
+    for (unsigned int i = 0; i < selection->count; i++) {
+        printf(",ch%u", selection->channels[i]);
+    }
+    printf("\n");
+    capture_for_each_scan(map, selection, csv_visit, &csv);
+    fflush(stdout);
+    return 0;
+}
+
+static int stats_visit(const t_capture_scan *scan, const t_capture_selection *selection, void *arg)
+{
+    t_channel_stats *stats = (t_channel_stats *)arg;
+
+    for (unsigned int i = 0; i < selection->count; i++) {
+        uint16_t code = scan->codes[selection->slots[i]];
+        t_channel_stats *channel = &stats[i];
+
+        if (code == CAPTURE_CODE_INVALID) {
+            channel->missing++;
+            continue;
+        }
+        channel->count++;
+        channel->sum += code;
+        channel->sum_sq += (uint64_t)code * code;
+        if (code < channel->min) {
+            channel->min = code;
+        }
+        if (code > channel->max) {
+            channel->max = code;
+        }
+    }
+    return 0;
+}
+
+static int run_stats(const t_capture_map *map, const t_capture_selection *selection)
+{
+    t_channel_stats stats[CAPTURE_MAX_CHANNELS];
+    double volts_per_code = (double)map->header->full_scale_uv / 1e6 / (double)((1U << map->header->code_bits) - 1U);
+
+    memset(stats, 0, sizeof(stats));
+    for (unsigned int i = 0; i < selection->count; i++) {
+        stats[i].min = UINT16_MAX;
+    }
+    capture_for_each_scan(map, selection, stats_visit, stats);
+
+    printf("channel      count   missing   min   max      mean    stddev   mean(V)  stddev(V)\n");
+    for (unsigned int i = 0; i < selection->count; i++) {
+        const t_channel_stats *channel = &stats[i];
+        double mean = 0.0;
+        double variance = 0.0;
+
+        if (channel->count == 0) {
+            printf("ch%-4u %12llu %9llu     -     -         -         -         -          -\n",
+                selection->channels[i], 0ULL, (unsigned long long)channel->missing);
+            continue;
+        }
+        mean = (double)channel->sum / (double)channel->count;
+        variance = (double)channel->sum_sq / (double)channel->count - mean * mean;
+        printf("ch%-4u %12llu %9llu %5u %5u %9.3f %9.3f %9.4f %10.4f\n", selection->channels[i],
+            (unsigned long long)channel->count, (unsigned long long)channel->missing, channel->min, channel->max,
+            mean, sqrt(fmax(variance, 0.0)), mean * volts_per_code, sqrt(fmax(variance, 0.0)) * volts_per_code);
+    }
+    return 0;
+}
+
+typedef struct s_slice_ctx {
+    t_capture_writer writer;
+    int failed;
+}   t_slice_ctx;
+
+static int slice_visit(const t_capture_scan *scan, const t_capture_selection *selection, void *arg)
+{
+    t_slice_ctx *slice = (t_slice_ctx *)arg;
+    uint16_t codes[CAPTURE_MAX_CHANNELS];
+
+    for (unsigned int i = 0; i < selection->count; i++) {
+        codes[i] = scan->codes[selection->slots[i]];
+    }
+    if (capture_writer_append(&slice->writer, scan->timestamp_ns, codes) != 0) {
+        slice->failed = 1;
+        return -1;
+    }
+    return 0;
+}
+
+static int run_slice(const t_capture_map *map, const t_capture_selection *selection, const char *out_path)
+{
+    const t_capture_header *source = map->header;
+    t_capture_header header;
+    static t_slice_ctx slice;
+
+    capture_header_init(&header, selection->mask, source->sample_rate_hz, source->full_scale_uv,
+        source->start_monotonic_ns);
+    // Same time base as the source so --from/--to offsets keep their meaning.
+    header.start_realtime_ns = source->start_realtime_ns;
+    header.dropped_scans = source->dropped_scans;
+    if (capture_writer_open(&slice.writer, out_path, &header) != 0) {
+        printf("Error: unable to create '%s': %s\n", out_path, strerror(errno));
+        return 1;
+    }
+    capture_for_each_scan(map, selection, slice_visit, &slice);
+    if (slice.failed) {
+        printf("Error: write to '%s' failed: %s\n", out_path, strerror(errno));
+        capture_writer_close(&slice.writer);
+        return 1;
+    }
+    if (capture_writer_close(&slice.writer) != 0) {
+        printf("Error: unable to finish '%s': %s\n", out_path, strerror(errno));
+        return 1;
+    }
+    printf("Slice: %s | scans=%llu | blocks=%llu\n", out_path, (unsigned long long)slice.writer.header.scan_count,
+        (unsigned long long)slice.writer.header.block_count);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    t_tool_options options;
+    t_capture_map map;
+    t_capture_selection selection;
+    int parse_status;
+    int status = 0;
+
+    parse_status = parse_tool_options(argc, argv, &options);
+    if (parse_status != 0) {
+        return parse_status > 0 ? 0 : 1;
+    }
+    if (capture_map_open(&map, options.path) != 0) {
+        capture_map_close(&map);
+        return 1;
+    }
+    if (options.command == COMMAND_INFO) {
+        status = run_info(&map, options.path);
+    } else if (selection_init(&selection, &map, &options) != 0) {
+        status = 1;
+    } else if (options.command == COMMAND_CSV) {
+        status = run_csv(&map, &selection, options.volts);
+    } else if (options.command == COMMAND_STATS) {
+        status = run_stats(&map, &selection);
+    } else {
+        status = run_slice(&map, &selection, options.out_path);
+    }
+    capture_map_close(&map);
+    return status;
+}
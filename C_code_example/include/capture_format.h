@@ -0,0 +1,258 @@
+#ifndef CAPTURE_FORMAT_H
+#define CAPTURE_FORMAT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Binary ADC capture (.cap), written by input_reader --record and read by capture_tool.
+ *
+ *   [header, CAPTURE_HEADER_SIZE bytes][block 0][block 1]...
+ *   block = [t_capture_block 32 bytes][scan 0][scan 1]... zero padded to CAPTURE_BLOCK_SIZE
+ *   scan  = [uint64 timestamp_ns][uint16 code per channel of channel_mask, ascending] padded to 8 bytes
+ *
+ * Fields are stored in host order (little-endian on the Raspberry Pi); byte_order tells a
+ * reader on another host. Every block is full size, so block N is at a fixed offset and
+ * every scan is 8-byte aligned when the file is mmap'ed. Timestamps are CLOCK_MONOTONIC.
+ */
+#define CAPTURE_MAGIC "MHATCAP1"
+#define CAPTURE_VERSION 1U
+#define CAPTURE_BYTE_ORDER 0x01020304U
+#define CAPTURE_HEADER_SIZE 4096U
+#define CAPTURE_BLOCK_SIZE 65536U
+#define CAPTURE_WRITE_BLOCKS 16U
+#define CAPTURE_MAX_CHANNELS 16
+#define CAPTURE_CODE_BITS 10U
+#define CAPTURE_CODE_INVALID 0xFFFFU
+#define CAPTURE_FLAG_COMPLETE 1U
+
+typedef struct s_capture_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t header_size;
+    uint32_t block_size;
+    uint32_t scan_size;
+    uint32_t scans_per_block;
+    uint16_t channel_mask;
+    uint16_t channel_count;
+    uint16_t code_bits;
+    uint16_t flags;
+    uint32_t full_scale_uv;
+    uint32_t reserved;
+    double sample_rate_hz;
+    double measured_rate_hz;
+    uint64_t start_realtime_ns;
+    uint64_t start_monotonic_ns;
+    uint64_t scan_count;
+    uint64_t block_count;
+    uint64_t dropped_scans;
+}   t_capture_header;
+
+typedef struct s_capture_block {
+    uint32_t scan_count;
+    uint32_t reserved;
+    uint64_t block_index;
+    uint64_t first_timestamp_ns;
+    uint64_t last_timestamp_ns;
+}   t_capture_block;
+
+typedef struct s_capture_scan {
+    uint64_t timestamp_ns;
+    uint16_t codes[];
+}   t_capture_scan;
+
+/*
+ * Sequential writer: scans are packed into blocks in a CAPTURE_WRITE_BLOCKS buffer that
+ * goes to the file in one write(). The header is rewritten with the totals on close.
+ */
+typedef struct s_capture_writer {
+    int fd;
+    t_capture_header header;
+    uint8_t *buffer;
+    unsigned int buffered_blocks;
+    t_capture_block *block;
+    uint64_t first_timestamp_ns;
+    uint64_t last_timestamp_ns;
+}   t_capture_writer;
+
+static inline unsigned int capture_channel_count(uint16_t channel_mask)
+{
+    return (unsigned int)__builtin_popcount(channel_mask);
+}
+
+static inline uint32_t capture_scan_size(unsigned int channel_count)
+{
+    return (uint32_t)((sizeof(uint64_t) + channel_count * sizeof(uint16_t) + 7U) & ~7U);
+}
+
+static inline const t_capture_block *capture_block_at(const uint8_t *base, const t_capture_header *header,
+    uint64_t index)
+{
+    return (const t_capture_block *)(base + header->header_size + index * header->block_size);
+}
+
+static inline const t_capture_scan *capture_scan_at(const t_capture_block *block, const t_capture_header *header,
+    unsigned int index)
+{
+    return (const t_capture_scan *)((const uint8_t *)block + sizeof(*block) + (size_t)index * header->scan_size);
+}
+
+static inline void capture_header_init(t_capture_header *header, uint16_t channel_mask, double sample_rate_hz,
+    uint32_t full_scale_uv, uint64_t start_monotonic_ns)
+{
+    struct timespec now;
+
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, CAPTURE_MAGIC, sizeof(header->magic));
+    header->version = CAPTURE_VERSION;
+    header->byte_order = CAPTURE_BYTE_ORDER;
+    header->header_size = CAPTURE_HEADER_SIZE;
+    header->block_size = CAPTURE_BLOCK_SIZE;
+    header->channel_mask = channel_mask;
+    header->channel_count = (uint16_t)capture_channel_count(channel_mask);
+    header->scan_size = capture_scan_size(header->channel_count);
+    header->scans_per_block = (uint32_t)((CAPTURE_BLOCK_SIZE - sizeof(t_capture_block)) / header->scan_size);
+    header->code_bits = CAPTURE_CODE_BITS;
+    header->full_scale_uv = full_scale_uv;
+    header->sample_rate_hz = sample_rate_hz;
+    clock_gettime(CLOCK_REALTIME, &now);
+    header->start_realtime_ns = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+    header->start_monotonic_ns = start_monotonic_ns;
+}
+
+static inline int capture_write_all(int fd, const uint8_t *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t written = write(fd, data, len);
+
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return -1;
+        }
+        data += written;
+        len -= (size_t)written;
+    }
+    return 0;
+}
+
+static inline int capture_writer_flush(t_capture_writer *writer)
+{
+    int status = capture_write_all(writer->fd, writer->buffer, (size_t)writer->buffered_blocks * CAPTURE_BLOCK_SIZE);
+
+    writer->buffered_blocks = 0;
+    return status;
+}
+
+// Create path and reserve the header page. Returns -1 with errno set on failure.
+static inline int capture_writer_open(t_capture_writer *writer, const char *path, const t_capture_header *header)
+{
+    uint8_t header_page[CAPTURE_HEADER_SIZE] = {0};
+
+    memset(writer, 0, sizeof(*writer));
+    writer->fd = -1;
+    writer->header = *header;
+    writer->buffer = aligned_alloc(CAPTURE_HEADER_SIZE, (size_t)CAPTURE_WRITE_BLOCKS * CAPTURE_BLOCK_SIZE);
+    if (!writer->buffer) {
+        return -1;
+    }
+    writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (writer->fd < 0) {
+        free(writer->buffer);
+        writer->buffer = NULL;
+        return -1;
+    }
+    // Placeholder header so blocks land at their final offsets; totals are filled on close.
+    memcpy(header_page, &writer->header, sizeof(writer->header));
+    if (capture_write_all(writer->fd, header_page, sizeof(header_page)) != 0) {
+        int saved_errno = errno;
+
+        close(writer->fd);
+        writer->fd = -1;
+        free(writer->buffer);
+        writer->buffer = NULL;
+        errno = saved_errno;
+        return -1;
+    }
+    return 0;
+}
+
+// Append one scan of channel_count codes (CAPTURE_CODE_INVALID for a failed read).
+static inline int capture_writer_append(t_capture_writer *writer, uint64_t timestamp_ns, const uint16_t *codes)
+{
+    t_capture_scan *scan;
+
+    if (!writer->block) {
+        if (writer->buffered_blocks == CAPTURE_WRITE_BLOCKS && capture_writer_flush(writer) != 0) {
+            return -1;
+        }
+        writer->block = (t_capture_block *)(writer->buffer + (size_t)writer->buffered_blocks * CAPTURE_BLOCK_SIZE);
+        memset(writer->block, 0, CAPTURE_BLOCK_SIZE);
+        writer->block->block_index = writer->header.block_count;
+        writer->block->first_timestamp_ns = timestamp_ns;
+    }
+    scan = (t_capture_scan *)capture_scan_at(writer->block, &writer->header, writer->block->scan_count);
+    scan->timestamp_ns = timestamp_ns;
+    memcpy(scan->codes, codes, writer->header.channel_count * sizeof(uint16_t));
+    writer->block->last_timestamp_ns = timestamp_ns;
+    writer->block->scan_count++;
+    if (writer->header.scan_count == 0) {
+        writer->first_timestamp_ns = timestamp_ns;
+    }
+    writer->last_timestamp_ns = timestamp_ns;
+    writer->header.scan_count++;
+    if (writer->block->scan_count == writer->header.scans_per_block) {
+        writer->block = NULL;
+        writer->buffered_blocks++;
+        writer->header.block_count++;
+    }
+    return 0;
+}
+
+// Write the partial last block and the final header. Returns -1 with errno set on failure.
+static inline int capture_writer_close(t_capture_writer *writer)
+{
+    int status = 0;
+    int saved_errno = 0;
+
+    if (writer->fd < 0) {
+        return 0;
+    }
+    if (writer->block) {
+        writer->block = NULL;
+        writer->buffered_blocks++;
+        writer->header.block_count++;
+    }
+    if (capture_writer_flush(writer) != 0) {
+        status = -1;
+        saved_errno = errno;
+    }
+    if (writer->header.scan_count > 1 && writer->last_timestamp_ns > writer->first_timestamp_ns) {
+        writer->header.measured_rate_hz = (double)(writer->header.scan_count - 1U) * 1e9
+            / (double)(writer->last_timestamp_ns - writer->first_timestamp_ns);
+    }
+    writer->header.flags |= CAPTURE_FLAG_COMPLETE;
+    if (status == 0
+        && pwrite(writer->fd, &writer->header, sizeof(writer->header), 0) != (ssize_t)sizeof(writer->header)) {
+        status = -1;
+        saved_errno = errno;
+    }
+    if (close(writer->fd) != 0 && status == 0) {
+        status = -1;
+        saved_errno = errno;
+    }
+    writer->fd = -1;
+    free(writer->buffer);
+    writer->buffer = NULL;
+    errno = saved_errno;
+    return status;
+}
+
+#endif
@@ -0,0 +1,604 @@
+#ifndef HAT_RUNTIME_H
+#define HAT_RUNTIME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Loop runtime shared by output_generator, input_reader and input_output_tester.
+ * Header only, like capture_format.h; the tools define _GNU_SOURCE before including it.
+ *
+ * Run flag and absolute-deadline sample clock.
+ */
+#define SHORT_PERIOD_NS 100000U
+#define AUTO_BUSY_WAIT_US 50U
+
+typedef struct s_sample_clock {
+    uint64_t period_ns;
+    uint64_t busy_wait_ns;
+    uint64_t next_ns;
+    unsigned long ticks;
+    unsigned long overruns;
+    unsigned long missed_periods;
+    uint64_t deadline_ns;
+}   t_sample_clock;
+
+// Cleared by SIGINT/SIGTERM; the sample clock stops waiting once it is 0.
+static volatile sig_atomic_t g_keep_running = 1;
+
+static inline void signal_handler(int signo)
+{
+    (void)signo;
+    g_keep_running = 0;
+}
+
+static inline uint64_t monotonic_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000ULL) + (uint64_t)now.tv_nsec;
+}
+
+static inline void sleep_until_ns(uint64_t deadline_ns)
+{
+    struct timespec deadline;
+
+    deadline.tv_sec = (time_t)(deadline_ns / 1000000000ULL);
+    deadline.tv_nsec = (long)(deadline_ns % 1000000000ULL);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR && g_keep_running) {
+    }
+}
+
+static inline void sample_clock_init(t_sample_clock *sample_clock, double rate_hz, int busy_wait_us)
+{
+    memset(sample_clock, 0, sizeof(*sample_clock));
+    sample_clock->period_ns = (rate_hz > 0.0) ? (uint64_t)llround(1000000000.0 / rate_hz) : 0;
+    if (busy_wait_us < 0) {
+        // Auto: wakeup slop of clock_nanosleep is tens of us, so spin the tail of short periods.
+        busy_wait_us = (sample_clock->period_ns > 0 && sample_clock->period_ns < SHORT_PERIOD_NS)
+            ? (int)AUTO_BUSY_WAIT_US : 0;
+    }
+    sample_clock->busy_wait_ns = (uint64_t)busy_wait_us * 1000ULL;
+    sample_clock->next_ns = monotonic_ns() + sample_clock->period_ns;
+}
+
+/*
+ * Wait for the next absolute deadline on CLOCK_MONOTONIC. Deadlines sit on a fixed
+ * grid from the start time, so work time and wakeup latency never accumulate as drift.
+ * After an overrun the missed deadlines are skipped instead of replayed in a burst.
+ * Returns the number of periods elapsed since the previous tick (1 when on time).
+ */
+static inline unsigned int sample_clock_wait(t_sample_clock *sample_clock)
+{
+    unsigned int periods = 1;
+    uint64_t now;
+
+    sample_clock->ticks++;
+    if (sample_clock->period_ns == 0) {
+        return periods;
+    }
+
+    now = monotonic_ns();
+    if (now > sample_clock->next_ns) {
+        uint64_t missed = (now - sample_clock->next_ns) / sample_clock->period_ns;
+
+        sample_clock->overruns++;
+        sample_clock->missed_periods += missed;
+        sample_clock->next_ns += missed * sample_clock->period_ns;
+        periods += (unsigned int)missed;
+    } else {
+        if (sample_clock->next_ns - now > sample_clock->busy_wait_ns) {
+            sleep_until_ns(sample_clock->next_ns - sample_clock->busy_wait_ns);
+        }
+        while (monotonic_ns() < sample_clock->next_ns && g_keep_running) {
+        }
+    }
+    sample_clock->deadline_ns = sample_clock->next_ns;
+    sample_clock->next_ns += sample_clock->period_ns;
+    return periods;
+}
+
+static inline void print_sample_clock_report(const t_sample_clock *sample_clock)
+{
+    printf("Sample clock: period=%.1f us | ticks=%lu | overruns=%lu | missed periods=%lu\n",
+        (double)sample_clock->period_ns / 1000.0, sample_clock->ticks,
+        sample_clock->overruns, sample_clock->missed_periods);
+}
+
+/*
+ * Latency histograms for the per-stage loop timing. SIGUSR1 asks the loop for a report
+ * while it runs; the loop prints it at the end of the current tick.
+ */
+#define HIST_SUB_BITS 4U
+#define HIST_SUB_COUNT (1U << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64U - HIST_SUB_BITS + 1U) * HIST_SUB_COUNT)
+
+typedef struct s_latency_hist {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+}   t_latency_hist;
+
+static volatile sig_atomic_t g_stats_requested = 0;
+
+static inline void stats_signal_handler(int signo)
+{
+    (void)signo;
+    g_stats_requested = 1;
+}
+
+/*
+ * Log-linear bucket index: values below HIST_SUB_COUNT get their own bucket, above that
+ * each power of two is split into HIST_SUB_COUNT linear sub-buckets (~6% resolution).
+ */
+static inline unsigned int hist_bucket_index(uint64_t value)
+{
+    unsigned int msb;
+
+    if (value < HIST_SUB_COUNT) {
+        return (unsigned int)value;
+    }
+    msb = 63U - (unsigned int)__builtin_clzll(value);
+    return ((msb - HIST_SUB_BITS + 1U) << HIST_SUB_BITS)
+        | (unsigned int)((value >> (msb - HIST_SUB_BITS)) & (HIST_SUB_COUNT - 1U));
+}
+
+static inline uint64_t hist_bucket_upper_bound(unsigned int index)
+{
+    unsigned int major = index >> HIST_SUB_BITS;
+    unsigned int minor = index & (HIST_SUB_COUNT - 1U);
+    unsigned int shift;
+
+    if (major == 0) {
+        return minor;
+    }
+    shift = major - 1U;
+    return ((uint64_t)(HIST_SUB_COUNT | minor) << shift) + ((1ULL << shift) - 1ULL);
+}
+
+static inline void hist_record(t_latency_hist *hist, uint64_t value_ns)
+{
+    hist->counts[hist_bucket_index(value_ns)]++;
+    hist->total++;
+    hist->sum_ns += value_ns;
+    if (value_ns > hist->max_ns) {
+        hist->max_ns = value_ns;
+    }
+}
+
+static inline uint64_t hist_percentile(const t_latency_hist *hist, double percentile)
+{
+    uint64_t rank = (uint64_t)ceil((percentile / 100.0) * (double)hist->total);
+    uint64_t cumulative = 0;
+
+    if (rank == 0) {
+        rank = 1;
+    }
+    for (unsigned int i = 0; i < HIST_BUCKETS; i++) {
+        cumulative += hist->counts[i];
+        if (cumulative >= rank) {
+            uint64_t upper = hist_bucket_upper_bound(i);
+            return (upper < hist->max_ns) ? upper : hist->max_ns;
+        }
+    }
+    return hist->max_ns;
+}
+
+// Record the time elapsed since start_ns for one loop stage and return the new timestamp.
+static inline uint64_t stage_mark(t_latency_hist *hist, uint64_t start_ns)
+{
+    uint64_t now = monotonic_ns();
+
+    hist_record(hist, now - start_ns);
+    return now;
+}
+
+static inline void print_hist_header(FILE *out)
+{
+    fprintf(out, "%-10s %10s %10s %10s %10s %10s %10s\n",
+        "stage", "count", "mean us", "p50 us", "p99 us", "p99.9 us", "max us");
+}
+
+static inline void print_hist_row(FILE *out, const char *name, const t_latency_hist *hist)
+{
+    if (hist->total == 0) {
+        fprintf(out, "%-10s %10d %10s %10s %10s %10s %10s\n", name, 0, "-", "-", "-", "-", "-");
+        return;
+    }
+    fprintf(out, "%-10s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", name,
+        (unsigned long long)hist->total, (double)hist->sum_ns / (double)hist->total / 1000.0,
+        (double)hist_percentile(hist, 50.0) / 1000.0, (double)hist_percentile(hist, 99.0) / 1000.0,
+        (double)hist_percentile(hist, 99.9) / 1000.0, (double)hist->max_ns / 1000.0);
+}
+
+// One row per loop stage (names[i] for hists[i]), then the sample clock overruns.
+static inline void print_latency_report(FILE *out, const t_latency_hist *hists, const char **names, int count,
+    const t_sample_clock *sample_clock)
+{
+    print_hist_header(out);
+    for (int stage = 0; stage < count; stage++) {
+        print_hist_row(out, names[stage], &hists[stage]);
+    }
+    fprintf(out, "overruns=%lu | missed periods=%lu\n", sample_clock->overruns, sample_clock->missed_periods);
+    fflush(out);
+}
+
+/*
+ * Single-writer seqlock around a plain struct, for the sample thread -> render thread
+ * snapshot: the writer never waits, the reader retries on a torn copy.
+ */
+static inline void seqlock_publish(atomic_uint *seq, void *latest, const void *snapshot, size_t size)
+{
+    unsigned int begin = atomic_load_explicit(seq, memory_order_relaxed);
+
+    // Odd sequence = write in progress.
+    atomic_store_explicit(seq, begin + 1U, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(latest, snapshot, size);
+    atomic_store_explicit(seq, begin + 2U, memory_order_release);
+}
+
+// Copy the latest snapshot; returns 0 while nothing has been published yet.
+static inline int seqlock_read_latest(atomic_uint *seq, const void *latest, void *snapshot, size_t size)
+{
+    unsigned int begin;
+    unsigned int end;
+
+    do {
+        begin = atomic_load_explicit(seq, memory_order_acquire);
+        memcpy(snapshot, latest, size);
+        atomic_thread_fence(memory_order_acquire);
+        end = atomic_load_explicit(seq, memory_order_relaxed);
+    } while ((begin & 1U) || begin != end);
+    return begin != 0;
+}
+
+/*
+ * Equalizer dashboards: EQ_ROWS rows of EQ_STEPS_PER_ROW glyph steps per bar, one bar
+ * per channel after an EQ_LABEL_WIDTH label column.
+ */
+#define EQ_ROWS 5
+#define EQ_STEPS_PER_ROW 8
+#define EQ_BAR_WIDTH 4
+#define EQ_LABEL_WIDTH 9
+
+// Sized for the largest dashboard: 19 text rows, 16 ADC bars.
+#define SCREEN_MAX_TEXT_ROWS 32
+#define SCREEN_MAX_BARS 16
+#define SCREEN_LINE_LEN 256
+#define SCREEN_OUT_LEN 16384
+#define SCREEN_REPAINT_EVERY 100U
+
+/*
+ * Terminal model of the last drawn frame: text rows (header + history) and one glyph
+ * index per equalizer cell. Only differences are emitted, all in one write().
+ */
+typedef struct s_screen {
+    char lines[SCREEN_MAX_TEXT_ROWS][SCREEN_LINE_LEN];
+    uint8_t cells[EQ_ROWS][SCREEN_MAX_BARS];
+    int drawn;
+    unsigned int frames;
+    char out[SCREEN_OUT_LEN];
+    size_t out_len;
+}   t_screen;
+
+// Bars span 0..10 V.
+static inline int mv_to_equalizer_steps(uint32_t mv)
+{
+    if (mv > 10000U) {
+        mv = 10000U;
+    }
+    return (int)((mv * (EQ_ROWS * EQ_STEPS_PER_ROW) + 5000U) / 10000U);
+}
+
+static inline void screen_append(t_screen *screen, const char *data, size_t len)
+{
+    if (len > sizeof(screen->out) - screen->out_len) {
+        len = sizeof(screen->out) - screen->out_len;
+    }
+    memcpy(screen->out + screen->out_len, data, len);
+    screen->out_len += len;
+}
+
+static inline void screen_move(t_screen *screen, int row, int col)
+{
+    char seq[16];
+    int len = snprintf(seq, sizeof(seq), "\033[%d;%dH", row + 1, col + 1);
+
+    screen_append(screen, seq, (size_t)len);
+}
+
+// Redraw one text row only when it differs from what is on the terminal.
+static inline void screen_set_line(t_screen *screen, int row, const char *text)
+{
+    if (screen->drawn && strcmp(screen->lines[row], text) == 0) {
+        return;
+    }
+    screen_move(screen, row, 0);
+    screen_append(screen, text, strlen(text));
+    screen_append(screen, "\033[K", 3);
+    snprintf(screen->lines[row], SCREEN_LINE_LEN, "%s", text);
+}
+
+// One equalizer cell; eq_top is the terminal row of the top equalizer row.
+static inline void screen_set_cell(t_screen *screen, int eq_top, int eq_row, int bar, uint8_t glyph)
+{
+    static const char *blocks[EQ_STEPS_PER_ROW + 1] = {" ", "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"};
+    size_t glyph_len = strlen(blocks[glyph]);
+
+    if (screen->drawn && screen->cells[eq_row][bar] == glyph) {
+        return;
+    }
+    screen_move(screen, eq_top + (EQ_ROWS - 1 - eq_row), EQ_LABEL_WIDTH + 1 + bar * (EQ_BAR_WIDTH + 1));
+    for (int w = 0; w < EQ_BAR_WIDTH; w++) {
+        screen_append(screen, blocks[glyph], glyph_len);
+    }
+    screen->cells[eq_row][bar] = glyph;
+}
+
+static inline void screen_flush(t_screen *screen)
+{
+    size_t written = 0;
+
+    while (written < screen->out_len) {
+        ssize_t ret = write(STDOUT_FILENO, screen->out + written, screen->out_len - written);
+
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            break;
+        }
+        written += (size_t)ret;
+    }
+    screen->out_len = 0;
+    screen->drawn = 1;
+}
+
+/*
+ * History of raw samples: the sample thread overwrites the oldest record, the render
+ * thread copies the newest ones and formats them only when a frame is drawn. Records
+ * are opaque here, record_size bytes each (each tool has its own t_history_record).
+ */
+typedef struct s_history_ring {
+    uint8_t *records;
+    size_t record_size;
+    unsigned int capacity;
+    atomic_ulong head;
+}   t_history_ring;
+
+static inline int history_ring_init(t_history_ring *ring, unsigned int capacity, size_t record_size)
+{
+    ring->records = calloc(capacity, record_size);
+    ring->record_size = record_size;
+    ring->capacity = ring->records ? capacity : 0;
+    atomic_store(&ring->head, 0);
+    return ring->records ? 0 : -1;
+}
+
+static inline void history_ring_free(t_history_ring *ring)
+{
+    free(ring->records);
+    ring->records = NULL;
+    ring->capacity = 0;
+}
+
+static inline void history_ring_push(t_history_ring *ring, const void *record)
+{
+    unsigned long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    if (ring->capacity == 0) {
+        return;
+    }
+    memcpy(ring->records + (head % ring->capacity) * ring->record_size, record, ring->record_size);
+    atomic_store_explicit(&ring->head, head + 1UL, memory_order_release);
+}
+
+/*
+ * Copy up to max_records of the newest records, oldest first. Records the writer may
+ * have overwritten while they were copied are dropped from the front.
+ */
+static inline unsigned int history_ring_latest(t_history_ring *ring, void *out, unsigned int max_records)
+{
+    unsigned long head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint8_t *dst = (uint8_t *)out;
+    unsigned long first;
+    unsigned long end;
+
+    if (max_records > ring->capacity) {
+        max_records = ring->capacity;
+    }
+    first = (head > max_records) ? head - max_records : 0;
+    for (unsigned long i = first; i < head; i++) {
+        memcpy(dst + (i - first) * ring->record_size, ring->records + (i % ring->capacity) * ring->record_size,
+            ring->record_size);
+    }
+    atomic_thread_fence(memory_order_acquire);
+    end = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    // The writer may be filling index end, which shares a slot with end - capacity.
+    if (end - first >= ring->capacity) {
+        unsigned long stale = end - first - ring->capacity + 1;
+
+        if (stale >= head - first) {
+            return 0;
+        }
+        memmove(dst, dst + stale * ring->record_size, (size_t)(head - first - stale) * ring->record_size);
+        first += stale;
+    }
+    return (unsigned int)(head - first);
+}
+
+// --in-channels/--out-channels schedules: up to 16 ADC inputs or 8 DAC outputs.
+#define SCHEDULE_MAX_CHANNELS 16
+#define MAX_CHANNEL_DIVISOR 1000000U
+
+/*
+ * Per-channel scan schedule: channel ch is read every divisor[ch] loop ticks. Channels
+ * given the same explicit /divisor start at staggered offsets, so their conversions are
+ * spread over the period; channels on the mode default stay on one tick, one batched
+ * message per MCP3008. A pass ends once every channel of mask has been read.
+ */
+typedef struct s_channel_schedule {
+    uint16_t mask;
+    uint16_t explicit_mask;
+    uint32_t divisor[SCHEDULE_MAX_CHANNELS];
+    uint32_t countdown[SCHEDULE_MAX_CHANNELS];
+    uint16_t pass_seen;
+    unsigned long passes;
+}   t_channel_schedule;
+
+/*
+ * Parse "0,3/10,8-11/100" into a channel mask and per-channel rate divisors: "/N" reads
+ * the channel every N loop ticks, channels without one get 0 (mode default).
+ * Keeps the previous selection on error.
+ */
+static inline int parse_channel_schedule(const char *raw_value, const char *param_name, unsigned int channel_count,
+    uint16_t *mask, uint32_t divisors[])
+{
+    uint16_t parsed_mask = 0;
+    uint32_t parsed_divisors[SCHEDULE_MAX_CHANNELS] = {0};
+    const char *cursor = raw_value;
+
+    while (cursor && *cursor != '\0') {
+        char *end;
+        unsigned long first = strtoul(cursor, &end, 10);
+        unsigned long last = first;
+        unsigned long divisor = 0;
+
+        if (end == cursor) {
+            break;
+        }
+        if (*end == '-') {
+            const char *range = end + 1;
+
+            last = strtoul(range, &end, 10);
+            if (end == range) {
+                break;
+            }
+        }
+        if (*end == '/') {
+            const char *rate = end + 1;
+
+            divisor = strtoul(rate, &end, 10);
+            if (end == rate || divisor == 0 || divisor > MAX_CHANNEL_DIVISOR) {
+                break;
+            }
+        }
+        if (first > last || last >= channel_count) {
+            break;
+        }
+        for (unsigned long ch = first; ch <= last; ch++) {
+            parsed_mask |= (uint16_t)(1U << ch);
+            parsed_divisors[ch] = (uint32_t)divisor;
+        }
+        if (*end == '\0') {
+            *mask = parsed_mask;
+            memcpy(divisors, parsed_divisors, channel_count * sizeof(divisors[0]));
+            return 0;
+        }
+        if (*end != ',') {
+            break;
+        }
+        cursor = end + 1;
+    }
+    printf("Warning: invalid %s='%s' (channels 0..%u with optional /divisor 1..%u, e.g. 0/1,3,8-11/100),"
+        " keeping current selection\n", param_name, raw_value ? raw_value : "", channel_count - 1U,
+        MAX_CHANNEL_DIVISOR);
+    return -1;
+}
+
+static inline void channel_schedule_init(t_channel_schedule *schedule, uint16_t mask, const uint32_t divisors[],
+    uint32_t default_divisor)
+{
+    memset(schedule, 0, sizeof(*schedule));
+    schedule->mask = mask;
+    for (uint8_t ch = 0; ch < SCHEDULE_MAX_CHANNELS; ch++) {
+        if (mask & (1U << ch)) {
+            schedule->divisor[ch] = divisors[ch] ? divisors[ch] : default_divisor;
+            if (divisors[ch]) {
+                schedule->explicit_mask |= (uint16_t)(1U << ch);
+            }
+        }
+    }
+    for (uint8_t ch = 0; ch < SCHEDULE_MAX_CHANNELS; ch++) {
+        unsigned int rank = 0;
+        unsigned int peers = 0;
+
+        if (!(schedule->explicit_mask & (1U << ch))) {
+            continue;
+        }
+        for (uint8_t other = 0; other < SCHEDULE_MAX_CHANNELS; other++) {
+            if ((schedule->explicit_mask & (1U << other)) && schedule->divisor[other] == schedule->divisor[ch]) {
+                rank += (other < ch) ? 1U : 0U;
+                peers++;
+            }
+        }
+        schedule->countdown[ch] = (uint32_t)(((uint64_t)rank * schedule->divisor[ch]) / peers);
+    }
+}
+
+// Advance one loop tick and return the channels due on it.
+static inline uint16_t channel_schedule_next(t_channel_schedule *schedule)
+{
+    uint16_t due = 0;
+
+    for (uint8_t ch = 0; ch < SCHEDULE_MAX_CHANNELS; ch++) {
+        if (!(schedule->mask & (1U << ch))) {
+            continue;
+        }
+        if (schedule->countdown[ch] == 0) {
+            due |= (uint16_t)(1U << ch);
+            schedule->countdown[ch] = schedule->divisor[ch];
+        }
+        schedule->countdown[ch]--;
+    }
+    schedule->pass_seen |= due;
+    if (schedule->mask != 0 && schedule->pass_seen == schedule->mask) {
+        schedule->passes++;
+        schedule->pass_seen = 0;
+    }
+    return due;
+}
+
+// One entry per run of consecutive channels sharing a divisor, e.g. "ch0=10000 Hz ch1-15=10 Hz".
+static inline void print_channel_schedule(FILE *out, const char *label, const t_channel_schedule *schedule,
+    double rate_hz)
+{
+    fprintf(out, "%s schedule:", label);
+    for (uint8_t ch = 0; ch < SCHEDULE_MAX_CHANNELS; ch++) {
+        uint8_t last = ch;
+
+        if (!(schedule->mask & (1U << ch))) {
+            continue;
+        }
+        while (last + 1U < SCHEDULE_MAX_CHANNELS && (schedule->mask & (1U << (last + 1U)))
+            && schedule->divisor[last + 1U] == schedule->divisor[ch]) {
+            last++;
+        }
+        if (last > ch) {
+            fprintf(out, " ch%u-%u", ch, last);
+        } else {
+            fprintf(out, " ch%u", ch);
+        }
+        if (rate_hz > 0.0) {
+            fprintf(out, "=%.6g Hz", rate_hz / (double)schedule->divisor[ch]);
+        } else {
+            fprintf(out, "=1/%u scans", schedule->divisor[ch]);
+        }
+        ch = last;
+    }
+    fprintf(out, "\n");
+}
+
+#endif
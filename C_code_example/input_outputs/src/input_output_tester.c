@@ -1,7 +1,8 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <spidev_lib.h>
+#include <linux/spi/spidev.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <linux/i2c-dev.h>
@@ -9,65 +10,214 @@
 #include <linux/i2c.h>
 #include <math.h>
 #include <stdint.h>
-#include <gpiod.h>
 #include <errno.h>
 #include <signal.h>
-
-#define CHIP_NAME "gpiochip0"
-#define CHIP_PATH "/dev/" CHIP_NAME
-
-#define DAC_1 0x63
-#define DAC_2 0x64
-
-#define LDAC1_GPIO 0
-#define LDAC2_GPIO 1
-
-#define MCP4728_VREF_INTERNAL 1
-#define MCP4728_GAIN_X1 0
+#include <time.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "calibration.h"
+#include "hat_runtime.h"
+#define HAT_TRANSPORT_SPI
+#define HAT_TRANSPORT_GPIO
+#include "hat_transport.h"
+#include "modhat.h"
 
 #define DEFAULT_POINTS_PER_PERIOD 4096U
 #define MIN_POINTS_PER_PERIOD 16U
 #define MAX_POINTS_PER_PERIOD 20000U
 
-#define DEFAULT_SAMPLE_DELAY_US 10U
+#define DEFAULT_RATE_HZ 2000U
+#define MAX_RATE_HZ 100000U
+#define DEFAULT_SAMPLE_DELAY_US (1000000U / DEFAULT_RATE_HZ)
 #define MAX_SAMPLE_DELAY_US 1000000U
 
+#define MAX_BUSY_WAIT_US 10000U
+
+#define DDS_TABLE_BITS 12
+#define DDS_TABLE_SIZE (1U << DDS_TABLE_BITS)
+#define DDS_PHASE_ONE_TURN 4294967296.0
+
 #define EQUALIZER_EVERY 20U
 #define HISTORY_EVERY 100U
+#define DEFAULT_DASHBOARD_FPS 20U
+#define MAX_DASHBOARD_FPS 120U
+#define DEFAULT_HISTORY_CAPACITY 4096U
+#define MAX_HISTORY_CAPACITY 1048576U
 
-#define ADS_CHANNEL_COUNT 16
 #define ADS_HISTORY_LINES 14
 #define ADS_HISTORY_LINE_LEN 256
 
-#define EQ_ROWS 5
-#define EQ_STEPS_PER_ROW 8
-#define EQ_BAR_WIDTH 4
-
-typedef struct s_ldac_gpio_ctx {
-    struct gpiod_chip *chip;
-    struct gpiod_line_request *request;
-    int ready;
-}   t_ldac_gpio_ctx;
-
-typedef struct s_ads_spi_ctx {
-    int spi0_fd;
-    int spi1_fd;
-    int ready;
-}   t_ads_spi_ctx;
-
-static t_ldac_gpio_ctx g_ldac_ctx = {0};
-static volatile sig_atomic_t g_keep_running = 1;
-
-static void signal_handler(int signo)
-{
-    (void)signo;
-    g_keep_running = 0;
-}
-
-static void delay_microseconds(unsigned int micros)
-{
-    usleep(micros);
-}
+#define DEFAULT_LATENCY_STEPS 1000U
+#define MAX_LATENCY_STEPS 1000000U
+#define DEFAULT_LDAC_STROBES 10000U
+#define MAX_LDAC_STROBES 1000000U
+#define LATENCY_LOW_MV 2000U
+#define LATENCY_HIGH_MV 8000U
+#define LATENCY_THRESHOLD_MV 5000U
+#define LATENCY_TIMEOUT_NS 50000000ULL
+#define LATENCY_SETTLE_NS 2000000ULL
+#define LATENCY_MAX_MISSES 10U
+
+#define MCP_CODE_COUNT 4096U
+#define DEFAULT_SWEEP_STRIDE 16U
+#define DEFAULT_SWEEP_SAMPLES 8U
+#define MAX_SWEEP_SAMPLES 256U
+#define DEFAULT_SWEEP_SETTLE_US 200U
+#define MAX_SWEEP_SETTLE_US 100000U
+
+#define SCREEN_HEADER_ROWS 5
+#define SCREEN_TEXT_ROWS (SCREEN_HEADER_ROWS + ADS_HISTORY_LINES)
+#define SCREEN_EQ_ROW SCREEN_TEXT_ROWS
+
+typedef struct s_runtime_options {
+    unsigned int points_per_period;
+    t_mcp4728_frame_mode frame_mode;
+    int dac_delta;
+    t_i2c_transport transport;
+    double rate_hz;
+    int rt_priority;
+    int lock_memory;
+    int cpu;
+    int busy_wait_us;
+    unsigned int ldac_hold_ns;
+    double freq_hz[MCP_OUTPUT_COUNT];
+    double phase_deg[MCP_OUTPUT_COUNT];
+    int freq_set;
+    unsigned int fps;
+    unsigned int history_capacity;
+    uint16_t in_channels;
+    uint32_t in_divisor[ADS_CHANNEL_COUNT];
+    uint16_t out_channels;
+    uint32_t out_divisor[ADS_CHANNEL_COUNT];
+    const char *calibration_path;
+    int measure_latency;
+    unsigned int latency_steps;
+    int measure_ldac;
+    unsigned int ldac_strobes;
+    int8_t loopback[MCP_OUTPUT_COUNT];
+    int sweep;
+    unsigned int sweep_stride;
+    unsigned int sweep_samples;
+    unsigned int sweep_settle_us;
+    const char *calibration_out_path;
+    const char *sim_spec;
+}   t_runtime_options;
+
+typedef enum e_loop_stage {
+    STAGE_WAKEUP,
+    STAGE_WAVE,
+    STAGE_I2C,
+    STAGE_LDAC,
+    STAGE_SPI,
+    STAGE_PUBLISH,
+    STAGE_LOOP,
+    STAGE_COUNT
+}   t_loop_stage;
+
+// --measure-latency: timestamps of one output step, from I2C write to threshold crossing.
+typedef enum e_step_stage {
+    STEP_I2C,
+    STEP_LDAC,
+    STEP_ADC,
+    STEP_TOTAL,
+    STEP_POLL,
+    STEP_STAGE_COUNT
+}   t_step_stage;
+
+// --measure-ldac: ways of latching both DACs, timed side by side.
+typedef enum e_ldac_path {
+    LDAC_PATH_STROBE,
+    LDAC_PATH_PER_LINE,
+    LDAC_PATH_USLEEP,
+    LDAC_PATH_COUNT
+}   t_ldac_path;
+
+typedef struct s_history_record {
+    unsigned long sample_counter;
+    uint64_t timestamp_ns;
+    uint16_t codes[ADS_CHANNEL_COUNT];
+    uint16_t valid_mask;
+}   t_history_record;
+
+typedef struct s_dashboard_snapshot {
+    unsigned long sample_counter;
+    uint16_t codes[ADS_CHANNEL_COUNT];
+    uint16_t valid_mask;
+    unsigned long ticks;
+    unsigned long overruns;
+    unsigned long missed_periods;
+    unsigned long i2c_frames;
+    unsigned long i2c_syscalls;
+}   t_dashboard_snapshot;
+
+/*
+ * Sample thread -> render thread handoff. The latest snapshot goes through a seqlock
+ * (writer never waits, reader retries on a torn copy); history goes through the ring.
+ */
+typedef struct s_dashboard_ctx {
+    atomic_uint seq;
+    t_dashboard_snapshot latest;
+    t_history_ring history;
+    atomic_int running;
+    pthread_t thread;
+    const t_runtime_options *options;
+}   t_dashboard_ctx;
+
+typedef struct s_dds_osc {
+    uint32_t phase;
+    uint32_t increment;
+}   t_dds_osc;
+
+typedef struct s_dds_engine {
+    uint16_t table[MCP_OUTPUT_COUNT][DDS_TABLE_SIZE];
+    t_dds_osc osc[MCP_OUTPUT_COUNT];
+}   t_dds_engine;
+
+// One output patched to one input, stepped back and forth across LATENCY_THRESHOLD_MV.
+typedef struct s_latency_probe {
+    t_hat_dac *dac;
+    const t_runtime_options *options;
+    t_hat_adc *ads_ctx;
+    int ldac_ready;
+    uint8_t dac_configured;
+    uint8_t output;
+    uint8_t input;
+    uint16_t values[MCP_OUTPUT_COUNT];
+    uint16_t codes[ADS_CHANNEL_COUNT];
+    uint16_t valid_mask;
+    unsigned long steps;
+    unsigned long missed;
+    t_latency_hist hist[STEP_STAGE_COUNT];
+}   t_latency_probe;
+
+// --sweep: ADC readings of one loopback pair at every swept DAC code.
+typedef struct s_sweep_pair {
+    uint8_t output;
+    uint8_t input;
+    uint32_t sum[MCP_CODE_COUNT];
+    uint16_t samples[MCP_CODE_COUNT];
+}   t_sweep_pair;
+
+// Least-squares line through the unclipped points of a pair, and the deviations from it.
+typedef struct s_sweep_result {
+    unsigned int points;
+    unsigned int clipped;
+    double slope_mv;
+    double offset_mv;
+    double gain;
+    double inl_lsb;
+    double dnl_lsb;
+}   t_sweep_result;
+
+static t_latency_hist g_stage_hist[STAGE_COUNT];
+static const char *g_stage_names[STAGE_COUNT] = {"wakeup", "wave", "i2c", "ldac", "spi", "publish", "loop"};
+static const char *g_step_stage_names[STEP_STAGE_COUNT] = {"i2c", "ldac", "ldac->adc", "total", "adc poll"};
+static const char *g_ldac_path_names[LDAC_PATH_COUNT] = {"strobe", "per-line", "usleep(2)"};
+static t_calibration g_calibration;
+static t_hat_transport g_transport;
+static t_hat_dac g_dac;
 
 static unsigned int parse_u32_or_default(const char *raw_value, const char *param_name,
     unsigned int default_value, unsigned int min_value, unsigned int max_value)
@@ -89,48 +239,339 @@ static unsigned int parse_u32_or_default(const char *raw_value, const char *para
     return (unsigned int)parsed;
 }
 
-static int parse_runtime_options(int argc, char **argv,
-    unsigned int *points_per_period, unsigned int *sample_delay_us)
+static const char *mcp4728_frame_mode_name(t_mcp4728_frame_mode mode)
+{
+    static const char *names[] = {"single", "fast", "multi", "sequential"};
+
+    return names[mode];
+}
+
+static const char *i2c_transport_name(t_i2c_transport transport)
+{
+    return (transport == I2C_TRANSPORT_RDWR) ? "rdwr" : "slave";
+}
+
+static t_mcp4728_frame_mode parse_frame_mode_or_default(const char *raw_value, t_mcp4728_frame_mode default_mode)
+{
+    if (raw_value && strcmp(raw_value, "fast") == 0) {
+        return MCP4728_FRAME_FAST;
+    } else if (raw_value && strcmp(raw_value, "multi") == 0) {
+        return MCP4728_FRAME_MULTI;
+    } else if (raw_value && strcmp(raw_value, "single") == 0) {
+        return MCP4728_FRAME_SINGLE;
+    }
+    printf("Warning: invalid dac-frame='%s' (fast, multi, single), using default %s\n",
+        raw_value ? raw_value : "", mcp4728_frame_mode_name(default_mode));
+    return default_mode;
+}
+
+static int parse_on_off_or_default(const char *raw_value, const char *param_name, int default_value)
+{
+    if (raw_value && strcmp(raw_value, "on") == 0) {
+        return 1;
+    } else if (raw_value && strcmp(raw_value, "off") == 0) {
+        return 0;
+    }
+    printf("Warning: invalid %s='%s' (on, off), using default %s\n", param_name, raw_value ? raw_value : "",
+        default_value ? "on" : "off");
+    return default_value;
+}
+
+static t_i2c_transport parse_transport_or_default(const char *raw_value, t_i2c_transport default_transport)
+{
+    if (raw_value && strcmp(raw_value, "rdwr") == 0) {
+        return I2C_TRANSPORT_RDWR;
+    } else if (raw_value && strcmp(raw_value, "slave") == 0) {
+        return I2C_TRANSPORT_SLAVE;
+    }
+    printf("Warning: invalid i2c-transport='%s' (rdwr, slave), using default %s\n",
+        raw_value ? raw_value : "", i2c_transport_name(default_transport));
+    return default_transport;
+}
+
+static int parse_double_list(const char *raw_value, const char *param_name, double min_value, double max_value,
+    double values[MCP_OUTPUT_COUNT])
+{
+    double parsed[MCP_OUTPUT_COUNT];
+    const char *cursor = raw_value;
+    int count = 0;
+
+    if (!raw_value || *raw_value == '\0') {
+        printf("Warning: missing value for %s, keeping defaults\n", param_name);
+        return -1;
+    }
+    for (;;) {
+        char *end = NULL;
+
+        errno = 0;
+        parsed[count] = strtod(cursor, &end);
+        if (errno != 0 || end == cursor || parsed[count] < min_value || parsed[count] > max_value) {
+            printf("Warning: invalid %s='%s' (range %g..%g), keeping defaults\n",
+                param_name, raw_value, min_value, max_value);
+            return -1;
+        }
+        count++;
+        if (*end == '\0') {
+            break;
+        }
+        if (*end != ',' || count == MCP_OUTPUT_COUNT) {
+            printf("Warning: invalid %s='%s' (1..%d comma separated values), keeping defaults\n",
+                param_name, raw_value, MCP_OUTPUT_COUNT);
+            return -1;
+        }
+        cursor = end + 1;
+    }
+    // A single value applies to every output, a shorter list repeats its last value.
+    for (int output = 0; output < MCP_OUTPUT_COUNT; output++) {
+        values[output] = parsed[(output < count) ? output : count - 1];
+    }
+    return 0;
+}
+
+// "<out>:<in>[,<out>:<in>...]": which ADC input each measured output is patched to.
+static int parse_loopback_map(const char *raw_value, int8_t loopback[MCP_OUTPUT_COUNT])
 {
-    *points_per_period = DEFAULT_POINTS_PER_PERIOD;
-    *sample_delay_us = DEFAULT_SAMPLE_DELAY_US;
+    int8_t parsed[MCP_OUTPUT_COUNT];
+    const char *cursor = raw_value;
 
+    memset(parsed, -1, sizeof(parsed));
+    while (cursor && *cursor != '\0') {
+        char *end;
+        unsigned long output = strtoul(cursor, &end, 10);
+        unsigned long input;
+
+        if (end == cursor || *end != ':' || output >= MCP_OUTPUT_COUNT) {
+            break;
+        }
+        cursor = end + 1;
+        input = strtoul(cursor, &end, 10);
+        if (end == cursor || input >= ADS_CHANNEL_COUNT) {
+            break;
+        }
+        parsed[output] = (int8_t)input;
+        if (*end == '\0') {
+            memcpy(loopback, parsed, sizeof(parsed));
+            return 0;
+        }
+        if (*end != ',') {
+            break;
+        }
+        cursor = end + 1;
+    }
+    printf("Warning: invalid loopback='%s' (<out 0..%d>:<in 0..%d>, e.g. 0:0,1:9), keeping current pairs\n",
+        raw_value ? raw_value : "", MCP_OUTPUT_COUNT - 1, ADS_CHANNEL_COUNT - 1);
+    return -1;
+}
+
+static int parse_runtime_options(int argc, char **argv, t_runtime_options *options)
+{
+    options->points_per_period = DEFAULT_POINTS_PER_PERIOD;
+    options->frame_mode = MCP4728_FRAME_FAST;
+    options->dac_delta = 1;
+    options->transport = I2C_TRANSPORT_RDWR;
+    options->rate_hz = DEFAULT_RATE_HZ;
+    options->rt_priority = 0;
+    options->lock_memory = 0;
+    options->cpu = -1;
+    options->busy_wait_us = -1;
+    options->ldac_hold_ns = HAT_LDAC_HOLD_NS;
+    options->freq_set = 0;
+    options->fps = DEFAULT_DASHBOARD_FPS;
+    options->history_capacity = DEFAULT_HISTORY_CAPACITY;
+    options->in_channels = ADS_ALL_CHANNELS;
+    options->out_channels = MCP_ALL_OUTPUTS;
+    options->calibration_path = NULL;
+    options->measure_latency = 0;
+    options->latency_steps = DEFAULT_LATENCY_STEPS;
+    options->measure_ldac = 0;
+    options->ldac_strobes = DEFAULT_LDAC_STROBES;
+    options->sweep = 0;
+    options->sweep_stride = DEFAULT_SWEEP_STRIDE;
+    options->sweep_samples = DEFAULT_SWEEP_SAMPLES;
+    options->sweep_settle_us = DEFAULT_SWEEP_SETTLE_US;
+    options->calibration_out_path = NULL;
+    options->sim_spec = NULL;
+    memset(options->in_divisor, 0, sizeof(options->in_divisor));
+    memset(options->out_divisor, 0, sizeof(options->out_divisor));
+    for (int output = 0; output < MCP_OUTPUT_COUNT; output++) {
+        options->freq_hz[output] = 0.0;
+        options->phase_deg[output] = (360.0 / MCP_OUTPUT_COUNT) * (double)output;
+        options->loopback[output] = (int8_t)output;
+    }
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--help") == 0) {
-            printf("Usage: %s [--resolution=<points>] [--delay-us=<microseconds>]\n", argv[0]);
-            printf("  --resolution / --points : points per sine period (%u..%u), default: %u\n",
+            printf("Usage: %s [--resolution=<points>] [--delay-us=<microseconds>] [--dac-frame=<mode>]\n"
+                "       [--dac-delta=<on|off>] [--i2c-transport=<rdwr|slave>] [--rate-hz=<Hz>] [--freq-hz=<Hz>[,<Hz>...]]\n"
+                "       [--phase-deg=<deg>[,<deg>...]] [--rt-priority=<1..99>] [--mlock] [--cpu=<core>]\n"
+                "       [--busy-wait-us=<microseconds>] [--fps=<frames>] [--history=<records>]\n"
+                "       [--in-channels=<list>] [--out-channels=<list>] [--calibration=<file>]\n"
+                "       [--measure-latency] [--latency-steps=<N>] [--loopback=<out>:<in>[,...]]\n"
+                "       [--sweep] [--sweep-stride=<codes>] [--sweep-samples=<N>] [--sweep-settle-us=<us>]\n"
+                "       [--calibration-out=<file>] [--measure-ldac] [--ldac-strobes=<N>] [--ldac-hold-ns=<ns>]\n"
+                "       [--sim[=<options>]]\n", argv[0]);
+            printf("  --resolution / --points : points per sine period (%u..%u) when --freq-hz is not set, default: %u\n",
                 MIN_POINTS_PER_PERIOD, MAX_POINTS_PER_PERIOD, DEFAULT_POINTS_PER_PERIOD);
-            printf("  --delay-us              : delay between updates in microseconds (0..%u), default: %u\n",
-                MAX_SAMPLE_DELAY_US, DEFAULT_SAMPLE_DELAY_US);
-            printf("Display cadence is controlled by EQUALIZER_EVERY and HISTORY_EVERY defines in source.\n");
+            printf("  --delay-us              : legacy alias of --rate-hz, period between updates in microseconds (0..%u)\n",
+                MAX_SAMPLE_DELAY_US);
+            printf("  --dac-frame             : fast (1 Fast Write per DAC), multi (1 batched Multi-Write per DAC),\n");
+            printf("                            single (1 transaction per channel), default: fast\n");
+            printf("  --dac-delta             : on (send only the due outputs whose code changed, cheapest command per DAC)\n");
+            printf("                            or off (rewrite every due output), default: on\n");
+            printf("  --i2c-transport         : rdwr (whole 8-output frame in one I2C_RDWR ioctl) or\n");
+            printf("                            slave (I2C_SLAVE + write() per message), default: rdwr\n");
+            printf("  --rate-hz               : sample rate on an absolute-deadline clock (0 = free-running, max %u), default: %u\n",
+                MAX_RATE_HZ, DEFAULT_RATE_HZ);
+            printf("                            (the old default, a 1..10 us sleep per sample, was close to --rate-hz=0)\n");
+            printf("  --freq-hz               : output frequency in Hz, one value or one per output (max rate/2)\n");
+            printf("  --phase-deg             : phase offset in degrees, one value or one per output, default: 0,45,...,315\n");
+            printf("  --rt-priority           : run the sample loop with SCHED_FIFO priority (1..99), default: off\n");
+            printf("  --mlock                 : lock all pages in RAM (mlockall) to avoid page-fault stalls\n");
+            printf("  --cpu                   : pin the process to one CPU core, default: no pinning\n");
+            printf("  --busy-wait-us          : spin this long before each deadline (0..%u), default: %u below %u us periods\n",
+                MAX_BUSY_WAIT_US, AUTO_BUSY_WAIT_US, SHORT_PERIOD_NS / 1000U);
+            printf("  --fps                   : dashboard redraw rate of the render thread (0 = no dashboard, max %u), default: %u\n",
+                MAX_DASHBOARD_FPS, DEFAULT_DASHBOARD_FPS);
+            printf("  --history               : history records kept in RAM (%u..%u), default: %u\n",
+                ADS_HISTORY_LINES, MAX_HISTORY_CAPACITY, DEFAULT_HISTORY_CAPACITY);
+            printf("  --in-channels           : ADC channels to read, each with an optional /divisor (read every N samples),\n");
+            printf("                            e.g. 0/1,3,8-11/100, default: 0-15 every %u samples\n", EQUALIZER_EVERY);
+            printf("  --out-channels          : outputs to drive, each with an optional /divisor (update every N samples),\n");
+            printf("                            e.g. 0-3 or 0,4/10, default: 0-7 every sample; other outputs are never written\n");
+            printf("  --calibration           : per-channel ADC/DAC gain/offset or piecewise-linear table file (see README),\n");
+            printf("                            default: nominal 0..%u mV inputs, 0..%u mV outputs\n",
+                CAL_ADC_FULL_SCALE_MV, CAL_DAC_FULL_SCALE_MV);
+            printf("  --measure-latency       : instead of the sine loop, step each --out-channels output between %u and %u mV\n",
+                LATENCY_LOW_MV, LATENCY_HIGH_MV);
+            printf("                            and time write, LDAC and the first ADC sample past %u mV on its input\n",
+                LATENCY_THRESHOLD_MV);
+            printf("  --latency-steps         : steps per output for --measure-latency (1..%u), default: %u\n",
+                MAX_LATENCY_STEPS, DEFAULT_LATENCY_STEPS);
+            printf("  --loopback              : output:input pairs patched together, e.g. 0:0,1:9, default: output N -> input N\n");
+            printf("  --sweep                 : instead of the sine loop, drive every --sweep-stride-th DAC code on all\n");
+            printf("                            --out-channels outputs at once and report gain, offset, INL and DNL per pair\n");
+            printf("  --sweep-stride          : DAC code step of the sweep (1..%u), default: %u\n", MCP_CODE_COUNT,
+                DEFAULT_SWEEP_STRIDE);
+            printf("  --sweep-samples         : ADC scans averaged per code (1..%u), default: %u\n", MAX_SWEEP_SAMPLES,
+                DEFAULT_SWEEP_SAMPLES);
+            printf("  --sweep-settle-us       : wait after each code before reading (0..%u), default: %u\n",
+                MAX_SWEEP_SETTLE_US, DEFAULT_SWEEP_SETTLE_US);
+            printf("  --calibration-out       : with --sweep, write the measured DAC tables as a --calibration file\n");
+            printf("  --measure-ldac          : instead of the sine loop, time LDAC updates of both DACs as one strobe, one line\n");
+            printf("                            after the other and with the old usleep(2) pulses, and report cost and latch skew\n");
+            printf("  --ldac-strobes          : updates per path for --measure-ldac (1..%u), default: %u\n",
+                MAX_LDAC_STROBES, DEFAULT_LDAC_STROBES);
+            printf("  --ldac-hold-ns          : low time of the LDAC strobe (0..%u), default: %u\n",
+                HAT_LDAC_MAX_HOLD_NS, HAT_LDAC_HOLD_NS);
+            printf("  --sim                   : run against the simulated hat (DAC outputs wired to ADC inputs)\n");
+            printf("                            instead of I2C/SPI/GPIO, options i2c-hz=,spi-hz=,loopback=,noise=,pace\n");
+            printf("Default ADC divisor and history cadence are controlled by EQUALIZER_EVERY and HISTORY_EVERY defines in source.\n");
             return 1;
         } else if (strncmp(argv[i], "--resolution=", 13) == 0) {
-            *points_per_period = parse_u32_or_default(argv[i] + 13, "resolution",
+            options->points_per_period = parse_u32_or_default(argv[i] + 13, "resolution",
                 DEFAULT_POINTS_PER_PERIOD, MIN_POINTS_PER_PERIOD, MAX_POINTS_PER_PERIOD);
         } else if (strncmp(argv[i], "--points=", 9) == 0) {
-            *points_per_period = parse_u32_or_default(argv[i] + 9, "points",
+            options->points_per_period = parse_u32_or_default(argv[i] + 9, "points",
                 DEFAULT_POINTS_PER_PERIOD, MIN_POINTS_PER_PERIOD, MAX_POINTS_PER_PERIOD);
         } else if (strncmp(argv[i], "--delay-us=", 11) == 0) {
-            *sample_delay_us = parse_u32_or_default(argv[i] + 11, "delay-us",
+            unsigned int delay_us = parse_u32_or_default(argv[i] + 11, "delay-us",
                 DEFAULT_SAMPLE_DELAY_US, 0U, MAX_SAMPLE_DELAY_US);
+
+            options->rate_hz = delay_us ? fmin(1000000.0 / (double)delay_us, (double)MAX_RATE_HZ) : 0.0;
+        } else if (strncmp(argv[i], "--dac-frame=", 12) == 0) {
+            options->frame_mode = parse_frame_mode_or_default(argv[i] + 12, MCP4728_FRAME_FAST);
+        } else if (strncmp(argv[i], "--dac-delta=", 12) == 0) {
+            options->dac_delta = parse_on_off_or_default(argv[i] + 12, "dac-delta", 1);
+        } else if (strncmp(argv[i], "--i2c-transport=", 16) == 0) {
+            options->transport = parse_transport_or_default(argv[i] + 16, I2C_TRANSPORT_RDWR);
+        } else if (strncmp(argv[i], "--rate-hz=", 10) == 0) {
+            options->rate_hz = (double)parse_u32_or_default(argv[i] + 10, "rate-hz",
+                DEFAULT_RATE_HZ, 0U, MAX_RATE_HZ);
+        } else if (strncmp(argv[i], "--freq-hz=", 10) == 0) {
+            if (parse_double_list(argv[i] + 10, "freq-hz", 0.0, MAX_RATE_HZ / 2.0, options->freq_hz) == 0) {
+                options->freq_set = 1;
+            }
+        } else if (strncmp(argv[i], "--phase-deg=", 12) == 0) {
+            parse_double_list(argv[i] + 12, "phase-deg", -360.0, 360.0, options->phase_deg);
+        } else if (strncmp(argv[i], "--rt-priority=", 14) == 0) {
+            options->rt_priority = (int)parse_u32_or_default(argv[i] + 14, "rt-priority", 0U, 0U, 99U);
+        } else if (strcmp(argv[i], "--mlock") == 0) {
+            options->lock_memory = 1;
+        } else if (strncmp(argv[i], "--cpu=", 6) == 0) {
+            options->cpu = (int)parse_u32_or_default(argv[i] + 6, "cpu", 0U, 0U, CPU_SETSIZE - 1U);
+        } else if (strncmp(argv[i], "--busy-wait-us=", 15) == 0) {
+            options->busy_wait_us = (int)parse_u32_or_default(argv[i] + 15, "busy-wait-us",
+                AUTO_BUSY_WAIT_US, 0U, MAX_BUSY_WAIT_US);
+        } else if (strncmp(argv[i], "--fps=", 6) == 0) {
+            options->fps = parse_u32_or_default(argv[i] + 6, "fps", DEFAULT_DASHBOARD_FPS, 0U, MAX_DASHBOARD_FPS);
+        } else if (strncmp(argv[i], "--history=", 10) == 0) {
+            options->history_capacity = parse_u32_or_default(argv[i] + 10, "history", DEFAULT_HISTORY_CAPACITY,
+                ADS_HISTORY_LINES, MAX_HISTORY_CAPACITY);
+        } else if (strncmp(argv[i], "--in-channels=", 14) == 0) {
+            parse_channel_schedule(argv[i] + 14, "in-channels", ADS_CHANNEL_COUNT, &options->in_channels,
+                options->in_divisor);
+        } else if (strncmp(argv[i], "--out-channels=", 15) == 0) {
+            parse_channel_schedule(argv[i] + 15, "out-channels", MCP_OUTPUT_COUNT, &options->out_channels,
+                options->out_divisor);
+        } else if (strncmp(argv[i], "--calibration=", 14) == 0) {
+            options->calibration_path = argv[i] + 14;
+        } else if (strcmp(argv[i], "--measure-latency") == 0) {
+            options->measure_latency = 1;
+        } else if (strncmp(argv[i], "--latency-steps=", 16) == 0) {
+            options->latency_steps = parse_u32_or_default(argv[i] + 16, "latency-steps", DEFAULT_LATENCY_STEPS,
+                1U, MAX_LATENCY_STEPS);
+        } else if (strncmp(argv[i], "--loopback=", 11) == 0) {
+            parse_loopback_map(argv[i] + 11, options->loopback);
+        } else if (strcmp(argv[i], "--sweep") == 0) {
+            options->sweep = 1;
+        } else if (strncmp(argv[i], "--sweep-stride=", 15) == 0) {
+            options->sweep_stride = parse_u32_or_default(argv[i] + 15, "sweep-stride", DEFAULT_SWEEP_STRIDE,
+                1U, MCP_CODE_COUNT);
+        } else if (strncmp(argv[i], "--sweep-samples=", 16) == 0) {
+            options->sweep_samples = parse_u32_or_default(argv[i] + 16, "sweep-samples", DEFAULT_SWEEP_SAMPLES,
+                1U, MAX_SWEEP_SAMPLES);
+        } else if (strncmp(argv[i], "--sweep-settle-us=", 18) == 0) {
+            options->sweep_settle_us = parse_u32_or_default(argv[i] + 18, "sweep-settle-us", DEFAULT_SWEEP_SETTLE_US,
+                0U, MAX_SWEEP_SETTLE_US);
+        } else if (strncmp(argv[i], "--calibration-out=", 18) == 0) {
+            options->calibration_out_path = argv[i] + 18;
+        } else if (strcmp(argv[i], "--measure-ldac") == 0) {
+            options->measure_ldac = 1;
+        } else if (strncmp(argv[i], "--ldac-strobes=", 15) == 0) {
+            options->ldac_strobes = parse_u32_or_default(argv[i] + 15, "ldac-strobes", DEFAULT_LDAC_STROBES,
+                1U, MAX_LDAC_STROBES);
+        } else if (strncmp(argv[i], "--ldac-hold-ns=", 15) == 0) {
+            options->ldac_hold_ns = parse_u32_or_default(argv[i] + 15, "ldac-hold-ns", HAT_LDAC_HOLD_NS,
+                0U, HAT_LDAC_MAX_HOLD_NS);
+        } else if (strcmp(argv[i], "--sim") == 0 || strncmp(argv[i], "--sim=", 6) == 0) {
+            options->sim_spec = argv[i][5] == '=' ? argv[i] + 6 : "";
         } else {
             printf("Warning: unknown option '%s' (use --help)\n", argv[i]);
         }
     }
+    if (options->freq_set && options->rate_hz <= 0.0) {
+        printf("Warning: --freq-hz needs a fixed sample rate, using --rate-hz=%u\n", DEFAULT_RATE_HZ);
+        options->rate_hz = DEFAULT_RATE_HZ;
+    }
+    for (int output = 0; output < MCP_OUTPUT_COUNT && options->freq_set; output++) {
+        if (options->freq_hz[output] > options->rate_hz / 2.0) {
+            printf("Warning: freq-hz %.3f on output %d is above rate/2, clamped to %.3f\n",
+                options->freq_hz[output], output, options->rate_hz / 2.0);
+            options->freq_hz[output] = options->rate_hz / 2.0;
+        }
+    }
     return 0;
 }
 
 static int i2c_init(const char *i2c_bus)
 {
-    int fd = open(i2c_bus, O_RDWR);
-    if (fd < 0) {
+    if (hat_dac_open(&g_dac, i2c_bus) < 0) {
         perror("Error opening I2C bus");
         return -1;
     }
-    return fd;
+    return g_dac.fd;
 }
 
-static void scan_i2c_bus(int file)
+static void scan_i2c_bus(t_hat_dac *dac)
 {
     printf("\nScanning I2C bus...\n");
     printf("     0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F\n");
@@ -143,12 +584,7 @@ static void scan_i2c_bus(int file)
                 printf("   ");
                 continue;
             }
-            if (ioctl(file, I2C_SLAVE, addr) < 0) {
-                printf("-- ");
-                continue;
-            }
-            char buf;
-            if (read(file, &buf, 1) < 0) {
+            if (!hat_dac_probe(dac, (uint8_t)addr)) {
                 printf("-- ");
             } else {
                 printf("%02x ", addr);
@@ -159,335 +595,885 @@ static void scan_i2c_bus(int file)
     printf("\nScan completed.\n");
 }
 
-static void cleanup_ldac(void)
+static int setup_ldac(void)
 {
-    if (g_ldac_ctx.request) {
-        gpiod_line_request_release(g_ldac_ctx.request);
-        g_ldac_ctx.request = NULL;
+    if (hat_ldac_open(&g_dac, HAT_GPIO_CHIP) != 0) {
+        printf("Error: unable to request LDAC GPIO lines on %s: %s\n", HAT_GPIO_CHIP, strerror(errno));
+        return -1;
     }
-    if (g_ldac_ctx.chip) {
-        gpiod_chip_close(g_ldac_ctx.chip);
-        g_ldac_ctx.chip = NULL;
+    return 0;
+}
+
+static t_i2c_transport i2c_select_transport(t_hat_dac *dac, t_i2c_transport requested)
+{
+    if (hat_dac_select_transport(dac, requested) != requested) {
+        printf("Warning: I2C adapter has no I2C_RDWR support, falling back to I2C_SLAVE + write().\n");
     }
-    g_ldac_ctx.ready = 0;
+    return dac->transport;
 }
 
-static int setup_ldac(void)
+static void print_i2c_syscall_report(t_i2c_transport transport, t_mcp4728_frame_mode mode, int delta)
 {
-    struct gpiod_line_settings *line_settings = NULL;
-    struct gpiod_line_config *line_config = NULL;
-    struct gpiod_request_config *request_config = NULL;
-    const unsigned int offsets[2] = {LDAC1_GPIO, LDAC2_GPIO};
-    const enum gpiod_line_value init_values[2] = {
-        GPIOD_LINE_VALUE_ACTIVE,
-        GPIOD_LINE_VALUE_ACTIVE
-    };
-
-    g_ldac_ctx.chip = gpiod_chip_open(CHIP_PATH);
-    if (!g_ldac_ctx.chip) {
-        printf("Error: unable to open %s for LDAC control: %s\n", CHIP_PATH, strerror(errno));
-        return -1;
+    double per_frame = g_dac.frames ? (double)g_dac.syscalls / (double)g_dac.frames : 0.0;
+    unsigned long channels = g_dac.channels_sent + g_dac.channels_skipped;
+    unsigned long updates = g_dac.frames + g_dac.idle_frames;
+
+    printf("I2C output: transport=%s | dac-frame=%s | frames=%lu | syscalls=%lu | %.2f syscalls/frame\n",
+        i2c_transport_name(transport), mcp4728_frame_mode_name(mode),
+        g_dac.frames, g_dac.syscalls, per_frame);
+    if (delta) {
+        printf("I2C delta: channels sent=%lu | unchanged=%lu (%.1f%%) | idle updates=%lu | %.1f bytes/update\n",
+            g_dac.channels_sent, g_dac.channels_skipped,
+            channels ? 100.0 * (double)g_dac.channels_skipped / (double)channels : 0.0, g_dac.idle_frames,
+            updates ? (double)g_dac.bytes / (double)updates : 0.0);
     }
+}
 
-    line_settings = gpiod_line_settings_new();
-    line_config = gpiod_line_config_new();
-    request_config = gpiod_request_config_new();
-    if (!line_settings || !line_config || !request_config) {
-        printf("Error: unable to allocate libgpiod config objects\n");
-        goto error;
+static int ads_spi_init(t_hat_adc *ctx)
+{
+    static const char *devices[ADS_CHIP_COUNT] = {HAT_SPI0_DEVICE, HAT_SPI1_DEVICE};
+
+    hat_adc_init(ctx, &g_transport, ADS_SPI_SPEED_HZ);
+    for (unsigned int chip = 0; chip < ADS_CHIP_COUNT; chip++) {
+        if (hat_adc_open(ctx, chip, devices[chip]) != 0) {
+            printf("Error: %s unavailable\n", devices[chip]);
+            hat_adc_close(ctx);
+            return -1;
+        }
     }
+    return 0;
+}
 
-    if (gpiod_line_settings_set_direction(line_settings, GPIOD_LINE_DIRECTION_OUTPUT) < 0) {
-        printf("Error: failed to configure LDAC lines as outputs\n");
-        goto error;
+static inline uint32_t ads_code_to_mv(uint8_t channel, uint16_t code)
+{
+    return calibration_adc_mv(&g_calibration, channel, code, 0);
+}
+
+/*
+ * Read the channels in due_mask (one SPI message per MCP3008 that has any) into codes[].
+ * Channels outside due_mask keep their previous code and valid bit.
+ */
+static void ads_capture_snapshot(t_hat_adc *ads_ctx, uint16_t due_mask, uint16_t codes[ADS_CHANNEL_COUNT],
+    uint16_t *valid_mask)
+{
+    int batched = ads_ctx->batched;
+
+    *valid_mask = (uint16_t)((*valid_mask & ~due_mask) | hat_read_channels(ads_ctx, due_mask, codes));
+    if (batched && !ads_ctx->batched) {
+        fprintf(stderr, "Warning: batched SPI scan unsupported (%s), using one transfer per channel\n",
+            strerror(ads_ctx->batch_errno));
     }
-    if (gpiod_line_settings_set_output_value(line_settings, GPIOD_LINE_VALUE_ACTIVE) < 0) {
-        printf("Error: failed to set initial LDAC output value\n");
-        goto error;
+}
+
+// A scan is one schedule pass (every scheduled channel read once), or one read call without a schedule.
+static void print_spi_syscall_report(FILE *out, const t_hat_adc *ads_ctx, const t_channel_schedule *schedule)
+{
+    unsigned long scans = schedule ? schedule->passes : ads_ctx->scans;
+
+    fprintf(out, "SPI: %s scans | scans=%lu | conversions=%lu | %.2f syscalls/scan\n",
+        ads_ctx->batched ? "batched" : "per-channel", scans, ads_ctx->conversions,
+        scans ? (double)ads_ctx->syscalls / (double)scans : 0.0);
+}
+
+static void ads_format_history_line(char *line, size_t line_size, const t_history_record *record)
+{
+    int used = snprintf(line, line_size, "#%08lu", record->sample_counter);
+    if (used < 0 || (size_t)used >= line_size) {
+        return;
     }
-    if (gpiod_line_config_add_line_settings(line_config, offsets, 2, line_settings) < 0) {
-        printf("Error: failed to add LDAC line settings\n");
-        goto error;
+    for (uint8_t ch = 0; ch < ADS_CHANNEL_COUNT; ch++) {
+        int written;
+        if (record->valid_mask & (1U << ch)) {
+            uint32_t tenths = (ads_code_to_mv(ch, record->codes[ch]) + 50U) / 100U;
+
+            // 1 leading space + 4 chars value so it aligns with 4-char equalizer bars.
+            written = snprintf(line + used, line_size - (size_t)used, " %2u.%u", tenths / 10U, tenths % 10U);
+        } else {
+            written = snprintf(line + used, line_size - (size_t)used, " ERR ");
+        }
+        if (written < 0 || (size_t)written >= line_size - (size_t)used) {
+            break;
+        }
+        used += written;
+    }
+}
+
+/*
+ * Compose the frame into the screen buffer and emit it with one write(). Rows sit at
+ * fixed positions, so only changed text rows and bar cells are redrawn using cursor
+ * addressing; a full repaint every SCREEN_REPAINT_EVERY frames heals stray output.
+ */
+static void ads_render_dashboard(t_screen *screen, const t_history_record *history,
+    unsigned int history_count, const t_dashboard_snapshot *snapshot, const t_runtime_options *options)
+{
+    char line[SCREEN_LINE_LEN];
+    int row = 0;
+
+    if ((screen->frames++ % SCREEN_REPAINT_EVERY) == 0) {
+        screen->drawn = 0;
     }
-    if (gpiod_line_config_set_output_values(line_config, init_values, 2) < 0) {
-        printf("Error: failed to set LDAC initial levels\n");
-        goto error;
+    if (!screen->drawn) {
+        int used;
+
+        screen_append(screen, "\033[H\033[2J", 7);
+        for (int eq_row = 0; eq_row < EQ_ROWS; eq_row++) {
+            screen_move(screen, SCREEN_EQ_ROW + (EQ_ROWS - 1 - eq_row), 0);
+            used = snprintf(line, sizeof(line), "%2dV", (eq_row + 1) * 2);
+            screen_append(screen, line, (size_t)used);
+        }
+        used = snprintf(line, sizeof(line), "%*s", EQ_LABEL_WIDTH, "");
+        for (uint8_t ch = 0; ch < ADS_CHANNEL_COUNT; ch++) {
+            used += snprintf(line + used, sizeof(line) - (size_t)used, " %4u", ch);
+        }
+        screen_move(screen, SCREEN_EQ_ROW + EQ_ROWS, 0);
+        screen_append(screen, line, (size_t)used);
     }
 
-    gpiod_request_config_set_consumer(request_config, "mcp4728-ldac");
-    g_ldac_ctx.request = gpiod_chip_request_lines(g_ldac_ctx.chip, request_config, line_config);
-    if (!g_ldac_ctx.request) {
-        printf("Error: unable to request LDAC GPIO lines on %s: %s\n", CHIP_PATH, strerror(errno));
-        goto error;
+    screen_set_line(screen, row++, "=== MCP->ADS loopback test ===");
+    if (options->freq_set) {
+        snprintf(line, sizeof(line), "Config: freq=%.3f Hz (out 0) | rate=%.0f Hz | eq-every=%u | history-every=%u | fps=%u",
+            options->freq_hz[0], options->rate_hz, EQUALIZER_EVERY, HISTORY_EVERY, options->fps);
+    } else {
+        snprintf(line, sizeof(line), "Config: resolution=%u points | rate=%.0f Hz | eq-every=%u | history-every=%u | fps=%u",
+            options->points_per_period, options->rate_hz, EQUALIZER_EVERY, HISTORY_EVERY, options->fps);
+    }
+    screen_set_line(screen, row++, line);
+    snprintf(line, sizeof(line), "Clock: ticks=%lu | overruns=%lu | missed periods=%lu",
+        snapshot->ticks, snapshot->overruns, snapshot->missed_periods);
+    screen_set_line(screen, row++, line);
+    snprintf(line, sizeof(line), "I2C: transport=%s | dac-frame=%s | %.2f syscalls/frame",
+        i2c_transport_name(options->transport), mcp4728_frame_mode_name(options->frame_mode),
+        snapshot->i2c_frames ? (double)snapshot->i2c_syscalls / (double)snapshot->i2c_frames : 0.0);
+    screen_set_line(screen, row++, line);
+    screen_set_line(screen, row++, g_calibration.adc_calibrated ? "ADS voltage history (V, calibrated):"
+        : "ADS voltage history (V):");
+    for (unsigned int i = 0; i < ADS_HISTORY_LINES; i++) {
+        line[0] = '\0';
+        if (i < history_count) {
+            ads_format_history_line(line, sizeof(line), &history[i]);
+        }
+        screen_set_line(screen, row++, line);
     }
 
-    g_ldac_ctx.ready = 1;
-    gpiod_request_config_free(request_config);
-    gpiod_line_config_free(line_config);
-    gpiod_line_settings_free(line_settings);
-    return 0;
+    for (int eq_row = 0; eq_row < EQ_ROWS; eq_row++) {
+        for (uint8_t ch = 0; ch < ADS_CHANNEL_COUNT; ch++) {
+            int steps = (snapshot->valid_mask & (1U << ch))
+                ? mv_to_equalizer_steps(ads_code_to_mv(ch, snapshot->codes[ch])) : 0;
+            int cell = steps - (eq_row * EQ_STEPS_PER_ROW);
 
-error:
-    gpiod_request_config_free(request_config);
-    gpiod_line_config_free(line_config);
-    gpiod_line_settings_free(line_settings);
-    cleanup_ldac();
-    return -1;
+            if (cell < 0) {
+                cell = 0;
+            } else if (cell > EQ_STEPS_PER_ROW) {
+                cell = EQ_STEPS_PER_ROW;
+            }
+            screen_set_cell(screen, SCREEN_EQ_ROW, eq_row, ch, (uint8_t)cell);
+        }
+    }
+    screen_move(screen, SCREEN_EQ_ROW + EQ_ROWS + 1, 0);
+    screen_flush(screen);
 }
 
-static int ldac_pulse_low(unsigned int gpio_offset)
+static void apply_realtime_options(const t_runtime_options *options)
 {
-    if (!g_ldac_ctx.ready || !g_ldac_ctx.request) {
-        return -1;
+    if (options->lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        printf("Warning: mlockall failed: %s\n", strerror(errno));
     }
-    if (gpiod_line_request_set_value(g_ldac_ctx.request, gpio_offset, GPIOD_LINE_VALUE_ACTIVE) < 0) {
-        return -1;
-    }
-    usleep(2);
-    if (gpiod_line_request_set_value(g_ldac_ctx.request, gpio_offset, GPIOD_LINE_VALUE_INACTIVE) < 0) {
-        return -1;
+    if (options->cpu >= 0) {
+        cpu_set_t cpu_set;
+
+        CPU_ZERO(&cpu_set);
+        CPU_SET(options->cpu, &cpu_set);
+        if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) != 0) {
+            printf("Warning: unable to pin to CPU %d: %s\n", options->cpu, strerror(errno));
+        }
     }
-    usleep(2);
-    if (gpiod_line_request_set_value(g_ldac_ctx.request, gpio_offset, GPIOD_LINE_VALUE_ACTIVE) < 0) {
-        return -1;
+    if (options->rt_priority > 0) {
+        struct sched_param param;
+
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = options->rt_priority;
+        if (sched_setscheduler(0, SCHED_FIFO, &param) != 0) {
+            printf("Warning: unable to set SCHED_FIFO priority %d: %s\n", options->rt_priority, strerror(errno));
+        }
     }
-    return 0;
 }
 
-static int mcp4728_write_channel_with_udac(int fd, uint8_t address, uint8_t channel,
-    uint16_t value, uint8_t vref, uint8_t gain, uint8_t power_down, uint8_t udac)
+static void dashboard_fill_snapshot(t_dashboard_snapshot *snapshot, unsigned long sample_counter,
+    const uint16_t codes[ADS_CHANNEL_COUNT], uint16_t valid_mask, const t_sample_clock *sample_clock)
+{
+    snapshot->sample_counter = sample_counter;
+    memcpy(snapshot->codes, codes, sizeof(snapshot->codes));
+    snapshot->valid_mask = valid_mask;
+    snapshot->ticks = sample_clock->ticks;
+    snapshot->overruns = sample_clock->overruns;
+    snapshot->missed_periods = sample_clock->missed_periods;
+    snapshot->i2c_frames = g_dac.frames;
+    snapshot->i2c_syscalls = g_dac.syscalls;
+}
+
+static void *dashboard_thread(void *arg)
 {
-    uint8_t buf[3];
+    t_dashboard_ctx *dashboard = (t_dashboard_ctx *)arg;
+    t_history_record history[ADS_HISTORY_LINES];
+    unsigned int history_count;
+    t_dashboard_snapshot snapshot;
+    static t_screen screen;
+    uint64_t frame_ns = 1000000000ULL / dashboard->options->fps;
+    uint64_t next_ns = monotonic_ns();
+
+    while (atomic_load_explicit(&dashboard->running, memory_order_acquire)) {
+        if (seqlock_read_latest(&dashboard->seq, &dashboard->latest, &snapshot, sizeof(snapshot))) {
+            history_count = history_ring_latest(&dashboard->history, history, ADS_HISTORY_LINES);
+            ads_render_dashboard(&screen, history, history_count, &snapshot, dashboard->options);
+        }
 
-    if (channel > 3 || value > 4095 || vref > 1 || gain > 1 || power_down > 3) {
-        return -1;
+        // Fixed frame rate; a slow terminal drops frames instead of queueing them.
+        next_ns += frame_ns;
+        if (next_ns < monotonic_ns()) {
+            next_ns = monotonic_ns();
+        }
+        sleep_until_ns(next_ns);
     }
+    return NULL;
+}
 
-    buf[0] = (0x08 << 3) | ((channel & 0x03) << 1) | (udac & 0x01);
-    buf[1] = ((vref & 0x01) << 7) | ((power_down & 0x03) << 5) | ((gain & 0x01) << 4) | ((value >> 8) & 0x0F);
-    buf[2] = value & 0xFF;
+static void dashboard_start(t_dashboard_ctx *dashboard, const t_runtime_options *options)
+{
+    int err;
 
-    if (ioctl(fd, I2C_SLAVE, address) < 0) {
-        return -1;
+    memset(dashboard, 0, sizeof(*dashboard));
+    dashboard->options = options;
+    if (options->fps == 0) {
+        return;
     }
-    if (write(fd, buf, 3) != 3) {
-        return -1;
+    if (history_ring_init(&dashboard->history, options->history_capacity, sizeof(t_history_record)) != 0) {
+        printf("Warning: unable to allocate %u history records, history disabled\n", options->history_capacity);
+    }
+    atomic_store(&dashboard->running, 1);
+    err = pthread_create(&dashboard->thread, NULL, dashboard_thread, dashboard);
+    if (err != 0) {
+        printf("Warning: unable to start dashboard thread: %s\n", strerror(err));
+        atomic_store(&dashboard->running, 0);
+        history_ring_free(&dashboard->history);
     }
-    return 0;
 }
 
-static int write_all_mcp_outputs(int i2c_fd, uint8_t udac, const uint16_t values[8])
+static void dashboard_stop(t_dashboard_ctx *dashboard)
 {
-    static const uint8_t addresses[2] = {DAC_1, DAC_2};
-
-    for (int dac = 0; dac < 2; dac++) {
-        for (int channel = 0; channel < 4; channel++) {
-            int value_index = (dac * 4) + channel;
-            if (mcp4728_write_channel_with_udac(i2c_fd, addresses[dac], (uint8_t)channel, values[value_index],
-                    MCP4728_VREF_INTERNAL, MCP4728_GAIN_X1, 0, udac) != 0) {
-                return -1;
-            }
-        }
+    if (!atomic_load(&dashboard->running)) {
+        return;
     }
-    return 0;
+    atomic_store(&dashboard->running, 0);
+    pthread_join(dashboard->thread, NULL);
+    history_ring_free(&dashboard->history);
 }
 
-static int ads_spi_init(t_ads_spi_ctx *ctx)
+/*
+ * One table per output: the sine is defined in millivolts (full DAC swing) and mapped
+ * through that output's calibration once, so the sample loop stays a plain lookup.
+ */
+static void dds_init_sine_table(uint16_t table[DDS_TABLE_SIZE], const t_calibration *cal, int output)
 {
-    spi_config_t spi_config;
+    const double two_pi = 2.0 * 3.14159265358979323846;
+    const double half_mv = (double)CAL_DAC_FULL_SCALE_MV / 2.0;
 
-    memset(ctx, 0, sizeof(*ctx));
-    spi_config.mode = 0;
-    spi_config.speed = 1000000;
-    spi_config.delay = 0;
-    spi_config.bits_per_word = 8;
+    for (uint32_t i = 0; i < DDS_TABLE_SIZE; i++) {
+        long mv = lround(half_mv + half_mv * sin(two_pi * (double)i / (double)DDS_TABLE_SIZE));
 
-    ctx->spi0_fd = spi_open("/dev/spidev0.0", spi_config);
-    if (ctx->spi0_fd < 0) {
-        printf("Error: /dev/spidev0.0 unavailable\n");
-        return -1;
+        table[i] = calibration_dac_code(cal, (unsigned int)output, (uint32_t)mv);
     }
-    ctx->spi1_fd = spi_open("/dev/spidev0.1", spi_config);
-    if (ctx->spi1_fd < 0) {
-        printf("Error: /dev/spidev0.1 unavailable\n");
-        spi_close(ctx->spi0_fd);
-        ctx->spi0_fd = -1;
-        return -1;
+}
+
+// Phase increment per sample for a tone of freq_hz at rate_hz (2^32 == one full period).
+static uint32_t dds_increment_from_hz(double freq_hz, double rate_hz)
+{
+    return (uint32_t)llround((freq_hz / rate_hz) * DDS_PHASE_ONE_TURN);
+}
+
+static uint32_t dds_phase_from_degrees(double degrees)
+{
+    double turns = fmod(degrees / 360.0, 1.0);
+
+    if (turns < 0.0) {
+        turns += 1.0;
     }
-    ctx->ready = 1;
-    return 0;
+    return (uint32_t)llround(turns * DDS_PHASE_ONE_TURN);
 }
 
-static void ads_spi_cleanup(t_ads_spi_ctx *ctx)
+static void dds_init(t_dds_engine *dds, const t_runtime_options *options)
 {
-    if (ctx->spi0_fd >= 0) {
-        spi_close(ctx->spi0_fd);
-        ctx->spi0_fd = -1;
+    for (int output = 0; output < MCP_OUTPUT_COUNT; output++) {
+        dds_init_sine_table(dds->table[output], &g_calibration, output);
+        if (options->freq_set) {
+            dds->osc[output].increment = dds_increment_from_hz(options->freq_hz[output], options->rate_hz);
+        } else {
+            // Legacy --resolution behaviour: one period every points_per_period samples.
+            dds->osc[output].increment = (uint32_t)llround(DDS_PHASE_ONE_TURN / (double)options->points_per_period);
+        }
+        dds->osc[output].phase = dds_phase_from_degrees(options->phase_deg[output]);
     }
-    if (ctx->spi1_fd >= 0) {
-        spi_close(ctx->spi1_fd);
-        ctx->spi1_fd = -1;
+}
+
+// One table lookup per output, then advance every phase accumulator by its own increment.
+static inline void dds_render(t_dds_engine *dds, uint16_t values[MCP_OUTPUT_COUNT])
+{
+    for (int output = 0; output < MCP_OUTPUT_COUNT; output++) {
+        values[output] = dds->table[output][dds->osc[output].phase >> (32 - DDS_TABLE_BITS)];
+        dds->osc[output].phase += dds->osc[output].increment;
     }
-    ctx->ready = 0;
 }
 
-static int ads_read_voltage(t_ads_spi_ctx *ctx, uint8_t channel, float *voltage_value)
+// Advance every oscillator as if `periods` samples had been rendered (keeps pitch exact after clock overruns).
+static void dds_skip(t_dds_engine *dds, unsigned int periods)
 {
-    uint8_t tx_buffer[3] = {0};
-    uint8_t rx_buffer[3] = {0};
-    uint8_t local_channel;
-    int spifd;
+    for (int output = 0; output < MCP_OUTPUT_COUNT && periods > 0; output++) {
+        dds->osc[output].phase += dds->osc[output].increment * periods;
+    }
+}
 
-    if (!ctx->ready || channel > 15 || !voltage_value) {
+/*
+ * Step the probe output to code and poll its input until the reading crosses
+ * LATENCY_THRESHOLD_MV in the step direction. Records each stage when record is set.
+ * Returns 0 on a crossing, 1 on a miss (input already past the threshold before the
+ * write, timeout or stop request), -1 on an I2C/LDAC failure.
+ */
+static int latency_step(t_latency_probe *probe, uint16_t code, int rising, int record)
+{
+    t_mcp4728_frame_mode mode = probe->options->frame_mode;
+    uint8_t output_bit = (uint8_t)(1U << probe->output);
+    uint16_t input_bit = (uint16_t)(1U << probe->input);
+    uint64_t write_ns;
+    uint64_t written_ns;
+    uint64_t ldac_ns;
+
+    // Fast Write carries no VREF/gain/UDAC: use Multi-Write until the config is latched and LDAC is driven.
+    if (mode == MCP4728_FRAME_FAST && (!probe->ldac_ready || !(probe->dac_configured & output_bit))) {
+        mode = MCP4728_FRAME_MULTI;
+    }
+    if (record) {
+        // A crossing only counts if the input starts on the other side (catches unwired inputs).
+        ads_capture_snapshot(probe->ads_ctx, input_bit, probe->codes, &probe->valid_mask);
+        if (!(probe->valid_mask & input_bit)
+            || (ads_code_to_mv(probe->input, probe->codes[probe->input]) >= LATENCY_THRESHOLD_MV) == rising) {
+            return 1;
+        }
+    }
+    probe->values[probe->output] = code;
+    write_ns = monotonic_ns();
+    if (hat_write_outputs(probe->dac, mode, probe->ldac_ready ? 1 : 0, probe->values, output_bit) != 0) {
+        printf("Error: failed to write MCP4728 output %u\n", probe->output);
         return -1;
     }
+    probe->dac_configured |= output_bit;
+    written_ns = monotonic_ns();
+    ldac_ns = written_ns;
+    if (probe->ldac_ready) {
+        if (hat_ldac_strobe(probe->dac, hat_ldac_mask(output_bit)) < 0) {
+            printf("Error: LDAC strobe failed\n");
+            return -1;
+        }
+        ldac_ns = monotonic_ns();
+    }
+    while (g_keep_running) {
+        uint64_t poll_ns = monotonic_ns();
+        uint64_t sample_ns;
 
-    spifd = (channel < 8) ? ctx->spi0_fd : ctx->spi1_fd;
-    local_channel = (channel < 8) ? channel : (uint8_t)(channel - 8);
-
-    tx_buffer[0] = 1;
-    tx_buffer[1] = (uint8_t)((8 + local_channel) << 4);
-    tx_buffer[2] = 0;
-
-    if (spi_xfer(spifd, tx_buffer, 3, rx_buffer, 3) < 0) {
-        return -1;
+        ads_capture_snapshot(probe->ads_ctx, input_bit, probe->codes, &probe->valid_mask);
+        sample_ns = monotonic_ns();
+        if (record) {
+            hist_record(&probe->hist[STEP_POLL], sample_ns - poll_ns);
+        }
+        if (probe->valid_mask & input_bit) {
+            uint32_t mv = ads_code_to_mv(probe->input, probe->codes[probe->input]);
+
+            // sample_ns is an upper bound: the conversion happened during the last poll.
+            if (rising ? mv >= LATENCY_THRESHOLD_MV : mv < LATENCY_THRESHOLD_MV) {
+                if (record) {
+                    hist_record(&probe->hist[STEP_I2C], written_ns - write_ns);
+                    if (probe->ldac_ready) {
+                        hist_record(&probe->hist[STEP_LDAC], ldac_ns - written_ns);
+                    }
+                    hist_record(&probe->hist[STEP_ADC], sample_ns - ldac_ns);
+                    hist_record(&probe->hist[STEP_TOTAL], sample_ns - write_ns);
+                }
+                return 0;
+            }
+        }
+        if (sample_ns - write_ns > LATENCY_TIMEOUT_NS) {
+            break;
+        }
     }
+    return 1;
+}
 
-    *voltage_value = (float)(((rx_buffer[1] & 3) << 8) + rx_buffer[2]) / 1023.0f * 9.9f;
-    return 0;
+static void print_step_latency_report(FILE *out, const t_latency_probe *probe)
+{
+    fprintf(out, "Latency: out%u -> in%u | steps=%lu | missed=%lu | transport=%s | dac-frame=%s | ldac=%s\n",
+        probe->output, probe->input, probe->steps, probe->missed, i2c_transport_name(probe->options->transport),
+        mcp4728_frame_mode_name(probe->options->frame_mode), probe->ldac_ready ? "pulse" : "off (UDAC=0)");
+    print_hist_header(out);
+    for (int stage = 0; stage < STEP_STAGE_COUNT; stage++) {
+        print_hist_row(out, g_step_stage_names[stage], &probe->hist[stage]);
+    }
+    fflush(out);
 }
 
-static void ads_capture_snapshot(t_ads_spi_ctx *ads_ctx, float voltages[ADS_CHANNEL_COUNT],
-    uint8_t valid[ADS_CHANNEL_COUNT])
+/*
+ * --measure-latency: for each selected output with a loopback input, alternate steps
+ * between LATENCY_LOW_MV and LATENCY_HIGH_MV and time each one from the I2C write to
+ * the first ADC reading past the threshold. Outputs settle between steps.
+ */
+static int run_latency_measurement(const t_runtime_options *options, t_hat_dac *dac, t_hat_adc *ads_ctx,
+    int ldac_ready)
 {
-    for (uint8_t ch = 0; ch < ADS_CHANNEL_COUNT; ch++) {
-        voltages[ch] = 0.0f;
-        valid[ch] = 0;
-        if (ads_read_voltage(ads_ctx, ch, &voltages[ch]) == 0) {
-            valid[ch] = 1;
+    static t_latency_probe probe;
+    int status = 0;
+
+    for (uint8_t output = 0; output < MCP_OUTPUT_COUNT && g_keep_running && status == 0; output++) {
+        uint16_t low_code = calibration_dac_code(&g_calibration, output, LATENCY_LOW_MV);
+        uint16_t high_code = calibration_dac_code(&g_calibration, output, LATENCY_HIGH_MV);
+        unsigned int misses_in_row = 0;
+        int rising = 1;
+
+        if (!(options->out_channels & (1U << output)) || options->loopback[output] < 0) {
+            continue;
         }
+        memset(&probe, 0, sizeof(probe));
+        probe.dac = dac;
+        probe.options = options;
+        probe.ads_ctx = ads_ctx;
+        probe.ldac_ready = ldac_ready;
+        probe.output = output;
+        probe.input = (uint8_t)options->loopback[output];
+        // Start from the low level; this step is not measured.
+        status = latency_step(&probe, low_code, 0, 0);
+        while (status >= 0 && probe.steps < options->latency_steps && g_keep_running) {
+            sleep_until_ns(monotonic_ns() + LATENCY_SETTLE_NS);
+            status = latency_step(&probe, rising ? high_code : low_code, rising, 1);
+            if (status == 1 && g_keep_running) {
+                probe.missed++;
+                if (++misses_in_row == LATENCY_MAX_MISSES) {
+                    printf("Warning: out%u -> in%u missed %u mV %u times in a row, check the loopback wiring\n",
+                        output, probe.input, LATENCY_THRESHOLD_MV, LATENCY_MAX_MISSES);
+                    probe.steps++;
+                    break;
+                }
+            } else if (status == 0) {
+                misses_in_row = 0;
+            }
+            probe.steps++;
+            rising = !rising;
+        }
+        if (status > 0) {
+            status = 0;
+        }
+        probe.values[output] = 0;
+        hat_write_outputs(dac, MCP4728_FRAME_MULTI, 0, probe.values, (uint8_t)(1U << output));
+        print_step_latency_report(stdout, &probe);
     }
+    return status < 0 ? 1 : 0;
 }
 
-static void ads_build_history_line(char *line, size_t line_size, unsigned long sample_counter,
-    const float voltages[ADS_CHANNEL_COUNT], const uint8_t valid[ADS_CHANNEL_COUNT])
+/*
+ * One LDAC update of both DACs along path. cost_ns covers the whole update and skew_ns
+ * the time between the two falling edges, each taken at the middle of its set call. A
+ * strobe moves both lines in one call, so its skew is that call's duration (an upper bound).
+ */
+static int ldac_timed_update(t_hat_dac *dac, t_ldac_path path, uint64_t *cost_ns, uint64_t *skew_ns)
 {
-    int used = snprintf(line, line_size, "#%08lu", sample_counter);
-    if (used < 0 || (size_t)used >= line_size) {
-        return;
+    uint64_t start_ns = monotonic_ns();
+    uint64_t fall_ns[MCP_DAC_COUNT];
+
+    if (path == LDAC_PATH_STROBE) {
+        if (hat_ldac_set(dac, HAT_LDAC_ALL) < 0) {
+            return -1;
+        }
+        *skew_ns = monotonic_ns() - start_ns;
+        hat_ldac_hold(dac);
+        if (hat_ldac_set(dac, 0) < 0) {
+            return -1;
+        }
+        *cost_ns = monotonic_ns() - start_ns;
+        return 0;
     }
-    for (uint8_t ch = 0; ch < ADS_CHANNEL_COUNT; ch++) {
-        int written;
-        if (valid[ch]) {
-            // 1 leading space + 4 chars value so it aligns with 4-char equalizer bars.
-            written = snprintf(line + used, line_size - (size_t)used, " %4.1f", voltages[ch]);
+    for (int line = 0; line < MCP_DAC_COUNT; line++) {
+        uint64_t before_ns;
+
+        // The pulse the tools used before: high, usleep(2), low, usleep(2), high.
+        if (path == LDAC_PATH_USLEEP) {
+            if (hat_ldac_set(dac, 0) < 0) {
+                return -1;
+            }
+            usleep(2);
+        }
+        before_ns = monotonic_ns();
+        if (hat_ldac_set(dac, (uint8_t)(1U << line)) < 0) {
+            return -1;
+        }
+        fall_ns[line] = before_ns + (monotonic_ns() - before_ns) / 2U;
+        if (path == LDAC_PATH_USLEEP) {
+            usleep(2);
         } else {
-            written = snprintf(line + used, line_size - (size_t)used, " ERR ");
+            hat_ldac_hold(dac);
         }
-        if (written < 0 || (size_t)written >= line_size - (size_t)used) {
-            break;
+        if (hat_ldac_set(dac, 0) < 0) {
+            return -1;
         }
-        used += written;
     }
+    *skew_ns = fall_ns[1] - fall_ns[0];
+    *cost_ns = monotonic_ns() - start_ns;
+    return 0;
 }
 
-static void ads_push_history(char history[ADS_HISTORY_LINES][ADS_HISTORY_LINE_LEN],
-    unsigned int *history_count, const char *line)
+/*
+ * --measure-ldac: latch both DACs --ldac-strobes times along each path and report the
+ * update cost and the skew between the two latches. The paths are interleaved so CPU
+ * frequency and load changes hit them alike. No DAC is written: the latches repeat the
+ * current outputs.
+ */
+static int run_ldac_measurement(const t_runtime_options *options, t_hat_dac *dac, int ldac_ready)
 {
-    if (*history_count < ADS_HISTORY_LINES) {
-        snprintf(history[*history_count], ADS_HISTORY_LINE_LEN, "%s", line);
-        (*history_count)++;
-        return;
+    static t_latency_hist cost[LDAC_PATH_COUNT];
+    static t_latency_hist skew[LDAC_PATH_COUNT];
+    unsigned long updates = 0;
+
+    if (!ldac_ready) {
+        printf("Error: --measure-ldac needs the LDAC GPIO lines\n");
+        return 1;
+    }
+    while (updates < options->ldac_strobes && g_keep_running) {
+        for (int path = 0; path < LDAC_PATH_COUNT; path++) {
+            uint64_t cost_ns;
+            uint64_t skew_ns;
+
+            if (ldac_timed_update(dac, (t_ldac_path)path, &cost_ns, &skew_ns) < 0) {
+                printf("Error: LDAC %s update failed: %s\n", g_ldac_path_names[path], strerror(errno));
+                return 1;
+            }
+            hist_record(&cost[path], cost_ns);
+            hist_record(&skew[path], skew_ns);
+        }
+        updates++;
+    }
+    printf("LDAC: %lu updates per path | hold=%u ns | clock read=%u ns\n", updates, dac->ldac_hold_ns,
+        dac->clock_read_ns);
+    printf("Update cost (both DACs latched):\n");
+    print_hist_header(stdout);
+    for (int path = 0; path < LDAC_PATH_COUNT; path++) {
+        print_hist_row(stdout, g_ldac_path_names[path], &cost[path]);
     }
+    printf("Latch skew DAC1 -> DAC2 (strobe: bounded by its single set call):\n");
+    print_hist_header(stdout);
+    for (int path = 0; path < LDAC_PATH_COUNT; path++) {
+        print_hist_row(stdout, g_ldac_path_names[path], &skew[path]);
+    }
+    fflush(stdout);
+    return 0;
+}
 
-    for (unsigned int i = 1; i < ADS_HISTORY_LINES; i++) {
-        snprintf(history[i - 1], ADS_HISTORY_LINE_LEN, "%s", history[i]);
+// Next swept code: every stride-th code, always ending on the top code.
+static unsigned int sweep_next_code(unsigned int code, unsigned int stride)
+{
+    if (code == MCP_CODE_COUNT - 1U) {
+        return MCP_CODE_COUNT;
     }
-    snprintf(history[ADS_HISTORY_LINES - 1], ADS_HISTORY_LINE_LEN, "%s", line);
+    code += stride;
+    return code < MCP_CODE_COUNT ? code : MCP_CODE_COUNT - 1U;
 }
 
-static int voltage_to_equalizer_steps(float voltage)
+// Mean ADC reading of a swept code, kept with 6 fractional bits, converted through the ADC calibration.
+static uint32_t sweep_point_mv(const t_sweep_pair *pair, unsigned int code)
 {
-    double scaled;
+    uint32_t mean_q6 = (uint32_t)((((uint64_t)pair->sum[code] << 6) + pair->samples[code] / 2U) / pair->samples[code]);
+
+    return calibration_adc_mv(&g_calibration, pair->input, mean_q6, 6);
+}
+
+static int sweep_point_clipped(const t_sweep_pair *pair, unsigned int code)
+{
+    // Half a code from either rail: the input saturated for at least half the samples.
+    return pair->sum[code] * 2U < pair->samples[code]
+        || pair->sum[code] * 2U > (2U * ADS_CODE_MAX - 1U) * pair->samples[code];
+}
 
-    if (voltage < 0.0f) {
-        voltage = 0.0f;
-    } else if (voltage > 10.0f) {
-        voltage = 10.0f;
+/*
+ * Fit mV = slope * code + offset over the unclipped points. INL is the largest distance
+ * from that line, DNL the largest error of one stride step, both in DAC LSB (fitted slope).
+ */
+static void sweep_analyze(const t_sweep_pair *pair, unsigned int stride, t_sweep_result *result)
+{
+    double sx = 0.0;
+    double sy = 0.0;
+    double sxx = 0.0;
+    double sxy = 0.0;
+    double n;
+    int have_previous = 0;
+    unsigned int previous_code = 0;
+    double previous_mv = 0.0;
+
+    memset(result, 0, sizeof(*result));
+    for (unsigned int code = 0; code < MCP_CODE_COUNT; code = sweep_next_code(code, stride)) {
+        double mv;
+
+        if (pair->samples[code] == 0) {
+            continue;
+        }
+        if (sweep_point_clipped(pair, code)) {
+            result->clipped++;
+            continue;
+        }
+        mv = (double)sweep_point_mv(pair, code);
+        sx += code;
+        sy += mv;
+        sxx += (double)code * code;
+        sxy += (double)code * mv;
+        result->points++;
     }
+    n = (double)result->points;
+    if (result->points < 2 || n * sxx - sx * sx == 0.0) {
+        return;
+    }
+    result->slope_mv = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+    result->offset_mv = (sy - result->slope_mv * sx) / n;
+    result->gain = result->slope_mv * (double)(MCP_CODE_COUNT - 1U) / (double)CAL_DAC_FULL_SCALE_MV;
+    if (result->slope_mv <= 0.0) {
+        return;
+    }
+    for (unsigned int code = 0; code < MCP_CODE_COUNT; code = sweep_next_code(code, stride)) {
+        double mv;
+        double inl;
 
-    scaled = ((double)voltage / 10.0) * (double)(EQ_ROWS * EQ_STEPS_PER_ROW);
-    return (int)lround(scaled);
+        if (pair->samples[code] == 0 || sweep_point_clipped(pair, code)) {
+            have_previous = 0;
+            continue;
+        }
+        mv = (double)sweep_point_mv(pair, code);
+        inl = fabs(mv - (result->slope_mv * code + result->offset_mv)) / result->slope_mv;
+        if (inl > result->inl_lsb) {
+            result->inl_lsb = inl;
+        }
+        if (have_previous) {
+            double dnl = fabs((mv - previous_mv) / result->slope_mv - (double)(code - previous_code));
+
+            if (dnl > result->dnl_lsb) {
+                result->dnl_lsb = dnl;
+            }
+        }
+        have_previous = 1;
+        previous_code = code;
+        previous_mv = mv;
+    }
 }
 
-static void ads_render_dashboard(const char history[ADS_HISTORY_LINES][ADS_HISTORY_LINE_LEN],
-    unsigned int history_count, const float voltages[ADS_CHANNEL_COUNT], const uint8_t valid[ADS_CHANNEL_COUNT],
-    unsigned int points_per_period, unsigned int sample_delay_us)
+// Piecewise-linear "dac" rule from up to CAL_MAX_POINTS evenly spread unclipped points.
+static void sweep_write_calibration_rule(FILE *file, const t_sweep_pair *pair, unsigned int stride,
+    const t_sweep_result *result)
 {
-    static const char *blocks[EQ_STEPS_PER_ROW + 1] = {" ", "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"};
+    unsigned int every = (result->points + CAL_MAX_POINTS - 2U) / (CAL_MAX_POINTS - 1U);
+    unsigned int index = 0;
+    unsigned int last_code = 0;
+    int last_written = 1;
 
-    // Keep an always-updated dashboard: history above, equalizer on the last 5 lines.
-    printf("\033[H\033[J");
-    printf("=== MCP->ADS loopback test ===\n");
-    printf("Config: resolution=%u points | delay=%u us | eq-every=%u | history-every=%u\n",
-        points_per_period, sample_delay_us, EQUALIZER_EVERY, HISTORY_EVERY);
-    printf("ADS voltage history (V):\n");
-    for (unsigned int i = 0; i < history_count; i++) {
-        printf("%s\n", history[i]);
+    if (every == 0) {
+        every = 1;
     }
-    for (int row = EQ_ROWS - 1; row >= 0; row--) {
-        // Prefix width is fixed to 9 chars to match history line prefix (#00000000).
-        printf("%2dV%6s", (row + 1) * 2, "");
-        for (uint8_t ch = 0; ch < ADS_CHANNEL_COUNT; ch++) {
-            int steps = valid[ch] ? voltage_to_equalizer_steps(voltages[ch]) : 0;
-            int cell = steps - (row * EQ_STEPS_PER_ROW);
+    fprintf(file, "# out%u -> in%u: gain=%.5f offset=%.1f mV inl=%.2f LSB dnl=%.2f LSB (%u points, %u clipped)\n",
+        pair->output, pair->input, result->gain, result->offset_mv, result->inl_lsb, result->dnl_lsb,
+        result->points, result->clipped);
+    fprintf(file, "dac %u", pair->output);
+    for (unsigned int code = 0; code < MCP_CODE_COUNT; code = sweep_next_code(code, stride)) {
+        if (pair->samples[code] == 0 || sweep_point_clipped(pair, code)) {
+            continue;
+        }
+        last_written = (index % every) == 0;
+        if (last_written) {
+            fprintf(file, " %u:%u", code, sweep_point_mv(pair, code));
+        }
+        last_code = code;
+        index++;
+    }
+    // Always end on the last unclipped point so the top segment is measured, not extrapolated.
+    if (!last_written) {
+        fprintf(file, " %u:%u", last_code, sweep_point_mv(pair, last_code));
+    }
+    fprintf(file, "\n");
+}
 
-            if (cell < 0) {
-                cell = 0;
-            } else if (cell > EQ_STEPS_PER_ROW) {
-                cell = EQ_STEPS_PER_ROW;
-            }
-            printf(" ");
-            for (int w = 0; w < EQ_BAR_WIDTH; w++) {
-                printf("%s", blocks[cell]);
+/*
+ * --sweep: every swept code goes to all selected outputs in one frame (one LDAC pulse
+ * per DAC), then each scan reads all loopback inputs with one SPI message per MCP3008,
+ * so the cost per code is one write, the settle time and sweep_samples scans.
+ */
+static int run_transfer_sweep(const t_runtime_options *options, t_hat_dac *dac, t_hat_adc *ads_ctx,
+    int ldac_ready)
+{
+    static t_sweep_pair pairs[MCP_OUTPUT_COUNT];
+    uint16_t values[MCP_OUTPUT_COUNT] = {0};
+    uint16_t codes[ADS_CHANNEL_COUNT] = {0};
+    uint16_t valid_mask = 0;
+    uint16_t input_mask = 0;
+    uint8_t outputs = 0;
+    uint8_t dac_configured = 0;
+    unsigned int swept = 0;
+    uint64_t start_ns;
+    double elapsed_s;
+    FILE *file = NULL;
+
+    for (uint8_t output = 0; output < MCP_OUTPUT_COUNT; output++) {
+        memset(&pairs[output], 0, sizeof(pairs[output]));
+        if (!(options->out_channels & (1U << output)) || options->loopback[output] < 0) {
+            continue;
+        }
+        pairs[output].output = output;
+        pairs[output].input = (uint8_t)options->loopback[output];
+        outputs |= (uint8_t)(1U << output);
+        input_mask |= (uint16_t)(1U << pairs[output].input);
+    }
+    if (outputs == 0) {
+        printf("Error: --sweep needs at least one --out-channels output with a --loopback input\n");
+        return 1;
+    }
+
+    start_ns = monotonic_ns();
+    for (unsigned int code = 0; code < MCP_CODE_COUNT && g_keep_running; code = sweep_next_code(code,
+            options->sweep_stride)) {
+        t_mcp4728_frame_mode mode = options->frame_mode;
+
+        if (mode == MCP4728_FRAME_FAST && (!ldac_ready || (outputs & ~dac_configured) != 0)) {
+            mode = MCP4728_FRAME_MULTI;
+        }
+        for (uint8_t output = 0; output < MCP_OUTPUT_COUNT; output++) {
+            values[output] = (uint16_t)code;
+        }
+        if (hat_write_outputs(dac, mode, ldac_ready ? 1 : 0, values, outputs) != 0) {
+            printf("Error: failed to write MCP4728 outputs\n");
+            return 1;
+        }
+        dac_configured |= outputs;
+        if (ldac_ready && hat_ldac_strobe(dac, hat_ldac_mask(outputs)) < 0) {
+            printf("Error: LDAC strobe failed\n");
+            return 1;
+        }
+        if (options->sweep_settle_us > 0) {
+            sleep_until_ns(monotonic_ns() + (uint64_t)options->sweep_settle_us * 1000ULL);
+        }
+        for (unsigned int sample = 0; sample < options->sweep_samples; sample++) {
+            ads_capture_snapshot(ads_ctx, input_mask, codes, &valid_mask);
+            for (uint8_t output = 0; output < MCP_OUTPUT_COUNT; output++) {
+                t_sweep_pair *pair = &pairs[output];
+
+                if ((outputs & (1U << output)) && (valid_mask & (1U << pair->input))) {
+                    pair->sum[code] += codes[pair->input];
+                    pair->samples[code]++;
+                }
             }
         }
-        printf("\n");
+        swept++;
     }
-    printf("%9s", "");
-    for (uint8_t ch = 0; ch < ADS_CHANNEL_COUNT; ch++) {
-        printf(" %4u", ch);
+    elapsed_s = (double)(monotonic_ns() - start_ns) / 1e9;
+    memset(values, 0, sizeof(values));
+    hat_write_outputs(dac, MCP4728_FRAME_MULTI, 0, values, outputs);
+
+    printf("Sweep: %u codes x %u outputs x %u samples in %.2f s (stride=%u, settle=%u us)\n", swept,
+        (unsigned int)__builtin_popcount(outputs), options->sweep_samples, elapsed_s, options->sweep_stride,
+        options->sweep_settle_us);
+    if (!g_keep_running) {
+        printf("Sweep interrupted, no results\n");
+        return 1;
     }
-    printf("\n");
-    fflush(stdout);
+    if (options->calibration_out_path) {
+        file = fopen(options->calibration_out_path, "w");
+        if (!file) {
+            printf("Error: unable to create %s: %s\n", options->calibration_out_path, strerror(errno));
+            return 1;
+        }
+        fprintf(file, "# input_output_tester --sweep: stride=%u samples=%u settle=%u us%s\n", options->sweep_stride,
+            options->sweep_samples, options->sweep_settle_us,
+            g_calibration.adc_calibrated ? " (ADC calibrated)" : " (ADC nominal)");
+    }
+    for (uint8_t output = 0; output < MCP_OUTPUT_COUNT; output++) {
+        t_sweep_result result;
+
+        if (!(outputs & (1U << output))) {
+            continue;
+        }
+        sweep_analyze(&pairs[output], options->sweep_stride, &result);
+        if (result.points < 2 || result.slope_mv <= 0.0) {
+            printf("Sweep out%u -> in%u: no usable transfer curve (%u points, %u clipped), check the loopback wiring\n",
+                output, pairs[output].input, result.points, result.clipped);
+            continue;
+        }
+        printf("Sweep out%u -> in%u: gain=%.5f | offset=%.1f mV | INL=%.2f LSB | DNL=%.2f LSB | points=%u"
+            " | clipped=%u\n", output, pairs[output].input, result.gain, result.offset_mv, result.inl_lsb,
+            result.dnl_lsb, result.points, result.clipped);
+        if (file) {
+            sweep_write_calibration_rule(file, &pairs[output], options->sweep_stride, &result);
+        }
+    }
+    if (file) {
+        if (fclose(file) != 0) {
+            printf("Error: unable to write %s: %s\n", options->calibration_out_path, strerror(errno));
+            return 1;
+        }
+        printf("Calibration written to %s\n", options->calibration_out_path);
+    }
+    return 0;
 }
 
 int main(int argc, char **argv)
 {
     const char *i2c_bus = "/dev/i2c-1";
-    const double two_pi = 2.0 * 3.14159265358979323846;
-    const double phase_step = two_pi / 8.0;
-    unsigned int points_per_period;
-    unsigned int sample_delay_us;
+    t_runtime_options options;
+    static t_dds_engine dds;
+    t_sample_clock sample_clock;
+    uint8_t dac_configured = 0;
     int i2c_fd;
     int ldac_ready;
     int ldac_error_reported = 0;
     unsigned long sample_counter = 0;
-    char ads_history[ADS_HISTORY_LINES][ADS_HISTORY_LINE_LEN] = {{0}};
-    unsigned int ads_history_count = 0;
-    char history_line[ADS_HISTORY_LINE_LEN] = {0};
-    float ads_voltages[ADS_CHANNEL_COUNT] = {0.0f};
-    uint8_t ads_valid[ADS_CHANNEL_COUNT] = {0};
-    t_ads_spi_ctx ads_ctx;
+    static t_dashboard_ctx dashboard;
+    t_dashboard_snapshot snapshot;
+    uint16_t ads_codes[ADS_CHANNEL_COUNT] = {0};
+    uint16_t ads_valid_mask = 0;
+    t_history_record history_record;
+    t_hat_adc ads_ctx;
+    t_channel_schedule in_schedule;
+    t_channel_schedule out_schedule;
     int parse_status;
 
-    parse_status = parse_runtime_options(argc, argv, &points_per_period, &sample_delay_us);
+    parse_status = parse_runtime_options(argc, argv, &options);
     if (parse_status > 0) {
         return 0;
     }
+    calibration_init_nominal(&g_calibration);
+    if (options.calibration_path) {
+        char error[256];
+
+        if (calibration_load(&g_calibration, options.calibration_path, error, sizeof(error)) != 0) {
+            printf("Error: calibration %s\n", error);
+            return 1;
+        }
+        printf("Calibration: %s (inputs 0x%04x, outputs 0x%02x)\n", options.calibration_path,
+            g_calibration.adc_calibrated, g_calibration.dac_calibrated);
+    }
+    {
+        char error[256];
+
+        if (hat_transport_init(&g_transport, options.sim_spec, error, sizeof(error)) != 0) {
+            printf("Error: --sim %s\n", error);
+            return 1;
+        }
+    }
+    if (g_transport.simulated) {
+        i2c_bus = "sim";
+        printf("Transport: simulated hat (no I2C/SPI/GPIO access)\n");
+    }
+    hat_dac_init(&g_dac, &g_transport);
+    g_dac.ldac_hold_ns = options.ldac_hold_ns;
 
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
+    signal(SIGUSR1, stats_signal_handler);
 
     i2c_fd = i2c_init(i2c_bus);
     if (i2c_fd < 0) {
@@ -495,61 +1481,136 @@ int main(int argc, char **argv)
     }
 
     if (ads_spi_init(&ads_ctx) != 0) {
-        close(i2c_fd);
+        hat_dac_close(&g_dac);
         return 1;
     }
 
-    scan_i2c_bus(i2c_fd);
+    scan_i2c_bus(&g_dac);
+    options.transport = i2c_select_transport(&g_dac, options.transport);
     ldac_ready = (setup_ldac() == 0);
     if (!ldac_ready) {
         printf("Warning: LDAC init failed, fallback to immediate updates (UDAC=0).\n");
+    } else {
+        printf("LDAC: written DACs strobed together, hold %u ns (clock read %u ns)\n", g_dac.ldac_hold_ns,
+            g_dac.clock_read_ns);
     }
 
-    while (g_keep_running) {
-        for (unsigned int i = 0; i < points_per_period && g_keep_running; i++) {
-            uint16_t phased_values[8];
-            uint8_t udac = ldac_ready ? 1 : 0;
-            double angle = two_pi * (double)i / (double)points_per_period;
-
-            for (int output = 0; output < 8; output++) {
-                double shifted_angle = angle + ((double)output * phase_step);
-                phased_values[output] = (uint16_t)(2048.0 + 2047.0 * sin(shifted_angle));
-            }
+    if (options.measure_latency || options.sweep || options.measure_ldac) {
+        int status;
+
+        apply_realtime_options(&options);
+        if (options.measure_ldac) {
+            status = run_ldac_measurement(&options, &g_dac, ldac_ready);
+        } else if (options.sweep) {
+            status = run_transfer_sweep(&options, &g_dac, &ads_ctx, ldac_ready);
+        } else {
+            status = run_latency_measurement(&options, &g_dac, &ads_ctx, ldac_ready);
+        }
+        print_spi_syscall_report(stdout, &ads_ctx, NULL);
+        hat_adc_close(&ads_ctx);
+        hat_dac_close(&g_dac);
+        print_i2c_syscall_report(options.transport, options.frame_mode, options.dac_delta);
+        hat_transport_report(stdout, &g_transport);
+        printf("Stopped.\n");
+        return status;
+    }
 
-            if (write_all_mcp_outputs(i2c_fd, udac, phased_values) != 0) {
+    dds_init(&dds, &options);
+    channel_schedule_init(&in_schedule, options.in_channels, options.in_divisor, EQUALIZER_EVERY);
+    channel_schedule_init(&out_schedule, options.out_channels, options.out_divisor, 1U);
+    // Start the renderer before raising priority so it stays SCHED_OTHER and unpinned.
+    dashboard_start(&dashboard, &options);
+    apply_realtime_options(&options);
+    sample_clock_init(&sample_clock, options.rate_hz, options.busy_wait_us);
+    while (g_keep_running) {
+        uint16_t phased_values[MCP_OUTPUT_COUNT];
+        uint8_t udac = ldac_ready ? 1 : 0;
+        t_mcp4728_frame_mode sample_mode = options.frame_mode;
+        uint64_t loop_start_ns = monotonic_ns();
+        uint64_t stage_ns = loop_start_ns;
+        uint8_t out_due = (uint8_t)channel_schedule_next(&out_schedule);
+        uint8_t out_sent = 0;
+        uint16_t in_due = channel_schedule_next(&in_schedule);
+
+        // Every oscillator advances each sample so divided outputs stay in phase.
+        dds_render(&dds, phased_values);
+        stage_ns = stage_mark(&g_stage_hist[STAGE_WAVE], stage_ns);
+
+        // Fast Write carries no VREF/gain/UDAC: use Multi-Write until the config is latched and LDAC is driven.
+        if (sample_mode == MCP4728_FRAME_FAST && (!ldac_ready || (out_due & ~dac_configured) != 0)) {
+            sample_mode = MCP4728_FRAME_MULTI;
+        }
+        if (out_due != 0) {
+            int sent;
+
+            g_dac.frame_mode = sample_mode;
+            g_dac.udac = udac;
+            sent = options.dac_delta ? hat_write_delta(&g_dac, phased_values, out_due)
+                : (hat_write_outputs(&g_dac, sample_mode, udac, phased_values, out_due) == 0 ? out_due : -1);
+            if (sent < 0) {
                 printf("Error: failed to write MCP4728 outputs\n");
                 g_keep_running = 0;
                 break;
             }
+            out_sent = (uint8_t)sent;
+            dac_configured |= out_due;
+            stage_ns = stage_mark(&g_stage_hist[STAGE_I2C], stage_ns);
+        }
 
-            if (ldac_ready) {
-                if (ldac_pulse_low(LDAC1_GPIO) < 0 || ldac_pulse_low(LDAC2_GPIO) < 0) {
-                    ldac_ready = 0;
-                    if (!ldac_error_reported) {
-                        printf("Warning: LDAC pulse failed, switching to immediate updates (UDAC=0).\n");
-                        ldac_error_reported = 1;
-                    }
+        if (ldac_ready && out_sent != 0) {
+            // Only strobe the DACs that received new values.
+            if (hat_ldac_strobe(&g_dac, hat_ldac_mask(out_sent)) < 0) {
+                // Written with UDAC=1 but never latched: resend them on the next frame.
+                hat_shadow_invalidate(&g_dac, out_sent);
+                ldac_ready = 0;
+                if (!ldac_error_reported) {
+                    printf("Warning: LDAC strobe failed, switching to immediate updates (UDAC=0).\n");
+                    ldac_error_reported = 1;
                 }
             }
+            stage_ns = stage_mark(&g_stage_hist[STAGE_LDAC], stage_ns);
+        }
 
-            if ((sample_counter % EQUALIZER_EVERY) == 0) {
-                ads_capture_snapshot(&ads_ctx, ads_voltages, ads_valid);
-                if ((sample_counter % HISTORY_EVERY) == 0) {
-                    ads_build_history_line(history_line, sizeof(history_line), sample_counter, ads_voltages, ads_valid);
-                    ads_push_history(ads_history, &ads_history_count, history_line);
-                }
-                ads_render_dashboard(ads_history, ads_history_count, ads_voltages, ads_valid,
-                    points_per_period, sample_delay_us);
+        if (in_due != 0) {
+            ads_capture_snapshot(&ads_ctx, in_due, ads_codes, &ads_valid_mask);
+            stage_ns = stage_mark(&g_stage_hist[STAGE_SPI], stage_ns);
+            if (options.fps > 0) {
+                dashboard_fill_snapshot(&snapshot, sample_counter, ads_codes, ads_valid_mask, &sample_clock);
+                seqlock_publish(&dashboard.seq, &dashboard.latest, &snapshot, sizeof(snapshot));
+                stage_ns = stage_mark(&g_stage_hist[STAGE_PUBLISH], stage_ns);
             }
+        }
+        if (options.fps > 0 && (sample_counter % HISTORY_EVERY) == 0) {
+            history_record.sample_counter = sample_counter;
+            history_record.timestamp_ns = stage_ns;
+            memcpy(history_record.codes, ads_codes, sizeof(history_record.codes));
+            history_record.valid_mask = ads_valid_mask;
+            history_ring_push(&dashboard.history, &history_record);
+        }
+        if (g_stats_requested) {
+            g_stats_requested = 0;
+            print_latency_report(stderr, g_stage_hist, g_stage_names, STAGE_COUNT, &sample_clock);
+        }
+        stage_mark(&g_stage_hist[STAGE_LOOP], loop_start_ns);
 
-            sample_counter++;
-            delay_microseconds(sample_delay_us);
+        sample_counter++;
+        dds_skip(&dds, sample_clock_wait(&sample_clock) - 1U);
+        // A stop request can end the wait before the deadline; do not record that as jitter.
+        if (sample_clock.period_ns > 0 && g_keep_running) {
+            hist_record(&g_stage_hist[STAGE_WAKEUP], monotonic_ns() - sample_clock.deadline_ns);
         }
     }
 
-    ads_spi_cleanup(&ads_ctx);
-    cleanup_ldac();
-    close(i2c_fd);
+    dashboard_stop(&dashboard);
+    print_channel_schedule(stdout, "ADC", &in_schedule, options.rate_hz);
+    print_channel_schedule(stdout, "DAC", &out_schedule, options.rate_hz);
+    print_spi_syscall_report(stdout, &ads_ctx, &in_schedule);
+    hat_adc_close(&ads_ctx);
+    hat_dac_close(&g_dac);
+    print_i2c_syscall_report(options.transport, options.frame_mode, options.dac_delta);
+    print_sample_clock_report(&sample_clock);
+    print_latency_report(stdout, g_stage_hist, g_stage_names, STAGE_COUNT, &sample_clock);
+    hat_transport_report(stdout, &g_transport);
     printf("Stopped.\n");
     return 0;
 }
@@ -1,45 +1,197 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <spidev_lib.h>
+#include <linux/spi/spidev.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
 #include <stdint.h>
 #include <signal.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <errno.h>
 #include <math.h>
+#include "capture_format.h"
+#include "hat_runtime.h"
+#include "calibration.h"
+#define HAT_TRANSPORT_SPI
+#include "hat_transport.h"
+#include "modhat.h"
 
-#define ADS_CHANNEL_COUNT 16
 #define ADS_HISTORY_LINES 14
 #define ADS_HISTORY_LINE_LEN 256
 
-#define EQ_ROWS 5
-#define EQ_STEPS_PER_ROW 8
-#define EQ_BAR_WIDTH 4
+#define SCREEN_HEADER_ROWS 4
+#define SCREEN_TEXT_ROWS (SCREEN_HEADER_ROWS + ADS_HISTORY_LINES)
+#define SCREEN_EQ_ROW SCREEN_TEXT_ROWS
 
-#define DEFAULT_SAMPLE_DELAY_US 10000U
+#define DEFAULT_RATE_HZ 100U
+#define MAX_RATE_HZ 100000U
+#define DEFAULT_SAMPLE_DELAY_US (1000000U / DEFAULT_RATE_HZ)
 #define MAX_SAMPLE_DELAY_US 1000000U
 
+#define MAX_BUSY_WAIT_US 10000U
+
 #define EQUALIZER_EVERY 2U
 #define HISTORY_EVERY 10U
+#define DEFAULT_DASHBOARD_FPS 20U
+#define MAX_DASHBOARD_FPS 120U
+#define DEFAULT_HISTORY_CAPACITY 4096U
+#define MAX_HISTORY_CAPACITY 1048576U
 
-typedef struct s_ads_spi_ctx {
-    int spi0_fd;
-    int spi1_fd;
-    int ready;
-}   t_ads_spi_ctx;
+#define DEFAULT_STREAM_BUFFER 65536U
+#define MAX_STREAM_BUFFER 16777216U
+#define STREAM_DRAIN_BATCH 256U
+#define STREAM_POLL_NS 1000000ULL
+#define STREAM_HISTORY_PERIOD_NS 100000000ULL
+#define STREAM_CSV_LINE_LEN 128
 
-static volatile sig_atomic_t g_keep_running = 1;
+#define FILTER_FRAC_BITS 6U
+#define FILTER_MAX_WINDOW 256U
+#define FILTER_MAX_OVERSAMPLE 1024U
+#define FILTER_MAX_CIC_RATIO 64U
+#define FILTER_MAX_CIC_ORDER 4U
+#define FILTER_MAX_LOWPASS_SHIFT 12U
+#define FILTER_LOWPASS_EXTRA_BITS 10U
 
-static void signal_handler(int signo)
-{
-    (void)signo;
-    g_keep_running = 0;
-}
+typedef enum e_filter_kind {
+    FILTER_NONE,
+    FILTER_AVERAGE,
+    FILTER_OVERSAMPLE,
+    FILTER_CIC
+}   t_filter_kind;
 
-static void delay_microseconds(unsigned int micros)
-{
-    usleep(micros);
-}
+// --filter: one decimator/averager, then an optional one-pole low-pass (lowpass_shift = 0 for none).
+typedef struct s_filter_config {
+    t_filter_kind kind;
+    unsigned int length;
+    unsigned int order;
+    unsigned int lowpass_shift;
+}   t_filter_config;
+
+/*
+ * Per-channel filter state, all integer. Outputs are codes with FILTER_FRAC_BITS extra
+ * fractional bits (code << 6 for a settled input), so averaging shows up as resolution.
+ */
+typedef struct s_channel_filter {
+    uint64_t integrator[FILTER_MAX_CIC_ORDER];
+    uint64_t comb[FILTER_MAX_CIC_ORDER];
+    uint32_t sum;
+    unsigned int count;
+    unsigned int warmup;
+    unsigned int window_pos;
+    uint16_t window[FILTER_MAX_WINDOW];
+    int32_t lowpass;
+    int lowpass_ready;
+}   t_channel_filter;
+
+typedef struct s_filter_bank {
+    t_filter_config config;
+    uint64_t cic_gain;
+    t_channel_filter channels[ADS_CHANNEL_COUNT];
+}   t_filter_bank;
+
+typedef struct s_runtime_options {
+    double rate_hz;
+    int rt_priority;
+    int lock_memory;
+    int cpu;
+    int busy_wait_us;
+    unsigned int fps;
+    unsigned int history_capacity;
+    int rate_set;
+    int stream;
+    int stream_csv;
+    int stream_mv;
+    unsigned int stream_buffer;
+    uint16_t in_channels;
+    uint32_t in_divisor[ADS_CHANNEL_COUNT];
+    const char *record_path;
+    t_filter_config filter;
+    const char *calibration_path;
+    const char *sim_spec;
+}   t_runtime_options;
+
+typedef enum e_loop_stage {
+    STAGE_WAKEUP,
+    STAGE_SPI,
+    STAGE_FILTER,
+    STAGE_PUBLISH,
+    STAGE_LOOP,
+    STAGE_COUNT
+}   t_loop_stage;
+
+typedef struct s_history_record {
+    unsigned long sample_counter;
+    uint64_t timestamp_ns;
+    uint16_t codes[ADS_CHANNEL_COUNT];
+    uint16_t valid_mask;
+}   t_history_record;
+
+typedef struct s_dashboard_snapshot {
+    unsigned long sample_counter;
+    uint16_t codes[ADS_CHANNEL_COUNT];
+    uint16_t valid_mask;
+    unsigned long ticks;
+    unsigned long overruns;
+    unsigned long missed_periods;
+    unsigned long dropped;
+}   t_dashboard_snapshot;
+
+/*
+ * Sample thread -> render thread handoff. The latest snapshot goes through a seqlock
+ * (writer never waits, reader retries on a torn copy); history goes through the ring.
+ */
+typedef struct s_dashboard_ctx {
+    atomic_uint seq;
+    t_dashboard_snapshot latest;
+    t_history_ring history;
+    atomic_int running;
+    pthread_t thread;
+    const t_runtime_options *options;
+}   t_dashboard_ctx;
+
+// --stream ring of timestamped scans: one capture thread writes, readers keep their own cursor.
+typedef struct s_stream_ctx {
+    t_history_record *samples;
+    unsigned int capacity;
+    atomic_ulong head;
+    atomic_int running;
+    pthread_t thread;
+    t_hat_adc *ads_ctx;
+    const t_runtime_options *options;
+    // clock belongs to the capture thread; readers use the counters it publishes below.
+    t_sample_clock clock;
+    t_channel_schedule schedule;
+    atomic_ulong ticks;
+    atomic_ulong overruns;
+    atomic_ulong missed_periods;
+    atomic_ulong scan_errors;
+}   t_stream_ctx;
+
+typedef struct s_stream_reader {
+    unsigned long cursor;
+    unsigned long dropped;
+}   t_stream_reader;
+
+// --record consumer: its own cursor on the stream ring, packs scans into capture blocks.
+typedef struct s_stream_recorder {
+    t_capture_writer writer;
+    t_stream_reader reader;
+    t_stream_ctx *stream;
+    atomic_int running;
+    pthread_t thread;
+    int failed;
+    t_history_record batch[STREAM_DRAIN_BATCH];
+}   t_stream_recorder;
+
+static t_latency_hist g_stage_hist[STAGE_COUNT];
+static const char *g_stage_names[STAGE_COUNT] = {"wakeup", "spi", "filter", "publish", "loop"};
+static t_calibration g_calibration;
+static t_hat_transport g_transport;
 
 static unsigned int parse_u32_or_default(const char *raw_value, const char *param_name,
     unsigned int default_value, unsigned int min_value, unsigned int max_value)
@@ -61,20 +213,182 @@ static unsigned int parse_u32_or_default(const char *raw_value, const char *para
     return (unsigned int)parsed;
 }
 
-static int parse_runtime_options(int argc, char **argv, unsigned int *sample_delay_us)
+/*
+ * Parse "avg:<N>", "os:<N>", "cic:<R>:<order>" and/or "lp:<shift>", comma separated,
+ * e.g. "cic:8:3,lp:4". Keeps the previous configuration on error.
+ */
+static int parse_filter_spec(const char *raw_value, t_filter_config *config)
 {
-    *sample_delay_us = DEFAULT_SAMPLE_DELAY_US;
+    t_filter_config parsed = {FILTER_NONE, 0, 0, 0};
+    const char *cursor = raw_value;
+
+    while (cursor && *cursor != '\0') {
+        unsigned long first = 0;
+        unsigned long second = 0;
+        char *end = NULL;
+
+        if (strncmp(cursor, "avg:", 4) == 0 || strncmp(cursor, "os:", 3) == 0) {
+            int average = (cursor[0] == 'a');
+            const char *number = cursor + (average ? 4 : 3);
+
+            first = strtoul(number, &end, 10);
+            if (end == number || parsed.kind != FILTER_NONE || first < 2
+                || first > (average ? FILTER_MAX_WINDOW : FILTER_MAX_OVERSAMPLE)) {
+                break;
+            }
+            parsed.kind = average ? FILTER_AVERAGE : FILTER_OVERSAMPLE;
+            parsed.length = (unsigned int)first;
+        } else if (strncmp(cursor, "cic:", 4) == 0) {
+            first = strtoul(cursor + 4, &end, 10);
+            if (end == cursor + 4 || *end != ':') {
+                break;
+            }
+            second = strtoul(end + 1, &end, 10);
+            if (parsed.kind != FILTER_NONE || first < 2 || first > FILTER_MAX_CIC_RATIO
+                || second < 1 || second > FILTER_MAX_CIC_ORDER) {
+                break;
+            }
+            parsed.kind = FILTER_CIC;
+            parsed.length = (unsigned int)first;
+            parsed.order = (unsigned int)second;
+        } else if (strncmp(cursor, "lp:", 3) == 0) {
+            first = strtoul(cursor + 3, &end, 10);
+            if (end == cursor + 3 || first < 1 || first > FILTER_MAX_LOWPASS_SHIFT) {
+                break;
+            }
+            parsed.lowpass_shift = (unsigned int)first;
+        } else {
+            break;
+        }
+        if (*end == '\0') {
+            *config = parsed;
+            return 0;
+        }
+        if (*end != ',') {
+            break;
+        }
+        cursor = end + 1;
+    }
+    printf("Warning: invalid filter='%s' (avg:<2..%u>, os:<2..%u>, cic:<2..%u>:<1..%u>, lp:<1..%u>,"
+        " e.g. cic:8:3,lp:4), keeping current filter\n", raw_value ? raw_value : "", FILTER_MAX_WINDOW,
+        FILTER_MAX_OVERSAMPLE, FILTER_MAX_CIC_RATIO, FILTER_MAX_CIC_ORDER, FILTER_MAX_LOWPASS_SHIFT);
+    return -1;
+}
+
+static int parse_runtime_options(int argc, char **argv, t_runtime_options *options)
+{
+    options->rate_hz = DEFAULT_RATE_HZ;
+    options->rt_priority = 0;
+    options->lock_memory = 0;
+    options->cpu = -1;
+    options->busy_wait_us = -1;
+    options->fps = DEFAULT_DASHBOARD_FPS;
+    options->history_capacity = DEFAULT_HISTORY_CAPACITY;
+    options->rate_set = 0;
+    options->stream = 0;
+    options->stream_csv = 0;
+    options->stream_mv = 0;
+    options->stream_buffer = DEFAULT_STREAM_BUFFER;
+    options->in_channels = ADS_ALL_CHANNELS;
+    memset(options->in_divisor, 0, sizeof(options->in_divisor));
+    options->record_path = NULL;
+    options->calibration_path = NULL;
+    options->sim_spec = NULL;
+    memset(&options->filter, 0, sizeof(options->filter));
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--help") == 0) {
-            printf("Usage: %s [--delay-us=<microseconds>]\n", argv[0]);
-            printf("  --delay-us      : delay between updates in microseconds (0..%u), default: %u\n",
-                MAX_SAMPLE_DELAY_US, DEFAULT_SAMPLE_DELAY_US);
-            printf("Display cadence is controlled by EQUALIZER_EVERY and HISTORY_EVERY defines in source.\n");
+            printf("Usage: %s [--rate-hz=<Hz>] [--delay-us=<microseconds>] [--rt-priority=<1..99>] [--mlock]\n"
+                "       [--cpu=<core>] [--busy-wait-us=<microseconds>] [--fps=<frames>] [--history=<records>]\n"
+                "       [--stream] [--stream-csv] [--stream-buffer=<scans>] [--in-channels=<list>]\n"
+                "       [--record=<file>] [--filter=<spec>] [--calibration=<file>] [--stream-mv]\n"
+                "       [--sim[=<options>]]\n", argv[0]);
+            printf("  --rate-hz       : update rate on an absolute-deadline clock (0 = free-running, max %u), default: %u\n",
+                MAX_RATE_HZ, DEFAULT_RATE_HZ);
+            printf("  --delay-us      : legacy alias of --rate-hz, period between updates in microseconds (0..%u)\n",
+                MAX_SAMPLE_DELAY_US);
+            printf("  --rt-priority   : run the sample loop with SCHED_FIFO priority (1..99), default: off\n");
+            printf("  --mlock         : lock all pages in RAM (mlockall) to avoid page-fault stalls\n");
+            printf("  --cpu           : pin the process to one CPU core, default: no pinning\n");
+            printf("  --busy-wait-us  : spin this long before each deadline (0..%u), default: %u below %u us periods\n",
+                MAX_BUSY_WAIT_US, AUTO_BUSY_WAIT_US, SHORT_PERIOD_NS / 1000U);
+            printf("  --fps           : dashboard redraw rate of the render thread (0 = no dashboard, max %u), default: %u\n",
+                MAX_DASHBOARD_FPS, DEFAULT_DASHBOARD_FPS);
+            printf("  --history       : history records kept in RAM (%u..%u), default: %u\n",
+                ADS_HISTORY_LINES, MAX_HISTORY_CAPACITY, DEFAULT_HISTORY_CAPACITY);
+            printf("  --stream        : capture thread scans as fast as SPI allows (or at --rate-hz if given)\n");
+            printf("                    into a lock-free ring; display and outputs drain it without blocking capture\n");
+            printf("  --stream-csv    : with --stream, print timestamp_ns and raw codes as CSV on stdout (no dashboard)\n");
+            printf("  --stream-buffer : stream ring capacity in scans, rounded up to a power of two (1024..%u), default: %u\n",
+                MAX_STREAM_BUFFER, DEFAULT_STREAM_BUFFER);
+            printf("  --in-channels   : channels to read, each with an optional /divisor (read every N ticks),\n");
+            printf("                    e.g. 0/1,3,8-11/100, default: 0-15 every %u ticks (every scan in stream mode)\n",
+                EQUALIZER_EVERY);
+            printf("  --record        : with --stream (implied), write raw scans to a binary capture file\n");
+            printf("                    (see capture_tool for info, CSV export, slicing and stats)\n");
+            printf("  --filter        : per-channel fixed-point filter on displayed / CSV values (captures stay raw):\n");
+            printf("                    avg:<N> moving average, os:<N> oversample and decimate by N,\n");
+            printf("                    cic:<R>:<order> CIC decimator, then optional lp:<k> one-pole low-pass\n");
+            printf("                    (y += (x - y) / 2^k), e.g. cic:8:3,lp:4, default: off\n");
+            printf("  --calibration   : per-channel gain/offset or piecewise-linear table file (see README),\n");
+            printf("                    default: nominal 0..%u mV\n", CAL_ADC_FULL_SCALE_MV);
+            printf("  --stream-mv     : like --stream-csv, with calibrated millivolts instead of codes\n");
+            printf("  --sim           : read the simulated MCP3008s instead of /dev/spidev0.x, options\n");
+            printf("                    spi-hz=,loopback=,noise=,pace (see README), default: hardware\n");
+            printf("Default ADC divisor and history cadence are controlled by EQUALIZER_EVERY and HISTORY_EVERY defines in source.\n");
             return 1;
+        } else if (strncmp(argv[i], "--rate-hz=", 10) == 0) {
+            options->rate_hz = (double)parse_u32_or_default(argv[i] + 10, "rate-hz",
+                DEFAULT_RATE_HZ, 0U, MAX_RATE_HZ);
+            options->rate_set = 1;
         } else if (strncmp(argv[i], "--delay-us=", 11) == 0) {
-            *sample_delay_us = parse_u32_or_default(argv[i] + 11, "delay-us",
+            unsigned int delay_us = parse_u32_or_default(argv[i] + 11, "delay-us",
                 DEFAULT_SAMPLE_DELAY_US, 0U, MAX_SAMPLE_DELAY_US);
+
+            options->rate_hz = delay_us ? fmin(1000000.0 / (double)delay_us, (double)MAX_RATE_HZ) : 0.0;
+            options->rate_set = 1;
+        } else if (strncmp(argv[i], "--rt-priority=", 14) == 0) {
+            options->rt_priority = (int)parse_u32_or_default(argv[i] + 14, "rt-priority", 0U, 0U, 99U);
+        } else if (strcmp(argv[i], "--mlock") == 0) {
+            options->lock_memory = 1;
+        } else if (strncmp(argv[i], "--cpu=", 6) == 0) {
+            options->cpu = (int)parse_u32_or_default(argv[i] + 6, "cpu", 0U, 0U, CPU_SETSIZE - 1U);
+        } else if (strncmp(argv[i], "--busy-wait-us=", 15) == 0) {
+            options->busy_wait_us = (int)parse_u32_or_default(argv[i] + 15, "busy-wait-us",
+                AUTO_BUSY_WAIT_US, 0U, MAX_BUSY_WAIT_US);
+        } else if (strncmp(argv[i], "--fps=", 6) == 0) {
+            options->fps = parse_u32_or_default(argv[i] + 6, "fps", DEFAULT_DASHBOARD_FPS, 0U, MAX_DASHBOARD_FPS);
+        } else if (strncmp(argv[i], "--history=", 10) == 0) {
+            options->history_capacity = parse_u32_or_default(argv[i] + 10, "history", DEFAULT_HISTORY_CAPACITY,
+                ADS_HISTORY_LINES, MAX_HISTORY_CAPACITY);
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            options->stream = 1;
+        } else if (strcmp(argv[i], "--stream-csv") == 0) {
+            options->stream = 1;
+            options->stream_csv = 1;
+        } else if (strcmp(argv[i], "--stream-mv") == 0) {
+            options->stream = 1;
+            options->stream_csv = 1;
+            options->stream_mv = 1;
+        } else if (strncmp(argv[i], "--stream-buffer=", 16) == 0) {
+            options->stream_buffer = parse_u32_or_default(argv[i] + 16, "stream-buffer", DEFAULT_STREAM_BUFFER,
+                1024U, MAX_STREAM_BUFFER);
+        } else if (strncmp(argv[i], "--in-channels=", 14) == 0) {
+            parse_channel_schedule(argv[i] + 14, "in-channels", ADS_CHANNEL_COUNT, &options->in_channels,
+                options->in_divisor);
+        } else if (strncmp(argv[i], "--filter=", 9) == 0) {
+            parse_filter_spec(argv[i] + 9, &options->filter);
+        } else if (strncmp(argv[i], "--record=", 9) == 0) {
+            if (argv[i][9] == '\0') {
+                printf("Warning: missing value for record, not recording\n");
+            } else {
+                options->stream = 1;
+                options->record_path = argv[i] + 9;
+            }
+        } else if (strncmp(argv[i], "--calibration=", 14) == 0) {
+            options->calibration_path = argv[i] + 14;
+        } else if (strcmp(argv[i], "--sim") == 0 || strncmp(argv[i], "--sim=", 6) == 0) {
+            options->sim_spec = argv[i][5] == '=' ? argv[i] + 6 : "";
         } else {
             printf("Warning: unknown option '%s' (use --help)\n", argv[i]);
         }
@@ -82,98 +396,249 @@ static int parse_runtime_options(int argc, char **argv, unsigned int *sample_del
     return 0;
 }
 
-static int ads_spi_init(t_ads_spi_ctx *ctx)
+static void apply_realtime_options(const t_runtime_options *options)
 {
-    spi_config_t spi_config;
-
-    memset(ctx, 0, sizeof(*ctx));
-    spi_config.mode = 0;
-    spi_config.speed = 1000000;
-    spi_config.delay = 0;
-    spi_config.bits_per_word = 8;
+    if (options->lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        printf("Warning: mlockall failed: %s\n", strerror(errno));
+    }
+    if (options->cpu >= 0) {
+        cpu_set_t cpu_set;
 
-    ctx->spi0_fd = spi_open("/dev/spidev0.0", spi_config);
-    if (ctx->spi0_fd < 0) {
-        printf("Error: /dev/spidev0.0 unavailable\n");
-        return -1;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(options->cpu, &cpu_set);
+        if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) != 0) {
+            printf("Warning: unable to pin to CPU %d: %s\n", options->cpu, strerror(errno));
+        }
     }
-    ctx->spi1_fd = spi_open("/dev/spidev0.1", spi_config);
-    if (ctx->spi1_fd < 0) {
-        printf("Error: /dev/spidev0.1 unavailable\n");
-        spi_close(ctx->spi0_fd);
-        ctx->spi0_fd = -1;
-        return -1;
+    if (options->rt_priority > 0) {
+        struct sched_param param;
+
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = options->rt_priority;
+        if (sched_setscheduler(0, SCHED_FIFO, &param) != 0) {
+            printf("Warning: unable to set SCHED_FIFO priority %d: %s\n", options->rt_priority, strerror(errno));
+        }
     }
+}
 
-    ctx->ready = 1;
+static int ads_spi_init(t_hat_adc *ctx)
+{
+    static const char *devices[ADS_CHIP_COUNT] = {HAT_SPI0_DEVICE, HAT_SPI1_DEVICE};
+
+    hat_adc_init(ctx, &g_transport, ADS_SPI_SPEED_HZ);
+    for (unsigned int chip = 0; chip < ADS_CHIP_COUNT; chip++) {
+        if (hat_adc_open(ctx, chip, devices[chip]) != 0) {
+            printf("Error: %s unavailable\n", devices[chip]);
+            hat_adc_close(ctx);
+            return -1;
+        }
+    }
     return 0;
 }
 
-static void ads_spi_cleanup(t_ads_spi_ctx *ctx)
+// frac_bits: fractional bits below the 10-bit code (FILTER_FRAC_BITS for filtered values).
+static inline uint32_t ads_code_to_mv(uint8_t channel, uint16_t code, unsigned int frac_bits)
 {
-    if (ctx->spi0_fd >= 0) {
-        spi_close(ctx->spi0_fd);
-        ctx->spi0_fd = -1;
-    }
-    if (ctx->spi1_fd >= 0) {
-        spi_close(ctx->spi1_fd);
-        ctx->spi1_fd = -1;
+    return calibration_adc_mv(&g_calibration, channel, code, frac_bits);
+}
+
+/*
+ * Read the channels in due_mask (one SPI message per MCP3008 that has any) into codes[].
+ * Channels outside due_mask keep their previous code and valid bit.
+ */
+static void ads_capture_snapshot(t_hat_adc *ads_ctx, uint16_t due_mask, uint16_t codes[ADS_CHANNEL_COUNT],
+    uint16_t *valid_mask)
+{
+    int batched = ads_ctx->batched;
+
+    *valid_mask = (uint16_t)((*valid_mask & ~due_mask) | hat_read_channels(ads_ctx, due_mask, codes));
+    if (batched && !ads_ctx->batched) {
+        fprintf(stderr, "Warning: batched SPI scan unsupported (%s), using one transfer per channel\n",
+            strerror(ads_ctx->batch_errno));
     }
-    ctx->ready = 0;
 }
 
-static int ads_read_voltage(t_ads_spi_ctx *ctx, uint8_t channel, float *voltage_value)
+static int filter_enabled(const t_filter_config *config)
 {
-    uint8_t tx_buffer[3] = {0};
-    uint8_t rx_buffer[3] = {0};
-    uint8_t local_channel;
-    int spifd;
+    return config->kind != FILTER_NONE || config->lowpass_shift > 0;
+}
 
-    if (!ctx->ready || channel >= ADS_CHANNEL_COUNT || !voltage_value) {
-        return -1;
+static void filter_bank_init(t_filter_bank *bank, const t_filter_config *config)
+{
+    memset(bank, 0, sizeof(*bank));
+    bank->config = *config;
+    bank->cic_gain = 1;
+    for (unsigned int stage = 0; config->kind == FILTER_CIC && stage < config->order; stage++) {
+        bank->cic_gain *= config->length;
     }
+}
 
-    spifd = (channel < 8) ? ctx->spi0_fd : ctx->spi1_fd;
-    local_channel = (channel < 8) ? channel : (uint8_t)(channel - 8);
+// Divide by a positive integer with rounding: (value + divisor / 2) / divisor.
+static inline uint32_t filter_div_round(uint64_t value, uint64_t divisor)
+{
+    return (uint32_t)((value + divisor / 2U) / divisor);
+}
 
-    tx_buffer[0] = 1;
-    tx_buffer[1] = (uint8_t)((8 + local_channel) << 4);
-    tx_buffer[2] = 0;
+/*
+ * Run one channel over a block of raw codes. Returns the number of outputs written to
+ * out[] (fewer than count when decimating); out_index[] gets the input that produced each.
+ */
+static unsigned int channel_filter_process(t_channel_filter *filter, const t_filter_bank *bank,
+    const uint16_t *codes, unsigned int count, uint16_t *out, uint16_t *out_index)
+{
+    const t_filter_config *config = &bank->config;
+    unsigned int produced = 0;
 
-    if (spi_xfer(spifd, tx_buffer, 3, rx_buffer, 3) < 0) {
-        return -1;
-    }
+    for (unsigned int i = 0; i < count; i++) {
+        uint32_t code = codes[i];
+        uint32_t value;
 
-    *voltage_value = (float)(((rx_buffer[1] & 3) << 8) + rx_buffer[2]) / 1023.0f * 9.9f;
-    return 0;
+        if (config->kind == FILTER_AVERAGE) {
+            // Running sum over a ring of the last N codes; shorter window until it is full.
+            filter->sum += code - filter->window[filter->window_pos];
+            filter->window[filter->window_pos] = (uint16_t)code;
+            filter->window_pos = (filter->window_pos + 1U) % config->length;
+            if (filter->count < config->length) {
+                filter->count++;
+            }
+            value = filter_div_round((uint64_t)filter->sum << FILTER_FRAC_BITS, filter->count);
+        } else if (config->kind == FILTER_OVERSAMPLE) {
+            filter->sum += code;
+            if (++filter->count < config->length) {
+                continue;
+            }
+            value = filter_div_round((uint64_t)filter->sum << FILTER_FRAC_BITS, config->length);
+            filter->sum = 0;
+            filter->count = 0;
+        } else if (config->kind == FILTER_CIC) {
+            // Integrators at the input rate (modulo 2^64 is fine for a CIC), combs at the output rate.
+            uint64_t acc = code;
+
+            for (unsigned int stage = 0; stage < config->order; stage++) {
+                filter->integrator[stage] += acc;
+                acc = filter->integrator[stage];
+            }
+            if (++filter->count < config->length) {
+                continue;
+            }
+            filter->count = 0;
+            for (unsigned int stage = 0; stage < config->order; stage++) {
+                uint64_t delayed = filter->comb[stage];
+
+                filter->comb[stage] = acc;
+                acc -= delayed;
+            }
+            // The first `order` outputs still see the zero initial state.
+            if (filter->warmup < config->order) {
+                filter->warmup++;
+                continue;
+            }
+            value = filter_div_round(acc << FILTER_FRAC_BITS, bank->cic_gain);
+        } else {
+            value = code << FILTER_FRAC_BITS;
+        }
+
+        if (config->lowpass_shift > 0) {
+            int32_t target = (int32_t)(value << FILTER_LOWPASS_EXTRA_BITS);
+
+            if (!filter->lowpass_ready) {
+                filter->lowpass = target;
+                filter->lowpass_ready = 1;
+            }
+            filter->lowpass += (target - filter->lowpass) >> config->lowpass_shift;
+            value = (uint32_t)(filter->lowpass + (1 << (FILTER_LOWPASS_EXTRA_BITS - 1U))) >> FILTER_LOWPASS_EXTRA_BITS;
+        }
+        out[produced] = (uint16_t)value;
+        out_index[produced] = (uint16_t)i;
+        produced++;
+    }
+    return produced;
 }
 
-static void ads_capture_snapshot(t_ads_spi_ctx *ads_ctx, float voltages[ADS_CHANNEL_COUNT],
-    uint8_t valid[ADS_CHANNEL_COUNT])
+/*
+ * Filter a block of scans channel by channel. out[i] keeps the counter and timestamp of
+ * in[i]; its valid_mask holds the channels that produced a filtered value on that scan.
+ */
+static void filter_bank_process(t_filter_bank *bank, const t_history_record *in, unsigned int count,
+    t_history_record *out)
 {
+    uint16_t codes[STREAM_DRAIN_BATCH];
+    uint16_t index[STREAM_DRAIN_BATCH];
+    uint16_t filtered[STREAM_DRAIN_BATCH];
+    uint16_t filtered_index[STREAM_DRAIN_BATCH];
+
+    for (unsigned int i = 0; i < count; i++) {
+        out[i].sample_counter = in[i].sample_counter;
+        out[i].timestamp_ns = in[i].timestamp_ns;
+        out[i].valid_mask = 0;
+    }
     for (uint8_t ch = 0; ch < ADS_CHANNEL_COUNT; ch++) {
-        voltages[ch] = 0.0f;
-        valid[ch] = 0;
-        if (ads_read_voltage(ads_ctx, ch, &voltages[ch]) == 0) {
-            valid[ch] = 1;
+        unsigned int gathered = 0;
+        unsigned int produced;
+
+        for (unsigned int i = 0; i < count; i++) {
+            if (in[i].valid_mask & (1U << ch)) {
+                codes[gathered] = in[i].codes[ch];
+                index[gathered] = (uint16_t)i;
+                gathered++;
+            }
+        }
+        if (gathered == 0) {
+            continue;
+        }
+        produced = channel_filter_process(&bank->channels[ch], bank, codes, gathered, filtered, filtered_index);
+        for (unsigned int k = 0; k < produced; k++) {
+            t_history_record *record = &out[index[filtered_index[k]]];
+
+            record->codes[ch] = filtered[k];
+            record->valid_mask |= (uint16_t)(1U << ch);
         }
     }
 }
 
-static void ads_build_history_line(char *line, size_t line_size, unsigned long sample_counter,
-    const float voltages[ADS_CHANNEL_COUNT], const uint8_t valid[ADS_CHANNEL_COUNT])
+static void format_filter_config(char *text, size_t text_size, const t_filter_config *config)
 {
-    int used = snprintf(line, line_size, "#%08lu", sample_counter);
+    static const char *kinds[] = {"", "avg", "os", "cic"};
+    int used = 0;
 
+    text[0] = '\0';
+    if (config->kind == FILTER_CIC) {
+        used = snprintf(text, text_size, "cic:%u:%u", config->length, config->order);
+    } else if (config->kind != FILTER_NONE) {
+        used = snprintf(text, text_size, "%s:%u", kinds[config->kind], config->length);
+    }
+    if (config->lowpass_shift > 0 && used >= 0 && (size_t)used < text_size) {
+        snprintf(text + used, text_size - (size_t)used, "%slp:%u", used > 0 ? "," : "", config->lowpass_shift);
+    }
+    if (!filter_enabled(config)) {
+        snprintf(text, text_size, "off");
+    }
+}
+
+// A scan is one schedule pass (every scheduled channel read once), or one read call without a schedule.
+static void print_spi_syscall_report(FILE *out, const t_hat_adc *ads_ctx, const t_channel_schedule *schedule)
+{
+    unsigned long scans = schedule ? schedule->passes : ads_ctx->scans;
+
+    fprintf(out, "SPI: %s scans | scans=%lu | conversions=%lu | %.2f syscalls/scan\n",
+        ads_ctx->batched ? "batched" : "per-channel", scans, ads_ctx->conversions,
+        scans ? (double)ads_ctx->syscalls / (double)scans : 0.0);
+}
+
+static void ads_format_history_line(char *line, size_t line_size, const t_history_record *record,
+    unsigned int frac_bits)
+{
+    int used = snprintf(line, line_size, "#%08lu", record->sample_counter);
     if (used < 0 || (size_t)used >= line_size) {
         return;
     }
-
     for (uint8_t ch = 0; ch < ADS_CHANNEL_COUNT; ch++) {
         int written;
+        if (record->valid_mask & (1U << ch)) {
+            uint32_t tenths = (ads_code_to_mv(ch, record->codes[ch], frac_bits) + 50U) / 100U;
 
-        if (valid[ch]) {
-            written = snprintf(line + used, line_size - (size_t)used, " %4.1f", voltages[ch]);
+            // 1 leading space + 4 chars value so it aligns with 4-char equalizer bars.
+            written = snprintf(line + used, line_size - (size_t)used, " %2u.%u", tenths / 10U, tenths % 10U);
         } else {
             written = snprintf(line + used, line_size - (size_t)used, " ERR ");
         }
@@ -184,119 +649,641 @@ static void ads_build_history_line(char *line, size_t line_size, unsigned long s
     }
 }
 
-static void ads_push_history(char history[ADS_HISTORY_LINES][ADS_HISTORY_LINE_LEN],
-    unsigned int *history_count, const char *line)
+/*
+ * Compose the frame into the screen buffer and emit it with one write(). Rows sit at
+ * fixed positions, so only changed text rows and bar cells are redrawn using cursor
+ * addressing; a full repaint every SCREEN_REPAINT_EVERY frames heals stray output.
+ */
+static void ads_render_dashboard(t_screen *screen, const t_history_record *history,
+    unsigned int history_count, const t_dashboard_snapshot *snapshot, const t_runtime_options *options)
+{
+    char line[SCREEN_LINE_LEN];
+    char filter_text[48];
+    unsigned int frac_bits = filter_enabled(&options->filter) ? FILTER_FRAC_BITS : 0;
+    int row = 0;
+
+    if ((screen->frames++ % SCREEN_REPAINT_EVERY) == 0) {
+        screen->drawn = 0;
+    }
+    if (!screen->drawn) {
+        int used;
+
+        screen_append(screen, "\033[H\033[2J", 7);
+        for (int eq_row = 0; eq_row < EQ_ROWS; eq_row++) {
+            screen_move(screen, SCREEN_EQ_ROW + (EQ_ROWS - 1 - eq_row), 0);
+            used = snprintf(line, sizeof(line), "%2dV", (eq_row + 1) * 2);
+            screen_append(screen, line, (size_t)used);
+        }
+        used = snprintf(line, sizeof(line), "%*s", EQ_LABEL_WIDTH, "");
+        for (uint8_t ch = 0; ch < ADS_CHANNEL_COUNT; ch++) {
+            used += snprintf(line + used, sizeof(line) - (size_t)used, " %4u", ch);
+        }
+        screen_move(screen, SCREEN_EQ_ROW + EQ_ROWS, 0);
+        screen_append(screen, line, (size_t)used);
+    }
+
+    screen_set_line(screen, row++, "=== ADS input monitor ===");
+    if (options->stream) {
+        snprintf(line, sizeof(line), "Config: stream | rate=%.0f Hz (0 = free-running) | history every %llu ms | fps=%u",
+            options->rate_set ? options->rate_hz : 0.0,
+            (unsigned long long)(STREAM_HISTORY_PERIOD_NS / 1000000ULL), options->fps);
+    } else {
+        snprintf(line, sizeof(line), "Config: rate=%.0f Hz | eq-every=%u | history-every=%u | fps=%u",
+            options->rate_hz, EQUALIZER_EVERY, HISTORY_EVERY, options->fps);
+    }
+    screen_set_line(screen, row++, line);
+    format_filter_config(filter_text, sizeof(filter_text), &options->filter);
+    if (options->stream) {
+        snprintf(line, sizeof(line), "Stream: scans=%lu | dropped=%lu | channels=0x%04x | filter=%s",
+            snapshot->ticks, snapshot->dropped, options->in_channels, filter_text);
+    } else {
+        snprintf(line, sizeof(line), "Clock: ticks=%lu | overruns=%lu | missed periods=%lu | filter=%s",
+            snapshot->ticks, snapshot->overruns, snapshot->missed_periods, filter_text);
+    }
+    screen_set_line(screen, row++, line);
+    screen_set_line(screen, row++, g_calibration.adc_calibrated ? "ADS voltage history (V, calibrated):"
+        : "ADS voltage history (V):");
+    for (unsigned int i = 0; i < ADS_HISTORY_LINES; i++) {
+        line[0] = '\0';
+        if (i < history_count) {
+            ads_format_history_line(line, sizeof(line), &history[i], frac_bits);
+        }
+        screen_set_line(screen, row++, line);
+    }
+
+    for (int eq_row = 0; eq_row < EQ_ROWS; eq_row++) {
+        for (uint8_t ch = 0; ch < ADS_CHANNEL_COUNT; ch++) {
+            int steps = (snapshot->valid_mask & (1U << ch))
+                ? mv_to_equalizer_steps(ads_code_to_mv(ch, snapshot->codes[ch], frac_bits)) : 0;
+            int cell = steps - (eq_row * EQ_STEPS_PER_ROW);
+
+            if (cell < 0) {
+                cell = 0;
+            } else if (cell > EQ_STEPS_PER_ROW) {
+                cell = EQ_STEPS_PER_ROW;
+            }
+            screen_set_cell(screen, SCREEN_EQ_ROW, eq_row, ch, (uint8_t)cell);
+        }
+    }
+    screen_move(screen, SCREEN_EQ_ROW + EQ_ROWS + 1, 0);
+    screen_flush(screen);
+}
+
+static void dashboard_fill_snapshot(t_dashboard_snapshot *snapshot, unsigned long sample_counter,
+    const uint16_t codes[ADS_CHANNEL_COUNT], uint16_t valid_mask, const t_sample_clock *sample_clock)
 {
-    if (*history_count < ADS_HISTORY_LINES) {
-        snprintf(history[*history_count], ADS_HISTORY_LINE_LEN, "%s", line);
-        (*history_count)++;
+    snapshot->sample_counter = sample_counter;
+    memcpy(snapshot->codes, codes, sizeof(snapshot->codes));
+    snapshot->valid_mask = valid_mask;
+    snapshot->ticks = sample_clock->ticks;
+    snapshot->overruns = sample_clock->overruns;
+    snapshot->missed_periods = sample_clock->missed_periods;
+    snapshot->dropped = 0;
+}
+
+static void *dashboard_thread(void *arg)
+{
+    t_dashboard_ctx *dashboard = (t_dashboard_ctx *)arg;
+    t_history_record history[ADS_HISTORY_LINES];
+    unsigned int history_count;
+    t_dashboard_snapshot snapshot;
+    static t_screen screen;
+    uint64_t frame_ns = 1000000000ULL / dashboard->options->fps;
+    uint64_t next_ns = monotonic_ns();
+
+    while (atomic_load_explicit(&dashboard->running, memory_order_acquire)) {
+        if (seqlock_read_latest(&dashboard->seq, &dashboard->latest, &snapshot, sizeof(snapshot))) {
+            history_count = history_ring_latest(&dashboard->history, history, ADS_HISTORY_LINES);
+            ads_render_dashboard(&screen, history, history_count, &snapshot, dashboard->options);
+        }
+
+        // Fixed frame rate; a slow terminal drops frames instead of queueing them.
+        next_ns += frame_ns;
+        if (next_ns < monotonic_ns()) {
+            next_ns = monotonic_ns();
+        }
+        sleep_until_ns(next_ns);
+    }
+    return NULL;
+}
+
+static void dashboard_start(t_dashboard_ctx *dashboard, const t_runtime_options *options)
+{
+    int err;
+
+    memset(dashboard, 0, sizeof(*dashboard));
+    dashboard->options = options;
+    if (options->fps == 0) {
         return;
     }
+    if (history_ring_init(&dashboard->history, options->history_capacity, sizeof(t_history_record)) != 0) {
+        printf("Warning: unable to allocate %u history records, history disabled\n", options->history_capacity);
+    }
+    atomic_store(&dashboard->running, 1);
+    err = pthread_create(&dashboard->thread, NULL, dashboard_thread, dashboard);
+    if (err != 0) {
+        printf("Warning: unable to start dashboard thread: %s\n", strerror(err));
+        atomic_store(&dashboard->running, 0);
+        history_ring_free(&dashboard->history);
+    }
+}
 
-    for (unsigned int i = 1; i < ADS_HISTORY_LINES; i++) {
-        snprintf(history[i - 1], ADS_HISTORY_LINE_LEN, "%s", history[i]);
+static void dashboard_stop(t_dashboard_ctx *dashboard)
+{
+    if (!atomic_load(&dashboard->running)) {
+        return;
     }
-    snprintf(history[ADS_HISTORY_LINES - 1], ADS_HISTORY_LINE_LEN, "%s", line);
+    atomic_store(&dashboard->running, 0);
+    pthread_join(dashboard->thread, NULL);
+    history_ring_free(&dashboard->history);
 }
 
-static int voltage_to_equalizer_steps(float voltage)
+static int stream_init(t_stream_ctx *stream, unsigned int capacity)
 {
-    double scaled;
+    unsigned int rounded = 1U;
 
-    if (voltage < 0.0f) {
-        voltage = 0.0f;
-    } else if (voltage > 10.0f) {
-        voltage = 10.0f;
+    memset(stream, 0, sizeof(*stream));
+    while (rounded < capacity) {
+        rounded <<= 1;
     }
+    stream->samples = calloc(rounded, sizeof(*stream->samples));
+    if (!stream->samples) {
+        printf("Error: unable to allocate %u stream scans\n", rounded);
+        return -1;
+    }
+    // Touch every page now so the capture thread never takes a page fault on a fresh slot.
+    memset(stream->samples, 0, (size_t)rounded * sizeof(*stream->samples));
+    stream->capacity = rounded;
+    atomic_store(&stream->head, 0);
+    return 0;
+}
+
+static void *stream_capture_thread(void *arg)
+{
+    t_stream_ctx *stream = (t_stream_ctx *)arg;
+    const t_runtime_options *options = stream->options;
+
+    // Real-time settings apply to this thread only: the consumers stay SCHED_OTHER.
+    apply_realtime_options(options);
+    sample_clock_init(&stream->clock, options->rate_set ? options->rate_hz : 0.0, options->busy_wait_us);
+    while (atomic_load_explicit(&stream->running, memory_order_relaxed) && g_keep_running) {
+        uint16_t due = channel_schedule_next(&stream->schedule);
 
-    scaled = ((double)voltage / 10.0) * (double)(EQ_ROWS * EQ_STEPS_PER_ROW);
-    return (int)lround(scaled);
+        // Ticks where no channel is due cost no bus time and produce no scan.
+        if (due != 0) {
+            unsigned long head = atomic_load_explicit(&stream->head, memory_order_relaxed);
+            t_history_record *slot = &stream->samples[head & (stream->capacity - 1U)];
+            uint64_t start_ns = monotonic_ns();
+
+            slot->sample_counter = head;
+            slot->timestamp_ns = start_ns;
+            slot->valid_mask = 0;
+            ads_capture_snapshot(stream->ads_ctx, due, slot->codes, &slot->valid_mask);
+            if (slot->valid_mask != due) {
+                atomic_fetch_add_explicit(&stream->scan_errors, 1UL, memory_order_relaxed);
+            }
+            atomic_store_explicit(&stream->head, head + 1UL, memory_order_release);
+            stage_mark(&g_stage_hist[STAGE_SPI], start_ns);
+        }
+        sample_clock_wait(&stream->clock);
+        atomic_store_explicit(&stream->ticks, stream->clock.ticks, memory_order_relaxed);
+        atomic_store_explicit(&stream->overruns, stream->clock.overruns, memory_order_relaxed);
+        atomic_store_explicit(&stream->missed_periods, stream->clock.missed_periods, memory_order_relaxed);
+    }
+    return NULL;
 }
 
-static void ads_render_dashboard(const char history[ADS_HISTORY_LINES][ADS_HISTORY_LINE_LEN],
-    unsigned int history_count, const float voltages[ADS_CHANNEL_COUNT], const uint8_t valid[ADS_CHANNEL_COUNT],
-    unsigned int sample_delay_us)
+// Clock counters of the capture thread as last published, for the dashboard and reports.
+static void stream_clock_snapshot(const t_stream_ctx *stream, t_sample_clock *clock)
 {
-    static const char *blocks[EQ_STEPS_PER_ROW + 1] = {" ", "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"};
+    memset(clock, 0, sizeof(*clock));
+    clock->ticks = atomic_load_explicit(&stream->ticks, memory_order_relaxed);
+    clock->overruns = atomic_load_explicit(&stream->overruns, memory_order_relaxed);
+    clock->missed_periods = atomic_load_explicit(&stream->missed_periods, memory_order_relaxed);
+}
 
-    printf("\033[H\033[J");
-    printf("=== ADS input monitor ===\n");
-    printf("Config: delay=%u us | eq-every=%u | history-every=%u\n",
-        sample_delay_us, EQUALIZER_EVERY, HISTORY_EVERY);
-    printf("ADS voltage history (V):\n");
+/*
+ * Copy up to max_scans scans after the reader's cursor. The capture thread never waits
+ * for readers: a reader that falls more than one ring behind skips ahead and counts the
+ * scans it lost, and scans overwritten while they were copied are dropped the same way.
+ */
+static unsigned int stream_read(t_stream_ctx *stream, t_stream_reader *reader, t_history_record *out,
+    unsigned int max_scans)
+{
+    unsigned long head = atomic_load_explicit(&stream->head, memory_order_acquire);
+    unsigned long end;
+    unsigned long stale = 0;
+    unsigned int count;
 
-    for (unsigned int i = 0; i < history_count; i++) {
-        printf("%s\n", history[i]);
+    // Keep one slot of margin: the writer may already be filling index head.
+    if (head - reader->cursor >= stream->capacity) {
+        reader->dropped += head - reader->cursor - (stream->capacity - 1U);
+        reader->cursor = head - (stream->capacity - 1U);
+    }
+    count = (head - reader->cursor < max_scans) ? (unsigned int)(head - reader->cursor) : max_scans;
+    for (unsigned int i = 0; i < count; i++) {
+        out[i] = stream->samples[(reader->cursor + i) & (stream->capacity - 1U)];
+    }
+    atomic_thread_fence(memory_order_acquire);
+    end = atomic_load_explicit(&stream->head, memory_order_relaxed);
+    if (end - reader->cursor >= stream->capacity) {
+        stale = end - reader->cursor - stream->capacity + 1U;
+        if (stale > count) {
+            stale = count;
+        }
+        memmove(out, out + stale, (size_t)(count - stale) * sizeof(*out));
     }
+    reader->dropped += stale;
+    reader->cursor += count;
+    return count - (unsigned int)stale;
+}
 
-    for (int row = EQ_ROWS - 1; row >= 0; row--) {
-        printf("%2dV%6s", (row + 1) * 2, "");
-        for (uint8_t ch = 0; ch < ADS_CHANNEL_COUNT; ch++) {
-            int steps = valid[ch] ? voltage_to_equalizer_steps(voltages[ch]) : 0;
-            int cell = steps - (row * EQ_STEPS_PER_ROW);
+// frac_bits > 0 prints filtered values as code.fraction, e.g. 512.250; millivolts prints calibrated mV.
+static size_t stream_format_csv(char *line, size_t line_size, const t_history_record *scan, uint16_t channel_mask,
+    unsigned int frac_bits, int millivolts)
+{
+    int used = snprintf(line, line_size, "%llu", (unsigned long long)scan->timestamp_ns);
 
-            if (cell < 0) {
-                cell = 0;
-            } else if (cell > EQ_STEPS_PER_ROW) {
-                cell = EQ_STEPS_PER_ROW;
+    for (uint8_t ch = 0; ch < ADS_CHANNEL_COUNT && used > 0 && (size_t)used < line_size; ch++) {
+        if (!(channel_mask & (1U << ch))) {
+            continue;
+        }
+        if ((scan->valid_mask & (1U << ch)) && millivolts) {
+            used += snprintf(line + used, line_size - (size_t)used, ",%u", ads_code_to_mv(ch, scan->codes[ch], frac_bits));
+        } else if ((scan->valid_mask & (1U << ch)) && frac_bits > 0) {
+            unsigned int fraction = ((scan->codes[ch] & ((1U << frac_bits) - 1U)) * 1000U + (1U << (frac_bits - 1U)))
+                >> frac_bits;
+
+            used += snprintf(line + used, line_size - (size_t)used, ",%u.%03u", scan->codes[ch] >> frac_bits, fraction);
+        } else if (scan->valid_mask & (1U << ch)) {
+            used += snprintf(line + used, line_size - (size_t)used, ",%u", scan->codes[ch]);
+        } else {
+            used += snprintf(line + used, line_size - (size_t)used, ",");
+        }
+    }
+    if (used < 0 || (size_t)used >= line_size - 1U) {
+        return 0;
+    }
+    line[used++] = '\n';
+    return (size_t)used;
+}
+
+static void print_stream_report(FILE *out, const t_stream_ctx *stream, const t_stream_reader *reader,
+    uint64_t elapsed_ns)
+{
+    unsigned long scans = atomic_load(&stream->head);
+
+    fprintf(out, "Stream: scans=%lu | %.0f scans/s | ring=%u scans | dropped=%lu | scan errors=%lu\n",
+        scans, elapsed_ns ? (double)scans * 1e9 / (double)elapsed_ns : 0.0, stream->capacity,
+        reader->dropped, atomic_load_explicit(&stream->scan_errors, memory_order_relaxed));
+    fflush(out);
+}
+
+// Drain the ring into the capture file until stopped, then flush what the capture thread left.
+static void *stream_recorder_thread(void *arg)
+{
+    t_stream_recorder *recorder = (t_stream_recorder *)arg;
+    uint16_t channel_mask = recorder->writer.header.channel_mask;
+    int draining = 1;
+
+    while (draining && !recorder->failed) {
+        int running = atomic_load_explicit(&recorder->running, memory_order_acquire);
+        unsigned int count = stream_read(recorder->stream, &recorder->reader, recorder->batch, STREAM_DRAIN_BATCH);
+
+        for (unsigned int i = 0; i < count; i++) {
+            const t_history_record *scan = &recorder->batch[i];
+            uint16_t codes[CAPTURE_MAX_CHANNELS];
+            unsigned int used = 0;
+
+            for (uint8_t ch = 0; ch < ADS_CHANNEL_COUNT; ch++) {
+                if (channel_mask & (1U << ch)) {
+                    codes[used++] = (scan->valid_mask & (1U << ch)) ? scan->codes[ch] : CAPTURE_CODE_INVALID;
+                }
+            }
+            if (capture_writer_append(&recorder->writer, scan->timestamp_ns, codes) != 0) {
+                fprintf(stderr, "Error: capture write failed: %s\n", strerror(errno));
+                recorder->failed = 1;
+                g_keep_running = 0;
+                break;
             }
+        }
+        if (count < STREAM_DRAIN_BATCH) {
+            struct timespec poll = {0, (long)STREAM_POLL_NS};
 
-            printf(" ");
-            for (int w = 0; w < EQ_BAR_WIDTH; w++) {
-                printf("%s", blocks[cell]);
+            // running was sampled before the read, so an empty read after stop means fully drained.
+            draining = running || count > 0;
+            if (draining) {
+                nanosleep(&poll, NULL);
+            }
+        }
+    }
+    return NULL;
+}
+
+static int stream_recorder_start(t_stream_recorder *recorder, t_stream_ctx *stream, const char *path,
+    uint16_t channel_mask, double rate_hz, uint64_t start_ns)
+{
+    t_capture_header header;
+    int err;
+
+    capture_header_init(&header, channel_mask, rate_hz, CAL_ADC_FULL_SCALE_MV * 1000U, start_ns);
+    if (capture_writer_open(&recorder->writer, path, &header) != 0) {
+        printf("Error: unable to create capture file '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    recorder->stream = stream;
+    recorder->reader.cursor = 0;
+    recorder->reader.dropped = 0;
+    recorder->failed = 0;
+    atomic_store(&recorder->running, 1);
+    err = pthread_create(&recorder->thread, NULL, stream_recorder_thread, recorder);
+    if (err != 0) {
+        printf("Error: unable to start recorder thread: %s\n", strerror(err));
+        capture_writer_close(&recorder->writer);
+        return -1;
+    }
+    return 0;
+}
+
+// Call after the capture thread has stopped so the recorder can drain the ring completely.
+static void stream_recorder_stop(t_stream_recorder *recorder, FILE *out, const char *path)
+{
+    atomic_store_explicit(&recorder->running, 0, memory_order_release);
+    pthread_join(recorder->thread, NULL);
+    recorder->writer.header.dropped_scans = recorder->reader.dropped;
+    if (capture_writer_close(&recorder->writer) != 0) {
+        fprintf(out, "Error: unable to finish capture file '%s': %s\n", path, strerror(errno));
+        return;
+    }
+    fprintf(out, "Capture: %s | scans=%llu | blocks=%llu | dropped=%lu | %.0f scans/s\n", path,
+        (unsigned long long)recorder->writer.header.scan_count,
+        (unsigned long long)recorder->writer.header.block_count, recorder->reader.dropped,
+        recorder->writer.header.measured_rate_hz);
+}
+
+/*
+ * --stream: a capture thread (pinned / SCHED_FIFO when requested) scans back to back
+ * into the ring; this thread drains it in batches and feeds the dashboard or CSV output.
+ */
+static int run_stream_mode(const t_runtime_options *options, t_hat_adc *ads_ctx)
+{
+    static t_stream_ctx stream;
+    static t_stream_recorder recorder;
+    static t_dashboard_ctx dashboard;
+    static t_history_record batch[STREAM_DRAIN_BATCH];
+    static t_history_record filtered[STREAM_DRAIN_BATCH];
+    static t_filter_bank filter_bank;
+    static char csv_buffer[STREAM_DRAIN_BATCH * STREAM_CSV_LINE_LEN];
+    t_stream_reader reader = {0, 0};
+    t_dashboard_snapshot snapshot;
+    t_sample_clock clock;
+    t_runtime_options dashboard_options = *options;
+    t_history_record held;
+    uint64_t start_ns;
+    uint64_t next_history_ns = 0;
+    int filtering = filter_enabled(&options->filter);
+    unsigned int frac_bits = filtering ? FILTER_FRAC_BITS : 0;
+    int err;
+
+    if (stream_init(&stream, options->stream_buffer) != 0) {
+        return 1;
+    }
+    stream.ads_ctx = ads_ctx;
+    stream.options = options;
+    channel_schedule_init(&stream.schedule, options->in_channels, options->in_divisor, 1U);
+    filter_bank_init(&filter_bank, &options->filter);
+    memset(&held, 0, sizeof(held));
+    if (options->stream_csv) {
+        // stdout carries the data, so no dashboard.
+        dashboard_options.fps = 0;
+        printf("timestamp_ns");
+        for (uint8_t ch = 0; ch < ADS_CHANNEL_COUNT; ch++) {
+            if (options->in_channels & (1U << ch)) {
+                printf(options->stream_mv ? ",ch%u_mv" : ",ch%u", ch);
             }
         }
         printf("\n");
+        fflush(stdout);
+    }
+    start_ns = monotonic_ns();
+    if (options->record_path && stream_recorder_start(&recorder, &stream, options->record_path,
+            options->in_channels, options->rate_set ? options->rate_hz : 0.0, start_ns) != 0) {
+        free(stream.samples);
+        return 1;
     }
+    dashboard_start(&dashboard, &dashboard_options);
 
-    printf("%9s", "");
-    for (uint8_t ch = 0; ch < ADS_CHANNEL_COUNT; ch++) {
-        printf(" %4u", ch);
+    atomic_store(&stream.running, 1);
+    err = pthread_create(&stream.thread, NULL, stream_capture_thread, &stream);
+    if (err != 0) {
+        printf("Error: unable to start capture thread: %s\n", strerror(err));
+        dashboard_stop(&dashboard);
+        if (options->record_path) {
+            stream_recorder_stop(&recorder, stdout, options->record_path);
+        }
+        free(stream.samples);
+        return 1;
+    }
+
+    while (g_keep_running) {
+        unsigned int count = stream_read(&stream, &reader, batch, STREAM_DRAIN_BATCH);
+        const t_history_record *shown = batch;
+        size_t csv_len = 0;
+
+        // Filters run here, off the capture thread; the recorder already has the raw scans.
+        if (filtering && count > 0) {
+            filter_bank_process(&filter_bank, batch, count, filtered);
+            shown = filtered;
+        }
+        for (unsigned int i = 0; i < count && options->stream_csv; i++) {
+            if (filtering && shown[i].valid_mask == 0) {
+                // Decimated away on every channel.
+                continue;
+            }
+            csv_len += stream_format_csv(csv_buffer + csv_len, sizeof(csv_buffer) - csv_len, &shown[i],
+                options->in_channels, frac_bits, options->stream_mv);
+        }
+        if (csv_len > 0 && fwrite(csv_buffer, 1, csv_len, stdout) != csv_len) {
+            // Closed pipe or full disk: stop instead of spinning.
+            g_keep_running = 0;
+        }
+        for (unsigned int i = 0; i < count && dashboard_options.fps > 0; i++) {
+            // Slow channels are not in every scan: the display holds each channel's last reading.
+            for (uint8_t ch = 0; ch < ADS_CHANNEL_COUNT; ch++) {
+                if (shown[i].valid_mask & (1U << ch)) {
+                    held.codes[ch] = shown[i].codes[ch];
+                }
+            }
+            held.valid_mask |= shown[i].valid_mask;
+            held.sample_counter = shown[i].sample_counter;
+            held.timestamp_ns = shown[i].timestamp_ns;
+        }
+        if (count > 0 && dashboard_options.fps > 0) {
+            stream_clock_snapshot(&stream, &clock);
+            dashboard_fill_snapshot(&snapshot, held.sample_counter, held.codes, held.valid_mask, &clock);
+            snapshot.dropped = reader.dropped;
+            seqlock_publish(&dashboard.seq, &dashboard.latest, &snapshot, sizeof(snapshot));
+            if (held.timestamp_ns >= next_history_ns) {
+                history_ring_push(&dashboard.history, &held);
+                next_history_ns = held.timestamp_ns + STREAM_HISTORY_PERIOD_NS;
+            }
+        }
+        if (g_stats_requested) {
+            g_stats_requested = 0;
+            print_stream_report(stderr, &stream, &reader, monotonic_ns() - start_ns);
+            stream_clock_snapshot(&stream, &clock);
+            print_latency_report(stderr, g_stage_hist, g_stage_names, STAGE_COUNT, &clock);
+        }
+        if (count < STREAM_DRAIN_BATCH) {
+            struct timespec poll = {0, (long)STREAM_POLL_NS};
+
+            nanosleep(&poll, NULL);
+        }
     }
-    printf("\n");
+
+    atomic_store(&stream.running, 0);
+    pthread_join(stream.thread, NULL);
+    dashboard_stop(&dashboard);
     fflush(stdout);
+    if (options->record_path) {
+        stream_recorder_stop(&recorder, options->stream_csv ? stderr : stdout, options->record_path);
+    }
+    print_stream_report(options->stream_csv ? stderr : stdout, &stream, &reader, monotonic_ns() - start_ns);
+    print_channel_schedule(options->stream_csv ? stderr : stdout, "ADC", &stream.schedule,
+        options->rate_set ? options->rate_hz : 0.0);
+    print_spi_syscall_report(options->stream_csv ? stderr : stdout, ads_ctx, &stream.schedule);
+    stream_clock_snapshot(&stream, &clock);
+    print_latency_report(options->stream_csv ? stderr : stdout, g_stage_hist, g_stage_names, STAGE_COUNT, &clock);
+    hat_transport_report(options->stream_csv ? stderr : stdout, &g_transport);
+    free(stream.samples);
+    return recorder.failed ? 1 : 0;
 }
 
 int main(int argc, char **argv)
 {
-    unsigned int sample_delay_us;
+    t_runtime_options options;
+    t_sample_clock sample_clock;
     unsigned long sample_counter = 0;
-    char ads_history[ADS_HISTORY_LINES][ADS_HISTORY_LINE_LEN] = {{0}};
-    unsigned int ads_history_count = 0;
-    char history_line[ADS_HISTORY_LINE_LEN] = {0};
-    float ads_voltages[ADS_CHANNEL_COUNT] = {0.0f};
-    uint8_t ads_valid[ADS_CHANNEL_COUNT] = {0};
-    t_ads_spi_ctx ads_ctx;
+    static t_dashboard_ctx dashboard;
+    t_dashboard_snapshot snapshot;
+    uint16_t ads_codes[ADS_CHANNEL_COUNT] = {0};
+    uint16_t ads_valid_mask = 0;
+    t_history_record history_record;
+    t_hat_adc ads_ctx;
+    t_channel_schedule in_schedule;
+    static t_filter_bank filter_bank;
+    int filtering;
     int parse_status;
 
-    parse_status = parse_runtime_options(argc, argv, &sample_delay_us);
+    parse_status = parse_runtime_options(argc, argv, &options);
     if (parse_status > 0) {
         return 0;
     }
+    calibration_init_nominal(&g_calibration);
+    if (options.calibration_path) {
+        char error[256];
+
+        if (calibration_load(&g_calibration, options.calibration_path, error, sizeof(error)) != 0) {
+            printf("Error: calibration %s\n", error);
+            return 1;
+        }
+        // Keep stdout clean for CSV.
+        fprintf(options.stream_csv ? stderr : stdout, "Calibration: %s (inputs 0x%04x)\n",
+            options.calibration_path, g_calibration.adc_calibrated);
+    }
+    {
+        char error[256];
+
+        if (hat_transport_init(&g_transport, options.sim_spec, error, sizeof(error)) != 0) {
+            printf("Error: --sim %s\n", error);
+            return 1;
+        }
+    }
+    if (g_transport.simulated) {
+        fprintf(options.stream_csv ? stderr : stdout, "Transport: simulated hat (no SPI access)\n");
+    }
 
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
+    signal(SIGUSR1, stats_signal_handler);
 
     if (ads_spi_init(&ads_ctx) != 0) {
         return 1;
     }
+    if (options.stream) {
+        int status = run_stream_mode(&options, &ads_ctx);
 
+        hat_adc_close(&ads_ctx);
+        if (!options.stream_csv) {
+            printf("Stopped.\n");
+        }
+        return status;
+    }
+
+    // Start the renderer before raising priority so it stays SCHED_OTHER and unpinned.
+    dashboard_start(&dashboard, &options);
+    apply_realtime_options(&options);
+    channel_schedule_init(&in_schedule, options.in_channels, options.in_divisor, EQUALIZER_EVERY);
+    filter_bank_init(&filter_bank, &options.filter);
+    filtering = filter_enabled(&options.filter);
+    sample_clock_init(&sample_clock, options.rate_hz, options.busy_wait_us);
     while (g_keep_running) {
-        if ((sample_counter % EQUALIZER_EVERY) == 0) {
-            ads_capture_snapshot(&ads_ctx, ads_voltages, ads_valid);
-            if ((sample_counter % HISTORY_EVERY) == 0) {
-                ads_build_history_line(history_line, sizeof(history_line), sample_counter, ads_voltages, ads_valid);
-                ads_push_history(ads_history, &ads_history_count, history_line);
+        uint64_t loop_start_ns = monotonic_ns();
+        uint64_t stage_ns = loop_start_ns;
+        uint16_t due = channel_schedule_next(&in_schedule);
+
+        if (due != 0 && !filtering) {
+            ads_capture_snapshot(&ads_ctx, due, ads_codes, &ads_valid_mask);
+            stage_ns = stage_mark(&g_stage_hist[STAGE_SPI], stage_ns);
+        } else if (due != 0) {
+            t_history_record scan = {sample_counter, 0, {0}, 0};
+            t_history_record output;
+
+            ads_capture_snapshot(&ads_ctx, due, scan.codes, &scan.valid_mask);
+            stage_ns = stage_mark(&g_stage_hist[STAGE_SPI], stage_ns);
+            // Only this tick's conversions go through the filters; a failed read shows ERR.
+            filter_bank_process(&filter_bank, &scan, 1, &output);
+            for (uint8_t ch = 0; ch < ADS_CHANNEL_COUNT; ch++) {
+                if (output.valid_mask & (1U << ch)) {
+                    ads_codes[ch] = output.codes[ch];
+                }
             }
-            ads_render_dashboard(ads_history, ads_history_count, ads_voltages, ads_valid,
-                sample_delay_us);
+            ads_valid_mask = (uint16_t)((ads_valid_mask & ~(due & ~scan.valid_mask)) | output.valid_mask);
+            stage_ns = stage_mark(&g_stage_hist[STAGE_FILTER], stage_ns);
+        }
+        if (due != 0 && options.fps > 0) {
+            dashboard_fill_snapshot(&snapshot, sample_counter, ads_codes, ads_valid_mask, &sample_clock);
+            seqlock_publish(&dashboard.seq, &dashboard.latest, &snapshot, sizeof(snapshot));
+            stage_ns = stage_mark(&g_stage_hist[STAGE_PUBLISH], stage_ns);
         }
+        if (options.fps > 0 && (sample_counter % HISTORY_EVERY) == 0) {
+            history_record.sample_counter = sample_counter;
+            history_record.timestamp_ns = stage_ns;
+            memcpy(history_record.codes, ads_codes, sizeof(history_record.codes));
+            history_record.valid_mask = ads_valid_mask;
+            history_ring_push(&dashboard.history, &history_record);
+        }
+        if (g_stats_requested) {
+            g_stats_requested = 0;
+            print_latency_report(stderr, g_stage_hist, g_stage_names, STAGE_COUNT, &sample_clock);
+        }
+        stage_mark(&g_stage_hist[STAGE_LOOP], loop_start_ns);
 
         sample_counter++;
-        delay_microseconds(sample_delay_us);
+        sample_clock_wait(&sample_clock);
+        // A stop request can end the wait before the deadline; do not record that as jitter.
+        if (sample_clock.period_ns > 0 && g_keep_running) {
+            hist_record(&g_stage_hist[STAGE_WAKEUP], monotonic_ns() - sample_clock.deadline_ns);
+        }
     }
 
-    ads_spi_cleanup(&ads_ctx);
+    dashboard_stop(&dashboard);
+    print_channel_schedule(stdout, "ADC", &in_schedule, options.rate_hz);
+    print_spi_syscall_report(stdout, &ads_ctx, &in_schedule);
+    hat_adc_close(&ads_ctx);
+    print_sample_clock_report(&sample_clock);
+    print_latency_report(stdout, g_stage_hist, g_stage_names, STAGE_COUNT, &sample_clock);
+    hat_transport_report(stdout, &g_transport);
     printf("Stopped.\n");
     return 0;
 }
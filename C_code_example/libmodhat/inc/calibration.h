@@ -0,0 +1,319 @@
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/*
+ * Per-channel calibration of the MCP3008 inputs and MCP4728 outputs, including the
+ * LM324 scaling stages. Every channel gets a code -> millivolt table built once from
+ * the nominal full scale or from a calibration file, so the sample path only does
+ * integer lookups.
+ *
+ * Calibration file (text, '#' starts a comment, one rule per line, later lines win):
+ *
+ *   <adc|dac> <channels> gain=<g> offset=<mV>           mV = nominal(code) * g + offset
+ *   <adc|dac> <channels> <code>:<mV> <code>:<mV> ...    piecewise linear, codes ascending
+ *
+ * <channels> is "all" or a list such as "0,3,8-11". Outside the first and last points
+ * the end segments are extrapolated. Results are clamped to 0..65535 mV.
+ */
+#define CAL_ADC_CHANNELS 16
+#define CAL_DAC_CHANNELS 8
+#define CAL_ADC_CODES 1024U
+#define CAL_DAC_CODES 4096U
+#define CAL_ADC_FULL_SCALE_MV 9900U
+#define CAL_DAC_FULL_SCALE_MV 10000U
+#define CAL_MAX_POINTS 32
+#define CAL_LINE_LEN 512
+
+typedef struct s_calibration {
+    uint16_t adc_mv[CAL_ADC_CHANNELS][CAL_ADC_CODES];
+    uint16_t dac_mv[CAL_DAC_CHANNELS][CAL_DAC_CODES];
+    uint16_t adc_calibrated;
+    uint8_t dac_calibrated;
+}   t_calibration;
+
+typedef struct s_calibration_point {
+    int32_t code;
+    int32_t mv;
+}   t_calibration_point;
+
+// Fill one table by linear interpolation between points (at least two, codes ascending).
+static inline void calibration_fill_table(uint16_t *table, unsigned int code_count,
+    const t_calibration_point *points, unsigned int point_count)
+{
+    unsigned int segment = 0;
+
+    for (unsigned int code = 0; code < code_count; code++) {
+        const t_calibration_point *a;
+        const t_calibration_point *b;
+        int64_t mv;
+
+        while (segment + 2U < point_count && (int32_t)code > points[segment + 1U].code) {
+            segment++;
+        }
+        a = &points[segment];
+        b = &points[segment + 1U];
+        mv = (int64_t)(b->mv - a->mv) * ((int32_t)code - a->code);
+        // Round half away from zero so negative slopes are symmetric.
+        mv = (mv >= 0 ? mv + (b->code - a->code) / 2 : mv - (b->code - a->code) / 2) / (b->code - a->code);
+        mv += a->mv;
+        if (mv < 0) {
+            mv = 0;
+        } else if (mv > UINT16_MAX) {
+            mv = UINT16_MAX;
+        }
+        table[code] = (uint16_t)mv;
+    }
+}
+
+static inline void calibration_init_nominal(t_calibration *cal)
+{
+    const t_calibration_point adc[2] = {{0, 0}, {(int32_t)CAL_ADC_CODES - 1, (int32_t)CAL_ADC_FULL_SCALE_MV}};
+    const t_calibration_point dac[2] = {{0, 0}, {(int32_t)CAL_DAC_CODES - 1, (int32_t)CAL_DAC_FULL_SCALE_MV}};
+
+    memset(cal, 0, sizeof(*cal));
+    for (unsigned int ch = 0; ch < CAL_ADC_CHANNELS; ch++) {
+        calibration_fill_table(cal->adc_mv[ch], CAL_ADC_CODES, adc, 2);
+    }
+    for (unsigned int ch = 0; ch < CAL_DAC_CHANNELS; ch++) {
+        calibration_fill_table(cal->dac_mv[ch], CAL_DAC_CODES, dac, 2);
+    }
+}
+
+// "all" or "0,3,8-11" -> bit mask of channels below channel_count. Returns -1 if invalid.
+static inline int calibration_parse_channels(const char *text, unsigned int channel_count, uint32_t *mask)
+{
+    const char *cursor = text;
+
+    if (strcmp(text, "all") == 0) {
+        *mask = (channel_count >= 32U) ? UINT32_MAX : ((1U << channel_count) - 1U);
+        return 0;
+    }
+    *mask = 0;
+    while (*cursor) {
+        char *end;
+        unsigned long first = strtoul(cursor, &end, 10);
+        unsigned long last = first;
+
+        if (end == cursor) {
+            return -1;
+        }
+        if (*end == '-') {
+            cursor = end + 1;
+            last = strtoul(cursor, &end, 10);
+            if (end == cursor) {
+                return -1;
+            }
+        }
+        if (first > last || last >= channel_count) {
+            return -1;
+        }
+        for (unsigned long ch = first; ch <= last; ch++) {
+            *mask |= 1U << ch;
+        }
+        if (*end == ',') {
+            end++;
+        } else if (*end != '\0') {
+            return -1;
+        }
+        cursor = end;
+    }
+    return *mask ? 0 : -1;
+}
+
+/*
+ * Parse the rule after "<adc|dac> <channels>" into points. Returns -1 with a message
+ * in error[] when the rule is malformed.
+ */
+static inline int calibration_parse_rule(char *rule, unsigned int code_count, unsigned int full_scale_mv,
+    t_calibration_point points[CAL_MAX_POINTS], unsigned int *point_count, char *error, size_t error_size)
+{
+    char *save = NULL;
+    char *token;
+    double gain = 1.0;
+    double offset_mv = 0.0;
+    int linear = 0;
+
+    *point_count = 0;
+    for (token = strtok_r(rule, " \t", &save); token; token = strtok_r(NULL, " \t", &save)) {
+        char *end;
+
+        if (strncmp(token, "gain=", 5) == 0 || strncmp(token, "offset=", 7) == 0) {
+            int is_gain = token[0] == 'g';
+            double value = strtod(token + (is_gain ? 5 : 7), &end);
+
+            if (*end != '\0' || (is_gain && value <= 0.0)) {
+                snprintf(error, error_size, "invalid '%s'", token);
+                return -1;
+            }
+            if (is_gain) {
+                gain = value;
+            } else {
+                offset_mv = value;
+            }
+            linear = 1;
+        } else {
+            long code = strtol(token, &end, 10);
+            long mv;
+
+            if (end == token || *end != ':' || code < 0 || code >= (long)code_count) {
+                snprintf(error, error_size, "invalid point '%s' (code 0..%u:mV)", token, code_count - 1U);
+                return -1;
+            }
+            mv = strtol(end + 1, &end, 10);
+            if (*end != '\0' || *point_count == CAL_MAX_POINTS
+                || (*point_count > 0 && code <= points[*point_count - 1U].code)) {
+                snprintf(error, error_size, "invalid point '%s' (max %d, codes ascending)", token, CAL_MAX_POINTS);
+                return -1;
+            }
+            points[*point_count].code = (int32_t)code;
+            points[*point_count].mv = (int32_t)mv;
+            (*point_count)++;
+        }
+    }
+    if (linear && *point_count > 0) {
+        snprintf(error, error_size, "use either gain/offset or points, not both");
+        return -1;
+    }
+    if (linear) {
+        points[0].code = 0;
+        points[0].mv = (int32_t)(offset_mv < 0.0 ? offset_mv - 0.5 : offset_mv + 0.5);
+        points[1].code = (int32_t)code_count - 1;
+        points[1].mv = (int32_t)((double)full_scale_mv * gain + offset_mv + 0.5);
+        *point_count = 2;
+    }
+    if (*point_count < 2) {
+        snprintf(error, error_size, "need gain=/offset= or at least two <code>:<mV> points");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Load path on top of the nominal tables. Returns -1 with "<path>:<line>: <reason>" in
+ * error[] on failure; cal is then left nominal.
+ */
+static inline int calibration_load(t_calibration *cal, const char *path, char *error, size_t error_size)
+{
+    char line[CAL_LINE_LEN];
+    unsigned int line_number = 0;
+    FILE *file;
+
+    calibration_init_nominal(cal);
+    file = fopen(path, "r");
+    if (!file) {
+        snprintf(error, error_size, "%s: %s", path, strerror(errno));
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        t_calibration_point points[CAL_MAX_POINTS];
+        unsigned int point_count;
+        char reason[128];
+        char *comment = strchr(line, '#');
+        char *save = NULL;
+        char *kind;
+        char *channels;
+        char *rule;
+        uint32_t mask;
+        int is_adc;
+
+        line_number++;
+        if (comment) {
+            *comment = '\0';
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        kind = strtok_r(line, " \t", &save);
+        if (!kind) {
+            continue;
+        }
+        channels = strtok_r(NULL, " \t", &save);
+        rule = save;
+        is_adc = strcmp(kind, "adc") == 0;
+        if (!is_adc && strcmp(kind, "dac") != 0) {
+            snprintf(reason, sizeof(reason), "expected 'adc' or 'dac', got '%s'", kind);
+        } else if (!channels || calibration_parse_channels(channels,
+                is_adc ? CAL_ADC_CHANNELS : CAL_DAC_CHANNELS, &mask) != 0) {
+            snprintf(reason, sizeof(reason), "invalid channel list '%s'", channels ? channels : "");
+        } else if (calibration_parse_rule(rule ? rule : (char *)"", is_adc ? CAL_ADC_CODES : CAL_DAC_CODES,
+                is_adc ? CAL_ADC_FULL_SCALE_MV : CAL_DAC_FULL_SCALE_MV, points, &point_count,
+                reason, sizeof(reason)) == 0) {
+            for (unsigned int ch = 0; ch < (is_adc ? CAL_ADC_CHANNELS : CAL_DAC_CHANNELS); ch++) {
+                if (!(mask & (1U << ch))) {
+                    continue;
+                }
+                if (is_adc) {
+                    calibration_fill_table(cal->adc_mv[ch], CAL_ADC_CODES, points, point_count);
+                    cal->adc_calibrated |= (uint16_t)(1U << ch);
+                } else {
+                    calibration_fill_table(cal->dac_mv[ch], CAL_DAC_CODES, points, point_count);
+                    cal->dac_calibrated |= (uint8_t)(1U << ch);
+                }
+            }
+            continue;
+        }
+        snprintf(error, error_size, "%s:%u: %s", path, line_number, reason);
+        fclose(file);
+        calibration_init_nominal(cal);
+        return -1;
+    }
+    fclose(file);
+    return 0;
+}
+
+// ADC value with frac_bits fractional bits (filtered readings) -> millivolts, interpolated.
+static inline uint32_t calibration_adc_mv(const t_calibration *cal, unsigned int channel, uint32_t value,
+    unsigned int frac_bits)
+{
+    const uint16_t *table = cal->adc_mv[channel];
+    uint32_t code = value >> frac_bits;
+    int32_t fraction = (int32_t)(value & ((1U << frac_bits) - 1U));
+    int32_t delta;
+
+    if (code >= CAL_ADC_CODES - 1U) {
+        return table[CAL_ADC_CODES - 1U];
+    }
+    if (frac_bits == 0) {
+        return table[code];
+    }
+    delta = (int32_t)table[code + 1U] - (int32_t)table[code];
+    return (uint32_t)((int32_t)table[code] + ((delta * fraction + (1 << (frac_bits - 1U))) >> frac_bits));
+}
+
+static inline uint32_t calibration_dac_mv(const t_calibration *cal, unsigned int channel, uint16_t code)
+{
+    return cal->dac_mv[channel][code < CAL_DAC_CODES ? code : CAL_DAC_CODES - 1U];
+}
+
+/*
+ * Millivolts -> the DAC code whose calibrated output is closest. Binary search, so the
+ * table must be monotonic (non-decreasing or non-increasing) for the channel.
+ */
+static inline uint16_t calibration_dac_code(const t_calibration *cal, unsigned int channel, uint32_t mv)
+{
+    const uint16_t *table = cal->dac_mv[channel];
+    int rising = table[CAL_DAC_CODES - 1U] >= table[0];
+    uint32_t low = 0;
+    uint32_t high = CAL_DAC_CODES - 1U;
+
+    while (low < high) {
+        uint32_t mid = (low + high) / 2U;
+
+        if (rising ? table[mid] < mv : table[mid] > mv) {
+            low = mid + 1U;
+        } else {
+            high = mid;
+        }
+    }
+    // low is the first code at or past mv; the one before it may be closer.
+    if (low > 0 && abs((int)table[low - 1U] - (int)mv) <= abs((int)table[low] - (int)mv)) {
+        low--;
+    }
+    return (uint16_t)low;
+}
+
+#endif
@@ -0,0 +1,446 @@
+#ifndef HAT_SIM_H
+#define HAT_SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <linux/i2c.h>
+#include <linux/spi/spidev.h>
+#include "calibration.h"
+
+/*
+ * Simulated hat for hat_transport.h: the two MCP4728s on I2C, their LDAC lines on
+ * GPIO and the two MCP3008s on SPI, so the tools run off-Pi at full speed.
+ *
+ * MCP4728: Fast Write, Multi-Write, Sequential Write and Single Write update the input
+ * registers; a channel latches into its output register right away when UDAC=0 or its
+ * LDAC line is low, otherwise on the next falling edge of LDAC (LDAC is low until a tool
+ * requests the line, as if it was tied low). Sequential/Single Write also program the
+ * EEPROM, which is counted because the sample loops must never do it.
+ * MCP3008: single-ended conversions of a virtual input. With loopback, DAC output n
+ * drives ADC input <loopback>+n through the nominal output and input scaling; other
+ * inputs see a 1 Hz triangle, one phase per channel.
+ *
+ * Every transfer costs its bit time at the simulated bus rate on a virtual clock that
+ * never falls behind the real one. Without pace the tools run as fast as the CPU allows
+ * and the report shows how busy the real buses would have been; with pace each transfer
+ * also waits for its virtual end time, as on the hat.
+ *
+ * Options (--sim=<key>=<value>,...):
+ *   i2c-hz=<hz>       I2C bit rate (default 1000000, the install script's baudrate)
+ *   spi-hz=<hz>       SPI bit rate (default: the rate each tool requests)
+ *   loopback=<in>|off first ADC input wired to DAC output 0 (default 0)
+ *   noise=<lsb>       uniform ADC noise of +/-lsb codes (default 0)
+ *   pace              run in real time
+ */
+#define HAT_SIM_DAC_COUNT 2
+#define HAT_SIM_DAC_CHANNELS 4
+#define HAT_SIM_DAC_ADDRESS_0 0x63
+#define HAT_SIM_DAC_ADDRESS_1 0x64
+#define HAT_SIM_LDAC_GPIO_0 0
+#define HAT_SIM_GPIO_MAX_LINES 8
+#define HAT_SIM_ADC_COUNT 2
+#define HAT_SIM_ADC_CHANNELS 8
+#define HAT_SIM_I2C_FD 1000
+#define HAT_SIM_SPI_FD_0 1001
+#define HAT_SIM_DEFAULT_I2C_HZ 1000000U
+#define HAT_SIM_MIN_HZ 10000U
+#define HAT_SIM_MAX_HZ 100000000U
+#define HAT_SIM_MAX_NOISE 64U
+#define HAT_SIM_INPUT_PERIOD_NS 1000000000ULL
+// Internal 2.048 V reference as the nominal scale; VDD (5 V) and gain x2 scale from it.
+#define HAT_SIM_VREF_MV 2048U
+#define HAT_SIM_VDD_MV 5000U
+// LM324 output stage saturation (supply-limited).
+#define HAT_SIM_RAIL_MV 11000U
+
+#define HAT_SIM_CMD_FAST_MASK 0xC0
+#define HAT_SIM_CMD_MASK 0xF8
+#define HAT_SIM_CMD_MULTI_WRITE 0x40
+#define HAT_SIM_CMD_SEQUENTIAL_WRITE 0x50
+#define HAT_SIM_CMD_SINGLE_WRITE 0x58
+
+typedef struct s_hat_sim_mcp4728 {
+    uint16_t input[HAT_SIM_DAC_CHANNELS];
+    uint8_t config[HAT_SIM_DAC_CHANNELS];
+    uint16_t output[HAT_SIM_DAC_CHANNELS];
+    uint8_t output_config[HAT_SIM_DAC_CHANNELS];
+    int ldac_high;
+}   t_hat_sim_mcp4728;
+
+typedef struct s_hat_sim_stats {
+    unsigned long i2c_messages;
+    unsigned long i2c_bytes;
+    unsigned long i2c_naks;
+    unsigned long dac_writes;
+    unsigned long dac_latches;
+    unsigned long eeprom_writes;
+    unsigned long unsupported;
+    unsigned long ldac_pulses;
+    unsigned long spi_transfers;
+    unsigned long conversions;
+}   t_hat_sim_stats;
+
+typedef struct s_hat_sim {
+    uint32_t i2c_hz;
+    uint32_t spi_hz;
+    int loopback;
+    unsigned int noise;
+    int pace;
+    uint64_t start_ns;
+    uint64_t virtual_ns;
+    uint64_t i2c_busy_ns;
+    uint64_t spi_busy_ns;
+    uint32_t spi_open_hz[HAT_SIM_ADC_COUNT];
+    uint16_t i2c_address;
+    int gpio_requested;
+    unsigned int gpio_offsets[HAT_SIM_GPIO_MAX_LINES];
+    unsigned int gpio_count;
+    uint32_t noise_state;
+    t_hat_sim_mcp4728 dac[HAT_SIM_DAC_COUNT];
+    t_hat_sim_stats stats;
+}   t_hat_sim;
+
+static t_hat_sim g_hat_sim;
+
+static inline uint64_t hat_sim_wall_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000ULL) + (uint64_t)now.tv_nsec;
+}
+
+static inline void hat_sim_reset(t_hat_sim *sim)
+{
+    memset(sim, 0, sizeof(*sim));
+    sim->i2c_hz = HAT_SIM_DEFAULT_I2C_HZ;
+    sim->loopback = 0;
+    sim->noise_state = 0x2545F491U;
+    sim->start_ns = hat_sim_wall_ns();
+}
+
+/*
+ * Parse "<key>=<value>,..." (see above) on top of the defaults. Returns -1 with a
+ * message in error[] on an unknown key or a value out of range.
+ */
+static inline int hat_sim_parse(t_hat_sim *sim, const char *spec, char *error, size_t error_size)
+{
+    char text[256];
+    char *save = NULL;
+
+    hat_sim_reset(sim);
+    if (!spec || *spec == '\0') {
+        return 0;
+    }
+    if (strlen(spec) >= sizeof(text)) {
+        snprintf(error, error_size, "options too long");
+        return -1;
+    }
+    strcpy(text, spec);
+    for (char *token = strtok_r(text, ",", &save); token; token = strtok_r(NULL, ",", &save)) {
+        char *value = strchr(token, '=');
+        char *end = NULL;
+        unsigned long parsed = 0;
+
+        if (value) {
+            *value++ = '\0';
+            errno = 0;
+            parsed = strtoul(value, &end, 10);
+            if (errno != 0 || end == value || *end != '\0') {
+                end = NULL;
+            }
+        }
+        if (strcmp(token, "pace") == 0 && !value) {
+            sim->pace = 1;
+        } else if (strcmp(token, "loopback") == 0 && value && strcmp(value, "off") == 0) {
+            sim->loopback = -1;
+        } else if (strcmp(token, "loopback") == 0 && end
+                && parsed + HAT_SIM_DAC_COUNT * HAT_SIM_DAC_CHANNELS <= HAT_SIM_ADC_COUNT * HAT_SIM_ADC_CHANNELS) {
+            sim->loopback = (int)parsed;
+        } else if (strcmp(token, "i2c-hz") == 0 && end && parsed >= HAT_SIM_MIN_HZ && parsed <= HAT_SIM_MAX_HZ) {
+            sim->i2c_hz = (uint32_t)parsed;
+        } else if (strcmp(token, "spi-hz") == 0 && end && parsed >= HAT_SIM_MIN_HZ && parsed <= HAT_SIM_MAX_HZ) {
+            sim->spi_hz = (uint32_t)parsed;
+        } else if (strcmp(token, "noise") == 0 && end && parsed <= HAT_SIM_MAX_NOISE) {
+            sim->noise = (unsigned int)parsed;
+        } else {
+            snprintf(error, error_size, "invalid option '%s%s%s' (i2c-hz=, spi-hz=, loopback=<0..%d>|off, "
+                "noise=<0..%u>, pace)", token, value ? "=" : "", value ? value : "",
+                HAT_SIM_ADC_COUNT * HAT_SIM_ADC_CHANNELS - HAT_SIM_DAC_COUNT * HAT_SIM_DAC_CHANNELS,
+                HAT_SIM_MAX_NOISE);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Book `bits` at `hz` on the virtual clock, which first catches up with real time.
+static inline void hat_sim_bus_time(t_hat_sim *sim, uint64_t bits, uint32_t hz, uint64_t *busy_ns)
+{
+    uint64_t elapsed_ns = hat_sim_wall_ns() - sim->start_ns;
+    uint64_t cost_ns = (bits * 1000000000ULL + hz - 1U) / hz;
+
+    if (sim->virtual_ns < elapsed_ns) {
+        sim->virtual_ns = elapsed_ns;
+    }
+    sim->virtual_ns += cost_ns;
+    *busy_ns += cost_ns;
+    if (sim->pace && sim->virtual_ns > elapsed_ns) {
+        uint64_t deadline_ns = sim->start_ns + sim->virtual_ns;
+        struct timespec ts;
+
+        ts.tv_sec = (time_t)(deadline_ns / 1000000000ULL);
+        ts.tv_nsec = (long)(deadline_ns % 1000000000ULL);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+        }
+    }
+}
+
+static inline int hat_sim_dac_index(uint16_t address)
+{
+    if (address == HAT_SIM_DAC_ADDRESS_0) {
+        return 0;
+    }
+    return (address == HAT_SIM_DAC_ADDRESS_1) ? 1 : -1;
+}
+
+static inline void hat_sim_dac_latch(t_hat_sim *sim, t_hat_sim_mcp4728 *dac, unsigned int channel)
+{
+    dac->output[channel] = dac->input[channel];
+    dac->output_config[channel] = dac->config[channel];
+    sim->stats.dac_latches++;
+}
+
+// config byte layout as in Multi-Write: VREF(7) PD1 PD0(6:5) GAIN(4).
+static inline void hat_sim_dac_set(t_hat_sim *sim, t_hat_sim_mcp4728 *dac, unsigned int channel, uint8_t config,
+    uint16_t code, int udac)
+{
+    dac->input[channel] = code & 0x0FFFU;
+    dac->config[channel] = config & 0xF0U;
+    sim->stats.dac_writes++;
+    if (!udac || !dac->ldac_high) {
+        hat_sim_dac_latch(sim, dac, channel);
+    }
+}
+
+/*
+ * Decode one I2C write to an MCP4728. Commands the hat never sends (address, VREF,
+ * gain and power-down select, general calls) are acknowledged and counted only.
+ */
+static inline void hat_sim_dac_write(t_hat_sim *sim, t_hat_sim_mcp4728 *dac, const uint8_t *data, size_t len)
+{
+    size_t pos = 0;
+
+    while (pos < len) {
+        uint8_t command = data[pos];
+
+        if ((command & HAT_SIM_CMD_FAST_MASK) == 0) {
+            // Fast Write: 2 bytes per channel from A, VREF/gain kept, no UDAC.
+            for (unsigned int channel = 0; channel < HAT_SIM_DAC_CHANNELS && pos + 1U < len; channel++) {
+                uint8_t config = (uint8_t)((dac->config[channel] & 0x90U) | ((data[pos] & 0x30U) << 1));
+
+                hat_sim_dac_set(sim, dac, channel, config, (uint16_t)(((data[pos] & 0x0FU) << 8) | data[pos + 1U]), 1);
+                pos += 2;
+            }
+            return;
+        }
+        if ((command & HAT_SIM_CMD_MASK) == HAT_SIM_CMD_MULTI_WRITE) {
+            if (pos + 2U >= len) {
+                break;
+            }
+            hat_sim_dac_set(sim, dac, (command >> 1) & 0x03U, data[pos + 1U],
+                (uint16_t)(((data[pos + 1U] & 0x0FU) << 8) | data[pos + 2U]), command & 0x01U);
+            pos += 3;
+            continue;
+        }
+        if ((command & HAT_SIM_CMD_MASK) == HAT_SIM_CMD_SEQUENTIAL_WRITE
+            || (command & HAT_SIM_CMD_MASK) == HAT_SIM_CMD_SINGLE_WRITE) {
+            unsigned int last = ((command & HAT_SIM_CMD_MASK) == HAT_SIM_CMD_SINGLE_WRITE)
+                ? (command >> 1) & 0x03U : HAT_SIM_DAC_CHANNELS - 1U;
+
+            pos++;
+            for (unsigned int channel = (command >> 1) & 0x03U; channel <= last && pos + 1U < len; channel++) {
+                hat_sim_dac_set(sim, dac, channel, data[pos], (uint16_t)(((data[pos] & 0x0FU) << 8) | data[pos + 1U]),
+                    command & 0x01U);
+                pos += 2;
+            }
+            sim->stats.eeprom_writes++;
+            return;
+        }
+        break;
+    }
+    if (pos < len) {
+        sim->stats.unsupported++;
+    }
+}
+
+// One I2C message (start, address, payload, ack per byte, stop). Returns -1/ENXIO on a NAK.
+static inline int hat_sim_i2c_message(t_hat_sim *sim, uint16_t address, int is_read, uint8_t *data, size_t len)
+{
+    int dac = hat_sim_dac_index(address);
+
+    hat_sim_bus_time(sim, (uint64_t)(len + 1U) * 9U + 2U, sim->i2c_hz, &sim->i2c_busy_ns);
+    sim->stats.i2c_messages++;
+    if (dac < 0) {
+        sim->stats.i2c_naks++;
+        errno = ENXIO;
+        return -1;
+    }
+    sim->stats.i2c_bytes += len;
+    if (is_read) {
+        // Register read-back: 3 bytes per channel (status, then the output register).
+        const t_hat_sim_mcp4728 *chip = &sim->dac[dac];
+
+        for (size_t i = 0; i < len; i++) {
+            unsigned int channel = (unsigned int)(i / 3U) % HAT_SIM_DAC_CHANNELS;
+
+            data[i] = (i % 3U == 0) ? (uint8_t)(0xC0U | (channel << 4))
+                : (i % 3U == 1) ? (uint8_t)(chip->output_config[channel] | (chip->output[channel] >> 8))
+                : (uint8_t)chip->output[channel];
+        }
+        return 0;
+    }
+    hat_sim_dac_write(sim, &sim->dac[dac], data, len);
+    return 0;
+}
+
+static inline void hat_sim_ldac_set(t_hat_sim *sim, unsigned int offset, int high)
+{
+    t_hat_sim_mcp4728 *dac;
+    unsigned int index = offset - HAT_SIM_LDAC_GPIO_0;
+
+    // Unsigned wrap also rejects offsets below the first LDAC line.
+    if (index >= HAT_SIM_DAC_COUNT) {
+        return;
+    }
+    dac = &sim->dac[index];
+    if (dac->ldac_high && !high) {
+        sim->stats.ldac_pulses++;
+        for (unsigned int channel = 0; channel < HAT_SIM_DAC_CHANNELS; channel++) {
+            hat_sim_dac_latch(sim, dac, channel);
+        }
+    }
+    dac->ldac_high = high;
+}
+
+// Voltage after the output stage for the latched register of DAC output `output`.
+static inline uint32_t hat_sim_output_mv(const t_hat_sim *sim, unsigned int output)
+{
+    const t_hat_sim_mcp4728 *dac = &sim->dac[output / HAT_SIM_DAC_CHANNELS];
+    unsigned int channel = output % HAT_SIM_DAC_CHANNELS;
+    uint8_t config = dac->output_config[channel];
+    uint64_t mv;
+
+    if (config & 0x60U) {
+        return 0;
+    }
+    mv = (uint64_t)dac->output[channel] * CAL_DAC_FULL_SCALE_MV / (CAL_DAC_CODES - 1U);
+    if (!(config & 0x80U)) {
+        mv = mv * HAT_SIM_VDD_MV / HAT_SIM_VREF_MV;
+    } else if (config & 0x10U) {
+        mv *= 2U;
+    }
+    return (uint32_t)(mv > HAT_SIM_RAIL_MV ? HAT_SIM_RAIL_MV : mv);
+}
+
+static inline uint16_t hat_sim_adc_code(t_hat_sim *sim, unsigned int input)
+{
+    int32_t code;
+
+    if (sim->loopback >= 0 && input >= (unsigned int)sim->loopback
+        && input < (unsigned int)sim->loopback + HAT_SIM_DAC_COUNT * HAT_SIM_DAC_CHANNELS) {
+        uint32_t mv = hat_sim_output_mv(sim, input - (unsigned int)sim->loopback);
+
+        code = (int32_t)((mv * (CAL_ADC_CODES - 1U) + CAL_ADC_FULL_SCALE_MV / 2U) / CAL_ADC_FULL_SCALE_MV);
+    } else {
+        uint64_t position = (sim->virtual_ns + input * (HAT_SIM_INPUT_PERIOD_NS / 16U)) % HAT_SIM_INPUT_PERIOD_NS;
+        uint64_t half = HAT_SIM_INPUT_PERIOD_NS / 2U;
+
+        if (position >= half) {
+            position = HAT_SIM_INPUT_PERIOD_NS - position;
+        }
+        code = (int32_t)(position * (CAL_ADC_CODES - 1U) / half);
+    }
+    if (sim->noise > 0) {
+        sim->noise_state ^= sim->noise_state << 13;
+        sim->noise_state ^= sim->noise_state >> 17;
+        sim->noise_state ^= sim->noise_state << 5;
+        code += (int32_t)(sim->noise_state % (2U * sim->noise + 1U)) - (int32_t)sim->noise;
+    }
+    if (code < 0) {
+        code = 0;
+    } else if (code > (int32_t)CAL_ADC_CODES - 1) {
+        code = (int32_t)CAL_ADC_CODES - 1;
+    }
+    return (uint16_t)code;
+}
+
+/*
+ * One SPI transfer to MCP3008 `chip`: find the start bit in tx, take SGL/DIFF + D2..D0
+ * from the next 4 bits and clock the null bit and 10-bit result out MSB first right
+ * behind them, as the chip does. Differential mode is read as single-ended.
+ */
+static inline void hat_sim_spi_transfer(t_hat_sim *sim, unsigned int chip, const uint8_t *tx, uint8_t *rx,
+    size_t len, uint32_t speed_hz)
+{
+    uint32_t hz = sim->spi_hz ? sim->spi_hz : (speed_hz ? speed_hz : sim->spi_open_hz[chip]);
+    size_t total_bits = len * 8U;
+    size_t start = total_bits;
+
+    hat_sim_bus_time(sim, total_bits, hz ? hz : HAT_SIM_MIN_HZ, &sim->spi_busy_ns);
+    sim->stats.spi_transfers++;
+    memset(rx, 0, len);
+    for (size_t bit = 0; bit < total_bits; bit++) {
+        if (tx[bit / 8U] & (0x80U >> (bit % 8U))) {
+            start = bit;
+            break;
+        }
+    }
+    if (start + 5U >= total_bits) {
+        return;
+    }
+    {
+        unsigned int channel = 0;
+        uint16_t code;
+
+        for (size_t bit = start + 2U; bit < start + 5U; bit++) {
+            channel = (channel << 1) | ((tx[bit / 8U] >> (7U - bit % 8U)) & 1U);
+        }
+        code = hat_sim_adc_code(sim, chip * HAT_SIM_ADC_CHANNELS + channel);
+        sim->stats.conversions++;
+        // Sample clock at start+5, null bit at start+6, B9 at start+7.
+        for (unsigned int i = 0; i < 10U && start + 7U + i < total_bits; i++) {
+            size_t bit = start + 7U + i;
+
+            if (code & (0x200U >> i)) {
+                rx[bit / 8U] |= (uint8_t)(0x80U >> (bit % 8U));
+            }
+        }
+    }
+}
+
+static inline void hat_sim_report(FILE *out, const t_hat_sim *sim)
+{
+    uint64_t wall_ns = hat_sim_wall_ns() - sim->start_ns;
+    uint64_t virtual_ns = sim->virtual_ns > wall_ns ? sim->virtual_ns : wall_ns;
+    double virtual_s = (double)virtual_ns / 1e9;
+
+    fprintf(out, "Sim: virtual %.3f s in %.3f s real (x%.2f)%s\n", virtual_s, (double)wall_ns / 1e9,
+        wall_ns ? (double)virtual_ns / (double)wall_ns : 0.0, sim->pace ? " | paced" : "");
+    fprintf(out, "Sim I2C: %u Hz | busy %.1f%% | messages=%lu | bytes=%lu | naks=%lu\n", sim->i2c_hz,
+        virtual_ns ? 100.0 * (double)sim->i2c_busy_ns / (double)virtual_ns : 0.0,
+        sim->stats.i2c_messages, sim->stats.i2c_bytes, sim->stats.i2c_naks);
+    fprintf(out, "Sim MCP4728: channel writes=%lu | latches=%lu | LDAC pulses=%lu | EEPROM writes=%lu | "
+        "unsupported=%lu\n", sim->stats.dac_writes, sim->stats.dac_latches, sim->stats.ldac_pulses,
+        sim->stats.eeprom_writes, sim->stats.unsupported);
+    fprintf(out, "Sim SPI: busy %.1f%% | transfers=%lu | conversions=%lu\n",
+        virtual_ns ? 100.0 * (double)sim->spi_busy_ns / (double)virtual_ns : 0.0,
+        sim->stats.spi_transfers, sim->stats.conversions);
+}
+
+#endif
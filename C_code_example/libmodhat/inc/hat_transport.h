@@ -0,0 +1,513 @@
+#ifndef HAT_TRANSPORT_H
+#define HAT_TRANSPORT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <linux/i2c-dev.h>
+#include <linux/i2c.h>
+#include <linux/spi/spidev.h>
+
+/*
+ * Device access for the tools through I2C, SPI and GPIO ops tables, filled either with
+ * the real buses (i2c-dev, spidev, libgpiod) or with the simulated hat of hat_sim.h.
+ * The tools keep their own framing, batching and error messages; an op only moves
+ * bytes or toggles lines, and fails with -1 and errno like the call it replaces.
+ *
+ * The hardware SPI ops need spidev-lib and the hardware GPIO ops need libgpiod. Define
+ * HAT_TRANSPORT_SPI / HAT_TRANSPORT_GPIO before including this header to enable them,
+ * so each tool links only what it uses; disabled ops fail with ENODEV.
+ * HAT_TRANSPORT_TYPES_ONLY keeps just the ops types, for code that is handed a
+ * transport (libmodhat) rather than building one.
+ */
+#ifdef HAT_TRANSPORT_SPI
+#include <spidev_lib.h>
+#endif
+#ifdef HAT_TRANSPORT_GPIO
+#include <gpiod.h>
+#endif
+
+#define HAT_GPIO_LOW 0
+#define HAT_GPIO_HIGH 1
+
+typedef struct s_hat_i2c_ops {
+    int (*open)(const char *bus);
+    int (*close)(int fd);
+    int (*funcs)(int fd, unsigned long *funcs);
+    int (*set_address)(int fd, uint16_t address);
+    ssize_t (*write)(int fd, const uint8_t *data, size_t len);
+    ssize_t (*read)(int fd, uint8_t *data, size_t len);
+    int (*transfer)(int fd, struct i2c_msg *msgs, unsigned int count);
+}   t_hat_i2c_ops;
+
+typedef struct s_hat_spi_ops {
+    int (*open)(const char *device, uint32_t speed_hz);
+    int (*close)(int fd);
+    int (*xfer)(int fd, uint8_t *tx, uint8_t tx_len, uint8_t *rx, uint8_t rx_len);
+    int (*message)(int fd, struct spi_ioc_transfer *xfers, unsigned int count);
+}   t_hat_spi_ops;
+
+// Output lines only (LDAC); a request holds `count` lines of one chip.
+typedef struct s_hat_gpio_ops {
+    void *(*request_outputs)(const char *chip_path, const unsigned int *offsets, unsigned int count, int value,
+        const char *consumer);
+    int (*set_value)(void *request, unsigned int offset, int value);
+    // One value per requested line, in request order, all changed by a single call.
+    int (*set_values)(void *request, const int *values);
+    void (*release)(void *request);
+}   t_hat_gpio_ops;
+
+typedef struct s_hat_transport {
+    const char *name;
+    int simulated;
+    t_hat_i2c_ops i2c;
+    t_hat_spi_ops spi;
+    t_hat_gpio_ops gpio;
+}   t_hat_transport;
+
+#ifndef HAT_TRANSPORT_TYPES_ONLY
+#include "hat_sim.h"
+
+/* Hardware: i2c-dev ---------------------------------------------------------------- */
+
+static int hat_hw_i2c_open(const char *bus)
+{
+    return open(bus, O_RDWR);
+}
+
+static int hat_hw_i2c_close(int fd)
+{
+    return close(fd);
+}
+
+static int hat_hw_i2c_funcs(int fd, unsigned long *funcs)
+{
+    return ioctl(fd, I2C_FUNCS, funcs);
+}
+
+static int hat_hw_i2c_set_address(int fd, uint16_t address)
+{
+    return ioctl(fd, I2C_SLAVE, address);
+}
+
+static ssize_t hat_hw_i2c_write(int fd, const uint8_t *data, size_t len)
+{
+    return write(fd, data, len);
+}
+
+static ssize_t hat_hw_i2c_read(int fd, uint8_t *data, size_t len)
+{
+    return read(fd, data, len);
+}
+
+static int hat_hw_i2c_transfer(int fd, struct i2c_msg *msgs, unsigned int count)
+{
+    struct i2c_rdwr_ioctl_data xfer;
+
+    xfer.msgs = msgs;
+    xfer.nmsgs = count;
+    return ioctl(fd, I2C_RDWR, &xfer);
+}
+
+/* Hardware: spidev ----------------------------------------------------------------- */
+
+static int hat_hw_spi_message(int fd, struct spi_ioc_transfer *xfers, unsigned int count)
+{
+    return ioctl(fd, SPI_IOC_MESSAGE(count), xfers);
+}
+
+#ifdef HAT_TRANSPORT_SPI
+static int hat_hw_spi_open(const char *device, uint32_t speed_hz)
+{
+    spi_config_t config;
+
+    config.mode = 0;
+    config.bits_per_word = 8;
+    config.speed = speed_hz;
+    config.delay = 0;
+    return spi_open((char *)device, config);
+}
+
+static int hat_hw_spi_close(int fd)
+{
+    return spi_close(fd);
+}
+
+static int hat_hw_spi_xfer(int fd, uint8_t *tx, uint8_t tx_len, uint8_t *rx, uint8_t rx_len)
+{
+    return spi_xfer(fd, tx, tx_len, rx, rx_len);
+}
+#else
+static int hat_hw_spi_open(const char *device, uint32_t speed_hz)
+{
+    (void)device;
+    (void)speed_hz;
+    errno = ENODEV;
+    return -1;
+}
+
+static int hat_hw_spi_close(int fd)
+{
+    (void)fd;
+    return 0;
+}
+
+static int hat_hw_spi_xfer(int fd, uint8_t *tx, uint8_t tx_len, uint8_t *rx, uint8_t rx_len)
+{
+    (void)fd;
+    (void)tx;
+    (void)tx_len;
+    (void)rx;
+    (void)rx_len;
+    errno = ENODEV;
+    return -1;
+}
+#endif
+
+/* Hardware: libgpiod v2 ------------------------------------------------------------ */
+
+#ifdef HAT_TRANSPORT_GPIO
+#define HAT_HW_GPIO_MAX_LINES 64
+
+typedef struct s_hat_hw_gpio_request {
+    struct gpiod_chip *chip;
+    struct gpiod_line_request *request;
+    unsigned int count;
+}   t_hat_hw_gpio_request;
+
+static void hat_hw_gpio_release(void *request)
+{
+    t_hat_hw_gpio_request *hw = (t_hat_hw_gpio_request *)request;
+
+    if (!hw) {
+        return;
+    }
+    if (hw->request) {
+        gpiod_line_request_release(hw->request);
+    }
+    if (hw->chip) {
+        gpiod_chip_close(hw->chip);
+    }
+    free(hw);
+}
+
+static void *hat_hw_gpio_request_outputs(const char *chip_path, const unsigned int *offsets, unsigned int count,
+    int value, const char *consumer)
+{
+    enum gpiod_line_value line_value = value ? GPIOD_LINE_VALUE_ACTIVE : GPIOD_LINE_VALUE_INACTIVE;
+    enum gpiod_line_value values[HAT_HW_GPIO_MAX_LINES];
+    t_hat_hw_gpio_request *hw;
+    struct gpiod_line_settings *settings;
+    struct gpiod_line_config *line_config;
+    struct gpiod_request_config *request_config;
+    int saved_errno;
+
+    if (count == 0 || count > sizeof(values) / sizeof(values[0])) {
+        errno = EINVAL;
+        return NULL;
+    }
+    hw = calloc(1, sizeof(*hw));
+    if (!hw) {
+        return NULL;
+    }
+    hw->count = count;
+    hw->chip = gpiod_chip_open(chip_path);
+    if (!hw->chip) {
+        saved_errno = errno;
+        free(hw);
+        errno = saved_errno;
+        return NULL;
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        values[i] = line_value;
+    }
+    settings = gpiod_line_settings_new();
+    line_config = gpiod_line_config_new();
+    request_config = gpiod_request_config_new();
+    errno = EINVAL;
+    if (settings && line_config && request_config
+        && gpiod_line_settings_set_direction(settings, GPIOD_LINE_DIRECTION_OUTPUT) == 0
+        && gpiod_line_settings_set_output_value(settings, line_value) == 0
+        && gpiod_line_config_add_line_settings(line_config, offsets, count, settings) == 0
+        && gpiod_line_config_set_output_values(line_config, values, count) == 0) {
+        gpiod_request_config_set_consumer(request_config, consumer);
+        hw->request = gpiod_chip_request_lines(hw->chip, request_config, line_config);
+    }
+    saved_errno = errno;
+    gpiod_request_config_free(request_config);
+    gpiod_line_config_free(line_config);
+    gpiod_line_settings_free(settings);
+    if (!hw->request) {
+        hat_hw_gpio_release(hw);
+        errno = saved_errno;
+        return NULL;
+    }
+    return hw;
+}
+
+static int hat_hw_gpio_set_value(void *request, unsigned int offset, int value)
+{
+    return gpiod_line_request_set_value(((t_hat_hw_gpio_request *)request)->request, offset,
+        value ? GPIOD_LINE_VALUE_ACTIVE : GPIOD_LINE_VALUE_INACTIVE);
+}
+
+// One GPIO_V2_LINE_SET_VALUES ioctl: the lines of a bank switch on the same register write.
+static int hat_hw_gpio_set_values(void *request, const int *values)
+{
+    t_hat_hw_gpio_request *hw = (t_hat_hw_gpio_request *)request;
+    enum gpiod_line_value line_values[HAT_HW_GPIO_MAX_LINES];
+
+    for (unsigned int i = 0; i < hw->count; i++) {
+        line_values[i] = values[i] ? GPIOD_LINE_VALUE_ACTIVE : GPIOD_LINE_VALUE_INACTIVE;
+    }
+    return gpiod_line_request_set_values(hw->request, line_values);
+}
+#else
+static void *hat_hw_gpio_request_outputs(const char *chip_path, const unsigned int *offsets, unsigned int count,
+    int value, const char *consumer)
+{
+    (void)chip_path;
+    (void)offsets;
+    (void)count;
+    (void)value;
+    (void)consumer;
+    errno = ENODEV;
+    return NULL;
+}
+
+static int hat_hw_gpio_set_value(void *request, unsigned int offset, int value)
+{
+    (void)request;
+    (void)offset;
+    (void)value;
+    errno = ENODEV;
+    return -1;
+}
+
+static int hat_hw_gpio_set_values(void *request, const int *values)
+{
+    (void)request;
+    (void)values;
+    errno = ENODEV;
+    return -1;
+}
+
+static void hat_hw_gpio_release(void *request)
+{
+    (void)request;
+}
+#endif
+
+/* Simulated hat (hat_sim.h) -------------------------------------------------------- */
+
+static int hat_sim_i2c_open(const char *bus)
+{
+    (void)bus;
+    return HAT_SIM_I2C_FD;
+}
+
+static int hat_sim_i2c_close(int fd)
+{
+    (void)fd;
+    return 0;
+}
+
+static int hat_sim_i2c_funcs(int fd, unsigned long *funcs)
+{
+    (void)fd;
+    *funcs = I2C_FUNC_I2C;
+    return 0;
+}
+
+static int hat_sim_i2c_set_address(int fd, uint16_t address)
+{
+    (void)fd;
+    g_hat_sim.i2c_address = address;
+    return 0;
+}
+
+static ssize_t hat_sim_i2c_write(int fd, const uint8_t *data, size_t len)
+{
+    (void)fd;
+    if (hat_sim_i2c_message(&g_hat_sim, g_hat_sim.i2c_address, 0, (uint8_t *)data, len) < 0) {
+        return -1;
+    }
+    return (ssize_t)len;
+}
+
+static ssize_t hat_sim_i2c_read(int fd, uint8_t *data, size_t len)
+{
+    (void)fd;
+    if (hat_sim_i2c_message(&g_hat_sim, g_hat_sim.i2c_address, 1, data, len) < 0) {
+        return -1;
+    }
+    return (ssize_t)len;
+}
+
+static int hat_sim_i2c_transfer(int fd, struct i2c_msg *msgs, unsigned int count)
+{
+    (void)fd;
+    for (unsigned int i = 0; i < count; i++) {
+        if (hat_sim_i2c_message(&g_hat_sim, msgs[i].addr, (msgs[i].flags & I2C_M_RD) != 0, msgs[i].buf,
+                msgs[i].len) < 0) {
+            return -1;
+        }
+    }
+    return (int)count;
+}
+
+// "/dev/spidev0.<cs>": chip select 0 and 1 are the two MCP3008s.
+static int hat_sim_spi_open(const char *device, uint32_t speed_hz)
+{
+    size_t len = strlen(device);
+    unsigned int chip;
+
+    if (len == 0 || device[len - 1] < '0' || device[len - 1] >= '0' + HAT_SIM_ADC_COUNT) {
+        errno = ENOENT;
+        return -1;
+    }
+    chip = (unsigned int)(device[len - 1] - '0');
+    g_hat_sim.spi_open_hz[chip] = speed_hz;
+    return HAT_SIM_SPI_FD_0 + (int)chip;
+}
+
+static int hat_sim_spi_close(int fd)
+{
+    (void)fd;
+    return 0;
+}
+
+static int hat_sim_spi_chip(int fd)
+{
+    if (fd < HAT_SIM_SPI_FD_0 || fd >= HAT_SIM_SPI_FD_0 + HAT_SIM_ADC_COUNT) {
+        errno = EBADF;
+        return -1;
+    }
+    return fd - HAT_SIM_SPI_FD_0;
+}
+
+static int hat_sim_spi_xfer(int fd, uint8_t *tx, uint8_t tx_len, uint8_t *rx, uint8_t rx_len)
+{
+    int chip = hat_sim_spi_chip(fd);
+    uint8_t padded[256] = {0};
+
+    if (chip < 0) {
+        return -1;
+    }
+    memcpy(padded, tx, tx_len);
+    hat_sim_spi_transfer(&g_hat_sim, (unsigned int)chip, padded, rx, rx_len, 0);
+    return rx_len;
+}
+
+static int hat_sim_spi_message(int fd, struct spi_ioc_transfer *xfers, unsigned int count)
+{
+    int chip = hat_sim_spi_chip(fd);
+    int total = 0;
+
+    if (chip < 0) {
+        return -1;
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        static const uint8_t zeros[256];
+        const uint8_t *tx = xfers[i].tx_buf ? (const uint8_t *)(uintptr_t)xfers[i].tx_buf : zeros;
+
+        if (xfers[i].len > sizeof(zeros) || !xfers[i].rx_buf) {
+            errno = EINVAL;
+            return -1;
+        }
+        hat_sim_spi_transfer(&g_hat_sim, (unsigned int)chip, tx, (uint8_t *)(uintptr_t)xfers[i].rx_buf,
+            xfers[i].len, xfers[i].speed_hz);
+        total += (int)xfers[i].len;
+    }
+    return total;
+}
+
+static void *hat_sim_gpio_request_outputs(const char *chip_path, const unsigned int *offsets, unsigned int count,
+    int value, const char *consumer)
+{
+    (void)chip_path;
+    (void)consumer;
+    if (count > HAT_SIM_GPIO_MAX_LINES) {
+        errno = EINVAL;
+        return NULL;
+    }
+    g_hat_sim.gpio_count = count;
+    for (unsigned int i = 0; i < count; i++) {
+        g_hat_sim.gpio_offsets[i] = offsets[i];
+        hat_sim_ldac_set(&g_hat_sim, offsets[i], value);
+    }
+    g_hat_sim.gpio_requested = 1;
+    return &g_hat_sim;
+}
+
+static int hat_sim_gpio_set_value(void *request, unsigned int offset, int value)
+{
+    hat_sim_ldac_set((t_hat_sim *)request, offset, value);
+    return 0;
+}
+
+// All lines move at the same virtual time, like the single register write of the hardware.
+static int hat_sim_gpio_set_values(void *request, const int *values)
+{
+    t_hat_sim *sim = (t_hat_sim *)request;
+
+    for (unsigned int i = 0; i < sim->gpio_count; i++) {
+        hat_sim_ldac_set(sim, sim->gpio_offsets[i], values[i]);
+    }
+    return 0;
+}
+
+static void hat_sim_gpio_release(void *request)
+{
+    ((t_hat_sim *)request)->gpio_requested = 0;
+}
+
+/*
+ * sim_spec NULL selects the hardware; otherwise it holds the --sim options ("" for the
+ * defaults). Returns -1 with a message in error[] if the options are invalid.
+ */
+static inline int hat_transport_init(t_hat_transport *transport, const char *sim_spec, char *error,
+    size_t error_size)
+{
+    static const t_hat_transport hardware = {
+        "hardware", 0,
+        {hat_hw_i2c_open, hat_hw_i2c_close, hat_hw_i2c_funcs, hat_hw_i2c_set_address, hat_hw_i2c_write,
+            hat_hw_i2c_read, hat_hw_i2c_transfer},
+        {hat_hw_spi_open, hat_hw_spi_close, hat_hw_spi_xfer, hat_hw_spi_message},
+        {hat_hw_gpio_request_outputs, hat_hw_gpio_set_value, hat_hw_gpio_set_values, hat_hw_gpio_release},
+    };
+    static const t_hat_transport simulated = {
+        "sim", 1,
+        {hat_sim_i2c_open, hat_sim_i2c_close, hat_sim_i2c_funcs, hat_sim_i2c_set_address, hat_sim_i2c_write,
+            hat_sim_i2c_read, hat_sim_i2c_transfer},
+        {hat_sim_spi_open, hat_sim_spi_close, hat_sim_spi_xfer, hat_sim_spi_message},
+        {hat_sim_gpio_request_outputs, hat_sim_gpio_set_value, hat_sim_gpio_set_values, hat_sim_gpio_release},
+    };
+
+    if (!sim_spec) {
+        *transport = hardware;
+        return 0;
+    }
+    if (hat_sim_parse(&g_hat_sim, sim_spec, error, error_size) != 0) {
+        return -1;
+    }
+    *transport = simulated;
+    return 0;
+}
+
+static inline void hat_transport_report(FILE *out, const t_hat_transport *transport)
+{
+    if (transport->simulated) {
+        hat_sim_report(out, &g_hat_sim);
+    }
+}
+
+#endif
+
+#endif
@@ -0,0 +1,219 @@
+#ifndef MODHAT_H
+#define MODHAT_H
+
+#include <stdint.h>
+#include <linux/i2c.h>
+#include <linux/spi/spidev.h>
+#include "hat_transport.h"
+
+/*
+ * libmodhat: device layer shared by the tools, for the two MCP4728 DACs (I2C, LDAC on
+ * GPIO) and the two MCP3008 ADCs (SPI) of the hat.
+ *
+ * Every device access goes through the caller's t_hat_transport, so the same code runs
+ * on the buses, on the simulated hat or on the bench sinks. State lives in caller-owned
+ * t_hat_dac / t_hat_adc handles: no call allocates or prints. Calls return 0 (or a
+ * count/mask) on success and -1 with errno set on failure; messages are the tools' job.
+ *
+ * Batched API: hat_write_frame() updates the 8 outputs with one I2C transaction
+ * (one per DAC with --i2c-transport=slave), hat_read_scan() reads the 16 inputs with
+ * one SPI message per MCP3008. The _outputs/_channels variants take a channel mask.
+ */
+#define HAT_I2C_BUS "/dev/i2c-1"
+#define HAT_GPIO_CHIP "/dev/gpiochip0"
+#define HAT_SPI0_DEVICE "/dev/spidev0.0"
+#define HAT_SPI1_DEVICE "/dev/spidev0.1"
+
+#define DAC_1 0x63
+#define DAC_2 0x64
+#define LDAC1_GPIO 0
+#define LDAC2_GPIO 1
+
+// hat_ldac_strobe() masks: bit n is the LDAC line of DAC n.
+#define HAT_LDAC_DAC1 0x01U
+#define HAT_LDAC_DAC2 0x02U
+#define HAT_LDAC_ALL 0x03U
+// Low time of a strobe, well above the MCP4728 minimum LDAC pulse width.
+#define HAT_LDAC_HOLD_NS 500U
+#define HAT_LDAC_MAX_HOLD_NS 100000U
+
+#define MCP_DAC_COUNT 2
+#define MCP_OUTPUT_COUNT 8
+#define MCP_ALL_OUTPUTS 0xFFU
+#define MCP_CODE_MAX 4095U
+
+#define MCP4728_VREF_VDD 0
+#define MCP4728_VREF_INTERNAL 1
+#define MCP4728_GAIN_X1 0
+#define MCP4728_GAIN_X2 1
+
+#define MCP4728_CHANNELS_PER_DAC 4
+#define MCP4728_CMD_FAST_WRITE 0x00
+#define MCP4728_CMD_MULTI_WRITE 0x40
+#define MCP4728_CMD_SEQUENTIAL_WRITE 0x50
+#define MCP4728_FRAME_MAX_LEN 12
+#define MCP4728_FAST_FRAME_LEN 8
+#define MCP4728_MULTI_WRITE_LEN 3
+
+#define ADS_CHIP_COUNT 2
+#define ADS_CHANNEL_COUNT 16
+#define ADS_ALL_CHANNELS 0xFFFFU
+#define ADS_CODE_MAX 1023U
+#define ADS_SPI_SPEED_HZ 1000000U
+#define MCP3008_CHANNELS 8
+#define MCP3008_XFER_LEN 3
+
+typedef enum e_mcp4728_frame_mode {
+    MCP4728_FRAME_SINGLE,
+    MCP4728_FRAME_FAST,
+    MCP4728_FRAME_MULTI,
+    MCP4728_FRAME_SEQUENTIAL
+}   t_mcp4728_frame_mode;
+
+typedef enum e_i2c_transport {
+    I2C_TRANSPORT_RDWR,
+    I2C_TRANSPORT_SLAVE
+}   t_i2c_transport;
+
+// I2C messages for one output update; buffers point into data[].
+typedef struct s_mcp_output_frame {
+    struct i2c_msg msgs[MCP_OUTPUT_COUNT];
+    uint8_t data[MCP_DAC_COUNT * MCP4728_FRAME_MAX_LEN];
+    unsigned int msg_count;
+}   t_mcp_output_frame;
+
+// What the DAC input register of one output holds, as last acknowledged on the bus.
+typedef struct s_mcp4728_shadow {
+    uint16_t value;
+    uint8_t vref;
+    uint8_t gain;
+    uint8_t power_down;
+}   t_mcp4728_shadow;
+
+typedef struct s_hat_dac {
+    const t_hat_transport *ops;
+    int fd;
+    t_i2c_transport transport;
+    t_mcp4728_frame_mode frame_mode;
+    uint8_t udac;
+    void *ldac_request;
+    uint32_t ldac_hold_ns;
+    uint32_t clock_read_ns;
+    unsigned long ldac_strobes;
+    t_mcp_output_frame frame;
+    t_mcp4728_shadow shadow[MCP_OUTPUT_COUNT];
+    uint8_t shadow_valid;
+    unsigned long frames;
+    unsigned long syscalls;
+    unsigned long bytes;
+    unsigned long channels_sent;
+    unsigned long channels_skipped;
+    unsigned long idle_frames;
+}   t_hat_dac;
+
+// One prebuilt SPI_IOC_MESSAGE per MCP3008: one conversion per selected channel, chip select toggled between them.
+typedef struct s_mcp3008_scan {
+    uint8_t mask;
+    unsigned int count;
+    uint8_t channels[MCP3008_CHANNELS];
+    struct spi_ioc_transfer xfers[MCP3008_CHANNELS];
+    uint8_t tx[MCP3008_CHANNELS][MCP3008_XFER_LEN];
+    uint8_t rx[MCP3008_CHANNELS][MCP3008_XFER_LEN];
+}   t_mcp3008_scan;
+
+typedef struct s_hat_adc {
+    const t_hat_transport *ops;
+    int spi_fd[ADS_CHIP_COUNT];
+    uint32_t speed_hz;
+    int ready;
+    int batched;
+    int batch_errno;
+    t_mcp3008_scan scan[ADS_CHIP_COUNT];
+    unsigned long scans;
+    unsigned long syscalls;
+    unsigned long conversions;
+}   t_hat_adc;
+
+/* MCP4728 outputs ------------------------------------------------------------------- */
+
+// Frame defaults: rdwr transport, fast frames, UDAC=0 (outputs update on the write), HAT_LDAC_HOLD_NS.
+void hat_dac_init(t_hat_dac *dac, const t_hat_transport *ops);
+int hat_dac_open(t_hat_dac *dac, const char *i2c_bus);
+void hat_dac_close(t_hat_dac *dac);
+// 1 when a device acknowledges a one-byte read at address, 0 otherwise.
+int hat_dac_probe(t_hat_dac *dac, uint8_t address);
+// Keep I2C_RDWR only if the adapter supports plain I2C messages; returns the transport kept.
+t_i2c_transport hat_dac_select_transport(t_hat_dac *dac, t_i2c_transport requested);
+
+int mcp4728_encode_channel(uint8_t buf[3], uint8_t channel, uint16_t value, uint8_t vref, uint8_t gain,
+    uint8_t power_down, uint8_t udac);
+int mcp4728_encode_frame(uint8_t frame[MCP4728_FRAME_MAX_LEN], t_mcp4728_frame_mode mode,
+    const uint16_t values[MCP4728_CHANNELS_PER_DAC], uint8_t vref, uint8_t gain, uint8_t power_down, uint8_t udac);
+int hat_build_output_frame(t_mcp_output_frame *frame, t_mcp4728_frame_mode mode, uint8_t udac,
+    const uint16_t values[MCP_OUTPUT_COUNT], uint8_t channel_mask);
+int hat_submit_output_frame(t_hat_dac *dac, const t_mcp_output_frame *frame);
+
+int hat_write_outputs(t_hat_dac *dac, t_mcp4728_frame_mode mode, uint8_t udac,
+    const uint16_t values[MCP_OUTPUT_COUNT], uint8_t channel_mask);
+int hat_write_frame(t_hat_dac *dac, const uint16_t out[MCP_OUTPUT_COUNT]);
+
+/*
+ * Delta writes: every write keeps shadow[] in step with the DAC input registers (a failed
+ * write marks its outputs unknown), so an output whose code and VREF/gain/power-down
+ * already match is not sent. hat_dirty_outputs() gives the outputs that would be sent.
+ */
+uint8_t hat_dirty_outputs(const t_hat_dac *dac, const uint16_t out[MCP_OUTPUT_COUNT], uint8_t channel_mask);
+/*
+ * Send the dirty outputs of channel_mask with the fewest bytes per DAC: nothing, a Multi-Write
+ * of just the dirty channels, or a Fast Write of all 4 when 3 or more are dirty (frame_mode
+ * fast, UDAC set and the DAC's VREF/gain known). frame_mode single sends one transaction per
+ * dirty channel. Sequential Write is never used: it also programs the EEPROM.
+ * Returns the mask of outputs sent (0 when nothing changed), or -1.
+ */
+int hat_write_delta(t_hat_dac *dac, const uint16_t out[MCP_OUTPUT_COUNT], uint8_t channel_mask);
+// Forget the shadow of the outputs in mask (e.g. after a DAC reset): their next delta write is sent.
+void hat_shadow_invalidate(t_hat_dac *dac, uint8_t output_mask);
+// One Multi-Write to one channel (VREF, gain and power-down included).
+int hat_write_channel(t_hat_dac *dac, uint8_t address, uint8_t channel, uint16_t value, uint8_t vref,
+    uint8_t gain, uint8_t power_down, uint8_t udac);
+
+/* LDAC lines ------------------------------------------------------------------------ */
+
+/*
+ * Both LDAC lines sit in one GPIO request and always change together through the
+ * set_values op, so the DACs of a strobe latch on the same edge. The low time is a
+ * busy-wait on CLOCK_MONOTONIC (usleep() sleeps tens of microseconds for 2): its
+ * target is shortened by the cost of one clock read, measured when the lines are opened.
+ */
+// Request both LDAC lines as outputs, idle high, and calibrate the hold.
+int hat_ldac_open(t_hat_dac *dac, const char *chip_path);
+void hat_ldac_close(t_hat_dac *dac);
+// Drive the lines in low_mask (HAT_LDAC_*) low and the others high, in one call.
+int hat_ldac_set(t_hat_dac *dac, uint8_t low_mask);
+// Spin for ldac_hold_ns.
+void hat_ldac_hold(const t_hat_dac *dac);
+// Low pulse on the lines in dac_mask: latches the input registers of those DACs at once.
+int hat_ldac_strobe(t_hat_dac *dac, uint8_t dac_mask);
+// HAT_LDAC_* mask of the DACs holding the outputs in output_mask.
+uint8_t hat_ldac_mask(uint8_t output_mask);
+
+/* MCP3008 inputs -------------------------------------------------------------------- */
+
+void hat_adc_init(t_hat_adc *adc, const t_hat_transport *ops, uint32_t speed_hz);
+// Open chip 0 or 1; the handle is ready once both are open.
+int hat_adc_open(t_hat_adc *adc, unsigned int chip, const char *device);
+void hat_adc_close(t_hat_adc *adc);
+
+void mcp3008_scan_init(t_mcp3008_scan *scan, uint8_t channel_mask, uint32_t speed_hz);
+int hat_adc_read_code(t_hat_adc *adc, uint8_t channel, uint16_t *code);
+int hat_adc_scan_chip(t_hat_adc *adc, unsigned int chip, uint16_t codes[MCP3008_CHANNELS]);
+
+/*
+ * Read the channels in due_mask into codes[] and return the mask of those read. When the
+ * SPI controller rejects multi-transfer messages the handle drops to one transfer per
+ * channel for good: batched becomes 0 and batch_errno keeps the error.
+ */
+uint16_t hat_read_channels(t_hat_adc *adc, uint16_t due_mask, uint16_t codes[ADS_CHANNEL_COUNT]);
+uint16_t hat_read_scan(t_hat_adc *adc, uint16_t in[ADS_CHANNEL_COUNT]);
+
+#endif
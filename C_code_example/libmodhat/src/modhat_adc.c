@@ -0,0 +1,160 @@
+#define HAT_TRANSPORT_TYPES_ONLY
+#include "modhat.h"
+
+void hat_adc_init(t_hat_adc *adc, const t_hat_transport *ops, uint32_t speed_hz)
+{
+    memset(adc, 0, sizeof(*adc));
+    adc->ops = ops;
+    adc->speed_hz = speed_hz;
+    for (unsigned int chip = 0; chip < ADS_CHIP_COUNT; chip++) {
+        adc->spi_fd[chip] = -1;
+        // Messages are built on first use, for whichever channels are due.
+        mcp3008_scan_init(&adc->scan[chip], 0, speed_hz);
+    }
+    adc->batched = 1;
+}
+
+int hat_adc_open(t_hat_adc *adc, unsigned int chip, const char *device)
+{
+    if (chip >= ADS_CHIP_COUNT) {
+        errno = EINVAL;
+        return -1;
+    }
+    adc->spi_fd[chip] = adc->ops->spi.open(device, adc->speed_hz);
+    if (adc->spi_fd[chip] < 0) {
+        return -1;
+    }
+    adc->ready = (adc->spi_fd[0] >= 0 && adc->spi_fd[1] >= 0);
+    return 0;
+}
+
+void hat_adc_close(t_hat_adc *adc)
+{
+    for (unsigned int chip = 0; chip < ADS_CHIP_COUNT; chip++) {
+        if (adc->spi_fd[chip] >= 0) {
+            adc->ops->spi.close(adc->spi_fd[chip]);
+            adc->spi_fd[chip] = -1;
+        }
+    }
+    adc->ready = 0;
+}
+
+void mcp3008_scan_init(t_mcp3008_scan *scan, uint8_t channel_mask, uint32_t speed_hz)
+{
+    memset(scan, 0, sizeof(*scan));
+    scan->mask = channel_mask;
+    for (uint8_t ch = 0; ch < MCP3008_CHANNELS; ch++) {
+        unsigned int slot = scan->count;
+
+        if (!(channel_mask & (1U << ch))) {
+            continue;
+        }
+        scan->channels[slot] = ch;
+        scan->tx[slot][0] = 1;
+        scan->tx[slot][1] = (uint8_t)((8 + ch) << 4);
+        scan->tx[slot][2] = 0;
+        scan->xfers[slot].tx_buf = (unsigned long)scan->tx[slot];
+        scan->xfers[slot].rx_buf = (unsigned long)scan->rx[slot];
+        scan->xfers[slot].len = MCP3008_XFER_LEN;
+        scan->xfers[slot].speed_hz = speed_hz;
+        scan->xfers[slot].bits_per_word = 8;
+        // Release CS between conversions; cleared again below for the last transfer.
+        scan->xfers[slot].cs_change = 1;
+        scan->count++;
+    }
+    if (scan->count > 0) {
+        scan->xfers[scan->count - 1].cs_change = 0;
+    }
+}
+
+int hat_adc_read_code(t_hat_adc *adc, uint8_t channel, uint16_t *code)
+{
+    uint8_t tx_buffer[3] = {0};
+    uint8_t rx_buffer[3] = {0};
+    uint8_t local_channel;
+
+    if (!adc->ready || channel >= ADS_CHANNEL_COUNT || !code) {
+        errno = EINVAL;
+        return -1;
+    }
+    local_channel = (uint8_t)(channel % MCP3008_CHANNELS);
+
+    tx_buffer[0] = 1;
+    tx_buffer[1] = (uint8_t)((8 + local_channel) << 4);
+    tx_buffer[2] = 0;
+
+    if (adc->ops->spi.xfer(adc->spi_fd[channel / MCP3008_CHANNELS], tx_buffer, 3, rx_buffer, 3) < 0) {
+        return -1;
+    }
+
+    *code = (uint16_t)(((rx_buffer[1] & 3) << 8) + rx_buffer[2]);
+    return 0;
+}
+
+// Read the prebuilt scan of one MCP3008 in a single ioctl. Returns the number of channels read.
+int hat_adc_scan_chip(t_hat_adc *adc, unsigned int chip, uint16_t codes[MCP3008_CHANNELS])
+{
+    t_mcp3008_scan *scan = &adc->scan[chip];
+
+    if (scan->count == 0) {
+        return 0;
+    }
+    adc->syscalls++;
+    if (adc->ops->spi.message(adc->spi_fd[chip], scan->xfers, scan->count) < 0) {
+        return -1;
+    }
+    for (unsigned int slot = 0; slot < scan->count; slot++) {
+        codes[scan->channels[slot]] = (uint16_t)(((scan->rx[slot][1] & 3) << 8) + scan->rx[slot][2]);
+    }
+    return (int)scan->count;
+}
+
+uint16_t hat_read_channels(t_hat_adc *adc, uint16_t due_mask, uint16_t codes[ADS_CHANNEL_COUNT])
+{
+    uint16_t read_mask = 0;
+
+    if (!adc->ready || due_mask == 0) {
+        return 0;
+    }
+    adc->scans++;
+    adc->conversions += (unsigned long)__builtin_popcount(due_mask);
+    if (adc->batched) {
+        for (unsigned int chip = 0; chip < ADS_CHIP_COUNT; chip++) {
+            uint8_t chip_mask = (uint8_t)(due_mask >> (chip * MCP3008_CHANNELS));
+
+            if (chip_mask == 0) {
+                continue;
+            }
+            if (adc->scan[chip].mask != chip_mask) {
+                mcp3008_scan_init(&adc->scan[chip], chip_mask, adc->speed_hz);
+            }
+            if (hat_adc_scan_chip(adc, chip, &codes[chip * MCP3008_CHANNELS]) >= 0) {
+                read_mask |= (uint16_t)(chip_mask << (chip * MCP3008_CHANNELS));
+            } else if (errno == EINVAL || errno == EMSGSIZE || errno == ENOTTY) {
+                // Controller cannot take multi-transfer messages: fall back to one xfer per channel.
+                adc->batch_errno = errno;
+                adc->batched = 0;
+                break;
+            }
+        }
+        if (adc->batched) {
+            return read_mask;
+        }
+        read_mask = 0;
+    }
+    for (uint8_t ch = 0; ch < ADS_CHANNEL_COUNT; ch++) {
+        if (!(due_mask & (1U << ch))) {
+            continue;
+        }
+        adc->syscalls++;
+        if (hat_adc_read_code(adc, ch, &codes[ch]) == 0) {
+            read_mask |= (uint16_t)(1U << ch);
+        }
+    }
+    return read_mask;
+}
+
+uint16_t hat_read_scan(t_hat_adc *adc, uint16_t in[ADS_CHANNEL_COUNT])
+{
+    return hat_read_channels(adc, ADS_ALL_CHANNELS, in);
+}
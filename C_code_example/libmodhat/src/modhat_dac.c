@@ -0,0 +1,480 @@
+#define HAT_TRANSPORT_TYPES_ONLY
+#include <time.h>
+#include "modhat.h"
+
+#define HAT_CLOCK_CALIBRATION_READS 64
+
+static inline uint64_t hat_clock_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000ULL) + (uint64_t)now.tv_nsec;
+}
+
+void hat_dac_init(t_hat_dac *dac, const t_hat_transport *ops)
+{
+    memset(dac, 0, sizeof(*dac));
+    dac->ops = ops;
+    dac->fd = -1;
+    dac->transport = I2C_TRANSPORT_RDWR;
+    dac->frame_mode = MCP4728_FRAME_FAST;
+    dac->ldac_hold_ns = HAT_LDAC_HOLD_NS;
+}
+
+int hat_dac_open(t_hat_dac *dac, const char *i2c_bus)
+{
+    dac->fd = dac->ops->i2c.open(i2c_bus);
+    return (dac->fd < 0) ? -1 : 0;
+}
+
+void hat_dac_close(t_hat_dac *dac)
+{
+    hat_ldac_close(dac);
+    if (dac->fd >= 0) {
+        dac->ops->i2c.close(dac->fd);
+        dac->fd = -1;
+    }
+}
+
+int hat_dac_probe(t_hat_dac *dac, uint8_t address)
+{
+    uint8_t buffer;
+
+    if (dac->ops->i2c.set_address(dac->fd, address) < 0) {
+        return 0;
+    }
+    return dac->ops->i2c.read(dac->fd, &buffer, 1) == 1;
+}
+
+t_i2c_transport hat_dac_select_transport(t_hat_dac *dac, t_i2c_transport requested)
+{
+    unsigned long funcs = 0;
+
+    dac->transport = requested;
+    if (requested == I2C_TRANSPORT_RDWR && (dac->ops->i2c.funcs(dac->fd, &funcs) < 0 || !(funcs & I2C_FUNC_I2C))) {
+        dac->transport = I2C_TRANSPORT_SLAVE;
+    }
+    return dac->transport;
+}
+
+// Encode one Multi-Write command (3 bytes) for a single channel. Returns 3, or -1 on invalid parameters.
+int mcp4728_encode_channel(uint8_t buf[3], uint8_t channel, uint16_t value, uint8_t vref, uint8_t gain,
+    uint8_t power_down, uint8_t udac)
+{
+    if (channel > 3 || value > MCP_CODE_MAX || vref > 1 || gain > 1 || power_down > 3) {
+        return -1;
+    }
+    buf[0] = MCP4728_CMD_MULTI_WRITE | ((channel & 0x03) << 1) | (udac & 0x01);
+    buf[1] = ((vref & 0x01) << 7) | ((power_down & 0x03) << 5) | ((gain & 0x01) << 4) | ((value >> 8) & 0x0F);
+    buf[2] = value & 0xFF;
+    return 3;
+}
+
+/*
+ * Encode one I2C payload updating the 4 channels of a single MCP4728.
+ * - FAST:       Fast Write, 2 bytes per channel (8 bytes). Keeps the current VREF/gain,
+ *               outputs latch on LDAC (no UDAC bit in this command).
+ * - MULTI:      Multi-Write repeated for A..D in one transaction (12 bytes), full VREF/gain/UDAC control.
+ * - SEQUENTIAL: Sequential Write from channel A (9 bytes). Also programs the EEPROM, so only
+ *               use it to store power-up defaults, never from the sample loop.
+ * Returns the frame length, or -1 on invalid parameters.
+ */
+int mcp4728_encode_frame(uint8_t frame[MCP4728_FRAME_MAX_LEN], t_mcp4728_frame_mode mode,
+    const uint16_t values[MCP4728_CHANNELS_PER_DAC], uint8_t vref, uint8_t gain, uint8_t power_down, uint8_t udac)
+{
+    int len = 0;
+
+    if (vref > 1 || gain > 1 || power_down > 3) {
+        return -1;
+    }
+    for (uint8_t channel = 0; channel < MCP4728_CHANNELS_PER_DAC; channel++) {
+        if (values[channel] > MCP_CODE_MAX) {
+            return -1;
+        }
+    }
+
+    if (mode == MCP4728_FRAME_SEQUENTIAL) {
+        frame[len++] = MCP4728_CMD_SEQUENTIAL_WRITE | (udac & 0x01);
+    }
+    for (uint8_t channel = 0; channel < MCP4728_CHANNELS_PER_DAC; channel++) {
+        uint16_t value = values[channel];
+
+        if (mode == MCP4728_FRAME_FAST) {
+            frame[len++] = MCP4728_CMD_FAST_WRITE | ((power_down & 0x03) << 4) | ((value >> 8) & 0x0F);
+            frame[len++] = value & 0xFF;
+            continue;
+        }
+        if (mode == MCP4728_FRAME_MULTI) {
+            len += mcp4728_encode_channel(&frame[len], channel, value, vref, gain, power_down, udac);
+            continue;
+        } else if (mode != MCP4728_FRAME_SEQUENTIAL) {
+            return -1;
+        }
+        frame[len++] = ((vref & 0x01) << 7) | ((power_down & 0x03) << 5) | ((gain & 0x01) << 4) | ((value >> 8) & 0x0F);
+        frame[len++] = value & 0xFF;
+    }
+    return len;
+}
+
+static int mcp_output_frame_push(t_mcp_output_frame *frame, uint8_t address, uint8_t *data, int len)
+{
+    struct i2c_msg *msg;
+
+    if (len < 0 || frame->msg_count >= MCP_OUTPUT_COUNT) {
+        return -1;
+    }
+    msg = &frame->msgs[frame->msg_count++];
+    msg->addr = address;
+    msg->flags = 0;
+    msg->len = (uint16_t)len;
+    msg->buf = data;
+    return len;
+}
+
+// One Multi-Write holding the channels of dac_mask, or one transaction per channel in SINGLE mode.
+static int mcp_output_frame_push_channels(t_mcp_output_frame *frame, uint8_t **cursor, uint8_t address,
+    const uint16_t dac_values[MCP4728_CHANNELS_PER_DAC], uint8_t dac_mask, t_mcp4728_frame_mode mode, uint8_t udac)
+{
+    uint8_t *message = *cursor;
+    int len;
+
+    for (uint8_t channel = 0; channel < MCP4728_CHANNELS_PER_DAC; channel++) {
+        if (!(dac_mask & (1U << channel))) {
+            continue;
+        }
+        len = mcp4728_encode_channel(*cursor, channel, dac_values[channel], MCP4728_VREF_INTERNAL,
+            MCP4728_GAIN_X1, 0, udac);
+        if (len < 0 || (mode == MCP4728_FRAME_SINGLE && mcp_output_frame_push(frame, address, *cursor, len) < 0)) {
+            return -1;
+        }
+        *cursor += len;
+    }
+    if (mode != MCP4728_FRAME_SINGLE && mcp_output_frame_push(frame, address, message, (int)(*cursor - message)) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Build the I2C messages for the outputs in channel_mask; a DAC with none of them is not
+ * addressed. A DAC with all 4 due gets one frame in the requested mode; a partial DAC
+ * gets one Multi-Write holding only its due channels (Fast Write has no channel field),
+ * and SINGLE mode one transaction per due channel.
+ */
+int hat_build_output_frame(t_mcp_output_frame *frame, t_mcp4728_frame_mode mode, uint8_t udac,
+    const uint16_t values[MCP_OUTPUT_COUNT], uint8_t channel_mask)
+{
+    static const uint8_t addresses[MCP_DAC_COUNT] = {DAC_1, DAC_2};
+    uint8_t *cursor = frame->data;
+    int len;
+
+    frame->msg_count = 0;
+    for (int dac = 0; dac < MCP_DAC_COUNT; dac++) {
+        const uint16_t *dac_values = &values[dac * MCP4728_CHANNELS_PER_DAC];
+        uint8_t dac_mask = (uint8_t)((channel_mask >> (dac * MCP4728_CHANNELS_PER_DAC)) & 0x0FU);
+
+        if (dac_mask == 0) {
+            continue;
+        }
+        if (mode == MCP4728_FRAME_SINGLE || dac_mask != 0x0FU) {
+            if (mcp_output_frame_push_channels(frame, &cursor, addresses[dac], dac_values, dac_mask, mode, udac) < 0) {
+                return -1;
+            }
+            continue;
+        }
+        len = mcp4728_encode_frame(cursor, mode, dac_values, MCP4728_VREF_INTERNAL, MCP4728_GAIN_X1, 0, udac);
+        if (mcp_output_frame_push(frame, addresses[dac], cursor, len) < 0) {
+            return -1;
+        }
+        cursor += len;
+    }
+    return 0;
+}
+
+// RDWR: one ioctl for every message. Bytes count the address byte of each message too. SLAVE: I2C_SLAVE + write() per message.
+int hat_submit_output_frame(t_hat_dac *dac, const t_mcp_output_frame *frame)
+{
+    for (unsigned int i = 0; i < frame->msg_count; i++) {
+        dac->bytes += frame->msgs[i].len + 1U;
+    }
+    if (dac->transport == I2C_TRANSPORT_RDWR) {
+        dac->syscalls++;
+        return (dac->ops->i2c.transfer(dac->fd, (struct i2c_msg *)frame->msgs, frame->msg_count) < 0) ? -1 : 0;
+    }
+
+    for (unsigned int i = 0; i < frame->msg_count; i++) {
+        dac->syscalls++;
+        if (dac->ops->i2c.set_address(dac->fd, frame->msgs[i].addr) < 0) {
+            return -1;
+        }
+        dac->syscalls++;
+        if (dac->ops->i2c.write(dac->fd, frame->msgs[i].buf, frame->msgs[i].len) != (ssize_t)frame->msgs[i].len) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void hat_shadow_store(t_hat_dac *dac, unsigned int output, uint16_t value, uint8_t vref, uint8_t gain,
+    uint8_t power_down)
+{
+    dac->shadow[output].value = value;
+    dac->shadow[output].vref = vref;
+    dac->shadow[output].gain = gain;
+    dac->shadow[output].power_down = power_down;
+    dac->shadow_valid |= (uint8_t)(1U << output);
+}
+
+/*
+ * Record a frame sent for the outputs in channel_mask. fast_dacs holds the DACs sent as a
+ * Fast Write, which sets code and power-down but leaves VREF/gain as they were.
+ */
+static void hat_shadow_sent(t_hat_dac *dac, const uint16_t values[MCP_OUTPUT_COUNT], uint8_t channel_mask,
+    uint8_t fast_dacs)
+{
+    for (unsigned int output = 0; output < MCP_OUTPUT_COUNT; output++) {
+        if (!(channel_mask & (1U << output))) {
+            continue;
+        }
+        if (fast_dacs & (1U << (output / MCP4728_CHANNELS_PER_DAC))) {
+            dac->shadow[output].value = values[output];
+            dac->shadow[output].power_down = 0;
+            continue;
+        }
+        hat_shadow_store(dac, output, values[output], MCP4728_VREF_INTERNAL, MCP4728_GAIN_X1, 0);
+    }
+    dac->channels_sent += (unsigned long)__builtin_popcount(channel_mask);
+}
+
+void hat_shadow_invalidate(t_hat_dac *dac, uint8_t output_mask)
+{
+    dac->shadow_valid &= (uint8_t)~output_mask;
+}
+
+// A whole DAC goes out in the frame mode itself; only Fast Write keeps the stored VREF/gain.
+static uint8_t hat_fast_dacs(t_mcp4728_frame_mode mode, uint8_t channel_mask)
+{
+    uint8_t fast_dacs = 0;
+
+    for (int dac = 0; dac < MCP_DAC_COUNT && mode == MCP4728_FRAME_FAST; dac++) {
+        if (((channel_mask >> (dac * MCP4728_CHANNELS_PER_DAC)) & 0x0FU) == 0x0FU) {
+            fast_dacs |= (uint8_t)(1U << dac);
+        }
+    }
+    return fast_dacs;
+}
+
+int hat_write_outputs(t_hat_dac *dac, t_mcp4728_frame_mode mode, uint8_t udac,
+    const uint16_t values[MCP_OUTPUT_COUNT], uint8_t channel_mask)
+{
+    if (hat_build_output_frame(&dac->frame, mode, udac, values, channel_mask) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    dac->frames++;
+    if (hat_submit_output_frame(dac, &dac->frame) != 0) {
+        // Part of the frame may have landed: the shadow no longer knows these registers.
+        hat_shadow_invalidate(dac, channel_mask);
+        return -1;
+    }
+    hat_shadow_sent(dac, values, channel_mask, hat_fast_dacs(mode, channel_mask));
+    return 0;
+}
+
+int hat_write_frame(t_hat_dac *dac, const uint16_t out[MCP_OUTPUT_COUNT])
+{
+    return hat_write_outputs(dac, dac->frame_mode, dac->udac, out, MCP_ALL_OUTPUTS);
+}
+
+uint8_t hat_dirty_outputs(const t_hat_dac *dac, const uint16_t out[MCP_OUTPUT_COUNT], uint8_t channel_mask)
+{
+    uint8_t dirty = (uint8_t)(channel_mask & ~dac->shadow_valid);
+
+    for (unsigned int output = 0; output < MCP_OUTPUT_COUNT; output++) {
+        const t_mcp4728_shadow *reg = &dac->shadow[output];
+
+        if (!(channel_mask & dac->shadow_valid & (1U << output))) {
+            continue;
+        }
+        if (reg->value != out[output] || reg->vref != MCP4728_VREF_INTERNAL || reg->gain != MCP4728_GAIN_X1
+            || reg->power_down != 0) {
+            dirty |= (uint8_t)(1U << output);
+        }
+    }
+    return dirty;
+}
+
+// Fast Write cannot set VREF/gain: all 4 channels must already hold the frame config.
+static int hat_shadow_config_known(const t_hat_dac *dac, int dac_index)
+{
+    for (int channel = 0; channel < MCP4728_CHANNELS_PER_DAC; channel++) {
+        int output = dac_index * MCP4728_CHANNELS_PER_DAC + channel;
+
+        if (!(dac->shadow_valid & (1U << output)) || dac->shadow[output].vref != MCP4728_VREF_INTERNAL
+            || dac->shadow[output].gain != MCP4728_GAIN_X1) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int hat_write_delta(t_hat_dac *dac, const uint16_t out[MCP_OUTPUT_COUNT], uint8_t channel_mask)
+{
+    static const uint8_t addresses[MCP_DAC_COUNT] = {DAC_1, DAC_2};
+    uint8_t dirty = hat_dirty_outputs(dac, out, channel_mask);
+    t_mcp_output_frame *frame = &dac->frame;
+    uint8_t *cursor = frame->data;
+    uint8_t sent = 0;
+    uint8_t fast_dacs = 0;
+
+    dac->channels_skipped += (unsigned long)__builtin_popcount(channel_mask & ~dirty);
+    if (dirty == 0) {
+        dac->idle_frames++;
+        return 0;
+    }
+    frame->msg_count = 0;
+    for (int index = 0; index < MCP_DAC_COUNT; index++) {
+        unsigned int shift = (unsigned int)index * MCP4728_CHANNELS_PER_DAC;
+        uint8_t dac_dirty = (uint8_t)((dirty >> shift) & 0x0FU);
+        int len;
+
+        if (dac_dirty == 0) {
+            continue;
+        }
+        // Fast Write latches on LDAC only, hence UDAC; it rewrites the clean channels with their own codes.
+        if (dac->frame_mode == MCP4728_FRAME_FAST && dac->udac
+            && __builtin_popcount(dac_dirty) * MCP4728_MULTI_WRITE_LEN > MCP4728_FAST_FRAME_LEN
+            && hat_shadow_config_known(dac, index)) {
+            len = mcp4728_encode_frame(cursor, MCP4728_FRAME_FAST, &out[shift], MCP4728_VREF_INTERNAL,
+                MCP4728_GAIN_X1, 0, dac->udac);
+            if (mcp_output_frame_push(frame, addresses[index], cursor, len) < 0) {
+                errno = EINVAL;
+                return -1;
+            }
+            cursor += len;
+            sent |= (uint8_t)(0x0FU << shift);
+            fast_dacs |= (uint8_t)(1U << index);
+            continue;
+        }
+        if (mcp_output_frame_push_channels(frame, &cursor, addresses[index], &out[shift], dac_dirty,
+                dac->frame_mode == MCP4728_FRAME_SINGLE ? MCP4728_FRAME_SINGLE : MCP4728_FRAME_MULTI,
+                dac->udac) < 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        sent |= (uint8_t)(dac_dirty << shift);
+    }
+    dac->frames++;
+    if (hat_submit_output_frame(dac, frame) != 0) {
+        hat_shadow_invalidate(dac, sent);
+        return -1;
+    }
+    hat_shadow_sent(dac, out, sent, fast_dacs);
+    return sent;
+}
+
+int hat_write_channel(t_hat_dac *dac, uint8_t address, uint8_t channel, uint16_t value, uint8_t vref,
+    uint8_t gain, uint8_t power_down, uint8_t udac)
+{
+    int dac_index = (address == DAC_1) ? 0 : (address == DAC_2) ? 1 : -1;
+    unsigned int output = (unsigned int)dac_index * MCP4728_CHANNELS_PER_DAC + channel;
+    uint8_t buf[3];
+
+    if (mcp4728_encode_channel(buf, channel, value, vref, gain, power_down, udac) < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (dac->ops->i2c.set_address(dac->fd, address) < 0 || dac->ops->i2c.write(dac->fd, buf, 3) != 3) {
+        if (dac_index >= 0) {
+            hat_shadow_invalidate(dac, (uint8_t)(1U << output));
+        }
+        return -1;
+    }
+    dac->bytes += sizeof(buf) + 1U;
+    if (dac_index >= 0) {
+        hat_shadow_store(dac, output, value, vref, gain, power_down);
+    }
+    return 0;
+}
+
+// Cheapest of a few back-to-back reads: the overshoot of the last read of a spin.
+static uint32_t hat_clock_read_cost(void)
+{
+    uint64_t best = UINT64_MAX;
+    uint64_t previous = hat_clock_ns();
+
+    for (int i = 0; i < HAT_CLOCK_CALIBRATION_READS; i++) {
+        uint64_t now = hat_clock_ns();
+
+        if (now - previous < best) {
+            best = now - previous;
+        }
+        previous = now;
+    }
+    return (uint32_t)best;
+}
+
+int hat_ldac_open(t_hat_dac *dac, const char *chip_path)
+{
+    const unsigned int offsets[MCP_DAC_COUNT] = {LDAC1_GPIO, LDAC2_GPIO};
+
+    hat_ldac_close(dac);
+    dac->clock_read_ns = hat_clock_read_cost();
+    // Both lines idle high; a low pulse latches the DAC input registers.
+    dac->ldac_request = dac->ops->gpio.request_outputs(chip_path, offsets, MCP_DAC_COUNT, HAT_GPIO_HIGH,
+        "mcp4728-ldac");
+    return dac->ldac_request ? 0 : -1;
+}
+
+void hat_ldac_close(t_hat_dac *dac)
+{
+    if (dac->ldac_request) {
+        dac->ops->gpio.release(dac->ldac_request);
+        dac->ldac_request = NULL;
+    }
+}
+
+int hat_ldac_set(t_hat_dac *dac, uint8_t low_mask)
+{
+    int values[MCP_DAC_COUNT];
+
+    if (!dac->ldac_request) {
+        errno = ENODEV;
+        return -1;
+    }
+    for (int line = 0; line < MCP_DAC_COUNT; line++) {
+        values[line] = (low_mask & (1U << line)) ? HAT_GPIO_LOW : HAT_GPIO_HIGH;
+    }
+    return dac->ops->gpio.set_values(dac->ldac_request, values);
+}
+
+void hat_ldac_hold(const t_hat_dac *dac)
+{
+    uint64_t start_ns;
+
+    if (dac->ldac_hold_ns <= dac->clock_read_ns) {
+        return;
+    }
+    start_ns = hat_clock_ns();
+    while (hat_clock_ns() - start_ns < dac->ldac_hold_ns - dac->clock_read_ns) {
+    }
+}
+
+int hat_ldac_strobe(t_hat_dac *dac, uint8_t dac_mask)
+{
+    if (hat_ldac_set(dac, dac_mask & HAT_LDAC_ALL) < 0) {
+        return -1;
+    }
+    hat_ldac_hold(dac);
+    if (hat_ldac_set(dac, 0) < 0) {
+        return -1;
+    }
+    dac->ldac_strobes++;
+    return 0;
+}
+
+uint8_t hat_ldac_mask(uint8_t output_mask)
+{
+    return (uint8_t)(((output_mask & 0x0FU) ? HAT_LDAC_DAC1 : 0U) | ((output_mask & 0xF0U) ? HAT_LDAC_DAC2 : 0U));
+}
@@ -0,0 +1,406 @@
+#ifndef WAVE_KERNEL_H
+#define WAVE_KERNEL_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <emmintrin.h>
+# define WAVE_KERNEL_SSE2 1
+#endif
+
+/*
+ * Block waveform kernel for the 8 DAC outputs: sine, triangle, saw, square/PWM and
+ * noise, each output with its own 32-bit phase accumulator.
+ *
+ * A block is computed as structure-of-arrays: one run of samples per output, in a
+ * single shape, 8 samples per step when the SSE2 kernel is available (x86, picked at
+ * run time from the CPU features; other targets, the Pi included, use the scalar
+ * kernel). Shape, 12-bit clamp and pack all stay in vector registers; an 8x8 transpose then interleaves the runs into
+ * frames of 8 codes, the layout the DAC writes take. The scalar kernel computes the
+ * same formulas one sample at a time and also finishes every block tail.
+ *
+ * Sine is an odd degree-9 polynomial on a quarter period (error below 4e-6 of full
+ * scale, far under one 12-bit step). Scalar and SSE2 give the same codes only when
+ * a*b+c is not contracted to FMA: build with -ffp-contract=off (GCC contracts by
+ * default where the target has FMA). Codes are nominal (0 mV..full scale); an output
+ * with a remap table gets its calibrated code by one lookup per sample.
+ */
+#define WAVE_CHANNELS 8
+#define WAVE_CODE_MAX 4095
+#define WAVE_CHUNK 256U
+#define WAVE_DEFAULT_DUTY 0.5f
+
+// Phase offsets that start triangle and saw at mid-scale and rising, like the sine.
+#define WAVE_TRIANGLE_PHASE 0x40000000U
+#define WAVE_SAW_PHASE 0x80000000U
+
+#define WAVE_TWO_PI 6.28318530717958647692f
+#define WAVE_UNIT_SCALE (1.0f / 16777216.0f)
+#define WAVE_NOISE_SCALE (1.0f / 8388608.0f)
+// code = s * half + mid + 0.5 (rounded by truncation, s in -1..1).
+#define WAVE_CODE_HALF 2047.5f
+#define WAVE_CODE_MID 2048.0f
+
+#define WAVE_SIN_C3 (-1.0f / 6.0f)
+#define WAVE_SIN_C5 (1.0f / 120.0f)
+#define WAVE_SIN_C7 (-1.0f / 5040.0f)
+#define WAVE_SIN_C9 (1.0f / 362880.0f)
+
+typedef enum e_wave_shape {
+    WAVE_SINE,
+    WAVE_TRIANGLE,
+    WAVE_SAW,
+    WAVE_SQUARE,
+    WAVE_NOISE,
+    WAVE_SHAPE_COUNT
+}   t_wave_shape;
+
+typedef struct s_wave_osc {
+    uint32_t phase;
+    uint32_t increment;
+    t_wave_shape shape;
+    // Square: fraction of the period spent high.
+    float duty;
+    // Noise: counter hashed into one value per sample, so every kernel draws the same stream.
+    uint32_t noise_seq;
+}   t_wave_osc;
+
+typedef struct s_wave_bank {
+    t_wave_osc osc[WAVE_CHANNELS];
+    // Nominal code -> calibrated code, NULL for an uncalibrated output.
+    const uint16_t *remap[WAVE_CHANNELS];
+}   t_wave_bank;
+
+typedef struct s_wave_kernel {
+    const char *name;
+    // Next count codes of one output into codes[], advancing its phase.
+    void (*fill)(t_wave_osc *osc, uint16_t *codes, unsigned int count);
+    // Per-output runs -> count frames of WAVE_CHANNELS codes.
+    void (*interleave)(const uint16_t codes[WAVE_CHANNELS][WAVE_CHUNK], uint16_t (*frames)[WAVE_CHANNELS],
+        unsigned int count);
+    int (*supported)(void);
+}   t_wave_kernel;
+
+static inline const char *wave_shape_name(t_wave_shape shape)
+{
+    static const char *names[WAVE_SHAPE_COUNT] = {"sine", "triangle", "saw", "square", "noise"};
+
+    return (shape < WAVE_SHAPE_COUNT) ? names[shape] : "?";
+}
+
+// Shape name -> shape, length len (the name need not be terminated). Returns -1 if unknown.
+static inline int wave_shape_parse(const char *name, size_t len, t_wave_shape *shape)
+{
+    for (int candidate = 0; candidate < WAVE_SHAPE_COUNT; candidate++) {
+        const char *known = wave_shape_name((t_wave_shape)candidate);
+
+        if (strlen(known) == len && strncmp(name, known, len) == 0) {
+            *shape = (t_wave_shape)candidate;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Scalar kernel ---------------------------------------------------------------------- */
+
+// Top 24 bits of the phase as a fraction of the period, 0 <= x < 1.
+static inline float wave_phase_unit(uint32_t phase)
+{
+    return (float)(int32_t)(phase >> 8) * WAVE_UNIT_SCALE;
+}
+
+// murmur3 finalizer of a Weyl sequence: full-period, well mixed 32-bit values.
+static inline uint32_t wave_noise_hash(uint32_t seq)
+{
+    uint32_t x = seq * 0x9E3779B1U;
+
+    x ^= x >> 16;
+    x *= 0x85EBCA6BU;
+    x ^= x >> 13;
+    x *= 0xC2B2AE35U;
+    x ^= x >> 16;
+    return x;
+}
+
+/*
+ * sin(2*pi*x): with y = x - 1/2, sin(2*pi*x) = -sign(y) * sin(2*pi*t) where
+ * t = min(|y|, 1/2 - |y|) folds the period onto the first quarter.
+ */
+static inline float wave_sine_poly(float x)
+{
+    float y = x - 0.5f;
+    float a = fabsf(y);
+    float fold = 0.5f - a;
+    // Not fminf(): without -ffast-math that is a libm call, this is one minss/fmin like the SIMD kernels.
+    float t = ((a < fold) ? a : fold) * WAVE_TWO_PI;
+    float t2 = t * t;
+    float p = t + t * t2 * (WAVE_SIN_C3 + t2 * (WAVE_SIN_C5 + t2 * (WAVE_SIN_C7 + t2 * WAVE_SIN_C9)));
+
+    return (y < 0.0f) ? p : -p;
+}
+
+// One sample of osc at phase / noise counter seq, -1..1.
+static inline float wave_sample(const t_wave_osc *osc, uint32_t phase, uint32_t seq)
+{
+    switch (osc->shape) {
+    case WAVE_TRIANGLE:
+        return 1.0f - 4.0f * fabsf(wave_phase_unit(phase + WAVE_TRIANGLE_PHASE) - 0.5f);
+    case WAVE_SAW:
+        return 2.0f * wave_phase_unit(phase + WAVE_SAW_PHASE) - 1.0f;
+    case WAVE_SQUARE:
+        return (wave_phase_unit(phase) < osc->duty) ? 1.0f : -1.0f;
+    case WAVE_NOISE:
+        return (float)(int32_t)(wave_noise_hash(seq) >> 8) * WAVE_NOISE_SCALE - 1.0f;
+    default:
+        return wave_sine_poly(wave_phase_unit(phase));
+    }
+}
+
+static inline uint16_t wave_code(float s)
+{
+    int32_t code = (int32_t)(s * WAVE_CODE_HALF + WAVE_CODE_MID);
+
+    if (code < 0) {
+        code = 0;
+    } else if (code > WAVE_CODE_MAX) {
+        code = WAVE_CODE_MAX;
+    }
+    return (uint16_t)code;
+}
+
+static void wave_fill_scalar(t_wave_osc *osc, uint16_t *codes, unsigned int count)
+{
+    for (unsigned int i = 0; i < count; i++) {
+        codes[i] = wave_code(wave_sample(osc, osc->phase, osc->noise_seq));
+        osc->phase += osc->increment;
+        osc->noise_seq++;
+    }
+}
+
+static void wave_interleave_scalar(const uint16_t codes[WAVE_CHANNELS][WAVE_CHUNK], uint16_t (*frames)[WAVE_CHANNELS],
+    unsigned int count)
+{
+    for (unsigned int i = 0; i < count; i++) {
+        for (unsigned int ch = 0; ch < WAVE_CHANNELS; ch++) {
+            frames[i][ch] = codes[ch][i];
+        }
+    }
+}
+
+/* SSE2 kernel (x86) ------------------------------------------------------------------ */
+
+#ifdef WAVE_KERNEL_SSE2
+__attribute__((target("sse2")))
+static inline __m128 wave_unit_sse2(__m128i phase)
+{
+    return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(phase, 8)), _mm_set1_ps(WAVE_UNIT_SCALE));
+}
+
+// 32-bit low multiply (_mm_mullo_epi32 is SSE4.1): even and odd lanes through _mm_mul_epu32.
+__attribute__((target("sse2")))
+static inline __m128i wave_mullo_sse2(__m128i a, uint32_t k)
+{
+    __m128i b = _mm_set1_epi32((int32_t)k);
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), b);
+
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+        _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+__attribute__((target("sse2")))
+static inline __m128 wave_sample_sse2(const t_wave_osc *osc, __m128i phase, __m128i seq)
+{
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+
+    switch (osc->shape) {
+    case WAVE_TRIANGLE: {
+        __m128 x = _mm_sub_ps(wave_unit_sse2(_mm_add_epi32(phase, _mm_set1_epi32((int32_t)WAVE_TRIANGLE_PHASE))), half);
+
+        return _mm_sub_ps(one, _mm_mul_ps(_mm_set1_ps(4.0f), _mm_andnot_ps(sign, x)));
+    }
+    case WAVE_SAW: {
+        __m128 x = wave_unit_sse2(_mm_add_epi32(phase, _mm_set1_epi32((int32_t)WAVE_SAW_PHASE)));
+
+        return _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(2.0f), x), one);
+    }
+    case WAVE_SQUARE: {
+        __m128 high = _mm_cmplt_ps(wave_unit_sse2(phase), _mm_set1_ps(osc->duty));
+
+        return _mm_sub_ps(_mm_and_ps(high, _mm_set1_ps(2.0f)), one);
+    }
+    case WAVE_NOISE: {
+        __m128i x = wave_mullo_sse2(seq, 0x9E3779B1U);
+
+        x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+        x = wave_mullo_sse2(x, 0x85EBCA6BU);
+        x = _mm_xor_si128(x, _mm_srli_epi32(x, 13));
+        x = wave_mullo_sse2(x, 0xC2B2AE35U);
+        x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+        return _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(x, 8)), _mm_set1_ps(WAVE_NOISE_SCALE)), one);
+    }
+    default: {
+        __m128 y = _mm_sub_ps(wave_unit_sse2(phase), half);
+        __m128 a = _mm_andnot_ps(sign, y);
+        __m128 t = _mm_mul_ps(_mm_min_ps(a, _mm_sub_ps(half, a)), _mm_set1_ps(WAVE_TWO_PI));
+        __m128 t2 = _mm_mul_ps(t, t);
+        __m128 p = _mm_add_ps(_mm_set1_ps(WAVE_SIN_C7), _mm_mul_ps(t2, _mm_set1_ps(WAVE_SIN_C9)));
+
+        p = _mm_add_ps(_mm_set1_ps(WAVE_SIN_C5), _mm_mul_ps(t2, p));
+        p = _mm_add_ps(_mm_set1_ps(WAVE_SIN_C3), _mm_mul_ps(t2, p));
+        p = _mm_add_ps(t, _mm_mul_ps(_mm_mul_ps(t, t2), p));
+        // Negate where y >= 0.
+        return _mm_xor_ps(p, _mm_xor_ps(_mm_and_ps(y, sign), sign));
+    }
+    }
+}
+
+__attribute__((target("sse2")))
+static void wave_fill_sse2(t_wave_osc *osc, uint16_t *codes, unsigned int count)
+{
+    const uint32_t p = osc->phase;
+    const uint32_t inc = osc->increment;
+    const __m128i phase_step = _mm_set1_epi32((int32_t)(inc * 4U));
+    const __m128i seq_step = _mm_set1_epi32(4);
+    const __m128 code_half = _mm_set1_ps(WAVE_CODE_HALF);
+    const __m128 code_mid = _mm_set1_ps(WAVE_CODE_MID);
+    const __m128i code_min = _mm_setzero_si128();
+    const __m128i code_max = _mm_set1_epi16(WAVE_CODE_MAX);
+    __m128i phase = _mm_setr_epi32((int32_t)p, (int32_t)(p + inc), (int32_t)(p + 2U * inc), (int32_t)(p + 3U * inc));
+    __m128i seq = _mm_add_epi32(_mm_set1_epi32((int32_t)osc->noise_seq), _mm_setr_epi32(0, 1, 2, 3));
+    unsigned int i = 0;
+
+    for (; i + 8U <= count; i += 8U) {
+        __m128 s0 = wave_sample_sse2(osc, phase, seq);
+        __m128 s1 = wave_sample_sse2(osc, _mm_add_epi32(phase, phase_step), _mm_add_epi32(seq, seq_step));
+        __m128i c0 = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(s0, code_half), code_mid));
+        __m128i c1 = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(s1, code_half), code_mid));
+        __m128i packed = _mm_packs_epi32(c0, c1);
+
+        packed = _mm_min_epi16(_mm_max_epi16(packed, code_min), code_max);
+        _mm_storeu_si128((__m128i *)(codes + i), packed);
+        phase = _mm_add_epi32(phase, _mm_add_epi32(phase_step, phase_step));
+        seq = _mm_add_epi32(seq, _mm_add_epi32(seq_step, seq_step));
+    }
+    osc->phase += inc * i;
+    osc->noise_seq += i;
+    wave_fill_scalar(osc, codes + i, count - i);
+}
+
+// 8x8 transpose of 16-bit codes: eight runs of 8 samples -> eight frames.
+__attribute__((target("sse2")))
+static void wave_interleave_sse2(const uint16_t codes[WAVE_CHANNELS][WAVE_CHUNK], uint16_t (*frames)[WAVE_CHANNELS],
+    unsigned int count)
+{
+    unsigned int i = 0;
+
+    for (; i + 8U <= count; i += 8U) {
+        __m128i r[WAVE_CHANNELS];
+        __m128i a[WAVE_CHANNELS];
+        __m128i b[WAVE_CHANNELS];
+
+        for (unsigned int ch = 0; ch < WAVE_CHANNELS; ch++) {
+            r[ch] = _mm_loadu_si128((const __m128i *)&codes[ch][i]);
+        }
+        for (unsigned int pair = 0; pair < WAVE_CHANNELS / 2U; pair++) {
+            a[2U * pair] = _mm_unpacklo_epi16(r[2U * pair], r[2U * pair + 1U]);
+            a[2U * pair + 1U] = _mm_unpackhi_epi16(r[2U * pair], r[2U * pair + 1U]);
+        }
+        b[0] = _mm_unpacklo_epi32(a[0], a[2]);
+        b[1] = _mm_unpackhi_epi32(a[0], a[2]);
+        b[2] = _mm_unpacklo_epi32(a[1], a[3]);
+        b[3] = _mm_unpackhi_epi32(a[1], a[3]);
+        b[4] = _mm_unpacklo_epi32(a[4], a[6]);
+        b[5] = _mm_unpackhi_epi32(a[4], a[6]);
+        b[6] = _mm_unpacklo_epi32(a[5], a[7]);
+        b[7] = _mm_unpackhi_epi32(a[5], a[7]);
+        for (unsigned int quad = 0; quad < 4U; quad++) {
+            _mm_storeu_si128((__m128i *)frames[i + 2U * quad], _mm_unpacklo_epi64(b[quad], b[quad + 4U]));
+            _mm_storeu_si128((__m128i *)frames[i + 2U * quad + 1U], _mm_unpackhi_epi64(b[quad], b[quad + 4U]));
+        }
+    }
+    for (; i < count; i++) {
+        for (unsigned int ch = 0; ch < WAVE_CHANNELS; ch++) {
+            frames[i][ch] = codes[ch][i];
+        }
+    }
+}
+
+static int wave_supported_sse2(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+}
+#endif
+
+/* Selection -------------------------------------------------------------------------- */
+
+/*
+ * "auto" (or NULL) -> the first kernel built in and supported by this CPU, SIMD first. A named kernel that is not built in or not supported gives NULL.
+ */
+static inline const t_wave_kernel *wave_kernel_select(const char *name)
+{
+    static const t_wave_kernel kernels[] = {
+#ifdef WAVE_KERNEL_SSE2
+        {"sse2", wave_fill_sse2, wave_interleave_sse2, wave_supported_sse2},
+#endif
+        {"scalar", wave_fill_scalar, wave_interleave_scalar, NULL},
+    };
+    int any = (!name || strcmp(name, "auto") == 0);
+
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        if (!any && strcmp(name, kernels[k].name) != 0) {
+            continue;
+        }
+        if (!kernels[k].supported || kernels[k].supported()) {
+            return &kernels[k];
+        }
+    }
+    return NULL;
+}
+
+// One frame straight from the scalar formulas, for callers rendering a sample at a time.
+static inline void wave_render_frame(t_wave_bank *bank, uint16_t frame[WAVE_CHANNELS])
+{
+    for (unsigned int ch = 0; ch < WAVE_CHANNELS; ch++) {
+        t_wave_osc *osc = &bank->osc[ch];
+        uint16_t code = wave_code(wave_sample(osc, osc->phase, osc->noise_seq));
+
+        frame[ch] = bank->remap[ch] ? bank->remap[ch][code] : code;
+        osc->phase += osc->increment;
+        osc->noise_seq++;
+    }
+}
+
+/*
+ * Render count frames from the bank, WAVE_CHUNK samples at a time: every output's run
+ * through the kernel, calibrated outputs through their remap, then one interleave.
+ */
+static inline void wave_render_block(t_wave_bank *bank, const t_wave_kernel *kernel,
+    uint16_t (*frames)[WAVE_CHANNELS], unsigned int count)
+{
+    uint16_t codes[WAVE_CHANNELS][WAVE_CHUNK] __attribute__((aligned(16)));
+
+    while (count > 0) {
+        unsigned int chunk = (count < WAVE_CHUNK) ? count : WAVE_CHUNK;
+
+        for (unsigned int ch = 0; ch < WAVE_CHANNELS; ch++) {
+            const uint16_t *remap = bank->remap[ch];
+
+            kernel->fill(&bank->osc[ch], codes[ch], chunk);
+            for (unsigned int i = 0; remap && i < chunk; i++) {
+                codes[ch][i] = remap[codes[ch][i]];
+            }
+        }
+        kernel->interleave((const uint16_t (*)[WAVE_CHUNK])codes, frames, chunk);
+        frames += chunk;
+        count -= chunk;
+    }
+}
+
+#endif
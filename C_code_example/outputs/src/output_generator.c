@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,43 +9,281 @@
 #include <sys/ioctl.h>
 #include <linux/i2c.h>
 #include <math.h>
+#include <limits.h>
 #include <stdint.h>
-#include <gpiod.h>
 #include <errno.h>
 #include <signal.h>
-
-#define CHIP_NAME "gpiochip0"
-#define CHIP_PATH "/dev/" CHIP_NAME
-
-#define DAC_1 0x63
-#define DAC_2 0x64
-
-#define LDAC1_GPIO 0
-#define LDAC2_GPIO 1
-
-#define MCP4728_VREF_VDD 0
-#define MCP4728_VREF_INTERNAL 1
-#define MCP4728_GAIN_X1 0
-#define MCP4728_GAIN_X2 1
+#include <time.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "calibration.h"
+#include "hat_runtime.h"
+#include "wave_kernel.h"
+#define HAT_TRANSPORT_GPIO
+#include "hat_transport.h"
+#include "modhat.h"
 
 #define DEFAULT_POINTS_PER_PERIOD 1000U
 #define MIN_POINTS_PER_PERIOD 16U
 #define MAX_POINTS_PER_PERIOD 20000U
-#define DEFAULT_SAMPLE_DELAY_US 1U
+#define DEFAULT_RATE_HZ 2000U
+#define MAX_RATE_HZ 100000U
+#define DEFAULT_SAMPLE_DELAY_US (1000000U / DEFAULT_RATE_HZ)
 #define MAX_SAMPLE_DELAY_US 1000000U
 
-#define EQUALIZER_EVERY 20U
+#define MAX_BUSY_WAIT_US 10000U
+
+#define DDS_PHASE_ONE_TURN 4294967296.0
+
+#define DEFAULT_PRERENDER_FRAMES 64U
+#define MAX_PRERENDER_FRAMES 4096U
+#define DEFAULT_PRERENDER_BLOCKS 3U
+#define MIN_PRERENDER_BLOCKS 2U
+#define MAX_PRERENDER_BLOCKS 4U
+
+#define MAX_PLAY_CHANNELS 16U
+// Readahead window of --play: kept faulted in ahead of the play head, dropped behind it.
+#define PLAY_WINDOW_BYTES (1U << 20)
+#define PLAY_PREFETCH_PERIOD_NS 5000000ULL
+
+#define EVENT_LINE_LEN 256
+#define MAX_EVENTS 65536U
+#define MAX_EVENT_MS 86400000.0
+
 #define HISTORY_EVERY 100U
+#define DEFAULT_DASHBOARD_FPS 20U
+#define MAX_DASHBOARD_FPS 120U
+#define DEFAULT_HISTORY_CAPACITY 4096U
+#define MAX_HISTORY_CAPACITY 1048576U
 
-#define MCP_OUTPUT_COUNT 8
 #define MCP_HISTORY_LINES 14
 #define MCP_HISTORY_LINE_LEN 256
 
-#define EQ_ROWS 5
-#define EQ_STEPS_PER_ROW 8
-#define EQ_BAR_WIDTH 4
+#define SCREEN_HEADER_ROWS 5
+#define SCREEN_TEXT_ROWS (SCREEN_HEADER_ROWS + MCP_HISTORY_LINES)
+#define SCREEN_EQ_ROW SCREEN_TEXT_ROWS
 
-static volatile sig_atomic_t g_keep_running = 1;
+typedef struct s_sine_options {
+    unsigned int points_per_period;
+    t_mcp4728_frame_mode frame_mode;
+    int dac_delta;
+    t_i2c_transport transport;
+    double rate_hz;
+    int rt_priority;
+    int lock_memory;
+    int cpu;
+    int busy_wait_us;
+    unsigned int ldac_hold_ns;
+    unsigned int prerender_frames;
+    unsigned int prerender_blocks;
+    const char *play_path;
+    unsigned int play_channels;
+    int play_loop;
+    unsigned long long play_start;
+    unsigned long long play_end;
+    int play_map[MCP_OUTPUT_COUNT];
+    const char *events_path;
+    int rate_set;
+    double freq_hz[MCP_OUTPUT_COUNT];
+    double phase_deg[MCP_OUTPUT_COUNT];
+    t_wave_shape wave[MCP_OUTPUT_COUNT];
+    double duty_pct[MCP_OUTPUT_COUNT];
+    const char *wave_kernel;
+    int freq_set;
+    unsigned int fps;
+    unsigned int history_capacity;
+    const char *calibration_path;
+    const char *sim_spec;
+}   t_sine_options;
+
+typedef enum e_loop_stage {
+    STAGE_WAKEUP,
+    STAGE_WAVE,
+    STAGE_I2C,
+    STAGE_LDAC,
+    STAGE_PUBLISH,
+    STAGE_LOOP,
+    STAGE_COUNT
+}   t_loop_stage;
+
+typedef struct s_history_record {
+    unsigned long sample_counter;
+    uint64_t timestamp_ns;
+    uint16_t codes[MCP_OUTPUT_COUNT];
+    uint16_t valid_mask;
+}   t_history_record;
+
+typedef struct s_dashboard_snapshot {
+    unsigned long sample_counter;
+    uint16_t codes[MCP_OUTPUT_COUNT];
+    unsigned long ticks;
+    unsigned long overruns;
+    unsigned long missed_periods;
+    unsigned long i2c_frames;
+    unsigned long i2c_syscalls;
+}   t_dashboard_snapshot;
+
+/*
+ * Sample thread -> render thread handoff. The latest snapshot goes through a seqlock
+ * (writer never waits, reader retries on a torn copy); history goes through the ring.
+ */
+typedef struct s_dashboard_ctx {
+    atomic_uint seq;
+    t_dashboard_snapshot latest;
+    t_history_ring history;
+    atomic_int running;
+    pthread_t thread;
+    const t_sine_options *options;
+}   t_dashboard_ctx;
+
+typedef struct s_dds_engine {
+    t_wave_bank bank;
+    const t_wave_kernel *kernel;
+    uint16_t remap[MCP_OUTPUT_COUNT][CAL_DAC_CODES];
+}   t_dds_engine;
+
+/*
+ * Wave thread -> sample loop handoff for --prerender: blocks of frames rendered ahead,
+ * so the sample loop only takes the next ready frame and a slow render never delays a
+ * bus write. Single producer, single consumer: `filled` (blocks rendered) is advanced by
+ * the wave thread only, `released` (blocks given back) by the sample loop only.
+ */
+typedef struct s_frame_queue {
+    uint16_t (*frames)[MCP_OUTPUT_COUNT];
+    unsigned int block_frames;
+    unsigned int blocks;
+    uint64_t block_ns;
+    t_dds_engine *dds;
+    atomic_ulong filled;
+    atomic_ulong released;
+    atomic_int running;
+    pthread_t thread;
+    t_latency_hist block_hist;
+    unsigned long block;
+    unsigned int frame;
+    unsigned long due;
+    unsigned long underruns;
+}   t_frame_queue;
+
+typedef enum e_play_format {
+    PLAY_FORMAT_RAW,
+    PLAY_FORMAT_WAV
+}   t_play_format;
+
+/*
+ * --play: a file of multichannel codes mapped read-only and played in place, one frame
+ * per tick straight from the mapping. Positions are frames; the stream position counts
+ * every frame played or skipped since the start, so it keeps growing across loops.
+ * The prefetch thread follows it to fault in the window ahead and drop the pages behind.
+ */
+typedef struct s_play_ctx {
+    const uint8_t *base;
+    size_t size;
+    const uint8_t *data;
+    unsigned long long frame_count;
+    unsigned int channels;
+    size_t frame_bytes;
+    t_play_format format;
+    uint32_t file_rate_hz;
+    unsigned long long start;
+    unsigned long long end;
+    int loop;
+    int map[MCP_OUTPUT_COUNT];
+    size_t page_size;
+    unsigned long long cursor;
+    unsigned long long loops;
+    unsigned long long skipped;
+    atomic_ullong position;
+    atomic_int running;
+    pthread_t thread;
+    unsigned long long prefetched_bytes;
+    unsigned long long dropped_bytes;
+}   t_play_ctx;
+
+typedef enum e_event_kind {
+    EVENT_SET,
+    EVENT_RAMP,
+    EVENT_ADSR,
+    EVENT_GATE_ON,
+    EVENT_GATE_OFF
+}   t_event_kind;
+
+// One line of an --events file; times are relative to the start of the sequence.
+typedef struct s_event {
+    uint64_t at_ns;
+    t_event_kind kind;
+    uint8_t output_mask;
+    uint16_t code;
+    uint16_t peak;
+    uint64_t ramp_ns;
+    uint64_t attack_ns;
+    uint64_t decay_ns;
+    uint64_t release_ns;
+}   t_event;
+
+// Heap entry: events[index] is due at due_ns; equal times keep the file order.
+typedef struct s_event_slot {
+    uint64_t due_ns;
+    uint32_t index;
+}   t_event_slot;
+
+typedef enum e_env_stage {
+    ENV_IDLE,
+    ENV_RAMP,
+    ENV_ATTACK,
+    ENV_DECAY,
+    ENV_SUSTAIN,
+    ENV_RELEASE
+}   t_env_stage;
+
+// A linear segment from `from` to `to` over [start_ns, start_ns + length_ns), plus the last ADSR set.
+typedef struct s_event_output {
+    t_env_stage stage;
+    uint64_t start_ns;
+    uint64_t length_ns;
+    uint16_t from;
+    uint16_t to;
+    uint16_t code;
+    uint64_t next_ns;
+    int has_envelope;
+    uint64_t attack_ns;
+    uint64_t decay_ns;
+    uint64_t release_ns;
+    uint16_t sustain;
+    uint16_t peak;
+}   t_event_output;
+
+/*
+ * --events: a min-heap of timestamped events drives the outputs instead of a sample
+ * clock. The loop wakes only for the next due event or the next code step of a running
+ * ramp/envelope segment, so a sparse sequence costs a few wakes and no polling.
+ */
+typedef struct s_event_sched {
+    t_event *events;
+    unsigned int count;
+    t_event_slot *heap;
+    unsigned int heap_size;
+    uint64_t loop_ns;
+    uint64_t origin_ns;
+    uint64_t min_step_ns;
+    uint64_t busy_wait_ns;
+    uint64_t deadline_ns;
+    t_event_output outputs[MCP_OUTPUT_COUNT];
+    uint16_t codes[MCP_OUTPUT_COUNT];
+    unsigned long applied;
+    unsigned long wakes;
+    unsigned long loops;
+}   t_event_sched;
+
+static t_latency_hist g_stage_hist[STAGE_COUNT];
+static const char *g_stage_names[STAGE_COUNT] = {"wakeup", "wave", "i2c", "ldac", "publish", "loop"};
+static t_calibration g_calibration;
+static t_hat_transport g_transport;
+static t_hat_dac g_dac;
 
 void delayMicroseconds(unsigned int micros) {
     usleep(micros);
@@ -54,12 +293,6 @@ void delay(unsigned int millis) {
     usleep(millis * 1000);
 }
 
-static void signal_handler(int signo)
-{
-    (void)signo;
-    g_keep_running = 0;
-}
-
 static unsigned int parse_u32_or_default(const char *raw_value, const char *param_name,
     unsigned int default_value, unsigned int min_value, unsigned int max_value)
 {
@@ -80,33 +313,389 @@ static unsigned int parse_u32_or_default(const char *raw_value, const char *para
     return (unsigned int)parsed;
 }
 
-static int parse_sine_runtime_options(int argc, char **argv,
-    unsigned int *points_per_period, unsigned int *sample_delay_us)
+static const char *mcp4728_frame_mode_name(t_mcp4728_frame_mode mode)
+{
+    static const char *names[] = {"single", "fast", "multi", "sequential"};
+
+    return names[mode];
+}
+
+static const char *i2c_transport_name(t_i2c_transport transport)
+{
+    return (transport == I2C_TRANSPORT_RDWR) ? "rdwr" : "slave";
+}
+
+static t_mcp4728_frame_mode parse_frame_mode_or_default(const char *raw_value, t_mcp4728_frame_mode default_mode)
+{
+    if (raw_value && strcmp(raw_value, "fast") == 0) {
+        return MCP4728_FRAME_FAST;
+    } else if (raw_value && strcmp(raw_value, "multi") == 0) {
+        return MCP4728_FRAME_MULTI;
+    } else if (raw_value && strcmp(raw_value, "single") == 0) {
+        return MCP4728_FRAME_SINGLE;
+    }
+    printf("Warning: invalid dac-frame='%s' (fast, multi, single), using default %s\n",
+        raw_value ? raw_value : "", mcp4728_frame_mode_name(default_mode));
+    return default_mode;
+}
+
+static int parse_on_off_or_default(const char *raw_value, const char *param_name, int default_value)
+{
+    if (raw_value && strcmp(raw_value, "on") == 0) {
+        return 1;
+    } else if (raw_value && strcmp(raw_value, "off") == 0) {
+        return 0;
+    }
+    printf("Warning: invalid %s='%s' (on, off), using default %s\n", param_name, raw_value ? raw_value : "",
+        default_value ? "on" : "off");
+    return default_value;
+}
+
+static t_i2c_transport parse_transport_or_default(const char *raw_value, t_i2c_transport default_transport)
+{
+    if (raw_value && strcmp(raw_value, "rdwr") == 0) {
+        return I2C_TRANSPORT_RDWR;
+    } else if (raw_value && strcmp(raw_value, "slave") == 0) {
+        return I2C_TRANSPORT_SLAVE;
+    }
+    printf("Warning: invalid i2c-transport='%s' (rdwr, slave), using default %s\n",
+        raw_value ? raw_value : "", i2c_transport_name(default_transport));
+    return default_transport;
+}
+
+static int parse_double_list(const char *raw_value, const char *param_name, double min_value, double max_value,
+    double values[MCP_OUTPUT_COUNT])
+{
+    double parsed[MCP_OUTPUT_COUNT];
+    const char *cursor = raw_value;
+    int count = 0;
+
+    if (!raw_value || *raw_value == '\0') {
+        printf("Warning: missing value for %s, keeping defaults\n", param_name);
+        return -1;
+    }
+    for (;;) {
+        char *end = NULL;
+
+        errno = 0;
+        parsed[count] = strtod(cursor, &end);
+        if (errno != 0 || end == cursor || parsed[count] < min_value || parsed[count] > max_value) {
+            printf("Warning: invalid %s='%s' (range %g..%g), keeping defaults\n",
+                param_name, raw_value, min_value, max_value);
+            return -1;
+        }
+        count++;
+        if (*end == '\0') {
+            break;
+        }
+        if (*end != ',' || count == MCP_OUTPUT_COUNT) {
+            printf("Warning: invalid %s='%s' (1..%d comma separated values), keeping defaults\n",
+                param_name, raw_value, MCP_OUTPUT_COUNT);
+            return -1;
+        }
+        cursor = end + 1;
+    }
+    // A single value applies to every output, a shorter list repeats its last value.
+    for (int output = 0; output < MCP_OUTPUT_COUNT; output++) {
+        values[output] = parsed[(output < count) ? output : count - 1];
+    }
+    return 0;
+}
+
+static unsigned long long parse_u64_or_default(const char *raw_value, const char *param_name,
+    unsigned long long default_value)
+{
+    char *end = NULL;
+    unsigned long long parsed;
+
+    if (!raw_value || *raw_value == '\0') {
+        printf("Warning: missing value for %s, using default %llu\n", param_name, default_value);
+        return default_value;
+    }
+    errno = 0;
+    parsed = strtoull(raw_value, &end, 10);
+    if (errno != 0 || end == raw_value || *end != '\0' || *raw_value == '-') {
+        printf("Warning: invalid %s='%s', using default %llu\n", param_name, raw_value, default_value);
+        return default_value;
+    }
+    return parsed;
+}
+
+// "<src>,<src>,..." file channel per output, "-" for an output left at 0; a short list leaves the rest off.
+static int parse_play_map(const char *raw_value, int map[MCP_OUTPUT_COUNT])
+{
+    int parsed[MCP_OUTPUT_COUNT];
+    const char *cursor = raw_value;
+    int count = 0;
+
+    if (!raw_value || *raw_value == '\0') {
+        printf("Warning: missing value for play-map, keeping defaults\n");
+        return -1;
+    }
+    for (;;) {
+        char *end = (char *)cursor;
+
+        if (*cursor == '-') {
+            parsed[count] = -1;
+            end++;
+        } else {
+            unsigned long channel;
+
+            errno = 0;
+            channel = strtoul(cursor, &end, 10);
+            if (errno != 0 || end == cursor || channel >= MAX_PLAY_CHANNELS) {
+                printf("Warning: invalid play-map='%s' (file channels 0..%u or -), keeping defaults\n",
+                    raw_value, MAX_PLAY_CHANNELS - 1U);
+                return -1;
+            }
+            parsed[count] = (int)channel;
+        }
+        count++;
+        if (*end == '\0') {
+            break;
+        }
+        if (*end != ',' || count == MCP_OUTPUT_COUNT) {
+            printf("Warning: invalid play-map='%s' (1..%d comma separated values), keeping defaults\n",
+                raw_value, MCP_OUTPUT_COUNT);
+            return -1;
+        }
+        cursor = end + 1;
+    }
+    for (int output = 0; output < MCP_OUTPUT_COUNT; output++) {
+        map[output] = (output < count) ? parsed[output] : -1;
+    }
+    return 0;
+}
+
+static int parse_wave_list(const char *raw_value, t_wave_shape shapes[MCP_OUTPUT_COUNT])
+{
+    t_wave_shape parsed[MCP_OUTPUT_COUNT];
+    const char *cursor = raw_value;
+    int count = 0;
+
+    if (!raw_value || *raw_value == '\0') {
+        printf("Warning: missing value for wave, keeping defaults\n");
+        return -1;
+    }
+    for (;;) {
+        size_t len = strcspn(cursor, ",");
+
+        if (wave_shape_parse(cursor, len, &parsed[count]) != 0) {
+            printf("Warning: invalid wave='%s' (sine, triangle, saw, square, noise), keeping defaults\n", raw_value);
+            return -1;
+        }
+        count++;
+        if (cursor[len] == '\0') {
+            break;
+        }
+        if (count == MCP_OUTPUT_COUNT) {
+            printf("Warning: invalid wave='%s' (1..%d comma separated values), keeping defaults\n",
+                raw_value, MCP_OUTPUT_COUNT);
+            return -1;
+        }
+        cursor += len + 1;
+    }
+    for (int output = 0; output < MCP_OUTPUT_COUNT; output++) {
+        shapes[output] = parsed[(output < count) ? output : count - 1];
+    }
+    return 0;
+}
+
+static int parse_sine_runtime_options(int argc, char **argv, t_sine_options *options)
 {
-    *points_per_period = DEFAULT_POINTS_PER_PERIOD;
-    *sample_delay_us = DEFAULT_SAMPLE_DELAY_US;
+    options->points_per_period = DEFAULT_POINTS_PER_PERIOD;
+    options->frame_mode = MCP4728_FRAME_FAST;
+    options->dac_delta = 1;
+    options->transport = I2C_TRANSPORT_RDWR;
+    options->rate_hz = DEFAULT_RATE_HZ;
+    options->rt_priority = 0;
+    options->lock_memory = 0;
+    options->cpu = -1;
+    options->busy_wait_us = -1;
+    options->ldac_hold_ns = HAT_LDAC_HOLD_NS;
+    options->prerender_frames = DEFAULT_PRERENDER_FRAMES;
+    options->prerender_blocks = DEFAULT_PRERENDER_BLOCKS;
+    options->wave_kernel = "auto";
+    options->play_path = NULL;
+    options->play_channels = MCP_OUTPUT_COUNT;
+    options->play_loop = 0;
+    options->play_start = 0;
+    options->play_end = 0;
+    options->events_path = NULL;
+    options->rate_set = 0;
+    options->freq_set = 0;
+    options->fps = DEFAULT_DASHBOARD_FPS;
+    options->history_capacity = DEFAULT_HISTORY_CAPACITY;
+    options->calibration_path = NULL;
+    options->sim_spec = NULL;
+    for (int output = 0; output < MCP_OUTPUT_COUNT; output++) {
+        options->freq_hz[output] = 0.0;
+        options->phase_deg[output] = (360.0 / MCP_OUTPUT_COUNT) * (double)output;
+        options->wave[output] = WAVE_SINE;
+        options->duty_pct[output] = 100.0 * WAVE_DEFAULT_DUTY;
+        options->play_map[output] = output;
+    }
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--help") == 0) {
-            printf("Usage: %s [--resolution=<points>] [--points=<points>] [--delay-us=<microseconds>]\n", argv[0]);
-            printf("  --resolution / --points : points per sine period (%u..%u), default: %u\n",
+            printf("Usage: %s [--resolution=<points>] [--points=<points>] [--delay-us=<microseconds>] [--dac-frame=<mode>]\n"
+                "       [--dac-delta=<on|off>] [--i2c-transport=<rdwr|slave>] [--rate-hz=<Hz>] [--freq-hz=<Hz>[,<Hz>...]]\n"
+                "       [--phase-deg=<deg>[,<deg>...]] [--wave=<shape>[,<shape>...]] [--duty=<percent>[,<percent>...]]\n"
+                "       [--wave-kernel=<auto|scalar|sse2>] [--rt-priority=<1..99>] [--mlock] [--cpu=<core>]\n"
+                "       [--busy-wait-us=<microseconds>] [--fps=<frames>] [--history=<records>]\n"
+                "       [--calibration=<file>] [--ldac-hold-ns=<ns>] [--prerender=<frames>] [--prerender-blocks=<n>]\n"
+                "       [--play=<file>] [--play-channels=<n>] [--play-loop] [--play-start=<frame>] [--play-end=<frame>]\n"
+                "       [--play-map=<ch|->[,<ch|->...]] [--events=<file>] [--sim[=<options>]]\n", argv[0]);
+            printf("  --resolution / --points : points per sine period (%u..%u) when --freq-hz is not set, default: %u\n",
                 MIN_POINTS_PER_PERIOD, MAX_POINTS_PER_PERIOD, DEFAULT_POINTS_PER_PERIOD);
-            printf("  --delay-us              : delay between samples in microseconds (0..%u), default: %u\n",
-                MAX_SAMPLE_DELAY_US, DEFAULT_SAMPLE_DELAY_US);
-            printf("Display cadence is controlled by EQUALIZER_EVERY and HISTORY_EVERY defines in source.\n");
+            printf("  --delay-us              : legacy alias of --rate-hz, period between samples in microseconds (0..%u)\n",
+                MAX_SAMPLE_DELAY_US);
+            printf("  --dac-frame             : fast (1 Fast Write per DAC), multi (1 batched Multi-Write per DAC),\n");
+            printf("                            single (1 transaction per channel), default: fast\n");
+            printf("  --dac-delta             : on (send only the outputs whose code changed, cheapest command per DAC)\n");
+            printf("                            or off (rewrite all 8 outputs every sample), default: on\n");
+            printf("  --i2c-transport         : rdwr (whole 8-output frame in one I2C_RDWR ioctl) or\n");
+            printf("                            slave (I2C_SLAVE + write() per message), default: rdwr\n");
+            printf("  --rate-hz               : sample rate on an absolute-deadline clock (0 = free-running, max %u), default: %u\n",
+                MAX_RATE_HZ, DEFAULT_RATE_HZ);
+            printf("                            (the old default, a 1..10 us sleep per sample, was close to --rate-hz=0)\n");
+            printf("  --freq-hz               : output frequency in Hz, one value or one per output (max rate/2)\n");
+            printf("  --phase-deg             : phase offset in degrees, one value or one per output, default: 0,45,...,315\n");
+            printf("  --wave                  : sine, triangle, saw, square or noise, one value or one per output, default: sine\n");
+            printf("  --duty                  : high time of square outputs in percent (1..99), one value or one per output,\n");
+            printf("                            default: 50\n");
+            printf("  --wave-kernel           : block waveform kernel, auto (sse2 when the CPU has it), scalar or sse2 (x86),\n");
+            printf("                            default: auto\n");
+            printf("  --rt-priority           : run the sample loop with SCHED_FIFO priority (1..99), default: off\n");
+            printf("  --mlock                 : lock all pages in RAM (mlockall) to avoid page-fault stalls\n");
+            printf("  --cpu                   : pin the process to one CPU core, default: no pinning\n");
+            printf("  --busy-wait-us          : spin this long before each deadline (0..%u), default: %u below %u us periods\n",
+                MAX_BUSY_WAIT_US, AUTO_BUSY_WAIT_US, SHORT_PERIOD_NS / 1000U);
+            printf("  --fps                   : dashboard redraw rate of the render thread (0 = no dashboard, max %u), default: %u\n",
+                MAX_DASHBOARD_FPS, DEFAULT_DASHBOARD_FPS);
+            printf("  --history               : history records kept in RAM (%u..%u), default: %u\n",
+                MCP_HISTORY_LINES, MAX_HISTORY_CAPACITY, DEFAULT_HISTORY_CAPACITY);
+            printf("  --calibration           : per-output gain/offset or piecewise-linear table file (see README),\n");
+            printf("                            default: nominal 0..%u mV\n", CAL_DAC_FULL_SCALE_MV);
+            printf("  --ldac-hold-ns          : low time of the LDAC strobe latching both DACs (0..%u), default: %u\n",
+                HAT_LDAC_MAX_HOLD_NS, HAT_LDAC_HOLD_NS);
+            printf("  --prerender             : frames per block rendered ahead by the wave thread (0 = render in the\n");
+            printf("                            sample loop, always the case when free-running, max %u), default: %u\n",
+                MAX_PRERENDER_FRAMES, DEFAULT_PRERENDER_FRAMES);
+            printf("  --prerender-blocks      : blocks in the prerender queue (%u = double, 3 = triple buffering, max %u),\n",
+                MIN_PRERENDER_BLOCKS, MAX_PRERENDER_BLOCKS);
+            printf("                            default: %u\n", DEFAULT_PRERENDER_BLOCKS);
+            printf("  --play                  : play a file of codes instead of the waveforms: 16-bit PCM WAV (its rate\n");
+            printf("                            unless --rate-hz is given) or raw little-endian 12-bit codes, default: off\n");
+            printf("  --play-channels         : channels per frame of a raw --play file (1..%u), default: %u\n",
+                MAX_PLAY_CHANNELS, MCP_OUTPUT_COUNT);
+            printf("  --play-loop             : loop between --play-start and --play-end instead of stopping at the end\n");
+            printf("  --play-start / -end     : first frame and end frame (exclusive, 0 = end of file), default: whole file\n");
+            printf("  --play-map              : file channel for each output, - leaves an output at 0, default: 0,1,...,7\n");
+            printf("  --events                : drive the outputs from a file of timed set/ramp/adsr/gate events (see\n");
+            printf("                            README); --rate-hz caps the ramp update rate (0 = every code), default: off\n");
+            printf("  --sim                   : run against the simulated hat instead of /dev/i2c-1 and LDAC GPIOs,\n");
+            printf("                            options i2c-hz=,loopback=,pace (see README), default: hardware\n");
+            printf("History cadence is controlled by the HISTORY_EVERY define in source.\n");
             return 1;
         } else if (strncmp(argv[i], "--resolution=", 13) == 0) {
-            *points_per_period = parse_u32_or_default(argv[i] + 13, "resolution",
+            options->points_per_period = parse_u32_or_default(argv[i] + 13, "resolution",
                 DEFAULT_POINTS_PER_PERIOD, MIN_POINTS_PER_PERIOD, MAX_POINTS_PER_PERIOD);
         } else if (strncmp(argv[i], "--points=", 9) == 0) {
-            *points_per_period = parse_u32_or_default(argv[i] + 9, "points",
+            options->points_per_period = parse_u32_or_default(argv[i] + 9, "points",
                 DEFAULT_POINTS_PER_PERIOD, MIN_POINTS_PER_PERIOD, MAX_POINTS_PER_PERIOD);
         } else if (strncmp(argv[i], "--delay-us=", 11) == 0) {
-            *sample_delay_us = parse_u32_or_default(argv[i] + 11, "delay-us",
+            unsigned int delay_us = parse_u32_or_default(argv[i] + 11, "delay-us",
                 DEFAULT_SAMPLE_DELAY_US, 0U, MAX_SAMPLE_DELAY_US);
+
+            options->rate_hz = delay_us ? fmin(1000000.0 / (double)delay_us, (double)MAX_RATE_HZ) : 0.0;
+            options->rate_set = 1;
+        } else if (strncmp(argv[i], "--dac-frame=", 12) == 0) {
+            options->frame_mode = parse_frame_mode_or_default(argv[i] + 12, MCP4728_FRAME_FAST);
+        } else if (strncmp(argv[i], "--dac-delta=", 12) == 0) {
+            options->dac_delta = parse_on_off_or_default(argv[i] + 12, "dac-delta", 1);
+        } else if (strncmp(argv[i], "--i2c-transport=", 16) == 0) {
+            options->transport = parse_transport_or_default(argv[i] + 16, I2C_TRANSPORT_RDWR);
+        } else if (strncmp(argv[i], "--rate-hz=", 10) == 0) {
+            options->rate_hz = (double)parse_u32_or_default(argv[i] + 10, "rate-hz",
+                DEFAULT_RATE_HZ, 0U, MAX_RATE_HZ);
+            options->rate_set = 1;
+        } else if (strncmp(argv[i], "--freq-hz=", 10) == 0) {
+            if (parse_double_list(argv[i] + 10, "freq-hz", 0.0, MAX_RATE_HZ / 2.0, options->freq_hz) == 0) {
+                options->freq_set = 1;
+            }
+        } else if (strncmp(argv[i], "--phase-deg=", 12) == 0) {
+            parse_double_list(argv[i] + 12, "phase-deg", -360.0, 360.0, options->phase_deg);
+        } else if (strncmp(argv[i], "--wave=", 7) == 0) {
+            parse_wave_list(argv[i] + 7, options->wave);
+        } else if (strncmp(argv[i], "--duty=", 7) == 0) {
+            parse_double_list(argv[i] + 7, "duty", 1.0, 99.0, options->duty_pct);
+        } else if (strncmp(argv[i], "--wave-kernel=", 14) == 0) {
+            options->wave_kernel = argv[i] + 14;
+        } else if (strncmp(argv[i], "--rt-priority=", 14) == 0) {
+            options->rt_priority = (int)parse_u32_or_default(argv[i] + 14, "rt-priority", 0U, 0U, 99U);
+        } else if (strcmp(argv[i], "--mlock") == 0) {
+            options->lock_memory = 1;
+        } else if (strncmp(argv[i], "--cpu=", 6) == 0) {
+            options->cpu = (int)parse_u32_or_default(argv[i] + 6, "cpu", 0U, 0U, CPU_SETSIZE - 1U);
+        } else if (strncmp(argv[i], "--busy-wait-us=", 15) == 0) {
+            options->busy_wait_us = (int)parse_u32_or_default(argv[i] + 15, "busy-wait-us",
+                AUTO_BUSY_WAIT_US, 0U, MAX_BUSY_WAIT_US);
+        } else if (strncmp(argv[i], "--fps=", 6) == 0) {
+            options->fps = parse_u32_or_default(argv[i] + 6, "fps", DEFAULT_DASHBOARD_FPS, 0U, MAX_DASHBOARD_FPS);
+        } else if (strncmp(argv[i], "--history=", 10) == 0) {
+            options->history_capacity = parse_u32_or_default(argv[i] + 10, "history", DEFAULT_HISTORY_CAPACITY,
+                MCP_HISTORY_LINES, MAX_HISTORY_CAPACITY);
+        } else if (strncmp(argv[i], "--calibration=", 14) == 0) {
+            options->calibration_path = argv[i] + 14;
+        } else if (strncmp(argv[i], "--ldac-hold-ns=", 15) == 0) {
+            options->ldac_hold_ns = parse_u32_or_default(argv[i] + 15, "ldac-hold-ns", HAT_LDAC_HOLD_NS,
+                0U, HAT_LDAC_MAX_HOLD_NS);
+        } else if (strncmp(argv[i], "--prerender=", 12) == 0) {
+            options->prerender_frames = parse_u32_or_default(argv[i] + 12, "prerender", DEFAULT_PRERENDER_FRAMES,
+                0U, MAX_PRERENDER_FRAMES);
+        } else if (strncmp(argv[i], "--prerender-blocks=", 19) == 0) {
+            options->prerender_blocks = parse_u32_or_default(argv[i] + 19, "prerender-blocks", DEFAULT_PRERENDER_BLOCKS,
+                MIN_PRERENDER_BLOCKS, MAX_PRERENDER_BLOCKS);
+        } else if (strncmp(argv[i], "--play=", 7) == 0) {
+            options->play_path = argv[i] + 7;
+        } else if (strncmp(argv[i], "--play-channels=", 16) == 0) {
+            options->play_channels = parse_u32_or_default(argv[i] + 16, "play-channels", MCP_OUTPUT_COUNT,
+                1U, MAX_PLAY_CHANNELS);
+        } else if (strcmp(argv[i], "--play-loop") == 0) {
+            options->play_loop = 1;
+        } else if (strncmp(argv[i], "--play-start=", 13) == 0) {
+            options->play_start = parse_u64_or_default(argv[i] + 13, "play-start", 0ULL);
+        } else if (strncmp(argv[i], "--play-end=", 11) == 0) {
+            options->play_end = parse_u64_or_default(argv[i] + 11, "play-end", 0ULL);
+        } else if (strncmp(argv[i], "--play-map=", 11) == 0) {
+            parse_play_map(argv[i] + 11, options->play_map);
+        } else if (strncmp(argv[i], "--events=", 9) == 0) {
+            options->events_path = argv[i] + 9;
+        } else if (strcmp(argv[i], "--sim") == 0 || strncmp(argv[i], "--sim=", 6) == 0) {
+            options->sim_spec = argv[i][5] == '=' ? argv[i] + 6 : "";
         } else {
             printf("Warning: unknown option '%s' (use --help)\n", argv[i]);
         }
     }
+    if (options->events_path && options->play_path) {
+        printf("Error: --events and --play both drive the outputs, use one of them\n");
+        return -1;
+    }
+    if (options->play_path && options->rate_hz <= 0.0) {
+        printf("Warning: --play needs a fixed sample rate, using --rate-hz=%u\n", DEFAULT_RATE_HZ);
+        options->rate_hz = DEFAULT_RATE_HZ;
+    }
+    if (options->freq_set && options->rate_hz <= 0.0) {
+        printf("Warning: --freq-hz needs a fixed sample rate, using --rate-hz=%u\n", DEFAULT_RATE_HZ);
+        options->rate_hz = DEFAULT_RATE_HZ;
+    }
+    for (int output = 0; output < MCP_OUTPUT_COUNT && options->freq_set; output++) {
+        if (options->freq_hz[output] > options->rate_hz / 2.0) {
+            printf("Warning: freq-hz %.3f on output %d is above rate/2, clamped to %.3f\n",
+                options->freq_hz[output], output, options->rate_hz / 2.0);
+            options->freq_hz[output] = options->rate_hz / 2.0;
+        }
+    }
     return 0;
 }
 
@@ -114,32 +703,22 @@ static int parse_sine_runtime_options(int argc, char **argv,
 
 int i2c_init(const char *i2c_bus)
 {
-	int fd;
-	if ((fd = open(i2c_bus, O_RDWR)) < 0)
+	if (hat_dac_open(&g_dac, i2c_bus) < 0)
 	{
 		perror("Error opening I2C bus");
 		return -1;
 	}
-	return fd;
+	return g_dac.fd;
 }
 
-int check_device_at_address(int fd, uint8_t address)
+int check_device_at_address(t_hat_dac *dac, uint8_t address)
 {
-    if (ioctl(fd, I2C_SLAVE, address) < 0)
-	{
-        return 0;
-	}
-	uint8_t buffer;
-    if (read(fd, &buffer, 1) != 1)
-	{
-        return 0;
-	}
-    return 1;
+    return hat_dac_probe(dac, address);
 }
 
 
 
-void scan_i2c_bus(int file) {
+void scan_i2c_bus(t_hat_dac *dac) {
     printf("\nScanning I2C bus...\n");
     printf("     0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F\n");
 
@@ -152,12 +731,7 @@ void scan_i2c_bus(int file) {
                 printf("   ");
                 continue;
             }
-            if (ioctl(file, I2C_SLAVE, addr) < 0) {
-                printf("-- ");
-                continue;
-            }
-            char buf;
-            if (read(file, &buf, 1) < 0) {
+            if (!hat_dac_probe(dac, (uint8_t)addr)) {
                 printf("-- ");
             } else {
                 printf("%02x ", addr);
@@ -168,28 +742,33 @@ void scan_i2c_bus(int file) {
     printf("\nScan completed.\n");
 }
 
-void i2c_write(int fd, uint8_t address, uint8_t* data, int length) {
-    if (ioctl(fd, I2C_SLAVE, address) < 0) {
+void i2c_write(t_hat_dac *dac, uint8_t address, uint8_t* data, int length) {
+    if (dac->ops->i2c.set_address(dac->fd, address) < 0) {
         printf("Error opening I2C bus\n");
         return;
     }
 
-    if (write(fd, data, length) != length) {
+    if (dac->ops->i2c.write(dac->fd, data, (size_t)length) != length) {
         printf("Error writing to device\n");
         return;
     }
 }
 
-static void mcp_build_history_line(char *line, size_t line_size, unsigned long sample_counter,
-    const float output_volts[MCP_OUTPUT_COUNT])
+static inline uint32_t mcp_code_to_mv(uint8_t channel, uint16_t code)
+{
+    return calibration_dac_mv(&g_calibration, channel, code);
+}
+
+static void mcp_format_history_line(char *line, size_t line_size, const t_history_record *record)
 {
-    int used = snprintf(line, line_size, "#%08lu", sample_counter);
+    int used = snprintf(line, line_size, "#%08lu", record->sample_counter);
     if (used < 0 || (size_t)used >= line_size) {
         return;
     }
 
     for (uint8_t ch = 0; ch < MCP_OUTPUT_COUNT; ch++) {
-        int written = snprintf(line + used, line_size - (size_t)used, " %4.1f", output_volts[ch]);
+        uint32_t tenths = (mcp_code_to_mv(ch, record->codes[ch]) + 50U) / 100U;
+        int written = snprintf(line + used, line_size - (size_t)used, " %2u.%u", tenths / 10U, tenths % 10U);
         if (written < 0 || (size_t)written >= line_size - (size_t)used) {
             break;
         }
@@ -197,289 +776,1302 @@ static void mcp_build_history_line(char *line, size_t line_size, unsigned long s
     }
 }
 
-static void mcp_push_history(char history[MCP_HISTORY_LINES][MCP_HISTORY_LINE_LEN],
-    unsigned int *history_count, const char *line)
+/*
+ * Compose the frame into the screen buffer and emit it with one write(). Rows sit at
+ * fixed positions, so only changed text rows and bar cells are redrawn using cursor
+ * addressing; a full repaint every SCREEN_REPAINT_EVERY frames heals stray output.
+ */
+static void mcp_render_dashboard(t_screen *screen, const t_history_record *history,
+    unsigned int history_count, const t_dashboard_snapshot *snapshot, const t_sine_options *options)
 {
-    if (*history_count < MCP_HISTORY_LINES) {
-        snprintf(history[*history_count], MCP_HISTORY_LINE_LEN, "%s", line);
-        (*history_count)++;
-        return;
-    }
+    char line[SCREEN_LINE_LEN];
+    int row = 0;
 
-    for (unsigned int i = 1; i < MCP_HISTORY_LINES; i++) {
-        snprintf(history[i - 1], MCP_HISTORY_LINE_LEN, "%s", history[i]);
+    if ((screen->frames++ % SCREEN_REPAINT_EVERY) == 0) {
+        screen->drawn = 0;
     }
-    snprintf(history[MCP_HISTORY_LINES - 1], MCP_HISTORY_LINE_LEN, "%s", line);
-}
-
-static int voltage_to_equalizer_steps(float voltage)
-{
-    double scaled;
-
-    if (voltage < 0.0f) {
-        voltage = 0.0f;
-    } else if (voltage > 10.0f) {
-        voltage = 10.0f;
+    if (!screen->drawn) {
+        int used;
+
+        screen_append(screen, "\033[H\033[2J", 7);
+        for (int eq_row = 0; eq_row < EQ_ROWS; eq_row++) {
+            screen_move(screen, SCREEN_EQ_ROW + (EQ_ROWS - 1 - eq_row), 0);
+            used = snprintf(line, sizeof(line), "%2dV", (eq_row + 1) * 2);
+            screen_append(screen, line, (size_t)used);
+        }
+        used = snprintf(line, sizeof(line), "%*s", EQ_LABEL_WIDTH, "");
+        for (uint8_t ch = 0; ch < MCP_OUTPUT_COUNT; ch++) {
+            used += snprintf(line + used, sizeof(line) - (size_t)used, " %4u", ch);
+        }
+        screen_move(screen, SCREEN_EQ_ROW + EQ_ROWS, 0);
+        screen_append(screen, line, (size_t)used);
     }
 
-    scaled = ((double)voltage / 10.0) * (double)(EQ_ROWS * EQ_STEPS_PER_ROW);
-    return (int)lround(scaled);
-}
-
-static void mcp_render_dashboard(const char history[MCP_HISTORY_LINES][MCP_HISTORY_LINE_LEN],
-    unsigned int history_count, const float output_volts[MCP_OUTPUT_COUNT],
-    unsigned int points_per_period, unsigned int sample_delay_us)
-{
-    static const char *blocks[EQ_STEPS_PER_ROW + 1] = {" ", "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"};
-
-    printf("\033[H\033[J");
-    printf("=== MCP output monitor ===\n");
-    printf("Config: resolution=%u points | delay=%u us | eq-every=%u | history-every=%u\n",
-        points_per_period, sample_delay_us, EQUALIZER_EVERY, HISTORY_EVERY);
-    printf("MCP output history (0..10V normalized):\n");
-
-    for (unsigned int i = 0; i < history_count; i++) {
-        printf("%s\n", history[i]);
+    screen_set_line(screen, row++, "=== MCP output monitor ===");
+    if (options->freq_set) {
+        snprintf(line, sizeof(line), "Config: freq=%.3f Hz (out 0) | rate=%.0f Hz | fps=%u | history-every=%u",
+            options->freq_hz[0], options->rate_hz, options->fps, HISTORY_EVERY);
+    } else {
+        snprintf(line, sizeof(line), "Config: resolution=%u points | rate=%.0f Hz | fps=%u | history-every=%u",
+            options->points_per_period, options->rate_hz, options->fps, HISTORY_EVERY);
+    }
+    screen_set_line(screen, row++, line);
+    snprintf(line, sizeof(line), "Clock: ticks=%lu | overruns=%lu | missed periods=%lu",
+        snapshot->ticks, snapshot->overruns, snapshot->missed_periods);
+    screen_set_line(screen, row++, line);
+    snprintf(line, sizeof(line), "I2C: transport=%s | dac-frame=%s | %.2f syscalls/frame",
+        i2c_transport_name(options->transport), mcp4728_frame_mode_name(options->frame_mode),
+        snapshot->i2c_frames ? (double)snapshot->i2c_syscalls / (double)snapshot->i2c_frames : 0.0);
+    screen_set_line(screen, row++, line);
+    screen_set_line(screen, row++, g_calibration.dac_calibrated ? "MCP output history (V, calibrated):"
+        : "MCP output history (V, nominal 0..10V):");
+    for (unsigned int i = 0; i < MCP_HISTORY_LINES; i++) {
+        line[0] = '\0';
+        if (i < history_count) {
+            mcp_format_history_line(line, sizeof(line), &history[i]);
+        }
+        screen_set_line(screen, row++, line);
     }
 
-    for (int row = EQ_ROWS - 1; row >= 0; row--) {
-        printf("%2dV%6s", (row + 1) * 2, "");
+    for (int eq_row = 0; eq_row < EQ_ROWS; eq_row++) {
         for (uint8_t ch = 0; ch < MCP_OUTPUT_COUNT; ch++) {
-            int steps = voltage_to_equalizer_steps(output_volts[ch]);
-            int cell = steps - (row * EQ_STEPS_PER_ROW);
+            int steps = mv_to_equalizer_steps(mcp_code_to_mv(ch, snapshot->codes[ch]));
+            int cell = steps - (eq_row * EQ_STEPS_PER_ROW);
 
             if (cell < 0) {
                 cell = 0;
             } else if (cell > EQ_STEPS_PER_ROW) {
                 cell = EQ_STEPS_PER_ROW;
             }
-
-            printf(" ");
-            for (int w = 0; w < EQ_BAR_WIDTH; w++) {
-                printf("%s", blocks[cell]);
-            }
+            screen_set_cell(screen, SCREEN_EQ_ROW, eq_row, ch, (uint8_t)cell);
         }
-        printf("\n");
     }
+    screen_move(screen, SCREEN_EQ_ROW + EQ_ROWS + 1, 0);
+    screen_flush(screen);
+}
 
-    printf("%9s", "");
-    for (uint8_t ch = 0; ch < MCP_OUTPUT_COUNT; ch++) {
-        printf(" %4u", ch);
+static int setup_ldac(void)
+{
+    if (hat_ldac_open(&g_dac, HAT_GPIO_CHIP) != 0) {
+        printf("Error: unable to request LDAC GPIO lines on %s: %s\n", HAT_GPIO_CHIP, strerror(errno));
+        return -1;
     }
-    printf("\n");
-    fflush(stdout);
+    return 0;
 }
 
-typedef struct s_ldac_gpio_ctx {
-    struct gpiod_chip *chip;
-    struct gpiod_line_request *request;
-    int ready;
-}   t_ldac_gpio_ctx;
+static int mcp4728_write_channel_with_udac(t_hat_dac *dac, uint8_t address, uint8_t channel, uint16_t value, uint8_t vref, uint8_t gain, uint8_t power_down, uint8_t udac)
+{
+    if (channel > 3) {
+        printf("Error: invalid channel (0-3)\n");
+        return -1;
+    }
 
-static t_ldac_gpio_ctx g_ldac_ctx = {0};
+    if (value > 4095) {
+        printf("Error: invalid value (0-4095)\n");
+        return -1;
+    }
 
-static void cleanup_ldac(void)
-{
-    if (g_ldac_ctx.request) {
-        gpiod_line_request_release(g_ldac_ctx.request);
-        g_ldac_ctx.request = NULL;
+    if (vref > 1 || gain > 1 || power_down > 3) {
+        printf("Error: invalid vref/gain/power_down parameters\n");
+        return -1;
     }
-    if (g_ldac_ctx.chip) {
-        gpiod_chip_close(g_ldac_ctx.chip);
-        g_ldac_ctx.chip = NULL;
+
+    if (hat_write_channel(dac, address, channel, value, vref, gain, power_down, udac) != 0) {
+        printf("Error writing to MCP4728 at address 0x%02X: %s\n", address, strerror(errno));
+        return -1;
     }
-    g_ldac_ctx.ready = 0;
+
+    return 0;
 }
 
-static int setup_ldac(void)
+int mcp4728_write_channel(t_hat_dac *dac, uint8_t address, uint8_t channel, uint16_t value, uint8_t vref, uint8_t gain, uint8_t power_down)
 {
-    struct gpiod_line_settings *line_settings = NULL;
-    struct gpiod_line_config *line_config = NULL;
-    struct gpiod_request_config *request_config = NULL;
-    const unsigned int offsets[2] = {LDAC1_GPIO, LDAC2_GPIO};
-    const enum gpiod_line_value init_values[2] = {
-        GPIOD_LINE_VALUE_ACTIVE,
-        GPIOD_LINE_VALUE_ACTIVE
-    };
+    // UDAC=0 pour mise à jour immédiate (comportement par défaut)
+    return mcp4728_write_channel_with_udac(dac, address, channel, value, vref, gain, power_down, 0);
+}
 
-    g_ldac_ctx.chip = gpiod_chip_open(CHIP_PATH);
-    if (!g_ldac_ctx.chip) {
-        printf("Error: unable to open %s for LDAC control: %s\n", CHIP_PATH, strerror(errno));
-        return -1;
+int mcp4728_set_output(t_hat_dac *dac, uint8_t address, uint8_t channel, uint16_t value) {
+    return mcp4728_write_channel(dac, address, channel, value, MCP4728_VREF_INTERNAL, MCP4728_GAIN_X1, 0);
+}
+
+int mcp4728_write_multiple_channels(t_hat_dac *dac, uint8_t address, uint16_t values[4]) {
+    for (int i = 0; i < 4; i++) {
+        if (mcp4728_set_output(dac, address, i, values[i]) != 0) {
+            printf("Error writing channel %d\n", i);
+            return -1;
+        }
     }
+    return 0;
+}
 
-    line_settings = gpiod_line_settings_new();
-    line_config = gpiod_line_config_new();
-    request_config = gpiod_request_config_new();
-    if (!line_settings || !line_config || !request_config) {
-        printf("Error: unable to allocate libgpiod config objects\n");
-        goto error;
+static t_i2c_transport i2c_select_transport(t_hat_dac *dac, t_i2c_transport requested)
+{
+    if (hat_dac_select_transport(dac, requested) != requested) {
+        printf("Warning: I2C adapter has no I2C_RDWR support, falling back to I2C_SLAVE + write().\n");
     }
+    return dac->transport;
+}
+
+// One batched update of all 8 outputs, in the frame mode and UDAC set on the handle.
+// Write the 8 outputs, or with delta only those that changed. Returns the mask of outputs sent, or -1.
+static int write_all_mcp_outputs(t_hat_dac *dac, const uint16_t values[MCP_OUTPUT_COUNT], int delta)
+{
+    int sent = delta ? hat_write_delta(dac, values, MCP_ALL_OUTPUTS)
+        : (hat_write_frame(dac, values) == 0 ? (int)MCP_ALL_OUTPUTS : -1);
 
-    if (gpiod_line_settings_set_direction(line_settings, GPIOD_LINE_DIRECTION_OUTPUT) < 0) {
-        printf("Error: failed to configure LDAC lines as outputs\n");
-        goto error;
+    if (sent < 0) {
+        printf("Error: MCP4728 %s frame write failed: %s\n", i2c_transport_name(dac->transport), strerror(errno));
+        return -1;
     }
-    if (gpiod_line_settings_set_output_value(line_settings, GPIOD_LINE_VALUE_ACTIVE) < 0) {
-        printf("Error: failed to set initial LDAC output value\n");
-        goto error;
+    return sent;
+}
+
+static void print_i2c_syscall_report(t_i2c_transport transport, t_mcp4728_frame_mode mode, int delta)
+{
+    double per_frame = g_dac.frames ? (double)g_dac.syscalls / (double)g_dac.frames : 0.0;
+    unsigned long channels = g_dac.channels_sent + g_dac.channels_skipped;
+    unsigned long updates = g_dac.frames + g_dac.idle_frames;
+
+    printf("I2C output: transport=%s | dac-frame=%s | frames=%lu | syscalls=%lu | %.2f syscalls/frame\n",
+        i2c_transport_name(transport), mcp4728_frame_mode_name(mode),
+        g_dac.frames, g_dac.syscalls, per_frame);
+    if (delta) {
+        printf("I2C delta: channels sent=%lu | unchanged=%lu (%.1f%%) | idle updates=%lu | %.1f bytes/update\n",
+            g_dac.channels_sent, g_dac.channels_skipped,
+            channels ? 100.0 * (double)g_dac.channels_skipped / (double)channels : 0.0, g_dac.idle_frames,
+            updates ? (double)g_dac.bytes / (double)updates : 0.0);
     }
+}
+
+static void apply_realtime_options(const t_sine_options *options)
+{
+    int lock_flags = MCL_CURRENT | MCL_FUTURE;
 
-    if (gpiod_line_config_add_line_settings(line_config, offsets, 2, line_settings) < 0) {
-        printf("Error: failed to add LDAC line settings\n");
-        goto error;
+#ifdef MCL_ONFAULT
+    // A --play file can be larger than RAM: lock pages as they fault instead of all at once.
+    if (options->play_path) {
+        lock_flags |= MCL_ONFAULT;
     }
-    if (gpiod_line_config_set_output_values(line_config, init_values, 2) < 0) {
-        printf("Error: failed to set LDAC initial levels\n");
-        goto error;
+#endif
+    if (options->lock_memory && mlockall(lock_flags) != 0) {
+        printf("Warning: mlockall failed: %s\n", strerror(errno));
     }
+    if (options->cpu >= 0) {
+        cpu_set_t cpu_set;
 
-    gpiod_request_config_set_consumer(request_config, "mcp4728-ldac");
-    g_ldac_ctx.request = gpiod_chip_request_lines(g_ldac_ctx.chip, request_config, line_config);
-    if (!g_ldac_ctx.request) {
-        printf("Error: unable to request LDAC GPIO lines on %s: %s\n", CHIP_PATH, strerror(errno));
-        goto error;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(options->cpu, &cpu_set);
+        if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) != 0) {
+            printf("Warning: unable to pin to CPU %d: %s\n", options->cpu, strerror(errno));
+        }
     }
+    if (options->rt_priority > 0) {
+        struct sched_param param;
 
-    g_ldac_ctx.ready = 1;
-    gpiod_request_config_free(request_config);
-    gpiod_line_config_free(line_config);
-    gpiod_line_settings_free(line_settings);
-    return 0;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = options->rt_priority;
+        if (sched_setscheduler(0, SCHED_FIFO, &param) != 0) {
+            printf("Warning: unable to set SCHED_FIFO priority %d: %s\n", options->rt_priority, strerror(errno));
+        }
+    }
+}
 
-error:
-    gpiod_request_config_free(request_config);
-    gpiod_line_config_free(line_config);
-    gpiod_line_settings_free(line_settings);
-    cleanup_ldac();
-    return -1;
+static void dashboard_fill_snapshot(t_dashboard_snapshot *snapshot, unsigned long sample_counter,
+    const uint16_t codes[MCP_OUTPUT_COUNT], const t_sample_clock *sample_clock)
+{
+    snapshot->sample_counter = sample_counter;
+    memcpy(snapshot->codes, codes, sizeof(snapshot->codes));
+    snapshot->ticks = sample_clock->ticks;
+    snapshot->overruns = sample_clock->overruns;
+    snapshot->missed_periods = sample_clock->missed_periods;
+    snapshot->i2c_frames = g_dac.frames;
+    snapshot->i2c_syscalls = g_dac.syscalls;
 }
 
-static int ldac_pulse_low(unsigned int gpio_offset)
+static void *dashboard_thread(void *arg)
 {
-    if (!g_ldac_ctx.ready || !g_ldac_ctx.request) {
-        return -1;
+    t_dashboard_ctx *dashboard = (t_dashboard_ctx *)arg;
+    t_history_record history[MCP_HISTORY_LINES];
+    unsigned int history_count;
+    t_dashboard_snapshot snapshot;
+    static t_screen screen;
+    uint64_t frame_ns = 1000000000ULL / dashboard->options->fps;
+    uint64_t next_ns = monotonic_ns();
+
+    while (atomic_load_explicit(&dashboard->running, memory_order_acquire)) {
+        if (seqlock_read_latest(&dashboard->seq, &dashboard->latest, &snapshot, sizeof(snapshot))) {
+            history_count = history_ring_latest(&dashboard->history, history, MCP_HISTORY_LINES);
+            mcp_render_dashboard(&screen, history, history_count, &snapshot, dashboard->options);
+        }
+
+        // Fixed frame rate; a slow terminal drops frames instead of queueing them.
+        next_ns += frame_ns;
+        if (next_ns < monotonic_ns()) {
+            next_ns = monotonic_ns();
+        }
+        sleep_until_ns(next_ns);
     }
-    if (gpiod_line_request_set_value(g_ldac_ctx.request, gpio_offset, GPIOD_LINE_VALUE_ACTIVE) < 0) {
-        return -1;
+    return NULL;
+}
+
+static void dashboard_start(t_dashboard_ctx *dashboard, const t_sine_options *options)
+{
+    int err;
+
+    memset(dashboard, 0, sizeof(*dashboard));
+    dashboard->options = options;
+    if (options->fps == 0) {
+        return;
     }
-    usleep(2);
-    if (gpiod_line_request_set_value(g_ldac_ctx.request, gpio_offset, GPIOD_LINE_VALUE_INACTIVE) < 0) {
-        return -1;
+    if (history_ring_init(&dashboard->history, options->history_capacity, sizeof(t_history_record)) != 0) {
+        printf("Warning: unable to allocate %u history records, history disabled\n", options->history_capacity);
     }
-    usleep(2);
-    if (gpiod_line_request_set_value(g_ldac_ctx.request, gpio_offset, GPIOD_LINE_VALUE_ACTIVE) < 0) {
-        return -1;
+    atomic_store(&dashboard->running, 1);
+    err = pthread_create(&dashboard->thread, NULL, dashboard_thread, dashboard);
+    if (err != 0) {
+        printf("Warning: unable to start dashboard thread: %s\n", strerror(err));
+        atomic_store(&dashboard->running, 0);
+        history_ring_free(&dashboard->history);
     }
-    return 0;
 }
 
-static int mcp4728_write_channel_with_udac(int fd, uint8_t address, uint8_t channel, uint16_t value, uint8_t vref, uint8_t gain, uint8_t power_down, uint8_t udac)
+static void dashboard_stop(t_dashboard_ctx *dashboard)
 {
-    if (channel > 3) {
-        printf("Error: invalid channel (0-3)\n");
-        return -1;
+    if (!atomic_load(&dashboard->running)) {
+        return;
     }
+    atomic_store(&dashboard->running, 0);
+    pthread_join(dashboard->thread, NULL);
+    history_ring_free(&dashboard->history);
+}
 
-    if (value > 4095) {
-        printf("Error: invalid value (0-4095)\n");
-        return -1;
-    }
+/*
+ * Nominal code -> calibrated code of one output: the kernel renders the wave on the
+ * nominal 0..full-scale grid, this lookup lands it on the calibrated millivolts.
+ */
+static void dds_init_remap(uint16_t remap[CAL_DAC_CODES], const t_calibration *cal, int output)
+{
+    for (uint32_t code = 0; code < CAL_DAC_CODES; code++) {
+        long mv = lround((double)code * (double)CAL_DAC_FULL_SCALE_MV / (double)(CAL_DAC_CODES - 1U));
 
-    if (vref > 1 || gain > 1 || power_down > 3) {
-        printf("Error: invalid vref/gain/power_down parameters\n");
-        return -1;
+        remap[code] = calibration_dac_code(cal, (unsigned int)output, (uint32_t)mv);
     }
+}
 
-    uint8_t buf[3];
+// Phase increment per sample for a tone of freq_hz at rate_hz (2^32 == one full period).
+static uint32_t dds_increment_from_hz(double freq_hz, double rate_hz)
+{
+    return (uint32_t)llround((freq_hz / rate_hz) * DDS_PHASE_ONE_TURN);
+}
 
-    buf[0] = (0x08 << 3) | ((channel & 0x03) << 1) | (udac & 0x01);
-    buf[1] = ((vref & 0x01) << 7) | ((power_down & 0x03) << 5) | ((gain & 0x01) << 4) | ((value >> 8) & 0x0F);
-    buf[2] = value & 0xFF;
-    // buf[2] = 0x00;
+static uint32_t dds_phase_from_degrees(double degrees)
+{
+    double turns = fmod(degrees / 360.0, 1.0);
 
-    if (ioctl(fd, I2C_SLAVE, address) < 0) {
-        printf("Error opening MCP4728 at address 0x%02X\n", address);
-        return -1;
+    if (turns < 0.0) {
+        turns += 1.0;
     }
+    return (uint32_t)llround(turns * DDS_PHASE_ONE_TURN);
+}
 
-    if (write(fd, buf, 3) != 3) {
-        printf("Error writing to MCP4728\n");
-        return -1;
+static void dds_init(t_dds_engine *dds, const t_sine_options *options)
+{
+    dds->kernel = wave_kernel_select(options->wave_kernel);
+    if (!dds->kernel) {
+        printf("Warning: wave-kernel '%s' is not available on this build or CPU, using auto\n", options->wave_kernel);
+        dds->kernel = wave_kernel_select("auto");
     }
+    for (int output = 0; output < MCP_OUTPUT_COUNT; output++) {
+        t_wave_osc *osc = &dds->bank.osc[output];
 
-    return 0;
+        if (options->freq_set) {
+            osc->increment = dds_increment_from_hz(options->freq_hz[output], options->rate_hz);
+        } else {
+            // Legacy --resolution behaviour: one period every points_per_period samples.
+            osc->increment = (uint32_t)llround(DDS_PHASE_ONE_TURN / (double)options->points_per_period);
+        }
+        osc->phase = dds_phase_from_degrees(options->phase_deg[output]);
+        osc->shape = options->wave[output];
+        osc->duty = (float)(options->duty_pct[output] / 100.0);
+        // Distinct noise stream per output.
+        osc->noise_seq = (uint32_t)output << 28;
+        dds->bank.remap[output] = NULL;
+        if (g_calibration.dac_calibrated & (1U << output)) {
+            dds_init_remap(dds->remap[output], &g_calibration, output);
+            dds->bank.remap[output] = dds->remap[output];
+        }
+    }
 }
 
-int mcp4728_write_channel(int fd, uint8_t address, uint8_t channel, uint16_t value, uint8_t vref, uint8_t gain, uint8_t power_down)
+// count frames of all 8 outputs through the block kernel, every phase accumulator advanced by its own increment.
+static inline void dds_render_block(t_dds_engine *dds, uint16_t (*frames)[MCP_OUTPUT_COUNT], unsigned int count)
 {
-    // UDAC=0 pour mise à jour immédiate (comportement par défaut)
-    return mcp4728_write_channel_with_udac(fd, address, channel, value, vref, gain, power_down, 0);
+    wave_render_block(&dds->bank, dds->kernel, frames, count);
 }
 
-int mcp4728_set_output(int fd, uint8_t address, uint8_t channel, uint16_t value) {
-    return mcp4728_write_channel(fd, address, channel, value, MCP4728_VREF_INTERNAL, MCP4728_GAIN_X1, 0);
+static inline void dds_render(t_dds_engine *dds, uint16_t values[MCP_OUTPUT_COUNT])
+{
+    wave_render_frame(&dds->bank, values);
 }
 
-int mcp4728_write_multiple_channels(int fd, uint8_t address, uint16_t values[4]) {
-    for (int i = 0; i < 4; i++) {
-        if (mcp4728_set_output(fd, address, i, values[i]) != 0) {
-            printf("Error writing channel %d\n", i);
-            return -1;
-        }
+// Advance every oscillator as if `periods` samples had been rendered (keeps pitch exact after clock overruns).
+static void dds_skip(t_dds_engine *dds, unsigned int periods)
+{
+    for (int output = 0; output < MCP_OUTPUT_COUNT && periods > 0; output++) {
+        dds->bank.osc[output].phase += dds->bank.osc[output].increment * periods;
+        dds->bank.osc[output].noise_seq += periods;
     }
-    return 0;
 }
 
-int main(int argc, char **argv)
+static void *wave_thread(void *arg)
 {
-	const char *i2c_bus = "/dev/i2c-1";
-	int i2c_fd = i2c_init(i2c_bus);
-    int ldac_ready;
-    int ldac_error_reported = 0;
-    unsigned int points_per_period;
-    unsigned int sample_delay_us;
-    unsigned long sample_counter = 0;
-    char mcp_history[MCP_HISTORY_LINES][MCP_HISTORY_LINE_LEN] = {{0}};
-    unsigned int mcp_history_count = 0;
-    char history_line[MCP_HISTORY_LINE_LEN] = {0};
-    float output_volts[MCP_OUTPUT_COUNT] = {0.0f};
-    int parse_status = parse_sine_runtime_options(argc, argv, &points_per_period, &sample_delay_us);
+    t_frame_queue *queue = (t_frame_queue *)arg;
+    unsigned long filled = atomic_load_explicit(&queue->filled, memory_order_relaxed);
 
-    if (parse_status > 0) {
-        return 0;
-    }
-    if (parse_status < 0) {
-        return 1;
+    while (atomic_load_explicit(&queue->running, memory_order_acquire)) {
+        uint64_t start_ns;
+
+        if (filled - atomic_load_explicit(&queue->released, memory_order_acquire) >= queue->blocks) {
+            // Queue full: check again a quarter block later.
+            sleep_until_ns(monotonic_ns() + queue->block_ns / 4U);
+            continue;
+        }
+        start_ns = monotonic_ns();
+        dds_render_block(queue->dds, &queue->frames[(filled % queue->blocks) * queue->block_frames],
+            queue->block_frames);
+        hist_record(&queue->block_hist, monotonic_ns() - start_ns);
+        filled++;
+        atomic_store_explicit(&queue->filled, filled, memory_order_release);
     }
+    return NULL;
+}
 
-    signal(SIGINT, signal_handler);
-    signal(SIGTERM, signal_handler);
+/*
+ * Fill the whole queue before the first deadline, then hand the DDS engine to the
+ * wave thread. Returns -1 (and leaves rendering to the sample loop) when off or failed.
+ */
+static int frame_queue_start(t_frame_queue *queue, t_dds_engine *dds, const t_sine_options *options)
+{
+    unsigned int frame_count = options->prerender_frames * options->prerender_blocks;
+    int err;
 
-	if (i2c_fd < 0) {
-        printf("Error: failed to initialize I2C bus\n");
+    memset(queue, 0, sizeof(*queue));
+    if (options->prerender_frames == 0 || options->rate_hz <= 0.0) {
+        return -1;
+    }
+    queue->frames = calloc(frame_count, sizeof(*queue->frames));
+    if (!queue->frames) {
+        printf("Warning: unable to allocate %u prerender frames, rendering in the sample loop\n", frame_count);
+        return -1;
+    }
+    queue->block_frames = options->prerender_frames;
+    queue->blocks = options->prerender_blocks;
+    queue->block_ns = (uint64_t)llround(1000000000.0 * (double)queue->block_frames / options->rate_hz);
+    queue->dds = dds;
+    dds_render_block(dds, queue->frames, frame_count);
+    atomic_store(&queue->filled, queue->blocks);
+    atomic_store(&queue->released, 0);
+    atomic_store(&queue->running, 1);
+    err = pthread_create(&queue->thread, NULL, wave_thread, queue);
+    if (err != 0) {
+        printf("Warning: unable to start wave thread: %s, rendering in the sample loop\n", strerror(err));
+        atomic_store(&queue->running, 0);
+        free(queue->frames);
+        queue->frames = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static void frame_queue_stop(t_frame_queue *queue)
+{
+    if (!atomic_load(&queue->running)) {
+        return;
+    }
+    atomic_store(&queue->running, 0);
+    pthread_join(queue->thread, NULL);
+}
+
+/*
+ * Frame for this tick, `periods` frames after the previous one: frames of missed periods
+ * are dropped so pitch stays exact, as dds_skip() does. When the wave thread is late the
+ * previous frame is held (its block is only released once the next one is ready) and the
+ * frames owed are dropped when they arrive. Never waits.
+ */
+static inline const uint16_t *frame_queue_next(t_frame_queue *queue, unsigned int periods)
+{
+    queue->due += periods;
+    while (queue->due > 0) {
+        unsigned int take;
+
+        if (queue->frame == queue->block_frames) {
+            if (atomic_load_explicit(&queue->filled, memory_order_acquire) == queue->block + 1UL) {
+                queue->underruns++;
+                break;
+            }
+            queue->block++;
+            atomic_store_explicit(&queue->released, queue->block, memory_order_release);
+            queue->frame = 0;
+        }
+        take = queue->block_frames - queue->frame;
+        if (take > queue->due) {
+            take = (unsigned int)queue->due;
+        }
+        queue->frame += take;
+        queue->due -= take;
+    }
+    return queue->frames[(queue->block % queue->blocks) * queue->block_frames + queue->frame - 1U];
+}
+
+static void print_frame_queue_report(const t_frame_queue *queue)
+{
+    const t_latency_hist *hist = &queue->block_hist;
+
+    if (!queue->frames) {
+        printf("Prerender: off (frames rendered in the sample loop)\n");
+        return;
+    }
+    printf("Prerender: %u frames x %u blocks (%.1f ms ahead) | blocks rendered=%llu | underruns=%lu"
+        " | block render p99=%.1f us max=%.1f us\n",
+        queue->block_frames, queue->blocks, (double)queue->block_ns * (double)queue->blocks / 1000000.0,
+        (unsigned long long)hist->total, queue->underruns,
+        (double)hist_percentile(hist, 99.0) / 1000.0, (double)hist->max_ns / 1000.0);
+}
+
+static void frame_queue_free(t_frame_queue *queue)
+{
+    free(queue->frames);
+    queue->frames = NULL;
+}
+
+static inline uint16_t play_read_le16(const uint8_t *bytes)
+{
+    return (uint16_t)(bytes[0] | (bytes[1] << 8));
+}
+
+static inline uint32_t play_read_le32(const uint8_t *bytes)
+{
+    return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+// RIFF/WAVE with a 16-bit PCM "fmt " chunk: point data/channels/rate at its "data" chunk.
+static int play_parse_wav(t_play_ctx *play, const char *path)
+{
+    const uint8_t *fmt = NULL;
+    size_t offset = 12;
+
+    while (offset + 8 <= play->size) {
+        const uint8_t *chunk = play->base + offset;
+        size_t chunk_size = play_read_le32(chunk + 4);
+        size_t available = play->size - offset - 8;
+
+        if (memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16 && chunk_size <= available) {
+            fmt = chunk + 8;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            play->data = chunk + 8;
+            // Streamed or truncated WAVs carry a bogus size: trust the bytes actually on disk.
+            play->frame_count = (chunk_size < available) ? chunk_size : available;
+            break;
+        }
+        if (chunk_size >= available) {
+            break;
+        }
+        offset += 8 + chunk_size + (chunk_size & 1U);
+    }
+    if (!fmt || !play->data) {
+        printf("Error: '%s' has no fmt/data chunk\n", path);
+        return -1;
+    }
+    if ((play_read_le16(fmt) != 1 && play_read_le16(fmt) != 0xFFFE) || play_read_le16(fmt + 14) != 16) {
+        printf("Error: '%s' is not 16-bit PCM (format 0x%04x, %u bits)\n", path, play_read_le16(fmt),
+            play_read_le16(fmt + 14));
+        return -1;
+    }
+    play->channels = play_read_le16(fmt + 2);
+    play->file_rate_hz = play_read_le32(fmt + 4);
+    if (play->channels == 0 || play->channels > MAX_PLAY_CHANNELS) {
+        printf("Error: '%s' has %u channels (1..%u)\n", path, play->channels, MAX_PLAY_CHANNELS);
+        return -1;
+    }
+    play->format = PLAY_FORMAT_WAV;
+    return 0;
+}
+
+/*
+ * Map the --play file and check start/end/map against it. Nothing is read here apart
+ * from a WAV header; pages come in as the prefetch thread walks the file.
+ */
+static int play_open(t_play_ctx *play, t_sine_options *options)
+{
+    struct stat st;
+    void *base;
+    int fd;
+
+    memset(play, 0, sizeof(*play));
+    fd = open(options->play_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        printf("Error: unable to open '%s': %s\n", options->play_path, strerror(errno));
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        printf("Error: '%s' is empty\n", options->play_path);
+        close(fd);
+        return -1;
+    }
+    play->size = (size_t)st.st_size;
+    base = mmap(NULL, play->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        printf("Error: unable to map '%s': %s\n", options->play_path, strerror(errno));
+        return -1;
+    }
+    play->base = (const uint8_t *)base;
+    play->page_size = (size_t)sysconf(_SC_PAGESIZE);
+    madvise(base, play->size, MADV_SEQUENTIAL);
+
+    if (play->size >= 12 && memcmp(play->base, "RIFF", 4) == 0 && memcmp(play->base + 8, "WAVE", 4) == 0) {
+        if (play_parse_wav(play, options->play_path) != 0) {
+            return -1;
+        }
+    } else {
+        play->format = PLAY_FORMAT_RAW;
+        play->data = play->base;
+        play->frame_count = play->size;
+        play->channels = options->play_channels;
+    }
+    play->frame_bytes = (size_t)play->channels * sizeof(uint16_t);
+    play->frame_count /= play->frame_bytes;
+
+    play->start = options->play_start;
+    play->end = options->play_end ? options->play_end : play->frame_count;
+    if (play->end > play->frame_count || play->start >= play->end) {
+        printf("Error: '%s' has %llu frames, --play-start=%llu --play-end=%llu is out of range\n",
+            options->play_path, play->frame_count, options->play_start, options->play_end);
+        return -1;
+    }
+    for (int output = 0; output < MCP_OUTPUT_COUNT; output++) {
+        play->map[output] = options->play_map[output];
+        if (play->map[output] >= (int)play->channels) {
+            play->map[output] = -1;
+        }
+    }
+    play->loop = options->play_loop;
+    play->cursor = play->start;
+    if (play->format == PLAY_FORMAT_WAV && !options->rate_set) {
+        if (play->file_rate_hz == 0 || play->file_rate_hz > MAX_RATE_HZ) {
+            printf("Warning: '%s' is sampled at %u Hz (1..%u), playing at --rate-hz=%.0f\n",
+                options->play_path, play->file_rate_hz, MAX_RATE_HZ, options->rate_hz);
+        } else {
+            options->rate_hz = play->file_rate_hz;
+        }
+    }
+    return 0;
+}
+
+static void play_close(t_play_ctx *play)
+{
+    if (play->base) {
+        munmap((void *)play->base, play->size);
+        play->base = NULL;
+    }
+}
+
+// File frame of stream position pos (frames since the start, loops unrolled).
+static inline unsigned long long play_stream_frame(const t_play_ctx *play, unsigned long long pos)
+{
+    unsigned long long length = play->end - play->start;
+
+    return play->start + (play->loop ? pos % length : pos);
+}
+
+/*
+ * madvise() the file bytes of stream positions [from, to), split where a loop wraps.
+ * inward rounds the range to whole pages inside it (for dropping), otherwise outward.
+ */
+static void play_advise(t_play_ctx *play, unsigned long long from, unsigned long long to, int advice, int inward)
+{
+    while (from < to) {
+        unsigned long long first = play_stream_frame(play, from);
+        unsigned long long count = to - from;
+        uintptr_t begin;
+        uintptr_t end;
+
+        if (count > play->end - first) {
+            count = play->end - first;
+        }
+        begin = (uintptr_t)(play->data + first * play->frame_bytes);
+        end = begin + (uintptr_t)(count * play->frame_bytes);
+        if (inward) {
+            begin = (begin + play->page_size - 1U) & ~(uintptr_t)(play->page_size - 1U);
+            end &= ~(uintptr_t)(play->page_size - 1U);
+        } else {
+            begin &= ~(uintptr_t)(play->page_size - 1U);
+        }
+        if (end > begin) {
+            madvise((void *)begin, (size_t)(end - begin), advice);
+        }
+        from += count;
+    }
+}
+
+/*
+ * Keep PLAY_WINDOW_BYTES ahead of the play head faulted in (WILLNEED starts the reads,
+ * one load per page waits for them here rather than in the sample loop) and drop the
+ * pages behind it, so memory stays at about two windows whatever the file size. A loop
+ * that fits in a few windows is left cached for its next pass.
+ */
+static void *play_prefetch_thread(void *arg)
+{
+    t_play_ctx *play = (t_play_ctx *)arg;
+    unsigned long long length = play->end - play->start;
+    unsigned long long window = PLAY_WINDOW_BYTES / play->frame_bytes;
+    unsigned long long step = play->page_size / play->frame_bytes;
+    unsigned long long limit = play->loop ? ULLONG_MAX : length;
+    int keep_cached = play->loop && length <= 4U * window;
+    unsigned long long ahead = 0;
+    unsigned long long behind = 0;
+    volatile uint8_t sink = 0;
+
+    if (step == 0) {
+        step = 1;
+    }
+    while (atomic_load_explicit(&play->running, memory_order_acquire)) {
+        unsigned long long pos = atomic_load_explicit(&play->position, memory_order_relaxed);
+        unsigned long long target = pos + window;
+
+        if (target > limit) {
+            target = limit;
+        }
+        // One pass of a cached loop is enough.
+        if (keep_cached && target > length) {
+            target = length;
+        }
+        if (ahead < pos) {
+            ahead = pos;
+        }
+        if (ahead < target) {
+            play_advise(play, ahead, target, MADV_WILLNEED, 0);
+            for (unsigned long long q = ahead; q < target; q += step) {
+                const uint8_t *frame = play->data + play_stream_frame(play, q) * play->frame_bytes;
+
+                sink ^= frame[0];
+                sink ^= frame[play->frame_bytes - 1U];
+            }
+            play->prefetched_bytes += (target - ahead) * play->frame_bytes;
+            ahead = target;
+        }
+        while (!keep_cached && behind + window <= pos) {
+            play_advise(play, behind, behind + window, MADV_DONTNEED, 1);
+            play->dropped_bytes += window * play->frame_bytes;
+            behind += window;
+        }
+        sleep_until_ns(monotonic_ns() + PLAY_PREFETCH_PERIOD_NS);
+    }
+    (void)sink;
+    return NULL;
+}
+
+// Follow the play head on a SCHED_OTHER thread, started before the sample loop is made real-time.
+static int play_start_prefetch(t_play_ctx *play)
+{
+    int err;
+
+    atomic_store(&play->position, 0);
+    atomic_store(&play->running, 1);
+    err = pthread_create(&play->thread, NULL, play_prefetch_thread, play);
+    if (err != 0) {
+        printf("Warning: unable to start play prefetch thread: %s, relying on kernel readahead\n", strerror(err));
+        atomic_store(&play->running, 0);
+        return -1;
+    }
+    return 0;
+}
+
+static void play_stop_prefetch(t_play_ctx *play)
+{
+    if (!atomic_load(&play->running)) {
+        return;
+    }
+    atomic_store(&play->running, 0);
+    pthread_join(play->thread, NULL);
+}
+
+/*
+ * Codes of the frame for this tick, read in place from the mapping: `periods` frames
+ * after the previous one, so missed periods are skipped and the timing stays exact.
+ * Unmapped outputs keep whatever values[] holds. Returns 0 once a non-looping play ends.
+ */
+static inline int play_next_frame(t_play_ctx *play, unsigned int periods, uint16_t values[MCP_OUTPUT_COUNT])
+{
+    unsigned long long pos = atomic_load_explicit(&play->position, memory_order_relaxed);
+    const uint8_t *frame;
+
+    if (pos > 0) {
+        play->cursor += periods;
+        play->skipped += periods - 1U;
+    }
+    if (play->cursor >= play->end) {
+        if (!play->loop) {
+            return 0;
+        }
+        play->loops += (play->cursor - play->start) / (play->end - play->start);
+        play->cursor = play->start + (play->cursor - play->start) % (play->end - play->start);
+    }
+    frame = play->data + play->cursor * play->frame_bytes;
+    for (int output = 0; output < MCP_OUTPUT_COUNT; output++) {
+        int channel = play->map[output];
+        uint16_t raw;
+
+        if (channel < 0) {
+            continue;
+        }
+        raw = play_read_le16(frame + (size_t)channel * sizeof(uint16_t));
+        if (play->format == PLAY_FORMAT_WAV) {
+            // Signed PCM -> offset binary -> top 12 bits.
+            values[output] = (uint16_t)((raw ^ 0x8000U) >> 4);
+        } else {
+            values[output] = (raw > MCP_CODE_MAX) ? (uint16_t)MCP_CODE_MAX : raw;
+        }
+    }
+    atomic_store_explicit(&play->position, pos + (pos > 0 ? periods : 1U), memory_order_relaxed);
+    return 1;
+}
+
+static void print_play_report(const t_play_ctx *play, const char *path)
+{
+    struct rusage usage;
+
+    memset(&usage, 0, sizeof(usage));
+    getrusage(RUSAGE_SELF, &usage);
+    printf("Play: %s | %s %u ch | frames %llu..%llu of %llu | played=%llu | loops=%llu | skipped=%llu\n",
+        path, play->format == PLAY_FORMAT_WAV ? "wav" : "raw", play->channels, play->start, play->end,
+        play->frame_count, atomic_load(&play->position) - play->skipped, play->loops, play->skipped);
+    printf("Play memory: prefetched=%.1f MiB | dropped=%.1f MiB | max RSS=%ld KiB\n",
+        (double)play->prefetched_bytes / 1048576.0, (double)play->dropped_bytes / 1048576.0, usage.ru_maxrss);
+}
+
+static void event_heap_push(t_event_sched *sched, uint64_t due_ns, uint32_t index)
+{
+    unsigned int slot = sched->heap_size++;
+
+    while (slot > 0) {
+        unsigned int parent = (slot - 1U) / 2U;
+        const t_event_slot *up = &sched->heap[parent];
+
+        if (up->due_ns < due_ns || (up->due_ns == due_ns && up->index < index)) {
+            break;
+        }
+        sched->heap[slot] = *up;
+        slot = parent;
+    }
+    sched->heap[slot].due_ns = due_ns;
+    sched->heap[slot].index = index;
+}
+
+static t_event_slot event_heap_pop(t_event_sched *sched)
+{
+    t_event_slot top = sched->heap[0];
+    t_event_slot last = sched->heap[--sched->heap_size];
+    unsigned int slot = 0;
+
+    for (;;) {
+        unsigned int child = slot * 2U + 1U;
+
+        if (child >= sched->heap_size) {
+            break;
+        }
+        if (child + 1U < sched->heap_size && (sched->heap[child + 1U].due_ns < sched->heap[child].due_ns
+                || (sched->heap[child + 1U].due_ns == sched->heap[child].due_ns
+                    && sched->heap[child + 1U].index < sched->heap[child].index))) {
+            child++;
+        }
+        if (last.due_ns < sched->heap[child].due_ns
+            || (last.due_ns == sched->heap[child].due_ns && last.index < sched->heap[child].index)) {
+            break;
+        }
+        sched->heap[slot] = sched->heap[child];
+        slot = child;
+    }
+    if (sched->heap_size > 0) {
+        sched->heap[slot] = last;
+    }
+    return top;
+}
+
+// Milliseconds (fractions allowed) -> ns. Returns -1 when out of 0..MAX_EVENT_MS.
+static int event_parse_ms(const char *text, uint64_t *ns)
+{
+    char *end = NULL;
+    double ms;
+
+    if (!text) {
+        return -1;
+    }
+    ms = strtod(text, &end);
+    if (end == text || *end != '\0' || !(ms >= 0.0) || ms > MAX_EVENT_MS) {
+        return -1;
+    }
+    *ns = (uint64_t)llround(ms * 1000000.0);
+    return 0;
+}
+
+static int event_parse_code(const char *text, uint16_t *code)
+{
+    char *end = NULL;
+    unsigned long value;
+
+    if (!text || *text == '-') {
+        return -1;
+    }
+    value = strtoul(text, &end, 10);
+    if (end == text || *end != '\0' || value > MCP_CODE_MAX) {
+        return -1;
+    }
+    *code = (uint16_t)value;
+    return 0;
+}
+
+/*
+ * "<ms> <outputs> <kind> <args...>" into event; "<ms> loop" sets the loop length instead.
+ * Returns 1 for an event, 0 for the loop line, -1 with reason[] filled.
+ */
+static int event_parse_line(char *line, t_event *event, uint64_t *loop_ns, char *reason, size_t reason_size)
+{
+    char *save = NULL;
+    char *at = strtok_r(line, " \t", &save);
+    char *outputs = strtok_r(NULL, " \t", &save);
+    char *kind = strtok_r(NULL, " \t", &save);
+    char *args[5] = {NULL, NULL, NULL, NULL, NULL};
+    unsigned int arg_count = 0;
+    uint32_t mask;
+
+    memset(event, 0, sizeof(*event));
+    if (event_parse_ms(at, &event->at_ns) != 0) {
+        snprintf(reason, reason_size, "invalid time '%s' (0..%.0f ms)", at, MAX_EVENT_MS);
+        return -1;
+    }
+    if (outputs && strcmp(outputs, "loop") == 0) {
+        if (kind || event->at_ns == 0) {
+            snprintf(reason, reason_size, "expected '<ms> loop' with a length above 0");
+            return -1;
+        }
+        *loop_ns = event->at_ns;
+        return 0;
+    }
+    if (!outputs || calibration_parse_channels(outputs, MCP_OUTPUT_COUNT, &mask) != 0) {
+        snprintf(reason, reason_size, "invalid output list '%s'", outputs ? outputs : "");
+        return -1;
+    }
+    event->output_mask = (uint8_t)mask;
+    while (arg_count < 5 && (args[arg_count] = strtok_r(NULL, " \t", &save)) != NULL) {
+        arg_count++;
+    }
+    if (!kind) {
+        snprintf(reason, reason_size, "missing event (set, ramp, adsr or gate)");
+        return -1;
+    }
+    if (strcmp(kind, "set") == 0 && arg_count == 1 && event_parse_code(args[0], &event->code) == 0) {
+        event->kind = EVENT_SET;
+    } else if (strcmp(kind, "ramp") == 0 && arg_count == 2 && event_parse_code(args[0], &event->code) == 0
+        && event_parse_ms(args[1], &event->ramp_ns) == 0) {
+        event->kind = EVENT_RAMP;
+    } else if (strcmp(kind, "adsr") == 0 && (arg_count == 4 || arg_count == 5)
+        && event_parse_ms(args[0], &event->attack_ns) == 0 && event_parse_ms(args[1], &event->decay_ns) == 0
+        && event_parse_code(args[2], &event->code) == 0 && event_parse_ms(args[3], &event->release_ns) == 0
+        && (arg_count == 4 || event_parse_code(args[4], &event->peak) == 0)) {
+        event->kind = EVENT_ADSR;
+        if (arg_count == 4) {
+            event->peak = MCP_CODE_MAX;
+        }
+    } else if (strcmp(kind, "gate") == 0 && arg_count == 1 && strcmp(args[0], "on") == 0) {
+        event->kind = EVENT_GATE_ON;
+    } else if (strcmp(kind, "gate") == 0 && arg_count == 1 && strcmp(args[0], "off") == 0) {
+        event->kind = EVENT_GATE_OFF;
+    } else {
+        snprintf(reason, reason_size, "invalid '%s' event (set <code> | ramp <code> <ms> | "
+            "adsr <a ms> <d ms> <sustain> <r ms> [<peak>] | gate on|off)", kind);
+        return -1;
+    }
+    return 1;
+}
+
+static void event_sched_free(t_event_sched *sched)
+{
+    free(sched->events);
+    free(sched->heap);
+    sched->events = NULL;
+    sched->heap = NULL;
+    sched->count = 0;
+    sched->heap_size = 0;
+}
+
+/*
+ * Load an --events file. Returns -1 with "<path>:<line>: <reason>" in error[] on failure.
+ * Events must fall inside the loop length when there is one.
+ */
+static int event_sched_load(t_event_sched *sched, const char *path, char *error, size_t error_size)
+{
+    char line[EVENT_LINE_LEN];
+    unsigned int line_number = 0;
+    unsigned int capacity = 0;
+    FILE *file;
+
+    memset(sched, 0, sizeof(*sched));
+    file = fopen(path, "r");
+    if (!file) {
+        snprintf(error, error_size, "%s: %s", path, strerror(errno));
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        char reason[160];
+        char *comment = strchr(line, '#');
+        t_event event;
+        int parsed;
+
+        line_number++;
+        if (comment) {
+            *comment = '\0';
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[strspn(line, " \t")] == '\0') {
+            continue;
+        }
+        parsed = event_parse_line(line, &event, &sched->loop_ns, reason, sizeof(reason));
+        if (parsed > 0 && sched->count == MAX_EVENTS) {
+            snprintf(reason, sizeof(reason), "more than %u events", MAX_EVENTS);
+            parsed = -1;
+        }
+        if (parsed > 0 && sched->count == capacity) {
+            unsigned int grown = capacity ? capacity * 2U : 64U;
+            t_event *events = realloc(sched->events, grown * sizeof(*events));
+
+            if (!events) {
+                snprintf(reason, sizeof(reason), "%s", strerror(errno));
+                parsed = -1;
+            } else {
+                sched->events = events;
+                capacity = grown;
+            }
+        }
+        if (parsed < 0) {
+            snprintf(error, error_size, "%s:%u: %s", path, line_number, reason);
+            fclose(file);
+            event_sched_free(sched);
+            return -1;
+        }
+        if (parsed > 0) {
+            sched->events[sched->count++] = event;
+        }
+    }
+    fclose(file);
+    if (sched->count == 0) {
+        snprintf(error, error_size, "%s: no events", path);
+        event_sched_free(sched);
+        return -1;
+    }
+    for (unsigned int i = 0; sched->loop_ns && i < sched->count; i++) {
+        if (sched->events[i].at_ns >= sched->loop_ns) {
+            snprintf(error, error_size, "%s: event at %.3f ms is past the %.3f ms loop", path,
+                (double)sched->events[i].at_ns / 1000000.0, (double)sched->loop_ns / 1000000.0);
+            event_sched_free(sched);
+            return -1;
+        }
+    }
+    sched->heap = malloc(sched->count * sizeof(*sched->heap));
+    if (!sched->heap) {
+        snprintf(error, error_size, "%s: %s", path, strerror(errno));
+        event_sched_free(sched);
+        return -1;
+    }
+    return 0;
+}
+
+// Start a segment from the current code towards `to`.
+static void event_output_segment(t_event_output *out, t_env_stage stage, uint64_t start_ns, uint64_t length_ns,
+    uint16_t to)
+{
+    out->stage = stage;
+    out->start_ns = start_ns;
+    out->length_ns = length_ns;
+    out->from = out->code;
+    out->to = to;
+}
+
+/*
+ * Bring out->code to time t_ns. A finished segment hands over to the next envelope stage
+ * at its exact end time, so late wakes never stretch an envelope.
+ */
+static void event_output_eval(t_event_output *out, uint64_t t_ns)
+{
+    while (out->stage != ENV_IDLE && out->stage != ENV_SUSTAIN) {
+        uint64_t end_ns = out->start_ns + out->length_ns;
+
+        if (t_ns < end_ns) {
+            uint64_t span = (out->to > out->from) ? (uint64_t)(out->to - out->from) : (uint64_t)(out->from - out->to);
+            // Rounded linear position: the code steps halfway between two codes.
+            uint64_t steps = (2U * span * (t_ns - out->start_ns) + out->length_ns) / (2U * out->length_ns);
+
+            out->code = (uint16_t)((out->to > out->from) ? out->from + steps : out->from - steps);
+            return;
+        }
+        out->code = out->to;
+        if (out->stage == ENV_ATTACK) {
+            event_output_segment(out, ENV_DECAY, end_ns, out->decay_ns, out->sustain);
+        } else if (out->stage == ENV_DECAY) {
+            out->stage = ENV_SUSTAIN;
+        } else {
+            out->stage = ENV_IDLE;
+        }
+    }
+}
+
+// Time the code next changes (UINT64_MAX when holding), no sooner than min_step_ns after now_ns.
+// A segment whose code reached its target is left for the next eval to close.
+static uint64_t event_output_next_ns(const t_event_output *out, uint64_t now_ns, uint64_t min_step_ns)
+{
+    uint64_t end_ns;
+    uint64_t span;
+    uint64_t done;
+    uint64_t next_ns;
+
+    if (out->stage == ENV_IDLE || out->stage == ENV_SUSTAIN) {
+        return UINT64_MAX;
+    }
+    end_ns = out->start_ns + out->length_ns;
+    span = (out->to > out->from) ? (uint64_t)(out->to - out->from) : (uint64_t)(out->from - out->to);
+    done = (out->code > out->from) ? (uint64_t)(out->code - out->from) : (uint64_t)(out->from - out->code);
+    next_ns = end_ns;
+    if (done >= span && out->stage != ENV_ATTACK) {
+        // At its target already: only an attack has a stage to start at the end.
+        return UINT64_MAX;
+    }
+    if (done < span) {
+        // Step done+1 is reached once span * elapsed / length >= done + 0.5.
+        uint64_t step_ns = out->start_ns + ((2U * done + 1U) * out->length_ns + 2U * span - 1U) / (2U * span);
+
+        if (step_ns < next_ns) {
+            next_ns = step_ns;
+        }
+    }
+    if (next_ns < now_ns + min_step_ns) {
+        next_ns = now_ns + min_step_ns;
+    }
+    return next_ns;
+}
+
+static void event_apply(t_event_sched *sched, const t_event *event, uint64_t due_ns)
+{
+    for (int output = 0; output < MCP_OUTPUT_COUNT; output++) {
+        t_event_output *out = &sched->outputs[output];
+
+        if (!(event->output_mask & (1U << output))) {
+            continue;
+        }
+        event_output_eval(out, due_ns);
+        if (event->kind == EVENT_ADSR) {
+            out->has_envelope = 1;
+            out->attack_ns = event->attack_ns;
+            out->decay_ns = event->decay_ns;
+            out->release_ns = event->release_ns;
+            out->sustain = event->code;
+            out->peak = event->peak;
+        }
+        if (event->kind == EVENT_SET) {
+            out->code = event->code;
+            out->stage = ENV_IDLE;
+        } else if (event->kind == EVENT_RAMP) {
+            event_output_segment(out, ENV_RAMP, due_ns, event->ramp_ns, event->code);
+        } else if (event->kind == EVENT_ADSR || event->kind == EVENT_GATE_ON) {
+            // Without an envelope a gate is a plain full-scale/zero step.
+            if (out->has_envelope) {
+                event_output_segment(out, ENV_ATTACK, due_ns, out->attack_ns, out->peak);
+            } else {
+                out->code = MCP_CODE_MAX;
+                out->stage = ENV_IDLE;
+            }
+        } else if (out->has_envelope) {
+            event_output_segment(out, ENV_RELEASE, due_ns, out->release_ns, 0);
+        } else {
+            out->code = 0;
+            out->stage = ENV_IDLE;
+        }
+        // A zero-length segment ends right away.
+        event_output_eval(out, due_ns);
+    }
+}
+
+// Arm every event relative to origin_ns; all outputs start at code 0.
+static void event_sched_start(t_event_sched *sched, uint64_t origin_ns, double rate_hz, int busy_wait_us)
+{
+    memset(sched->outputs, 0, sizeof(sched->outputs));
+    memset(sched->codes, 0, sizeof(sched->codes));
+    sched->origin_ns = origin_ns;
+    sched->min_step_ns = (rate_hz > 0.0) ? (uint64_t)llround(1000000000.0 / rate_hz) : 0;
+    sched->busy_wait_ns = (busy_wait_us > 0) ? (uint64_t)busy_wait_us * 1000ULL : 0;
+    sched->deadline_ns = origin_ns;
+    sched->heap_size = 0;
+    for (unsigned int i = 0; i < sched->count; i++) {
+        event_heap_push(sched, origin_ns + sched->events[i].at_ns, i);
+    }
+}
+
+// Apply the events due by now_ns (re-armed one loop later when looping) and update codes[].
+static void event_sched_advance(t_event_sched *sched, uint64_t now_ns)
+{
+    while (sched->heap_size > 0 && sched->heap[0].due_ns <= now_ns) {
+        t_event_slot slot = event_heap_pop(sched);
+
+        event_apply(sched, &sched->events[slot.index], slot.due_ns);
+        sched->applied++;
+        if (sched->loop_ns) {
+            if (slot.index == 0 && slot.due_ns > sched->origin_ns + sched->events[0].at_ns) {
+                sched->loops++;
+            }
+            event_heap_push(sched, slot.due_ns + sched->loop_ns, slot.index);
+        }
+    }
+    for (int output = 0; output < MCP_OUTPUT_COUNT; output++) {
+        t_event_output *out = &sched->outputs[output];
+
+        event_output_eval(out, now_ns);
+        out->next_ns = event_output_next_ns(out, now_ns, sched->min_step_ns);
+        sched->codes[output] = out->code;
+    }
+}
+
+/*
+ * Sleep until the next due event or segment step. Returns 0 once nothing is left to
+ * do (no pending event, every output holding), 1 after waking on deadline_ns.
+ */
+static int event_sched_wait(t_event_sched *sched)
+{
+    uint64_t next_ns = sched->heap_size > 0 ? sched->heap[0].due_ns : UINT64_MAX;
+
+    for (int output = 0; output < MCP_OUTPUT_COUNT; output++) {
+        if (sched->outputs[output].next_ns < next_ns) {
+            next_ns = sched->outputs[output].next_ns;
+        }
+    }
+    if (next_ns == UINT64_MAX) {
+        return 0;
+    }
+    if (next_ns > sched->busy_wait_ns && monotonic_ns() < next_ns - sched->busy_wait_ns) {
+        sleep_until_ns(next_ns - sched->busy_wait_ns);
+    }
+    while (monotonic_ns() < next_ns && g_keep_running) {
+    }
+    sched->deadline_ns = next_ns;
+    sched->wakes++;
+    return 1;
+}
+
+static void print_event_report(const t_event_sched *sched, const char *path)
+{
+    struct rusage usage;
+
+    memset(&usage, 0, sizeof(usage));
+    getrusage(RUSAGE_SELF, &usage);
+    printf("Events: %s | %u events | applied=%lu | loops=%lu | wakes=%lu\n", path, sched->count, sched->applied,
+        sched->loops, sched->wakes);
+    printf("Events CPU: user %.1f ms | system %.1f ms\n",
+        (double)usage.ru_utime.tv_sec * 1000.0 + (double)usage.ru_utime.tv_usec / 1000.0,
+        (double)usage.ru_stime.tv_sec * 1000.0 + (double)usage.ru_stime.tv_usec / 1000.0);
+}
+
+int main(int argc, char **argv)
+{
+	const char *i2c_bus = "/dev/i2c-1";
+	int i2c_fd;
+    int ldac_ready;
+    int ldac_error_reported = 0;
+    t_sine_options options;
+    static t_dds_engine dds;
+    t_sample_clock sample_clock;
+    int dac_config_written = 0;
+    unsigned long sample_counter = 0;
+    static t_dashboard_ctx dashboard;
+    static t_frame_queue frame_queue;
+    static t_play_ctx play;
+    static t_event_sched events;
+    uint16_t play_values[MCP_OUTPUT_COUNT] = {0};
+    unsigned int periods = 1;
+    t_dashboard_snapshot snapshot;
+    t_history_record history_record;
+    int parse_status = parse_sine_runtime_options(argc, argv, &options);
+
+    if (parse_status > 0) {
+        return 0;
+    }
+    if (parse_status < 0) {
+        return 1;
+    }
+    calibration_init_nominal(&g_calibration);
+    if (options.calibration_path) {
+        char error[256];
+
+        if (calibration_load(&g_calibration, options.calibration_path, error, sizeof(error)) != 0) {
+            printf("Error: calibration %s\n", error);
+            return 1;
+        }
+        printf("Calibration: %s (outputs 0x%02x)\n", options.calibration_path, g_calibration.dac_calibrated);
+    }
+    if (options.play_path && play_open(&play, &options) != 0) {
+        play_close(&play);
+        return 1;
+    }
+    if (options.events_path) {
+        char error[256];
+
+        if (event_sched_load(&events, options.events_path, error, sizeof(error)) != 0) {
+            printf("Error: events %s\n", error);
+            return 1;
+        }
+    }
+    {
+        char error[256];
+
+        if (hat_transport_init(&g_transport, options.sim_spec, error, sizeof(error)) != 0) {
+            printf("Error: --sim %s\n", error);
+            return 1;
+        }
+    }
+    if (g_transport.simulated) {
+        i2c_bus = "sim";
+        printf("Transport: simulated hat (no I2C/GPIO access)\n");
+    }
+    hat_dac_init(&g_dac, &g_transport);
+    g_dac.ldac_hold_ns = options.ldac_hold_ns;
+    i2c_fd = i2c_init(i2c_bus);
+
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+    signal(SIGUSR1, stats_signal_handler);
+
+	if (i2c_fd < 0) {
+        printf("Error: failed to initialize I2C bus\n");
 		return 1;
 	}
 
-	scan_i2c_bus(i2c_fd);
+	scan_i2c_bus(&g_dac);
+    options.transport = i2c_select_transport(&g_dac, options.transport);
 
 printf("\n=== MCP4728 Tests ===\n");
 	
 printf("\nTest 1: Write to channel A of first MCP4728 (0x63)\n");
     printf("Valeur: 2048\n");
-    mcp4728_set_output(i2c_fd, DAC_1, 0, 2048);
+    mcp4728_set_output(&g_dac, DAC_1, 0, 2048);
 //    usleep(100000);
 	delay(500);
 	
 printf("\nTest 2: Write to channel B of second MCP4728 (0x64)\n");
     printf("Valeur: 4095\n");
-    mcp4728_set_output(i2c_fd, DAC_2, 1, 4095);
+    mcp4728_set_output(&g_dac, DAC_2, 1, 4095);
 //	usleep(100000);
 	delay(500);
 	
 printf("\nTest 3: Write all channels of first MCP4728\n");
     uint16_t values[4] = {1024, 2048, 3072, 4095};
-	mcp4728_write_multiple_channels(i2c_fd, DAC_1, values);
+	mcp4728_write_multiple_channels(&g_dac, DAC_1, values);
 //	usleep(100000);
 	delay(500);	
 printf("\nTest 4: Phased sine sweep on all 8 outputs\n");
@@ -487,55 +2079,149 @@ printf("\nTest 4: Phased sine sweep on all 8 outputs\n");
     if (!ldac_ready) {
         // Keep outputs moving even if LDAC cannot be driven (kernel GPIO mapping changed, permissions, etc.).
         printf("Warning: LDAC init failed, falling back to immediate DAC update mode (UDAC=0).\n");
+    } else {
+        printf("LDAC: both DACs strobed together, hold %u ns (clock read %u ns)\n", g_dac.ldac_hold_ns,
+            g_dac.clock_read_ns);
     }
-    const double two_pi = 2.0 * 3.14159265358979323846;
-    const double phase_step = two_pi / 8.0;
-	while (g_keep_running) {
-		for (unsigned int i = 0; i < points_per_period && g_keep_running; i++) {
-            uint16_t phased_values[8];
-            double angle = two_pi * (double)i / (double)points_per_period;
-
-            for (int output = 0; output < 8; output++) {
-                double shifted_angle = angle + ((double)output * phase_step);
-                phased_values[output] = (uint16_t)(2048.0 + 2047.0 * sin(shifted_angle));
+    dds_init(&dds, &options);
+    if (events.count) {
+        printf("Events: %s | %u events", options.events_path, events.count);
+        if (events.loop_ns) {
+            printf(" | loop %.3f ms", (double)events.loop_ns / 1000000.0);
+        }
+        if (options.rate_hz > 0.0) {
+            printf(" | ramp steps >= %.1f us", 1000000.0 / options.rate_hz);
+        }
+    } else if (play.base) {
+        printf("Play: %s | %s %u ch | frames %llu..%llu of %llu%s | %.0f Hz | outputs=", options.play_path,
+            play.format == PLAY_FORMAT_WAV ? "wav" : "raw", play.channels, play.start, play.end, play.frame_count,
+            play.loop ? " looped" : "", options.rate_hz);
+        for (int output = 0; output < MCP_OUTPUT_COUNT; output++) {
+            if (play.map[output] < 0) {
+                printf("%s-", output ? "," : "");
+            } else {
+                printf("%s%d", output ? "," : "", play.map[output]);
             }
-            uint8_t udac = ldac_ready ? 1 : 0;
-			mcp4728_write_channel_with_udac(i2c_fd, DAC_1, 0, phased_values[0], MCP4728_VREF_INTERNAL, MCP4728_GAIN_X1, 0, udac);
-			mcp4728_write_channel_with_udac(i2c_fd, DAC_1, 1, phased_values[1], MCP4728_VREF_INTERNAL, MCP4728_GAIN_X1, 0, udac);
-			mcp4728_write_channel_with_udac(i2c_fd, DAC_1, 2, phased_values[2], MCP4728_VREF_INTERNAL, MCP4728_GAIN_X1, 0, udac);
-			mcp4728_write_channel_with_udac(i2c_fd, DAC_1, 3, phased_values[3], MCP4728_VREF_INTERNAL, MCP4728_GAIN_X1, 0, udac);
-
-			mcp4728_write_channel_with_udac(i2c_fd, DAC_2, 0, phased_values[4], MCP4728_VREF_INTERNAL, MCP4728_GAIN_X1, 0, udac);
-			mcp4728_write_channel_with_udac(i2c_fd, DAC_2, 1, phased_values[5], MCP4728_VREF_INTERNAL, MCP4728_GAIN_X1, 0, udac);
-			mcp4728_write_channel_with_udac(i2c_fd, DAC_2, 2, phased_values[6], MCP4728_VREF_INTERNAL, MCP4728_GAIN_X1, 0, udac);
-			mcp4728_write_channel_with_udac(i2c_fd, DAC_2, 3, phased_values[7], MCP4728_VREF_INTERNAL, MCP4728_GAIN_X1, 0, udac);
-
-            for (int output = 0; output < MCP_OUTPUT_COUNT; output++) {
-                output_volts[output] = ((float)phased_values[output] * 10.0f) / 4095.0f;
+        }
+    } else {
+        printf("Waveform: kernel=%s | outputs=", dds.kernel->name);
+        for (int output = 0; output < MCP_OUTPUT_COUNT; output++) {
+            printf("%s%s", output ? "," : "", wave_shape_name(options.wave[output]));
+        }
+    }
+    printf("\n");
+    g_dac.frames = 0;
+    g_dac.syscalls = 0;
+    g_dac.bytes = 0;
+    g_dac.channels_sent = 0;
+    g_dac.channels_skipped = 0;
+    g_dac.idle_frames = 0;
+    // Start both threads before raising priority so they stay SCHED_OTHER and unpinned.
+    dashboard_start(&dashboard, &options);
+    if (play.base) {
+        play_start_prefetch(&play);
+    } else if (!events.count) {
+        frame_queue_start(&frame_queue, &dds, &options);
+    }
+    apply_realtime_options(&options);
+    if (play.base && options.lock_memory) {
+        // The mapping stays pageable: the prefetch thread, not mlock, keeps the next pages in.
+        munlock(play.base, play.size);
+    }
+    sample_clock_init(&sample_clock, options.rate_hz, options.busy_wait_us);
+    if (events.count) {
+        event_sched_start(&events, monotonic_ns(), options.rate_hz, options.busy_wait_us);
+    }
+	while (g_keep_running) {
+        uint16_t phased_values[MCP_OUTPUT_COUNT];
+        const uint16_t *frame_values = phased_values;
+        uint8_t udac = ldac_ready ? 1 : 0;
+        t_mcp4728_frame_mode sample_mode = options.frame_mode;
+        int sent;
+        uint64_t loop_start_ns = monotonic_ns();
+        uint64_t stage_ns = loop_start_ns;
+
+        if (events.count) {
+            event_sched_advance(&events, loop_start_ns);
+            frame_values = events.codes;
+        } else if (play.base) {
+            if (!play_next_frame(&play, periods, play_values)) {
+                printf("Play: end of %s\n", options.play_path);
+                break;
             }
+            frame_values = play_values;
+        } else if (frame_queue.frames) {
+            frame_values = frame_queue_next(&frame_queue, periods);
+        } else {
+            dds_render(&dds, phased_values);
+        }
+        stage_ns = stage_mark(&g_stage_hist[STAGE_WAVE], stage_ns);
 
-            if (ldac_ready) {
-			    if (ldac_pulse_low(LDAC1_GPIO) < 0 || ldac_pulse_low(LDAC2_GPIO) < 0) {
-                    ldac_ready = 0;
-                    if (!ldac_error_reported) {
-                        printf("Warning: LDAC pulse failed, switching to immediate updates (UDAC=0).\n");
-                        ldac_error_reported = 1;
-                    }
+        // Fast Write carries no VREF/gain/UDAC: use Multi-Write until the config is latched and LDAC is driven.
+        if (sample_mode == MCP4728_FRAME_FAST && (!ldac_ready || !dac_config_written)) {
+            sample_mode = MCP4728_FRAME_MULTI;
+        }
+        g_dac.frame_mode = sample_mode;
+        g_dac.udac = udac;
+        sent = write_all_mcp_outputs(&g_dac, frame_values, options.dac_delta);
+        if (sent >= 0) {
+            dac_config_written = 1;
+        }
+        stage_ns = stage_mark(&g_stage_hist[STAGE_I2C], stage_ns);
+
+        // Only strobe the DACs that received new values.
+        if (ldac_ready && sent > 0) {
+            if (hat_ldac_strobe(&g_dac, hat_ldac_mask((uint8_t)sent)) < 0) {
+                // Written with UDAC=1 but never latched: resend them on the next frame.
+                hat_shadow_invalidate(&g_dac, (uint8_t)sent);
+                ldac_ready = 0;
+                if (!ldac_error_reported) {
+                    printf("Warning: LDAC strobe failed, switching to immediate updates (UDAC=0).\n");
+                    ldac_error_reported = 1;
                 }
             }
+            stage_ns = stage_mark(&g_stage_hist[STAGE_LDAC], stage_ns);
+        }
 
+        if (options.fps > 0) {
+            dashboard_fill_snapshot(&snapshot, sample_counter, frame_values, &sample_clock);
+            seqlock_publish(&dashboard.seq, &dashboard.latest, &snapshot, sizeof(snapshot));
             if ((sample_counter % HISTORY_EVERY) == 0) {
-                mcp_build_history_line(history_line, sizeof(history_line), sample_counter, output_volts);
-                mcp_push_history(mcp_history, &mcp_history_count, history_line);
+                history_record.sample_counter = sample_counter;
+                history_record.timestamp_ns = stage_ns;
+                memcpy(history_record.codes, frame_values, sizeof(history_record.codes));
+                history_record.valid_mask = (uint16_t)((1U << MCP_OUTPUT_COUNT) - 1U);
+                history_ring_push(&dashboard.history, &history_record);
             }
-            if ((sample_counter % EQUALIZER_EVERY) == 0) {
-                mcp_render_dashboard(mcp_history, mcp_history_count, output_volts,
-                    points_per_period, sample_delay_us);
+            stage_ns = stage_mark(&g_stage_hist[STAGE_PUBLISH], stage_ns);
+        }
+        if (g_stats_requested) {
+            g_stats_requested = 0;
+            print_latency_report(stderr, g_stage_hist, g_stage_names, STAGE_COUNT, &sample_clock);
+        }
+        stage_mark(&g_stage_hist[STAGE_LOOP], loop_start_ns);
+
+        sample_counter++;
+        if (events.count) {
+            // No sample clock: sleep until the next event or ramp step, stop when none is left.
+            if (!event_sched_wait(&events)) {
+                printf("Events: sequence finished\n");
+                break;
             }
-
-            sample_counter++;
-            delayMicroseconds(sample_delay_us);
-		}
+            if (g_keep_running) {
+                hist_record(&g_stage_hist[STAGE_WAKEUP], monotonic_ns() - events.deadline_ns);
+            }
+            continue;
+        }
+        periods = sample_clock_wait(&sample_clock);
+        // The prerender queue and the player skip the frames of missed periods themselves.
+        if (!frame_queue.frames && !play.base) {
+            dds_skip(&dds, periods - 1U);
+        }
+        // A stop request can end the wait before the deadline; do not record that as jitter.
+        if (sample_clock.period_ns > 0 && g_keep_running) {
+            hist_record(&g_stage_hist[STAGE_WAKEUP], monotonic_ns() - sample_clock.deadline_ns);
+        }
 	}
     // while (1) {
 	// 	for (int value = 0; value < 4096; value += 0xF) {
@@ -559,9 +2245,27 @@ printf("\nTest 4: Phased sine sweep on all 8 outputs\n");
 
 
 
+    dashboard_stop(&dashboard);
+    frame_queue_stop(&frame_queue);
+    play_stop_prefetch(&play);
+    print_i2c_syscall_report(options.transport, options.frame_mode, options.dac_delta);
+    if (events.count) {
+        print_event_report(&events, options.events_path);
+    } else {
+        print_sample_clock_report(&sample_clock);
+    }
+    if (play.base) {
+        print_play_report(&play, options.play_path);
+    } else if (!events.count) {
+        print_frame_queue_report(&frame_queue);
+    }
+    event_sched_free(&events);
+    play_close(&play);
+    frame_queue_free(&frame_queue);
+    print_latency_report(stdout, g_stage_hist, g_stage_names, STAGE_COUNT, &sample_clock);
+    hat_transport_report(stdout, &g_transport);
 printf("\nTests finished!\n");
 	
-	close(i2c_fd);
-    cleanup_ldac();
+    hat_dac_close(&g_dac);
     return 0;
 }
@@ -16,7 +16,99 @@ _rpi_hat_complete_output_generator() {
         COMPREPLY=($(compgen -W "--delay-us=0 --delay-us=1 --delay-us=2 --delay-us=5 --delay-us=10 --delay-us=20 --delay-us=50 --delay-us=100 --delay-us=200 --delay-us=500 --delay-us=1000" -- "$cur"))
         return
     fi
-    COMPREPLY=($(compgen -W "--help --resolution= --points= --delay-us=" -- "$cur"))
+    if [[ "$cur" == --dac-frame=* ]]; then
+        COMPREPLY=($(compgen -W "--dac-frame=fast --dac-frame=multi --dac-frame=single" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --dac-delta=* ]]; then
+        COMPREPLY=($(compgen -W "--dac-delta=on --dac-delta=off" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --i2c-transport=* ]]; then
+        COMPREPLY=($(compgen -W "--i2c-transport=rdwr --i2c-transport=slave" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --rate-hz=* ]]; then
+        COMPREPLY=($(compgen -W "--rate-hz=500 --rate-hz=1000 --rate-hz=2000 --rate-hz=5000 --rate-hz=10000" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --freq-hz=* ]]; then
+        COMPREPLY=($(compgen -W "--freq-hz=0.1 --freq-hz=1 --freq-hz=10 --freq-hz=100" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --phase-deg=* ]]; then
+        COMPREPLY=($(compgen -W "--phase-deg=0 --phase-deg=45 --phase-deg=90 --phase-deg=180" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --wave=* ]]; then
+        COMPREPLY=($(compgen -W "--wave=sine --wave=triangle --wave=saw --wave=square --wave=noise" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --duty=* ]]; then
+        COMPREPLY=($(compgen -W "--duty=10 --duty=25 --duty=50 --duty=75" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --wave-kernel=* ]]; then
+        COMPREPLY=($(compgen -W "--wave-kernel=auto --wave-kernel=scalar --wave-kernel=sse2" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --rt-priority=* ]]; then
+        COMPREPLY=($(compgen -W "--rt-priority=10 --rt-priority=50 --rt-priority=80 --rt-priority=99" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --cpu=* ]]; then
+        COMPREPLY=($(compgen -W "--cpu=0 --cpu=1 --cpu=2 --cpu=3" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --busy-wait-us=* ]]; then
+        COMPREPLY=($(compgen -W "--busy-wait-us=0 --busy-wait-us=20 --busy-wait-us=50 --busy-wait-us=100" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --ldac-hold-ns=* ]]; then
+        COMPREPLY=($(compgen -W "--ldac-hold-ns=0 --ldac-hold-ns=250 --ldac-hold-ns=500 --ldac-hold-ns=1000" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --prerender=* ]]; then
+        COMPREPLY=($(compgen -W "--prerender=0 --prerender=16 --prerender=64 --prerender=256" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --prerender-blocks=* ]]; then
+        COMPREPLY=($(compgen -W "--prerender-blocks=2 --prerender-blocks=3 --prerender-blocks=4" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --play=* ]]; then
+        COMPREPLY=($(compgen -f -P "--play=" -- "${cur#--play=}"))
+        return
+    fi
+    if [[ "$cur" == --events=* ]]; then
+        COMPREPLY=($(compgen -f -P "--events=" -- "${cur#--events=}"))
+        return
+    fi
+    if [[ "$cur" == --play-channels=* ]]; then
+        COMPREPLY=($(compgen -W "--play-channels=1 --play-channels=2 --play-channels=8 --play-channels=16" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --play-map=* ]]; then
+        COMPREPLY=($(compgen -W "--play-map=0,1,2,3,4,5,6,7 --play-map=0,0,0,0,0,0,0,0 --play-map=0,1" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --fps=* ]]; then
+        COMPREPLY=($(compgen -W "--fps=0 --fps=10 --fps=20 --fps=30 --fps=60" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --history=* ]]; then
+        COMPREPLY=($(compgen -W "--history=14 --history=1024 --history=4096 --history=65536" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --calibration=* ]]; then
+        COMPREPLY=($(compgen -f -P "--calibration=" -- "${cur#--calibration=}"))
+        return
+    fi
+    if [[ "$cur" == --sim=* ]]; then
+        COMPREPLY=($(compgen -W "--sim=pace --sim=noise=2 --sim=loopback=8 --sim=loopback=off --sim=i2c-hz=400000 --sim=spi-hz=1000000" -- "$cur"))
+        return
+    fi
+    COMPREPLY=($(compgen -W "--help --resolution= --points= --delay-us= --dac-frame= --dac-delta= --i2c-transport= --rate-hz= --freq-hz= --phase-deg= --wave= --duty= --wave-kernel= --rt-priority= --mlock --cpu= --busy-wait-us= --fps= --history= --calibration= --ldac-hold-ns= --prerender= --prerender-blocks= --play= --play-channels= --play-loop --play-start= --play-end= --play-map= --events= --sim --sim=" -- "$cur"))
 }
 
 _rpi_hat_complete_input_output_tester() {
@@ -35,7 +127,204 @@ _rpi_hat_complete_input_output_tester() {
         COMPREPLY=($(compgen -W "--delay-us=0 --delay-us=1 --delay-us=2 --delay-us=5 --delay-us=10 --delay-us=20 --delay-us=50 --delay-us=100 --delay-us=200 --delay-us=500 --delay-us=1000" -- "$cur"))
         return
     fi
-    COMPREPLY=($(compgen -W "--help --resolution= --points= --delay-us=" -- "$cur"))
+    if [[ "$cur" == --dac-frame=* ]]; then
+        COMPREPLY=($(compgen -W "--dac-frame=fast --dac-frame=multi --dac-frame=single" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --dac-delta=* ]]; then
+        COMPREPLY=($(compgen -W "--dac-delta=on --dac-delta=off" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --i2c-transport=* ]]; then
+        COMPREPLY=($(compgen -W "--i2c-transport=rdwr --i2c-transport=slave" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --rate-hz=* ]]; then
+        COMPREPLY=($(compgen -W "--rate-hz=500 --rate-hz=1000 --rate-hz=2000 --rate-hz=5000 --rate-hz=10000" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --freq-hz=* ]]; then
+        COMPREPLY=($(compgen -W "--freq-hz=0.1 --freq-hz=1 --freq-hz=10 --freq-hz=100" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --phase-deg=* ]]; then
+        COMPREPLY=($(compgen -W "--phase-deg=0 --phase-deg=45 --phase-deg=90 --phase-deg=180" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --rt-priority=* ]]; then
+        COMPREPLY=($(compgen -W "--rt-priority=10 --rt-priority=50 --rt-priority=80 --rt-priority=99" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --cpu=* ]]; then
+        COMPREPLY=($(compgen -W "--cpu=0 --cpu=1 --cpu=2 --cpu=3" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --busy-wait-us=* ]]; then
+        COMPREPLY=($(compgen -W "--busy-wait-us=0 --busy-wait-us=20 --busy-wait-us=50 --busy-wait-us=100" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --ldac-hold-ns=* ]]; then
+        COMPREPLY=($(compgen -W "--ldac-hold-ns=0 --ldac-hold-ns=250 --ldac-hold-ns=500 --ldac-hold-ns=1000" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --fps=* ]]; then
+        COMPREPLY=($(compgen -W "--fps=0 --fps=10 --fps=20 --fps=30 --fps=60" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --history=* ]]; then
+        COMPREPLY=($(compgen -W "--history=14 --history=1024 --history=4096 --history=65536" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --in-channels=* ]]; then
+        COMPREPLY=($(compgen -W "--in-channels=0-15 --in-channels=0/1,1-15/100 --in-channels=0-7 --in-channels=8-15" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --out-channels=* ]]; then
+        COMPREPLY=($(compgen -W "--out-channels=0-7 --out-channels=0-3 --out-channels=4-7 --out-channels=0,4/10" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --calibration=* ]]; then
+        COMPREPLY=($(compgen -f -P "--calibration=" -- "${cur#--calibration=}"))
+        return
+    fi
+    if [[ "$cur" == --latency-steps=* ]]; then
+        COMPREPLY=($(compgen -W "--latency-steps=100 --latency-steps=1000 --latency-steps=10000" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --ldac-strobes=* ]]; then
+        COMPREPLY=($(compgen -W "--ldac-strobes=1000 --ldac-strobes=10000 --ldac-strobes=100000" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --loopback=* ]]; then
+        COMPREPLY=($(compgen -W "--loopback=0:0 --loopback=0:0,1:1,2:2,3:3 --loopback=0:8" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --sweep-stride=* ]]; then
+        COMPREPLY=($(compgen -W "--sweep-stride=1 --sweep-stride=4 --sweep-stride=16 --sweep-stride=64 --sweep-stride=256" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --sweep-samples=* ]]; then
+        COMPREPLY=($(compgen -W "--sweep-samples=1 --sweep-samples=4 --sweep-samples=8 --sweep-samples=32" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --sweep-settle-us=* ]]; then
+        COMPREPLY=($(compgen -W "--sweep-settle-us=0 --sweep-settle-us=100 --sweep-settle-us=200 --sweep-settle-us=1000" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --calibration-out=* ]]; then
+        COMPREPLY=($(compgen -f -P "--calibration-out=" -- "${cur#--calibration-out=}"))
+        return
+    fi
+    if [[ "$cur" == --sim=* ]]; then
+        COMPREPLY=($(compgen -W "--sim=pace --sim=noise=2 --sim=loopback=8 --sim=loopback=off --sim=i2c-hz=400000 --sim=spi-hz=1000000" -- "$cur"))
+        return
+    fi
+    COMPREPLY=($(compgen -W "--help --resolution= --points= --delay-us= --dac-frame= --dac-delta= --i2c-transport= --rate-hz= --freq-hz= --phase-deg= --rt-priority= --mlock --cpu= --busy-wait-us= --fps= --history= --in-channels= --out-channels= --calibration= --measure-latency --latency-steps= --loopback= --sweep --sweep-stride= --sweep-samples= --sweep-settle-us= --calibration-out= --measure-ldac --ldac-strobes= --ldac-hold-ns= --sim --sim=" -- "$cur"))
+}
+
+_rpi_hat_complete_input_reader() {
+    local cur
+    cur="${COMP_WORDS[COMP_CWORD]}"
+
+    if [[ "$cur" == --rate-hz=* ]]; then
+        COMPREPLY=($(compgen -W "--rate-hz=10 --rate-hz=50 --rate-hz=100 --rate-hz=500 --rate-hz=1000" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --delay-us=* ]]; then
+        COMPREPLY=($(compgen -W "--delay-us=1000 --delay-us=10000 --delay-us=100000" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --rt-priority=* ]]; then
+        COMPREPLY=($(compgen -W "--rt-priority=10 --rt-priority=50 --rt-priority=80 --rt-priority=99" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --cpu=* ]]; then
+        COMPREPLY=($(compgen -W "--cpu=0 --cpu=1 --cpu=2 --cpu=3" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --busy-wait-us=* ]]; then
+        COMPREPLY=($(compgen -W "--busy-wait-us=0 --busy-wait-us=20 --busy-wait-us=50 --busy-wait-us=100" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --fps=* ]]; then
+        COMPREPLY=($(compgen -W "--fps=0 --fps=10 --fps=20 --fps=30 --fps=60" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --history=* ]]; then
+        COMPREPLY=($(compgen -W "--history=14 --history=1024 --history=4096 --history=65536" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --stream-buffer=* ]]; then
+        COMPREPLY=($(compgen -W "--stream-buffer=4096 --stream-buffer=65536 --stream-buffer=1048576" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --in-channels=* ]]; then
+        COMPREPLY=($(compgen -W "--in-channels=0-15 --in-channels=0/1,1-15/100 --in-channels=0-7 --in-channels=8-15 --in-channels=0" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --record=* ]]; then
+        COMPREPLY=($(compgen -f -P "--record=" -- "${cur#--record=}"))
+        return
+    fi
+    if [[ "$cur" == --filter=* ]]; then
+        COMPREPLY=($(compgen -W "--filter=avg:16 --filter=os:16 --filter=cic:8:3 --filter=cic:8:3,lp:4 --filter=lp:4" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --calibration=* ]]; then
+        COMPREPLY=($(compgen -f -P "--calibration=" -- "${cur#--calibration=}"))
+        return
+    fi
+    if [[ "$cur" == --sim=* ]]; then
+        COMPREPLY=($(compgen -W "--sim=pace --sim=noise=2 --sim=loopback=8 --sim=loopback=off --sim=i2c-hz=400000 --sim=spi-hz=1000000" -- "$cur"))
+        return
+    fi
+    COMPREPLY=($(compgen -W "--help --rate-hz= --delay-us= --rt-priority= --mlock --cpu= --busy-wait-us= --fps= --history= --stream --stream-csv --stream-buffer= --in-channels= --record= --filter= --calibration= --stream-mv --sim --sim=" -- "$cur"))
+}
+
+_rpi_hat_complete_capture_tool() {
+    local cur
+    cur="${COMP_WORDS[COMP_CWORD]}"
+
+    if [[ "$COMP_CWORD" -eq 1 ]]; then
+        COMPREPLY=($(compgen -W "--help info csv stats slice" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --from=* ]]; then
+        COMPREPLY=($(compgen -W "--from=0 --from=1 --from=10 --from=60" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --to=* ]]; then
+        COMPREPLY=($(compgen -W "--to=1 --to=10 --to=60 --to=600" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --channels=* ]]; then
+        COMPREPLY=($(compgen -W "--channels=0-15 --channels=0-7 --channels=8-15 --channels=0" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --* ]]; then
+        COMPREPLY=($(compgen -W "--from= --to= --channels= --volts" -- "$cur"))
+        return
+    fi
+    COMPREPLY=($(compgen -f -- "$cur"))
+}
+
+_rpi_hat_complete_hat_bench() {
+    local cur
+    cur="${COMP_WORDS[COMP_CWORD]}"
+
+    if [[ "$cur" == --min-ms=* ]]; then
+        COMPREPLY=($(compgen -W "--min-ms=50 --min-ms=200 --min-ms=1000" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --repeat=* ]]; then
+        COMPREPLY=($(compgen -W "--repeat=1 --repeat=3 --repeat=10" -- "$cur"))
+        return
+    fi
+    if [[ "$cur" == --filter=* ]]; then
+        COMPREPLY=($(compgen -W "--filter=dds --filter=mcp4728 --filter=mcp3008 --filter=adc --filter=dashboard" -- "$cur"))
+        return
+    fi
+    COMPREPLY=($(compgen -W "--help --min-ms= --repeat= --filter= --list" -- "$cur"))
 }
 
 _rpi_hat_complete_install_script() {
@@ -57,6 +346,15 @@ complete -F _rpi_hat_complete_output_generator C_code_example/outputs/output_gen
 complete -F _rpi_hat_complete_input_output_tester input_output_tester
 complete -F _rpi_hat_complete_input_output_tester ./input_output_tester
 complete -F _rpi_hat_complete_input_output_tester C_code_example/input_outputs/input_output_tester
+complete -F _rpi_hat_complete_input_reader input_reader
+complete -F _rpi_hat_complete_input_reader ./input_reader
+complete -F _rpi_hat_complete_input_reader C_code_example/inputs/input_reader
+complete -F _rpi_hat_complete_capture_tool capture_tool
+complete -F _rpi_hat_complete_capture_tool ./capture_tool
+complete -F _rpi_hat_complete_capture_tool C_code_example/captures/capture_tool
+complete -F _rpi_hat_complete_hat_bench hat_bench
+complete -F _rpi_hat_complete_hat_bench ./hat_bench
+complete -F _rpi_hat_complete_hat_bench C_code_example/bench/hat_bench
 complete -F _rpi_hat_complete_install_script install_rpi_dependencies.sh
 complete -F _rpi_hat_complete_install_script ./scripts/install_rpi_dependencies.sh
 complete -F _rpi_hat_complete_install_script scripts/install_rpi_dependencies.sh